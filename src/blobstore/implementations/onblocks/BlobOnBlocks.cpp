@@ -1,4 +1,5 @@
 #include "parallelaccessdatatreestore/DataTreeRef.h"
+#include "parallelaccessdatatreestore/ParallelAccessDataTreeStore.h"
 #include "BlobOnBlocks.h"
 
 #include "datanodestore/DataLeafNode.h"
@@ -6,61 +7,189 @@
 #include "utils/Math.h"
 #include <cmath>
 #include <cpp-utils/assert/assert.h>
+#include <cpp-utils/logging/logging.h>
 #include "datatreestore/LeafHandle.h"
 
 using cpputils::unique_ref;
 using cpputils::Data;
 using blockstore::BlockId;
+using std::unique_lock;
+using std::mutex;
+using namespace cpputils::logging;
 
 namespace blobstore {
 namespace onblocks {
 
 using parallelaccessdatatreestore::DataTreeRef;
 
+constexpr uint32_t BlobOnBlocks::WRITE_BUFFER_NUM_LEAVES;
+constexpr uint64_t BlobOnBlocks::WRITE_BUFFER_MAX_BYTES;
+
 BlobOnBlocks::BlobOnBlocks(unique_ref<DataTreeRef> datatree)
-: _datatree(std::move(datatree)) {
+: _datatree(std::move(datatree)), _writeBufferMutex(), _writeBuffer(0), _writeBufferOffset(0), _writeBufferSize(0) {
 }
 
 BlobOnBlocks::~BlobOnBlocks() {
+  try {
+    const unique_lock<mutex> lock(_writeBufferMutex);
+    _flushWriteBuffer();
+  } catch (const std::exception &e) {
+    LOG(ERR, "Could not write buffered data of blob {}: {}", _datatree->blockId().ToString(), e.what());
+  }
 } // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
 
 uint64_t BlobOnBlocks::size() const {
-  return _datatree->numBytes();
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  const uint64_t treeSize = _datatree->numBytes();
+  if (_writeBufferSize == 0) {
+    return treeSize;
+  }
+  return std::max(treeSize, _writeBufferEnd());
 }
 
 void BlobOnBlocks::resize(uint64_t numBytes) {
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  _flushWriteBuffer();
   _datatree->resizeNumBytes(numBytes);
 }
 
 Data BlobOnBlocks::readAll() const {
+  {
+    const unique_lock<mutex> lock(_writeBufferMutex);
+    _flushWriteBuffer();
+  }
   return _datatree->readAllBytes();
 }
 
 void BlobOnBlocks::read(void *target, uint64_t offset, uint64_t count) const {
+  _flushWriteBufferIfRead(offset, count);
   return _datatree->readBytes(target, offset, count);
 }
 
 uint64_t BlobOnBlocks::tryRead(void *target, uint64_t offset, uint64_t count) const {
+  _flushWriteBufferIfRead(offset, count);
   return _datatree->tryReadBytes(target, offset, count);
 }
 
 void BlobOnBlocks::write(const void *source, uint64_t offset, uint64_t count) {
-  _datatree->writeBytes(source, offset, count);
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  if (_writeBufferSize != 0) {
+    const bool continuesBuffer = offset >= _writeBufferOffset && offset <= _writeBufferEnd();
+    if (!continuesBuffer || offset + count - _writeBufferOffset > _writeBuffer.size()) {
+      _flushWriteBuffer();
+    }
+  }
+  if (_writeBufferSize == 0) {
+    // Flushing the buffer can change the leaf size of the tree, so only compute the capacity when starting a new buffer
+    const uint64_t capacity = _writeBufferCapacity();
+    if (count >= capacity) {
+      // Large writes already consist of whole leaves, buffering them doesn't help
+      _datatree->writeBytes(source, offset, count);
+      return;
+    }
+    if (_writeBuffer.size() != capacity) {
+      _writeBuffer = Data(capacity);
+    }
+    _writeBufferOffset = offset;
+  }
+  std::memcpy(_writeBuffer.dataOffset(offset - _writeBufferOffset), source, count);
+  _writeBufferSize = std::max(_writeBufferSize, offset + count - _writeBufferOffset);
+  if (_writeBufferSize == _writeBuffer.size()) {
+    _flushFullLeavesOfWriteBuffer();
+  }
 }
 
 void BlobOnBlocks::flush() {
+  {
+    const unique_lock<mutex> lock(_writeBufferMutex);
+    _flushWriteBuffer();
+    // Don't keep the memory for blobs that aren't written to anymore
+    _writeBuffer = Data(0);
+  }
   _datatree->flush();
 }
 
+void BlobOnBlocks::_flushWriteBufferIfRead(uint64_t offset, uint64_t count) const {
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  if (_writeBufferSize == 0) {
+    return;
+  }
+  // Reading behind the end of the tree also needs the buffer, because it could have grown the blob
+  // and the bytes between the old end and the buffered region are zeroes then.
+  const uint64_t end = offset + count;
+  if (end > _writeBufferOffset || end > _datatree->numBytes()) {
+    _flushWriteBuffer();
+  }
+}
+
+void BlobOnBlocks::_flushWriteBuffer() const {
+  if (_writeBufferSize == 0) {
+    return;
+  }
+  _datatree->writeBytes(_writeBuffer.data(), _writeBufferOffset, _writeBufferSize);
+  _writeBufferSize = 0;
+}
+
+void BlobOnBlocks::_flushFullLeavesOfWriteBuffer() {
+  // Keep the last, incomplete leaf in the buffer. The next sequential write will probably complete it.
+  const uint64_t leafSize = _datatree->maxBytesPerLeaf();
+  const uint64_t alignedEnd = _writeBufferEnd() / leafSize * leafSize;
+  if (alignedEnd <= _writeBufferOffset) {
+    _flushWriteBuffer();
+    return;
+  }
+  const uint64_t numBytesToWrite = alignedEnd - _writeBufferOffset;
+  _datatree->writeBytes(_writeBuffer.data(), _writeBufferOffset, numBytesToWrite);
+  const uint64_t numBytesRemaining = _writeBufferSize - numBytesToWrite;
+  std::memmove(_writeBuffer.data(), _writeBuffer.dataOffset(numBytesToWrite), numBytesRemaining);
+  _writeBufferOffset = alignedEnd;
+  _writeBufferSize = numBytesRemaining;
+}
+
+uint64_t BlobOnBlocks::_writeBufferEnd() const {
+  return _writeBufferOffset + _writeBufferSize;
+}
+
+uint64_t BlobOnBlocks::_writeBufferCapacity() const {
+  const uint64_t leafSize = _datatree->maxBytesPerLeaf();
+  const uint64_t numLeaves = std::max(UINT64_C(1), std::min(static_cast<uint64_t>(WRITE_BUFFER_NUM_LEAVES), WRITE_BUFFER_MAX_BYTES / leafSize));
+  return numLeaves * leafSize;
+}
+
 uint32_t BlobOnBlocks::numNodes() const {
+  {
+    const unique_lock<mutex> lock(_writeBufferMutex);
+    _flushWriteBuffer();
+  }
   return _datatree->numNodes();
 }
 
+void BlobOnBlocks::allowLargeLeaves() {
+  _datatree->allowLargeLeaves();
+}
+
 const BlockId &BlobOnBlocks::blockId() const {
   return _datatree->blockId();
 }
 
+unique_ref<DataTreeRef> BlobOnBlocks::createCopyOfTree(parallelaccessdatatreestore::ParallelAccessDataTreeStore *dataTreeStore, const std::function<void ()> &onBlockCopied) const {
+  // Keep the lock while copying, so that writes to this blob don't go into the buffer in the meantime
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  _flushWriteBuffer();
+  return dataTreeStore->createCopyOf(*_datatree, onBlockCopied);
+}
+
+unique_ref<DataTreeRef> BlobOnBlocks::createCloneOfTree(parallelaccessdatatreestore::ParallelAccessDataTreeStore *dataTreeStore) const {
+  const unique_lock<mutex> lock(_writeBufferMutex);
+  _flushWriteBuffer();
+  return dataTreeStore->createCloneOf(*_datatree);
+}
+
 unique_ref<DataTreeRef> BlobOnBlocks::releaseTree() {
+  {
+    const unique_lock<mutex> lock(_writeBufferMutex);
+    _writeBufferSize = 0;
+  }
   return std::move(_datatree);
 }
 
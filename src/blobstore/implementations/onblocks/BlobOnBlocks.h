@@ -8,6 +8,7 @@
 #include <memory>
 #include <boost/optional.hpp>
 #include <boost/thread/shared_mutex.hpp>
+#include <mutex>
 
 namespace blobstore {
 namespace onblocks {
@@ -16,6 +17,7 @@ class DataLeafNode;
 }
 namespace parallelaccessdatatreestore {
 class DataTreeRef;
+class ParallelAccessDataTreeStore;
 }
 
 class BlobOnBlocks final: public Blob {
@@ -37,16 +39,43 @@ public:
 
   uint32_t numNodes() const override;
 
+  void allowLargeLeaves() override;
+
+  // Creates a new tree with the contents of this blob, including writes that are still buffered
+  cpputils::unique_ref<parallelaccessdatatreestore::DataTreeRef> createCopyOfTree(parallelaccessdatatreestore::ParallelAccessDataTreeStore *dataTreeStore, const std::function<void ()> &onBlockCopied) const;
+  // Like createCopyOfTree(), but the new tree shares its nodes with this one
+  cpputils::unique_ref<parallelaccessdatatreestore::DataTreeRef> createCloneOfTree(parallelaccessdatatreestore::ParallelAccessDataTreeStore *dataTreeStore) const;
+
+  // Discards writes that are still buffered, because this is only used to remove the blob.
   cpputils::unique_ref<parallelaccessdatatreestore::DataTreeRef> releaseTree();
 
+  // The write buffer holds this many leaves, but at most WRITE_BUFFER_MAX_BYTES unless a single leaf is larger
+  static constexpr uint32_t WRITE_BUFFER_NUM_LEAVES = 8;
+  static constexpr uint64_t WRITE_BUFFER_MAX_BYTES = 2 * 1024 * 1024;
+
 private:
 
   uint64_t _tryRead(void *target, uint64_t offset, uint64_t size) const;
   void _read(void *target, uint64_t offset, uint64_t count) const;
   void _traverseLeaves(uint64_t offsetBytes, uint64_t sizeBytes, std::function<void (uint64_t leafOffset, datatreestore::LeafHandle leaf, uint32_t begin, uint32_t count)> onExistingLeaf, std::function<cpputils::Data (uint64_t beginByte, uint32_t count)> onCreateLeaf) const;
 
+  // Writing the write buffer to the tree is only needed before accessing data that could be in the buffer,
+  // so it happens in const functions as well.
+  void _flushWriteBuffer() const;
+  void _flushWriteBufferIfRead(uint64_t offset, uint64_t count) const;
+  void _flushFullLeavesOfWriteBuffer();
+  uint64_t _writeBufferEnd() const;
+  uint64_t _writeBufferCapacity() const;
+
   cpputils::unique_ref<parallelaccessdatatreestore::DataTreeRef> _datatree;
 
+  // Small adjacent writes are collected in this buffer, so that they can be written to the tree as whole leaves
+  // instead of loading and storing the same leaf for each of them.
+  mutable std::mutex _writeBufferMutex;
+  mutable cpputils::Data _writeBuffer;
+  mutable uint64_t _writeBufferOffset;
+  mutable uint64_t _writeBufferSize;
+
   DISALLOW_COPY_AND_ASSIGN(BlobOnBlocks);
 };
 
@@ -27,8 +27,8 @@ using datanodestore::DataNodeStore;
 using datatreestore::DataTreeStore;
 using parallelaccessdatatreestore::ParallelAccessDataTreeStore;
 
-BlobStoreOnBlocks::BlobStoreOnBlocks(unique_ref<BlockStore> blockStore, uint64_t physicalBlocksizeBytes)
-        : _dataTreeStore(make_unique_ref<ParallelAccessDataTreeStore>(make_unique_ref<DataTreeStore>(make_unique_ref<DataNodeStore>(make_unique_ref<ParallelAccessBlockStore>(std::move(blockStore)), physicalBlocksizeBytes)))) {
+BlobStoreOnBlocks::BlobStoreOnBlocks(unique_ref<BlockStore> blockStore, uint64_t physicalBlocksizeBytes, const optional<uint64_t> &physicalLargeLeafBlocksizeBytes, const optional<boost::filesystem::path> &refCountsFilePath, bool legacyNodeFormat)
+        : _dataTreeStore(make_unique_ref<ParallelAccessDataTreeStore>(make_unique_ref<DataTreeStore>(make_unique_ref<DataNodeStore>(make_unique_ref<ParallelAccessBlockStore>(std::move(blockStore)), physicalBlocksizeBytes, physicalLargeLeafBlocksizeBytes, refCountsFilePath, legacyNodeFormat)))) {
 }
 
 BlobStoreOnBlocks::~BlobStoreOnBlocks() {
@@ -46,6 +46,18 @@ optional<unique_ref<Blob>> BlobStoreOnBlocks::load(const BlockId &blockId) {
     return optional<unique_ref<Blob>>(make_unique_ref<BlobOnBlocks>(std::move(*tree)));
 }
 
+unique_ref<Blob> BlobStoreOnBlocks::createCopyOf(const Blob &source, const std::function<void ()> &onBlockCopied) {
+    const BlobOnBlocks *_source = dynamic_cast<const BlobOnBlocks*>(&source);
+    ASSERT(_source != nullptr, "Passed Blob in BlobStoreOnBlocks::createCopyOf() is not a BlobOnBlocks.");
+    return make_unique_ref<BlobOnBlocks>(_source->createCopyOfTree(_dataTreeStore.get(), onBlockCopied));
+}
+
+unique_ref<Blob> BlobStoreOnBlocks::createCloneOf(const Blob &source) {
+    const BlobOnBlocks *_source = dynamic_cast<const BlobOnBlocks*>(&source);
+    ASSERT(_source != nullptr, "Passed Blob in BlobStoreOnBlocks::createCloneOf() is not a BlobOnBlocks.");
+    return make_unique_ref<BlobOnBlocks>(_source->createCloneOfTree(_dataTreeStore.get()));
+}
+
 void BlobStoreOnBlocks::remove(unique_ref<Blob> blob) {
     auto _blob = dynamic_pointer_move<BlobOnBlocks>(blob);
     ASSERT(_blob != none, "Passed Blob in BlobStoreOnBlocks::remove() is not a BlobOnBlocks.");
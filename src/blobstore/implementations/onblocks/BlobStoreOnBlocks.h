@@ -5,6 +5,7 @@
 #include "../../interface/BlobStore.h"
 #include "BlobOnBlocks.h"
 #include <blockstore/interface/BlockStore.h>
+#include <boost/filesystem/path.hpp>
 
 namespace blobstore {
 namespace onblocks {
@@ -16,11 +17,16 @@ class ParallelAccessDataTreeStore;
 
 class BlobStoreOnBlocks final: public BlobStore {
 public:
-  BlobStoreOnBlocks(cpputils::unique_ref<blockstore::BlockStore> blockStore, uint64_t physicalBlocksizeBytes);
+  // If physicalLargeLeafBlocksizeBytes is set, blobs that allow large leaves use leaves of that size once they're large enough.
+  // If refCountsFilePath is set, it stores which blocks are shared between cloned blobs.
+  // With legacyNodeFormat, blobs are stored in a way older versions can read, see DataNodeStore.
+  BlobStoreOnBlocks(cpputils::unique_ref<blockstore::BlockStore> blockStore, uint64_t physicalBlocksizeBytes, const boost::optional<uint64_t> &physicalLargeLeafBlocksizeBytes = boost::none, const boost::optional<boost::filesystem::path> &refCountsFilePath = boost::none, bool legacyNodeFormat = false);
   ~BlobStoreOnBlocks() override;
 
   cpputils::unique_ref<Blob> create() override;
   boost::optional<cpputils::unique_ref<Blob>> load(const blockstore::BlockId &blockId) override;
+  cpputils::unique_ref<Blob> createCopyOf(const Blob &source, const std::function<void ()> &onBlockCopied) override;
+  cpputils::unique_ref<Blob> createCloneOf(const Blob &source) override;
 
   void remove(cpputils::unique_ref<Blob> blob) override;
   void remove(const blockstore::BlockId &blockId) override;
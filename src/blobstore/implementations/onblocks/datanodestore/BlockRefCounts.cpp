@@ -0,0 +1,124 @@
+#include "BlockRefCounts.h"
+#include <cpp-utils/data/Data.h>
+#include <cpp-utils/data/Deserializer.h>
+#include <cpp-utils/data/Serializer.h>
+
+namespace bf = boost::filesystem;
+using blockstore::BlockId;
+using boost::none;
+using boost::optional;
+using cpputils::Data;
+using cpputils::Deserializer;
+using cpputils::Serializer;
+using std::string;
+using std::unique_lock;
+using std::mutex;
+using std::vector;
+
+namespace blobstore {
+namespace onblocks {
+namespace datanodestore {
+
+const string BlockRefCounts::HEADER = "cryfs.blockrefcounts;0";
+
+BlockRefCounts::BlockRefCounts(optional<bf::path> stateFilePath)
+  : _additionalReferences(), _stateFilePath(std::move(stateFilePath)), _changedSinceSave(false), _mutex() {
+  const unique_lock<mutex> lock(_mutex);
+  _loadStateFile();
+}
+
+BlockRefCounts::~BlockRefCounts() {
+  const unique_lock<mutex> lock(_mutex);
+  if (_changedSinceSave) {
+    _saveStateFile();
+  }
+}
+
+bool BlockRefCounts::isShared(const BlockId &blockId) const {
+  const unique_lock<mutex> lock(_mutex);
+  return _additionalReferences.count(blockId) != 0;
+}
+
+void BlockRefCounts::addReferences(const vector<BlockId> &blockIds) {
+  const unique_lock<mutex> lock(_mutex);
+  for (const BlockId &blockId : blockIds) {
+    ++_additionalReferences[blockId];
+  }
+  _saveStateFile();
+  _changedSinceSave = false;
+}
+
+bool BlockRefCounts::release(const BlockId &blockId) {
+  const unique_lock<mutex> lock(_mutex);
+  return _release(blockId);
+}
+
+vector<BlockId> BlockRefCounts::release(const vector<BlockId> &blockIds) {
+  const unique_lock<mutex> lock(_mutex);
+  if (_additionalReferences.empty()) {
+    // Nothing is shared, which is the case unless files were cloned
+    return blockIds;
+  }
+  vector<BlockId> result;
+  result.reserve(blockIds.size());
+  for (const BlockId &blockId : blockIds) {
+    if (_release(blockId)) {
+      result.push_back(blockId);
+    }
+  }
+  return result;
+}
+
+bool BlockRefCounts::_release(const BlockId &blockId) {
+  auto found = _additionalReferences.find(blockId);
+  if (found == _additionalReferences.end()) {
+    return true;
+  }
+  if (--found->second == 0) {
+    _additionalReferences.erase(found);
+  }
+  _changedSinceSave = true;
+  return false;
+}
+
+void BlockRefCounts::_loadStateFile() {
+  if (_stateFilePath == none) {
+    return;
+  }
+  optional<Data> file = Data::LoadFromFile(*_stateFilePath);
+  if (file == none) {
+    // File doesn't exist means no node is shared
+    return;
+  }
+  Deserializer deserializer(&*file);
+  if (HEADER != deserializer.readString()) {
+    throw std::runtime_error("Invalid local state: Invalid block reference count file header.");
+  }
+  const uint64_t numEntries = deserializer.readUint64();
+  _additionalReferences.reserve(numEntries);
+  for (uint64_t i = 0; i < numEntries; ++i) {
+    const BlockId blockId(deserializer.readFixedSizeData<BlockId::BINARY_LENGTH>());
+    _additionalReferences[blockId] = deserializer.readUint32();
+  }
+  deserializer.finished();
+}
+
+void BlockRefCounts::_saveStateFile() const {
+  if (_stateFilePath == none) {
+    return;
+  }
+  Serializer serializer(
+          Serializer::StringSize(HEADER) +
+          sizeof(uint64_t) + _additionalReferences.size() * (BlockId::BINARY_LENGTH + sizeof(uint32_t)));
+  serializer.writeString(HEADER);
+  serializer.writeUint64(_additionalReferences.size());
+  for (const auto &entry : _additionalReferences) {
+    serializer.writeFixedSizeData<BlockId::BINARY_LENGTH>(entry.first.data());
+    serializer.writeUint32(entry.second);
+  }
+  serializer.finished().StoreToFile(*_stateFilePath);
+}
+
+}
+}
+}
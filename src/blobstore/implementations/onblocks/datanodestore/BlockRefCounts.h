@@ -0,0 +1,59 @@
+#pragma once
+#ifndef MESSMER_BLOBSTORE_IMPLEMENTATIONS_ONBLOCKS_DATANODESTORE_BLOCKREFCOUNTS_H_
+#define MESSMER_BLOBSTORE_IMPLEMENTATIONS_ONBLOCKS_DATANODESTORE_BLOCKREFCOUNTS_H_
+
+#include <cpp-utils/macros.h>
+#include <blockstore/utils/BlockId.h>
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace blobstore {
+namespace onblocks {
+namespace datanodestore {
+
+// Counts how many parent nodes reference a node, so that cloned trees can share nodes. Only nodes with more than one
+// reference are stored, all other nodes have exactly one reference.
+// The counts are local state like the integrity data. Adding references is saved immediately, because losing it
+// would remove nodes that are still in use. Dropping references is only saved later, losing it just leaks nodes.
+class BlockRefCounts final {
+public:
+  // Without a state file, the counts are only kept in memory
+  explicit BlockRefCounts(boost::optional<boost::filesystem::path> stateFilePath);
+  ~BlockRefCounts();
+
+  bool isShared(const blockstore::BlockId &blockId) const;
+
+  // Adds one reference to each of the nodes
+  void addReferences(const std::vector<blockstore::BlockId> &blockIds);
+
+  // Drops one reference and returns true if it was the last one, i.e. if the node has to be removed
+  WARN_UNUSED_RESULT
+  bool release(const blockstore::BlockId &blockId);
+  // Drops one reference to each of the nodes and returns the ones that have to be removed
+  std::vector<blockstore::BlockId> release(const std::vector<blockstore::BlockId> &blockIds);
+
+private:
+  static const std::string HEADER;
+
+  // Needs _mutex to be locked
+  bool _release(const blockstore::BlockId &blockId);
+  void _loadStateFile();
+  void _saveStateFile() const;
+
+  // Number of references beyond the first one
+  std::unordered_map<blockstore::BlockId, uint32_t> _additionalReferences;
+  boost::optional<boost::filesystem::path> _stateFilePath;
+  bool _changedSinceSave;
+  mutable std::mutex _mutex;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockRefCounts);
+};
+
+}
+}
+}
+
+#endif
@@ -17,7 +17,7 @@ namespace datanodestore {
 DataInnerNode::DataInnerNode(DataNodeView view)
 : DataNode(std::move(view)) {
   ASSERT(depth() > 0, "Inner node can't have depth 0. Is this a leaf maybe?");
-  if (node().FormatVersion() != FORMAT_VERSION_HEADER) {
+  if (node().FormatVersion() != FORMAT_VERSION_HEADER && !node().hasTreeSizeTrailer()) {
     throw std::runtime_error("This node format (" + std::to_string(node().FormatVersion()) + ") is not supported. Was it created with a newer version of CryFS?");
   }
 }
@@ -78,12 +78,47 @@ void DataInnerNode::addChild(const DataNode &child) {
   _writeLastChild(ChildEntry(child.blockId()));
 }
 
+void DataInnerNode::addHoleChild() {
+  ASSERT(numChildren() < maxStoreableChildren(), "Adding more children than we can store");
+  ASSERT(depth() == 1, "Only leaves can be holes");
+  node().setSize(node().Size()+1);
+  _writeLastChild(ChildEntry::Hole());
+}
+
+void DataInnerNode::fillHoleChild(unsigned int index, const DataNode &child) {
+  ASSERT(readChild(index).isHole(), "Child is not a hole");
+  ASSERT(child.depth() == 0, "Only leaves can be holes");
+  _writeChild(index, ChildEntry(child.blockId()));
+}
+
+void DataInnerNode::replaceChild(unsigned int index, const DataNode &child) {
+  ASSERT(!readChild(index).isHole(), "Use fillHoleChild() to fill holes");
+  ASSERT(child.depth() == depth()-1, "Child has wrong depth");
+  _writeChild(index, ChildEntry(child.blockId()));
+}
+
 void DataInnerNode::removeLastChild() {
   ASSERT(node().Size() > 1, "There is no child to remove");
   _writeLastChild(ChildEntry(BlockId::Null()));
   node().setSize(node().Size()-1);
 }
 
+boost::optional<DataInnerNode::TreeSize> DataInnerNode::readTreeSize() const {
+  if (!node().hasTreeSizeTrailer()) {
+    return boost::none;
+  }
+  return TreeSize{node().TreeSizeTrailerNumLeaves(), node().TreeSizeTrailerLastLeafNumBytes(), node().TreeSizeTrailerMaxBytesPerLeaf()};
+}
+
+void DataInnerNode::writeTreeSize(const TreeSize &treeSize) {
+  const auto current = readTreeSize();
+  if (current != boost::none && current->numLeaves == treeSize.numLeaves && current->lastLeafNumBytes == treeSize.lastLeafNumBytes && current->maxBytesPerLeaf == treeSize.maxBytesPerLeaf) {
+    // Don't make the root node dirty if nothing changed
+    return;
+  }
+  node().setTreeSizeTrailer(treeSize.numLeaves, treeSize.lastLeafNumBytes, treeSize.maxBytesPerLeaf);
+}
+
 uint32_t DataInnerNode::maxStoreableChildren() const {
   return node().layout().maxChildrenPerInnerNode();
 }
@@ -4,6 +4,7 @@
 
 #include "DataNode.h"
 #include "DataInnerNode_ChildEntry.h"
+#include <boost/optional.hpp>
 
 namespace blobstore {
 namespace onblocks {
@@ -27,9 +28,25 @@ public:
   uint32_t numChildren() const;
 
   void addChild(const DataNode &child_blockId);
+  void addHoleChild();
+  // Replaces a hole child with a leaf that was created for it
+  void fillHoleChild(unsigned int index, const DataNode &child);
+  // Replaces a child with a copy of it
+  void replaceChild(unsigned int index, const DataNode &child);
 
   void removeLastChild();
 
+  // Root nodes can store the size of their tree, so that it doesn't have to be computed by loading the rightmost
+  // nodes of the tree. This isn't used for any other nodes.
+  struct TreeSize final {
+    uint32_t numLeaves;
+    uint32_t lastLeafNumBytes;
+    // Leaves can be larger than the inner nodes of the tree
+    uint32_t maxBytesPerLeaf;
+  };
+  boost::optional<TreeSize> readTreeSize() const;
+  void writeTreeSize(const TreeSize &treeSize);
+
 private:
   void _writeChild(unsigned int index, const ChildEntry& child);
   void _writeLastChild(const ChildEntry& child);
@@ -3,6 +3,7 @@
 #define MESSMER_BLOBSTORE_IMPLEMENTATIONS_ONBLOCKS_DATANODESTORE_DATAINNERNODE_CHILDENTRY_H_
 
 #include <cpp-utils/macros.h>
+#include <blockstore/utils/BlockId.h>
 
 namespace blobstore{
 namespace onblocks{
@@ -16,6 +17,16 @@ public:
     return _blockId;
   }
 
+  // Children of depth 1 nodes can be holes, i.e. full size leaves containing only zeroes that aren't stored.
+  // The last leaf of a tree is never a hole.
+  static DataInnerNode_ChildEntry Hole() {
+    return DataInnerNode_ChildEntry(blockstore::BlockId::Null());
+  }
+
+  bool isHole() const {
+    return _blockId == blockstore::BlockId::Null();
+  }
+
   DataInnerNode_ChildEntry(const DataInnerNode_ChildEntry&) = delete;
   DataInnerNode_ChildEntry& operator=(const DataInnerNode_ChildEntry&) = delete;
   DataInnerNode_ChildEntry(DataInnerNode_ChildEntry&&) = default;
@@ -5,6 +5,7 @@
 using cpputils::Data;
 using blockstore::BlockId;
 using blockstore::BlockStore;
+using blockstore::Block;
 using cpputils::unique_ref;
 using cpputils::make_unique_ref;
 
@@ -24,6 +25,12 @@ DataLeafNode::DataLeafNode(DataNodeView view)
 DataLeafNode::~DataLeafNode() {
 }
 
+unique_ref<DataLeafNode> DataLeafNode::InitializeNewNode(unique_ref<Block> block, const DataNodeLayout &layout, Data data) {
+  ASSERT(data.size() <= layout.maxBytesPerLeaf(), "Data passed in is too large for one leaf.");
+  const uint32_t size = data.size();
+  return make_unique_ref<DataLeafNode>(DataNodeView::initialize(std::move(block), layout, DataNode::FORMAT_VERSION_HEADER, 0, size, std::move(data)));
+}
+
 unique_ref<DataLeafNode> DataLeafNode::CreateNewNode(BlockStore *blockStore, const DataNodeLayout &layout, Data data) {
   ASSERT(data.size() <= layout.maxBytesPerLeaf(), "Data passed in is too large for one leaf.");
   const uint32_t size = data.size();
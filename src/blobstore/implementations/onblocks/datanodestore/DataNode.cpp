@@ -2,7 +2,6 @@
 #include "DataLeafNode.h"
 #include "DataNode.h"
 #include "DataNodeStore.h"
-#include <blockstore/utils/BlockStoreUtils.h>
 
 using blockstore::BlockId;
 
@@ -37,13 +36,34 @@ uint8_t DataNode::depth() const {
   return _node.Depth();
 }
 
+DataNodeLayout DataNode::layout() const {
+  return _node.layout();
+}
+
 unique_ref<DataInnerNode> DataNode::convertToNewInnerNode(unique_ref<DataNode> node, const DataNodeLayout &layout, const DataNode &first_child) {
   auto block = node->_node.releaseBlock();
-  blockstore::utils::fillWithZeroes(block.get());
+  // The new root doesn't know the tree size yet, so drop the tree size trailer if there was one.
+  // No need to zero the block first, initializing the node overwrites all of it.
+  if (block->size() != layout.blocksizeBytes()) {
+    block->resize(layout.blocksizeBytes());
+  }
 
   return DataInnerNode::InitializeNewNode(std::move(block), layout, first_child.depth()+1, {first_child.blockId()});
 }
 
+unique_ref<DataLeafNode> DataNode::convertToNewEmptyLeafNode(unique_ref<DataNode> node, const DataNodeLayout &layout) {
+  auto block = node->_node.releaseBlock();
+  if (block->size() != layout.blocksizeBytes()) {
+    block->resize(layout.blocksizeBytes());
+  }
+
+  return DataLeafNode::InitializeNewNode(std::move(block), layout, cpputils::Data(0));
+}
+
+void DataNode::removeTreeSize() {
+  _node.removeTreeSizeTrailer(FORMAT_VERSION_HEADER);
+}
+
 void DataNode::flush() const {
   _node.flush();
 }
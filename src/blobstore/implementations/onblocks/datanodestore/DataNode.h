@@ -10,6 +10,7 @@ namespace onblocks {
 namespace datanodestore {
 class DataNodeStore;
 class DataInnerNode;
+class DataLeafNode;
 
 class DataNode {
 public:
@@ -19,7 +20,14 @@ public:
 
   uint8_t depth() const;
 
+  DataNodeLayout layout() const;
+
   static cpputils::unique_ref<DataInnerNode> convertToNewInnerNode(cpputils::unique_ref<DataNode> node, const DataNodeLayout &layout, const DataNode &first_child);
+  // The node is resized to the block size of the given layout, which can differ from its current one.
+  static cpputils::unique_ref<DataLeafNode> convertToNewEmptyLeafNode(cpputils::unique_ref<DataNode> node, const DataNodeLayout &layout);
+
+  // Only root nodes store the tree size. Call this before a root node is copied to a non-root position.
+  void removeTreeSize();
 
   void flush() const;
 
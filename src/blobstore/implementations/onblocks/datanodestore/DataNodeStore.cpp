@@ -5,6 +5,8 @@
 #include <blockstore/interface/Block.h>
 #include <blockstore/utils/BlockStoreUtils.h>
 #include <cpp-utils/assert/assert.h>
+#include <cpp-utils/thread/parallel.h>
+#include <atomic>
 
 using blockstore::BlockStore;
 using blockstore::Block;
@@ -22,13 +24,36 @@ namespace blobstore {
 namespace onblocks {
 namespace datanodestore {
 
-DataNodeStore::DataNodeStore(unique_ref<BlockStore> blockstore, uint64_t physicalBlocksizeBytes)
-: _blockstore(std::move(blockstore)), _layout(_blockstore->blockSizeFromPhysicalBlockSize(physicalBlocksizeBytes)), _physicalBlockSizeBytes(physicalBlocksizeBytes) {
+constexpr size_t DataNodeStore::LEAF_REMOVAL_BATCH_SIZE;
+constexpr size_t DataNodeStore::LEAF_COPY_BATCH_SIZE;
+
+namespace {
+optional<DataNodeLayout> largeLeafLayoutFor(const BlockStore &blockstore, const optional<uint64_t> &physicalLargeLeafBlocksizeBytes) {
+  if (physicalLargeLeafBlocksizeBytes == none) {
+    return none;
+  }
+  return DataNodeLayout(blockstore.blockSizeFromPhysicalBlockSize(*physicalLargeLeafBlocksizeBytes));
+}
+}
+
+DataNodeStore::DataNodeStore(unique_ref<BlockStore> blockstore, uint64_t physicalBlocksizeBytes, const optional<uint64_t> &physicalLargeLeafBlocksizeBytes, const optional<boost::filesystem::path> &refCountsFilePath, bool legacyNodeFormat)
+: _blockstore(std::move(blockstore)), _layout(_blockstore->blockSizeFromPhysicalBlockSize(physicalBlocksizeBytes)),
+  _largeLeafLayout(largeLeafLayoutFor(*_blockstore, physicalLargeLeafBlocksizeBytes)), _physicalBlockSizeBytes(physicalBlocksizeBytes),
+  _legacyNodeFormat(legacyNodeFormat), _refCounts(refCountsFilePath) {
+  ASSERT(_largeLeafLayout == none || _largeLeafLayout->blocksizeBytes() > _layout.blocksizeBytes(), "Large leaves have to be larger than normal nodes");
+  ASSERT(_largeLeafLayout == none || !_legacyNodeFormat, "Large leaves can't be read by versions that need the legacy node format");
 }
 
 DataNodeStore::~DataNodeStore() {
 }
 
+bool DataNodeStore::isInnerNode(const Data &nodeData) {
+  if (nodeData.size() < DataNodeLayout::HEADERSIZE_BYTES) {
+    return false;
+  }
+  return cpputils::deserializeWithOffset<uint8_t>(nodeData.data(), DataNodeLayout::DEPTH_OFFSET_BYTES) != 0;
+}
+
 unique_ref<DataNode> DataNodeStore::load(unique_ref<Block> block) {
   DataNodeView node(std::move(block));
 
@@ -46,12 +71,14 @@ unique_ref<DataInnerNode> DataNodeStore::createNewInnerNode(uint8_t depth, const
   return DataInnerNode::CreateNewNode(_blockstore.get(), _layout, depth, children);
 }
 
-unique_ref<DataLeafNode> DataNodeStore::createNewLeafNode(Data data) {
-  return DataLeafNode::CreateNewNode(_blockstore.get(), _layout, std::move(data));
+unique_ref<DataLeafNode> DataNodeStore::createNewLeafNode(const DataNodeLayout &layout, Data data) {
+  ASSERT(_isValidLeafLayout(layout), "Unsupported leaf layout");
+  return DataLeafNode::CreateNewNode(_blockstore.get(), layout, std::move(data));
 }
 
-unique_ref<DataLeafNode> DataNodeStore::overwriteLeaf(const BlockId &blockId, Data data) {
-  return DataLeafNode::OverwriteNode(_blockstore.get(), _layout, blockId, std::move(data));
+unique_ref<DataLeafNode> DataNodeStore::overwriteLeaf(const DataNodeLayout &layout, const BlockId &blockId, Data data) {
+  ASSERT(_isValidLeafLayout(layout), "Unsupported leaf layout");
+  return DataLeafNode::OverwriteNode(_blockstore.get(), layout, blockId, std::move(data));
 }
 
 optional<unique_ref<DataNode>> DataNodeStore::load(const BlockId &blockId) {
@@ -59,22 +86,142 @@ optional<unique_ref<DataNode>> DataNodeStore::load(const BlockId &blockId) {
   if (block == none) {
     return none;
   } else {
-    ASSERT((*block)->size() == _layout.blocksizeBytes(), "Loading block of wrong size");
-    return load(std::move(*block));
+    auto node = load(std::move(*block));
+    ASSERT(_isValidLayout(*node), "Loading block of wrong size");
+    return node;
   }
 }
 
 unique_ref<DataNode> DataNodeStore::createNewNodeAsCopyFrom(const DataNode &source) {
-  ASSERT(source.node().layout().blocksizeBytes() == _layout.blocksizeBytes(), "Source node has wrong layout. Is it from the same DataNodeStore?");
-  auto newBlock = blockstore::utils::copyToNewBlock(_blockstore.get(), source.node().block());
-  return load(std::move(newBlock));
+  ASSERT(_isValidLayout(source), "Source node has wrong layout. Is it from the same DataNodeStore?");
+  DataNodeView copy = DataNodeView::createCopyWithoutTreeSizeTrailer(_blockstore.get(), source.node(), DataNode::FORMAT_VERSION_HEADER);
+  return load(copy.releaseBlock());
+}
+
+unique_ref<DataNode> DataNodeStore::createNewSubtreeAsCopyFrom(const DataNode &source, const CopyObserver &onNodeCopied) {
+  const DataInnerNode *inner = dynamic_cast<const DataInnerNode*>(&source);
+  if (inner == nullptr) {
+    return createNewNodeAsCopyFrom(source);
+  }
+  vector<BlockId> children;
+  children.reserve(inner->numChildren());
+  for (uint32_t i = 0; i < inner->numChildren(); ++i) {
+    children.push_back(inner->readChild(i).blockId());
+  }
+  const vector<BlockId> copies = _copySubtrees(inner->depth()-1, children, onNodeCopied);
+  return createNewInnerNode(inner->depth(), copies);
+}
+
+unique_ref<DataNode> DataNodeStore::createNewNodeAsSharedCopyFrom(const DataNode &source) {
+  const DataInnerNode *inner = dynamic_cast<const DataInnerNode*>(&source);
+  if (inner != nullptr) {
+    // Count the references before they exist, so that a crash in between can only leak nodes
+    _refCounts.addReferences(_childrenOf(*inner));
+  }
+  return createNewNodeAsCopyFrom(source);
+}
+
+bool DataNodeStore::isShared(const BlockId &blockId) const {
+  return _refCounts.isShared(blockId);
+}
+
+unique_ref<DataNode> DataNodeStore::unshare(unique_ref<DataNode> node) {
+  auto copy = createNewNodeAsSharedCopyFrom(*node);
+  const BlockId blockId = node->blockId();
+  const DataInnerNode *inner = dynamic_cast<const DataInnerNode*>(node.get());
+  const vector<BlockId> children = (inner == nullptr) ? vector<BlockId>() : _childrenOf(*inner);
+  cpputils::destruct(std::move(node));
+  if (_refCounts.release(blockId)) {
+    // The other references were dropped in the meantime. The children are still referenced by the copy.
+    const vector<BlockId> unreferencedChildren = _refCounts.release(children);
+    ASSERT(unreferencedChildren.empty(), "Children of the copy can't be unreferenced");
+    _blockstore->remove(blockId);
+  }
+  return copy;
+}
+
+vector<BlockId> DataNodeStore::_copySubtrees(uint8_t depth, const vector<BlockId> &nodes, const CopyObserver &onNodeCopied) {
+  // Same batching as in removeSubtree(), but copying a leaf means decrypting and encrypting it, so the batches are smaller.
+  const size_t batchSize = (depth == 0) ? LEAF_COPY_BATCH_SIZE : 1;
+  const size_t numBatches = (nodes.size() + batchSize - 1) / batchSize;
+  vector<BlockId> copies(nodes.size(), BlockId::Null());
+  std::atomic<size_t> nextBatch(0);
+  try {
+    cpputils::runInParallel(numBatches, [&] {
+      for (size_t batch = nextBatch++; batch < numBatches; batch = nextBatch++) {
+        const size_t end = std::min(nodes.size(), (batch + 1) * batchSize);
+        for (size_t i = batch * batchSize; i < end; ++i) {
+          copies[i] = _copySubtree(depth, nodes[i], onNodeCopied);
+        }
+      }
+    });
+  } catch (...) {
+    // Don't leave the copies made so far behind
+    for (const BlockId &copy : copies) {
+      removeSubtree(depth, copy);
+    }
+    throw;
+  }
+  return copies;
+}
+
+// NOLINTNEXTLINE(misc-no-recursion)
+BlockId DataNodeStore::_copySubtree(uint8_t depth, const BlockId &blockId, const CopyObserver &onNodeCopied) {
+  if (DataInnerNode::ChildEntry(blockId).isHole()) {
+    return BlockId::Null();
+  }
+  auto node = load(blockId);
+  ASSERT(node != none, "Node to copy not found");
+  ASSERT((*node)->depth() == depth, "Wrong depth given");
+  if (depth == 0) {
+    const BlockId copy = createNewNodeAsCopyFrom(**node)->blockId();
+    try {
+      onNodeCopied();
+    } catch (...) {
+      _blockstore->remove(copy);
+      throw;
+    }
+    return copy;
+  }
+  auto inner = dynamic_pointer_move<DataInnerNode>(*node);
+  ASSERT(inner != none, "Is not an inner node, but depth was not zero");
+  vector<BlockId> children;
+  children.reserve((*inner)->numChildren());
+  for (uint32_t i = 0; i < (*inner)->numChildren(); ++i) {
+    children.push_back((*inner)->readChild(i).blockId());
+  }
+  cpputils::destruct(std::move(*inner));
+  vector<BlockId> copies;
+  copies.reserve(children.size());
+  try {
+    for (const BlockId &child : children) {
+      copies.push_back(_copySubtree(depth-1, child, onNodeCopied));
+    }
+  } catch (...) {
+    for (const BlockId &copy : copies) {
+      removeSubtree(depth-1, copy);
+    }
+    throw;
+  }
+  const BlockId copy = createNewInnerNode(depth, copies)->blockId();
+  try {
+    onNodeCopied();
+  } catch (...) {
+    removeSubtree(depth, copy);
+    throw;
+  }
+  return copy;
 }
 
 unique_ref<DataNode> DataNodeStore::overwriteNodeWith(unique_ref<DataNode> target, const DataNode &source) {
-  ASSERT(target->node().layout().blocksizeBytes() == _layout.blocksizeBytes(), "Target node has wrong layout. Is it from the same DataNodeStore?");
-  ASSERT(source.node().layout().blocksizeBytes() == _layout.blocksizeBytes(), "Source node has wrong layout. Is it from the same DataNodeStore?");
+  ASSERT(_isValidLayout(*target), "Target node has wrong layout. Is it from the same DataNodeStore?");
+  ASSERT(_isValidLayout(source), "Source node has wrong layout. Is it from the same DataNodeStore?");
   auto targetBlock = target->node().releaseBlock();
   cpputils::destruct(std::move(target)); // Call destructor
+  if (targetBlock->size() != source.node().block().size()) {
+    // The target could have had a tree size trailer
+    targetBlock->resize(source.node().block().size());
+  }
   blockstore::utils::copyTo(targetBlock.get(), source.node().block());
   return DataNodeStore::load(std::move(targetBlock));
 }
@@ -86,40 +233,90 @@ void DataNodeStore::remove(unique_ref<DataNode> node) {
 }
 
 void DataNodeStore::remove(const BlockId &blockId) {
-  _blockstore->remove(blockId);
+  if (_refCounts.release(blockId)) {
+    _blockstore->remove(blockId);
+  }
 }
 
 void DataNodeStore::removeSubtree(unique_ref<DataNode> node) {
+  const BlockId blockId = node->blockId();
+  if (!_refCounts.release(blockId)) {
+    // The subtree is still used by a cloned tree
+    return;
+  }
   auto leaf = dynamic_pointer_move<DataLeafNode>(node);
   if (leaf != none) {
-    remove(std::move(*leaf));
+    cpputils::destruct(std::move(*leaf));
+    _blockstore->remove(blockId);
     return;
   }
 
   auto inner = dynamic_pointer_move<DataInnerNode>(node);
   ASSERT(inner != none, "Is neither a leaf nor an inner node");
-  for (uint32_t i = 0; i < (*inner)->numChildren(); ++i) {
-    removeSubtree((*inner)->depth()-1, (*inner)->readChild(i).blockId());
+  const uint8_t childDepth = (*inner)->depth()-1;
+  const vector<BlockId> children = _refCounts.release(_childrenOf(**inner));
+  // Each task removes a batch of children. The subtree below an inner node is large enough to be a task on its own,
+  // but removing a single leaf is too little work to be worth the synchronization.
+  const size_t batchSize = (childDepth == 0) ? LEAF_REMOVAL_BATCH_SIZE : 1;
+  const size_t numBatches = (children.size() + batchSize - 1) / batchSize;
+  std::atomic<size_t> nextBatch(0);
+  cpputils::runInParallel(numBatches, [&] {
+    for (size_t batch = nextBatch++; batch < numBatches; batch = nextBatch++) {
+      const vector<BlockId> batchChildren(children.begin() + batch * batchSize, children.begin() + std::min(children.size(), (batch + 1) * batchSize));
+      _removeDescendants(childDepth, batchChildren);
+      _blockstore->removeMany(batchChildren);
+    }
+  });
+  cpputils::destruct(std::move(*inner));
+  _blockstore->remove(blockId);
+}
+
+void DataNodeStore::removeSubtree(uint8_t depth, const BlockId &blockId) {
+  if (DataInnerNode::ChildEntry(blockId).isHole()) {
+    return;
   }
-  remove(std::move(*inner));
+  if (!_refCounts.release(blockId)) {
+    return;
+  }
+  _removeDescendants(depth, {blockId});
+  _blockstore->remove(blockId);
 }
 
 // NOLINTNEXTLINE(misc-no-recursion)
-void DataNodeStore::removeSubtree(uint8_t depth, const BlockId &blockId) {
+void DataNodeStore::_removeDescendants(uint8_t depth, const vector<BlockId> &nodes) {
   if (depth == 0) {
-    remove(blockId);
-  } else {
-    auto node = load(blockId);
-    ASSERT(node != none, "Node for removeSubtree not found");
-
-    auto inner = dynamic_pointer_move<DataInnerNode>(*node);
-    ASSERT(inner != none, "Is not an inner node, but depth was not zero");
-    ASSERT((*inner)->depth() == depth, "Wrong depth given");
-    for (uint32_t i = 0; i < (*inner)->numChildren(); ++i) {
-      removeSubtree(depth-1, (*inner)->readChild(i).blockId());
+    // Leaves don't have descendants. Not loading them saves reading and decrypting them.
+    return;
+  }
+  for (const BlockId &blockId : nodes) {
+    // Children that are still used by a cloned tree are only dereferenced
+    const vector<BlockId> children = _refCounts.release(_loadChildrenOf(depth, blockId));
+    _removeDescendants(depth-1, children);
+    _blockstore->removeMany(children);
+  }
+}
+
+vector<BlockId> DataNodeStore::_loadChildrenOf(uint8_t depth, const BlockId &blockId) {
+  auto node = load(blockId);
+  ASSERT(node != none, "Node for removeSubtree not found");
+
+  auto inner = dynamic_pointer_move<DataInnerNode>(*node);
+  ASSERT(inner != none, "Is not an inner node, but depth was not zero");
+  ASSERT((*inner)->depth() == depth, "Wrong depth given");
+  return _childrenOf(**inner);
+}
+
+vector<BlockId> DataNodeStore::_childrenOf(const DataInnerNode &node) {
+  vector<BlockId> children;
+  children.reserve(node.numChildren());
+  for (uint32_t i = 0; i < node.numChildren(); ++i) {
+    auto child = node.readChild(i);
+    // Holes aren't stored, so there is nothing to remove
+    if (!child.isHole()) {
+      children.push_back(child.blockId());
     }
-    remove(std::move(*inner));
   }
+  return children;
 }
 
 uint64_t DataNodeStore::numNodes() const {
@@ -138,6 +335,26 @@ DataNodeLayout DataNodeStore::layout() const {
   return _layout;
 }
 
+const optional<DataNodeLayout> &DataNodeStore::largeLeafLayout() const {
+  return _largeLeafLayout;
+}
+
+bool DataNodeStore::legacyNodeFormat() const {
+  return _legacyNodeFormat;
+}
+
+bool DataNodeStore::_isValidLeafLayout(const DataNodeLayout &layout) const {
+  return layout.blocksizeBytes() == _layout.blocksizeBytes() || (_largeLeafLayout != none && layout.blocksizeBytes() == _largeLeafLayout->blocksizeBytes());
+}
+
+bool DataNodeStore::_isValidLayout(const DataNode &node) const {
+  if (node.depth() == 0) {
+    return _isValidLeafLayout(node.layout());
+  }
+  // Only leaves can be large
+  return node.layout().blocksizeBytes() == _layout.blocksizeBytes();
+}
+
 void DataNodeStore::forEachNode(std::function<void (const BlockId& nodeId)> callback) const {
   _blockstore->forEachBlock(std::move(callback));
 }
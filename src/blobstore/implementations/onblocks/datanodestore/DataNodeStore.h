@@ -5,7 +5,10 @@
 #include <memory>
 #include <cpp-utils/macros.h>
 #include "DataNodeView.h"
+#include "BlockRefCounts.h"
 #include <blockstore/utils/BlockId.h>
+#include <functional>
+#include <vector>
 
 namespace blockstore{
 class Block;
@@ -21,28 +24,53 @@ class DataInnerNode;
 
 class DataNodeStore final {
 public:
-  DataNodeStore(cpputils::unique_ref<blockstore::BlockStore> blockstore, uint64_t physicalBlocksizeBytes);
+  // If physicalLargeLeafBlocksizeBytes is set, trees can use leaves of that size instead of the normal block size.
+  // Inner nodes always use the normal block size.
+  // The reference counts of nodes shared between cloned trees are stored in refCountsFilePath, see BlockRefCounts.
+  // With legacyNodeFormat, trees only contain nodes that versions without holes and tree size trailers can read.
+  DataNodeStore(cpputils::unique_ref<blockstore::BlockStore> blockstore, uint64_t physicalBlocksizeBytes, const boost::optional<uint64_t> &physicalLargeLeafBlocksizeBytes = boost::none, const boost::optional<boost::filesystem::path> &refCountsFilePath = boost::none, bool legacyNodeFormat = false);
   ~DataNodeStore();
 
   static constexpr uint8_t MAX_DEPTH = 10;
 
   DataNodeLayout layout() const;
+  const boost::optional<DataNodeLayout> &largeLeafLayout() const;
+  bool legacyNodeFormat() const;
 
   boost::optional<cpputils::unique_ref<DataNode>> load(const blockstore::BlockId &blockId);
   static cpputils::unique_ref<DataNode> load(cpputils::unique_ref<blockstore::Block> block);
 
-  cpputils::unique_ref<DataLeafNode> createNewLeafNode(cpputils::Data data);
+  // Checks the header of a raw node block. Can be used by lower layers to give inner nodes a separate cache.
+  static bool isInnerNode(const cpputils::Data &nodeData);
+
+  // The layout has to be either layout() or largeLeafLayout()
+  cpputils::unique_ref<DataLeafNode> createNewLeafNode(const DataNodeLayout &layout, cpputils::Data data);
   cpputils::unique_ref<DataInnerNode> createNewInnerNode(uint8_t depth, const std::vector<blockstore::BlockId> &children);
 
   cpputils::unique_ref<DataNode> createNewNodeAsCopyFrom(const DataNode &source);
+  // Called after each node copied by createNewSubtreeAsCopyFrom(), possibly from several threads at once.
+  // If it throws, copying stops, the nodes copied so far are removed and the exception is passed on.
+  using CopyObserver = std::function<void ()>;
+  // Copies the node and all nodes below it. The subtrees below the node are copied in parallel.
+  cpputils::unique_ref<DataNode> createNewSubtreeAsCopyFrom(const DataNode &source, const CopyObserver &onNodeCopied);
+  // Copies only the node itself. The copy shares the nodes below it with the source.
+  cpputils::unique_ref<DataNode> createNewNodeAsSharedCopyFrom(const DataNode &source);
+
+  // Shared nodes are referenced by more than one parent and must not be modified
+  bool isShared(const blockstore::BlockId &blockId) const;
+  // Drops one reference to the shared node and returns a copy of it that isn't shared.
+  // The caller has to replace the reference in the parent node with the copy.
+  cpputils::unique_ref<DataNode> unshare(cpputils::unique_ref<DataNode> node);
 
   cpputils::unique_ref<DataNode> overwriteNodeWith(cpputils::unique_ref<DataNode> target, const DataNode &source);
 
-  cpputils::unique_ref<DataLeafNode> overwriteLeaf(const blockstore::BlockId &blockId, cpputils::Data data);
+  cpputils::unique_ref<DataLeafNode> overwriteLeaf(const DataNodeLayout &layout, const blockstore::BlockId &blockId, cpputils::Data data);
 
+  // Nodes that are still referenced elsewhere are only dereferenced instead of removed
   void remove(cpputils::unique_ref<DataNode> node);
   void remove(const blockstore::BlockId &blockId);
   void removeSubtree(uint8_t depth, const blockstore::BlockId &blockId);
+  // Removes the subtrees below the given node in parallel
   void removeSubtree(cpputils::unique_ref<DataNode> node);
 
   //TODO Test blocksizeBytes/numBlocks/estimateSpaceForNumBlocksLeft
@@ -54,10 +82,25 @@ public:
   void forEachNode(std::function<void (const blockstore::BlockId& nodeId)> callback) const;
 
 private:
+  static constexpr size_t LEAF_REMOVAL_BATCH_SIZE = 64;
+  static constexpr size_t LEAF_COPY_BATCH_SIZE = 16;
+
+  // Removes all nodes below the given nodes, but not the nodes themselves. The given nodes must not be referenced anymore.
+  void _removeDescendants(uint8_t depth, const std::vector<blockstore::BlockId> &nodes);
+  std::vector<blockstore::BlockId> _loadChildrenOf(uint8_t depth, const blockstore::BlockId &blockId);
+  static std::vector<blockstore::BlockId> _childrenOf(const DataInnerNode &node);
+  // Returns the id of the copy. Holes stay holes.
+  blockstore::BlockId _copySubtree(uint8_t depth, const blockstore::BlockId &blockId, const CopyObserver &onNodeCopied);
+  std::vector<blockstore::BlockId> _copySubtrees(uint8_t depth, const std::vector<blockstore::BlockId> &nodes, const CopyObserver &onNodeCopied);
+  bool _isValidLeafLayout(const DataNodeLayout &layout) const;
+  bool _isValidLayout(const DataNode &node) const;
 
   cpputils::unique_ref<blockstore::BlockStore> _blockstore;
   const DataNodeLayout _layout;
+  const boost::optional<DataNodeLayout> _largeLeafLayout;
   uint64_t _physicalBlockSizeBytes;
+  const bool _legacyNodeFormat;
+  BlockRefCounts _refCounts;
 
   DISALLOW_COPY_AND_ASSIGN(DataNodeStore);
 };
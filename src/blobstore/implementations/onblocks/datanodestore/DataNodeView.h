@@ -34,6 +34,16 @@ public:
   static constexpr uint32_t DEPTH_OFFSET_BYTES = 3; // depth uses 1 byte
   //Where in the header is the size field (for inner nodes: number of children, for leafs: content data size)
   static constexpr uint32_t SIZE_OFFSET_BYTES = 4; // size uses 4 bytes
+  //Format version of root nodes that store the size of their tree in a trailer behind the data region.
+  //Versions that don't know about the trailer refuse to load these nodes.
+  static constexpr uint16_t FORMAT_VERSION_WITH_TREE_SIZE = 1;
+  //Size of the tree size trailer (number of leaves and number of bytes in the last leaf, 4 bytes each)
+  static constexpr uint32_t TREE_SIZE_TRAILER_BYTES = 8;
+  //Format version of root nodes whose trailer additionally stores the leaf size of their tree.
+  //Trees can have leaves that are larger than their inner nodes.
+  static constexpr uint16_t FORMAT_VERSION_WITH_TREE_AND_LEAF_SIZE = 2;
+  //Size of the trailer storing the tree size and the leaf size (maximal number of bytes per leaf, 4 bytes)
+  static constexpr uint32_t TREE_AND_LEAF_SIZE_TRAILER_BYTES = TREE_SIZE_TRAILER_BYTES + 4;
 
 
   //Size of a block (header + data region)
@@ -73,6 +83,19 @@ public:
     return DataNodeView(std::move(block));
   }
 
+  // Creates a new block with the contents of the source node, but without its tree size trailer. The copy is built from the
+  // source data that is already in memory, so the new block only passes through the block store once.
+  static DataNodeView createCopyWithoutTreeSizeTrailer(blockstore::BlockStore *blockStore, const DataNodeView &source, uint16_t formatVersionWithoutTrailer) {
+    const uint64_t newSize = source._block->size() - source.treeSizeTrailerBytes();
+    cpputils::Data copy(newSize);
+    std::memcpy(copy.data(), source._block->data(), newSize);
+    if (source.hasTreeSizeTrailer()) {
+      cpputils::serialize<uint16_t>(copy.dataOffset(DataNodeLayout::FORMAT_VERSION_OFFSET_BYTES), formatVersionWithoutTrailer);
+    }
+    auto block = blockStore->create(copy);
+    return DataNodeView(std::move(block));
+  }
+
   static DataNodeView initialize(cpputils::unique_ref<blockstore::Block> block, const DataNodeLayout &layout, uint16_t formatVersion, uint8_t depth, uint32_t size, cpputils::Data data) {
     ASSERT(data.size() <= DataNodeLayout(block->size()).datasizeBytes(), "Data is too large for node");
     cpputils::Data serialized = serialize_(layout, formatVersion, depth, size, std::move(data));
@@ -123,7 +146,59 @@ public:
   }
 
   DataNodeLayout layout() const {
-    return DataNodeLayout(_block->size());
+    return DataNodeLayout(_block->size() - treeSizeTrailerBytes());
+  }
+
+  bool hasTreeSizeTrailer() const {
+    return treeSizeTrailerBytes() != 0;
+  }
+
+  uint32_t TreeSizeTrailerNumLeaves() const {
+    ASSERT(hasTreeSizeTrailer(), "Node doesn't have a tree size trailer");
+    return cpputils::deserializeWithOffset<uint32_t>(_block->data(), _treeSizeTrailerOffset());
+  }
+
+  uint32_t TreeSizeTrailerLastLeafNumBytes() const {
+    ASSERT(hasTreeSizeTrailer(), "Node doesn't have a tree size trailer");
+    return cpputils::deserializeWithOffset<uint32_t>(_block->data(), _treeSizeTrailerOffset() + sizeof(uint32_t));
+  }
+
+  uint32_t TreeSizeTrailerMaxBytesPerLeaf() const {
+    ASSERT(hasTreeSizeTrailer(), "Node doesn't have a tree size trailer");
+    if (FormatVersion() != DataNodeLayout::FORMAT_VERSION_WITH_TREE_AND_LEAF_SIZE) {
+      // Trailers without a leaf size were only written for trees whose leaves have the same size as their inner nodes
+      return layout().maxBytesPerLeaf();
+    }
+    return cpputils::deserializeWithOffset<uint32_t>(_block->data(), _treeSizeTrailerOffset() + 2*sizeof(uint32_t));
+  }
+
+  void setTreeSizeTrailer(uint32_t numLeaves, uint32_t lastLeafNumBytes, uint32_t maxBytesPerLeaf) {
+    if (FormatVersion() != DataNodeLayout::FORMAT_VERSION_WITH_TREE_AND_LEAF_SIZE) {
+      _block->resize(_block->size() - treeSizeTrailerBytes() + DataNodeLayout::TREE_AND_LEAF_SIZE_TRAILER_BYTES);
+      setFormatVersion(DataNodeLayout::FORMAT_VERSION_WITH_TREE_AND_LEAF_SIZE);
+    }
+    const uint64_t offset = _treeSizeTrailerOffset();
+    _block->write(&numLeaves, offset, sizeof(numLeaves));
+    _block->write(&lastLeafNumBytes, offset + sizeof(numLeaves), sizeof(lastLeafNumBytes));
+    _block->write(&maxBytesPerLeaf, offset + 2*sizeof(uint32_t), sizeof(maxBytesPerLeaf));
+  }
+
+  void removeTreeSizeTrailer(uint16_t formatVersionWithoutTrailer) {
+    if (hasTreeSizeTrailer()) {
+      _block->resize(_block->size() - treeSizeTrailerBytes());
+      setFormatVersion(formatVersionWithoutTrailer);
+    }
+  }
+
+  uint32_t treeSizeTrailerBytes() const {
+    switch (FormatVersion()) {
+      case DataNodeLayout::FORMAT_VERSION_WITH_TREE_SIZE:
+        return DataNodeLayout::TREE_SIZE_TRAILER_BYTES;
+      case DataNodeLayout::FORMAT_VERSION_WITH_TREE_AND_LEAF_SIZE:
+        return DataNodeLayout::TREE_AND_LEAF_SIZE_TRAILER_BYTES;
+      default:
+        return 0;
+    }
   }
 
   cpputils::unique_ref<blockstore::Block> releaseBlock() {
@@ -143,6 +218,10 @@ public:
   }
 
 private:
+  uint64_t _treeSizeTrailerOffset() const {
+    return _block->size() - treeSizeTrailerBytes();
+  }
+
   static cpputils::Data serialize_(const DataNodeLayout &layout, uint16_t formatVersion, uint8_t depth, uint32_t size, cpputils::Data data) {
     cpputils::Data result(layout.blocksizeBytes());
     cpputils::serialize<uint16_t>(result.dataOffset(layout.FORMAT_VERSION_OFFSET_BYTES), formatVersion);
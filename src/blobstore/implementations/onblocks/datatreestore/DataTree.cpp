@@ -18,8 +18,10 @@ using blobstore::onblocks::datanodestore::DataNodeStore;
 using blobstore::onblocks::datanodestore::DataNode;
 using blobstore::onblocks::datanodestore::DataInnerNode;
 using blobstore::onblocks::datanodestore::DataLeafNode;
+using blobstore::onblocks::datanodestore::DataNodeLayout;
 
 using std::function;
+using std::vector;
 using boost::shared_mutex;
 using boost::shared_lock;
 using boost::unique_lock;
@@ -38,9 +40,11 @@ namespace onblocks {
 namespace datatreestore {
 
 DataTree::DataTree(DataNodeStore *nodeStore, unique_ref<DataNode> rootNode)
-  : _treeStructureMutex(), _nodeStore(nodeStore), _rootNode(std::move(rootNode)), _blockId(_rootNode->blockId()), _sizeCache() {
+  : _treeStructureMutex(), _nodeStore(nodeStore), _rootNode(std::move(rootNode)), _blockId(_rootNode->blockId()), _sizeCache(), _largeLeavesAllowed(false) {
 }
 
+constexpr uint32_t DataTree::LARGE_LEAVES_THRESHOLD_NUM_LEAVES;
+
 DataTree::~DataTree() {
 }
 
@@ -90,10 +94,37 @@ uint64_t DataTree::_numBytes() const {
 
 DataTree::SizeCache DataTree::_getOrComputeSizeCache() const {
   return _sizeCache.getOrCompute([this] () {
+    const DataInnerNode *root = dynamic_cast<const DataInnerNode*>(_rootNode.get());
+    if (root != nullptr) {
+      auto treeSize = root->readTreeSize();
+      if (treeSize != none) {
+        const uint64_t numBytesInLeftLeaves = static_cast<uint64_t>(treeSize->numLeaves - 1) * treeSize->maxBytesPerLeaf;
+        const DataNodeLayout leafLayout(DataNodeLayout::HEADERSIZE_BYTES + treeSize->maxBytesPerLeaf);
+        return SizeCache{treeSize->numLeaves, numBytesInLeftLeaves + treeSize->lastLeafNumBytes, leafLayout};
+      }
+    }
+    // Trees written by older versions don't store their size in the root node
     return _computeSizeCache(*_rootNode);
   });
 }
 
+void DataTree::_setSize(const SizeCache &size) const {
+  _sizeCache.update([&size] (optional<SizeCache>* cache) {
+    *cache = size;
+  });
+  // Leaf roots know their size anyway, and older versions can't read the trailer
+  DataInnerNode *root = dynamic_cast<DataInnerNode*>(_rootNode.get());
+  if (root != nullptr && !_nodeStore->legacyNodeFormat()) {
+    const uint32_t maxBytesPerLeaf = size.leafLayout.maxBytesPerLeaf();
+    const uint32_t lastLeafNumBytes = size.numBytes - static_cast<uint64_t>(size.numLeaves - 1) * maxBytesPerLeaf;
+    root->writeTreeSize({size.numLeaves, lastLeafNumBytes, maxBytesPerLeaf});
+  }
+}
+
+DataNodeLayout DataTree::_leafLayout() const {
+  return _getOrComputeSizeCache().leafLayout;
+}
+
 uint32_t DataTree::forceComputeNumLeaves() const {
   _sizeCache.clear();
   return numLeaves();
@@ -103,19 +134,21 @@ uint32_t DataTree::forceComputeNumLeaves() const {
 DataTree::SizeCache DataTree::_computeSizeCache(const DataNode &node) const {
   const DataLeafNode *leaf = dynamic_cast<const DataLeafNode*>(&node);
   if (leaf != nullptr) {
-    return {1, leaf->numBytes()};
+    return {1, leaf->numBytes(), leaf->layout()};
   }
 
   const DataInnerNode &inner = dynamic_cast<const DataInnerNode&>(node);
-  const uint32_t numLeavesInLeftChildren = static_cast<uint32_t>(inner.numChildren()-1) * _leavesPerFullChild(inner);
-  const uint64_t numBytesInLeftChildren = numLeavesInLeftChildren * _nodeStore->layout().maxBytesPerLeaf();
   auto lastChild = _nodeStore->load(inner.readLastChild().blockId());
   ASSERT(lastChild != none, "Couldn't load last child");
+  // The last leaf is never a hole, so the rightmost path also tells the leaf size of the tree
   const SizeCache sizeInRightChild = _computeSizeCache(**lastChild);
+  const uint32_t numLeavesInLeftChildren = static_cast<uint32_t>(inner.numChildren()-1) * _leavesPerFullChild(inner);
+  const uint64_t numBytesInLeftChildren = numLeavesInLeftChildren * sizeInRightChild.leafLayout.maxBytesPerLeaf();
 
   return SizeCache {
     numLeavesInLeftChildren + sizeInRightChild.numLeaves,
-    numBytesInLeftChildren + sizeInRightChild.numBytes
+    numBytesInLeftChildren + sizeInRightChild.numBytes,
+    sizeInRightChild.leafLayout
   };
 }
 
@@ -128,7 +161,7 @@ void DataTree::_traverseLeavesByLeafIndices(uint32_t beginIndex, uint32_t endInd
   }
 
   // TODO no const cast
-  LeafTraverser(_nodeStore, readOnlyTraversal).traverseAndUpdateRoot(&const_cast<DataTree*>(this)->_rootNode, beginIndex, endIndex, onExistingLeaf, onCreateLeaf, onBacktrackFromSubtree);
+  LeafTraverser(_nodeStore, _leafLayout(), readOnlyTraversal).traverseAndUpdateRoot(&const_cast<DataTree*>(this)->_rootNode, beginIndex, endIndex, onExistingLeaf, onCreateLeaf, onBacktrackFromSubtree);
 }
 
 void DataTree::_traverseLeavesByByteIndices(uint64_t beginByte, uint64_t sizeBytes, bool readOnlyTraversal, function<void (uint64_t leafOffset, LeafHandle leaf, uint32_t begin, uint32_t count)> onExistingLeaf, function<Data (uint64_t beginByte, uint32_t count)> onCreateLeaf) const {
@@ -137,7 +170,8 @@ void DataTree::_traverseLeavesByByteIndices(uint64_t beginByte, uint64_t sizeByt
   }
 
   const uint64_t endByte = beginByte + sizeBytes;
-  const uint64_t _maxBytesPerLeaf = maxBytesPerLeaf();
+  const DataNodeLayout leafLayout = _leafLayout();
+  const uint64_t _maxBytesPerLeaf = leafLayout.maxBytesPerLeaf();
   const uint32_t firstLeaf = beginByte / _maxBytesPerLeaf;
   const uint32_t endLeaf = utils::ceilDivision(endByte, _maxBytesPerLeaf);
   bool blobIsGrowingFromThisTraversal = false;
@@ -184,9 +218,7 @@ void DataTree::_traverseLeavesByByteIndices(uint64_t beginByte, uint64_t sizeByt
   ASSERT(!readOnlyTraversal || !blobIsGrowingFromThisTraversal, "Blob grew from traversal that didn't allow growing (i.e. reading)");
 
   if (blobIsGrowingFromThisTraversal) {
-    _sizeCache.update([endLeaf, endByte] (optional<SizeCache>* cache) {
-        *cache = SizeCache{endLeaf, endByte};
-    });
+    _setSize({endLeaf, endByte, leafLayout});
   }
 }
 
@@ -197,8 +229,14 @@ uint32_t DataTree::_leavesPerFullChild(const DataInnerNode &root) const {
 void DataTree::resizeNumBytes(uint64_t newNumBytes) {
   const std::unique_lock<shared_mutex> lock(_treeStructureMutex);
 
-  const uint32_t newNumLeaves = std::max(UINT64_C(1), utils::ceilDivision(newNumBytes, _nodeStore->layout().maxBytesPerLeaf()));
-  const uint32_t newLastLeafSize = newNumBytes - (newNumLeaves-1) * _nodeStore->layout().maxBytesPerLeaf();
+  const bool isGrowing = newNumBytes > _numBytes();
+  if (isGrowing) {
+    _adaptLeafSize(newNumBytes);
+  }
+
+  const DataNodeLayout leafLayout = _leafLayout();
+  const uint32_t newNumLeaves = std::max(UINT64_C(1), utils::ceilDivision(newNumBytes, leafLayout.maxBytesPerLeaf()));
+  const uint32_t newLastLeafSize = newNumBytes - (newNumLeaves-1) * leafLayout.maxBytesPerLeaf();
   const uint32_t maxChildrenPerInnerNode = _nodeStore->layout().maxChildrenPerInnerNode();
   auto onExistingLeaf = [newLastLeafSize] (uint32_t /*index*/, bool /*isRightBorderLeaf*/, LeafHandle leafHandle) {
       auto leaf = leafHandle.node();
@@ -227,14 +265,78 @@ void DataTree::resizeNumBytes(uint64_t newNumBytes) {
   };
 
   _traverseLeavesByLeafIndices(newNumLeaves - 1, newNumLeaves, false, onExistingLeaf, onCreateLeaf, onBacktrackFromSubtree);
-  _sizeCache.update([newNumLeaves, newNumBytes] (boost::optional<SizeCache>* cache) {
-    *cache = SizeCache{newNumLeaves, newNumBytes};
-  });
+  _setSize({newNumLeaves, newNumBytes, leafLayout});
 
+  if (!isGrowing) {
+    // Shrink first, so that there is less data to rewrite
+    _adaptLeafSize(newNumBytes);
+  }
 }
 
 uint64_t DataTree::maxBytesPerLeaf() const {
-  return _nodeStore->layout().maxBytesPerLeaf();
+  const shared_lock<shared_mutex> lock(_treeStructureMutex);
+  return _leafLayout().maxBytesPerLeaf();
+}
+
+void DataTree::allowLargeLeaves() {
+  const unique_lock<shared_mutex> lock(_treeStructureMutex);
+  _largeLeavesAllowed = true;
+}
+
+void DataTree::_adaptLeafSize(uint64_t newNumBytes) {
+  const optional<DataNodeLayout> &largeLeafLayout = _nodeStore->largeLeafLayout();
+  if (!_largeLeavesAllowed || largeLeafLayout == none) {
+    return;
+  }
+  const uint64_t thresholdBytes = LARGE_LEAVES_THRESHOLD_NUM_LEAVES * largeLeafLayout->maxBytesPerLeaf();
+  const SizeCache size = _getOrComputeSizeCache();
+  const bool hasLargeLeaves = size.leafLayout.blocksizeBytes() == largeLeafLayout->blocksizeBytes();
+  if (!hasLargeLeaves && newNumBytes > thresholdBytes && size.numBytes <= thresholdBytes) {
+    _rewriteWithLeafLayout(*largeLeafLayout);
+  } else if (hasLargeLeaves && newNumBytes <= thresholdBytes / 2) {
+    _rewriteWithLeafLayout(_nodeStore->layout());
+  }
+}
+
+void DataTree::_rewriteWithLeafLayout(const DataNodeLayout &leafLayout) {
+  // Build the new tree next to the old one and only swap it in once it's complete, so that an exception leaves the
+  // blob as it was. The data is moved over in chunks of one leaf instead of reading the whole blob into memory.
+  const uint64_t numBytes = _numBytes();
+  DataTree newTree(_nodeStore, _nodeStore->createNewLeafNode(leafLayout, Data(0)));
+  try {
+    const uint64_t chunkSize = std::max(leafLayout.maxBytesPerLeaf(), _leafLayout().maxBytesPerLeaf());
+    Data chunk(std::min(chunkSize, numBytes));
+    for (uint64_t offset = 0; offset < numBytes; offset += chunkSize) {
+      const uint64_t count = std::min(chunkSize, numBytes - offset);
+      _doReadBytes(chunk.data(), offset, count);
+      newTree._writeBytes(chunk.data(), offset, count);
+    }
+  } catch (...) {
+    _nodeStore->removeSubtree(newTree.releaseRootNode());
+    throw;
+  }
+  const SizeCache newSize = newTree._getOrComputeSizeCache();
+
+  const uint8_t oldDepth = _rootNode->depth();
+  vector<BlockId> oldChildren;
+  const DataInnerNode *oldRoot = dynamic_cast<const DataInnerNode*>(_rootNode.get());
+  if (oldRoot != nullptr) {
+    oldChildren.reserve(oldRoot->numChildren());
+    for (uint32_t i = 0; i < oldRoot->numChildren(); ++i) {
+      oldChildren.push_back(oldRoot->readChild(i).blockId());
+    }
+  }
+
+  // The root keeps its block id, because that is the id of the blob
+  auto newRoot = newTree.releaseRootNode();
+  _rootNode = _nodeStore->overwriteNodeWith(std::move(_rootNode), *newRoot);
+  _nodeStore->remove(std::move(newRoot));
+  _setSize(newSize);
+
+  // From here on, failing only leaks the old nodes
+  for (const BlockId &child : oldChildren) {
+    _nodeStore->removeSubtree(oldDepth-1, child);
+  }
 }
 
 uint8_t DataTree::depth() const {
@@ -258,7 +360,6 @@ void DataTree::readBytes(void *target, uint64_t offset, uint64_t count) const {
 Data DataTree::readAllBytes() const {
   const shared_lock<shared_mutex> lock(_treeStructureMutex);
 
-  //TODO Querying numBytes can be inefficient. Is this possible without a call to size()?
   const uint64_t count = _numBytes();
   Data result(count);
   _doReadBytes(result.data(), 0, count);
@@ -273,7 +374,6 @@ uint64_t DataTree::tryReadBytes(void *target, uint64_t offset, uint64_t count) c
 }
 
 uint64_t DataTree::_tryReadBytes(void *target, uint64_t offset, uint64_t count) const {
-  //TODO Quite inefficient to call size() here, because that has to traverse the tree
   const uint64_t _size = _numBytes();
   const uint64_t realCount = std::max(INT64_C(0), std::min(static_cast<int64_t>(count), static_cast<int64_t>(_size)-static_cast<int64_t>(offset)));
   _doReadBytes(target, offset, realCount);
@@ -284,7 +384,12 @@ void DataTree::_doReadBytes(void *target, uint64_t offset, uint64_t count) const
   auto onExistingLeaf = [target, offset, count] (uint64_t indexOfFirstLeafByte, LeafHandle leaf, uint32_t leafDataOffset, uint32_t leafDataSize) {
     ASSERT(indexOfFirstLeafByte+leafDataOffset>=offset && indexOfFirstLeafByte-offset+leafDataOffset <= count && indexOfFirstLeafByte-offset+leafDataOffset+leafDataSize <= count, "Writing to target out of bounds");
     //TODO Simplify formula, make it easier to understand
-    leaf.node()->read(static_cast<uint8_t*>(target) + indexOfFirstLeafByte - offset + leafDataOffset, leafDataOffset, leafDataSize);
+    uint8_t *leafTarget = static_cast<uint8_t*>(target) + indexOfFirstLeafByte - offset + leafDataOffset;
+    if (leaf.isHole()) {
+      std::memset(leafTarget, 0, leafDataSize);
+    } else {
+      leaf.node()->read(leafTarget, leafDataOffset, leafDataSize);
+    }
   };
   auto onCreateLeaf = [] (uint64_t /*beginByte*/, uint32_t /*count*/) -> Data {
     ASSERT(false, "Reading shouldn't create new leaves.");
@@ -296,12 +401,20 @@ void DataTree::_doReadBytes(void *target, uint64_t offset, uint64_t count) const
 void DataTree::writeBytes(const void *source, uint64_t offset, uint64_t count) {
   const unique_lock<shared_mutex> lock(_treeStructureMutex);
 
-  auto onExistingLeaf = [source, offset, count] (uint64_t indexOfFirstLeafByte, LeafHandle leaf, uint32_t leafDataOffset, uint32_t leafDataSize) {
+  if (offset + count > _numBytes()) {
+    _adaptLeafSize(offset + count);
+  }
+  _writeBytes(source, offset, count);
+}
+
+void DataTree::_writeBytes(const void *source, uint64_t offset, uint64_t count) {
+  const DataNodeLayout leafLayout = _leafLayout();
+  auto onExistingLeaf = [source, offset, count, &leafLayout] (uint64_t indexOfFirstLeafByte, LeafHandle leaf, uint32_t leafDataOffset, uint32_t leafDataSize) {
     ASSERT(indexOfFirstLeafByte+leafDataOffset>=offset && indexOfFirstLeafByte-offset+leafDataOffset <= count && indexOfFirstLeafByte-offset+leafDataOffset+leafDataSize <= count, "Reading from source out of bounds");
-    if (leafDataOffset == 0 && leafDataSize == leaf.nodeStore()->layout().maxBytesPerLeaf()) {
+    if (leafDataOffset == 0 && leafDataSize == leafLayout.maxBytesPerLeaf()) {
       Data leafData(leafDataSize);
       std::memcpy(leafData.data(), static_cast<const uint8_t*>(source) + indexOfFirstLeafByte - offset, leafDataSize);
-      leaf.nodeStore()->overwriteLeaf(leaf.blockId(), std::move(leafData));
+      leaf.nodeStore()->overwriteLeaf(leafLayout, leaf.blockId(), std::move(leafData));
     } else {
       //TODO Simplify formula, make it easier to understand
       leaf.node()->write(static_cast<const uint8_t*>(source) + indexOfFirstLeafByte - offset + leafDataOffset, leafDataOffset,
@@ -30,8 +30,18 @@ public:
 
   const blockstore::BlockId &blockId() const;
   //Returning uint64_t, because calculations handling this probably need to be done in 64bit to support >4GB blobs.
+  //This can change when large leaves are allowed.
   uint64_t maxBytesPerLeaf() const;
 
+  // Trees switch to large leaves once they grow beyond this many large leaves
+  static constexpr uint32_t LARGE_LEAVES_THRESHOLD_NUM_LEAVES = 4;
+
+  // Allows the tree to switch to the large leaves of the node store when it grows beyond LARGE_LEAVES_THRESHOLD_NUM_LEAVES
+  // large leaves, and back to normal leaves when it shrinks to half of that. Switching rewrites the whole tree, but this
+  // only happens for trees around the threshold size. Trees that are already larger than the threshold keep their leaves.
+  // Does nothing if the node store doesn't support large leaves.
+  void allowLargeLeaves();
+
   uint64_t tryReadBytes(void *target, uint64_t offset, uint64_t count) const;
   void readBytes(void *target, uint64_t offset, uint64_t count) const;
   cpputils::Data readAllBytes() const;
@@ -40,6 +50,7 @@ public:
 
   void resizeNumBytes(uint64_t newNumBytes);
 
+  // Holes are counted as nodes even though they aren't stored
   uint32_t numNodes() const;
   uint32_t numLeaves() const;
   uint64_t numBytes() const;
@@ -64,8 +75,11 @@ private:
   struct SizeCache final {
     uint32_t numLeaves;
     uint64_t numBytes;
+    // Leaves can be larger than inner nodes, so the layout of the leaves is part of the tree size
+    datanodestore::DataNodeLayout leafLayout;
   };
   mutable CachedValue<SizeCache> _sizeCache;
+  bool _largeLeavesAllowed;
 
   cpputils::unique_ref<datanodestore::DataNode> releaseRootNode();
   friend class DataTreeStore;
@@ -80,10 +94,17 @@ private:
 
   SizeCache _getOrComputeSizeCache() const;
   SizeCache _computeSizeCache(const datanodestore::DataNode &node) const;
+  // Updates the cached size and the size stored in the root node
+  void _setSize(const SizeCache &size) const;
+  datanodestore::DataNodeLayout _leafLayout() const;
+
+  void _adaptLeafSize(uint64_t newNumBytes);
+  void _rewriteWithLeafLayout(const datanodestore::DataNodeLayout &leafLayout);
 
   uint64_t _tryReadBytes(void *target, uint64_t offset, uint64_t count) const;
   void _doReadBytes(void *target, uint64_t offset, uint64_t count) const;
   uint64_t _numBytes() const;
+  void _writeBytes(const void *source, uint64_t offset, uint64_t count);
 
   DISALLOW_COPY_AND_ASSIGN(DataTree);
 };
@@ -30,10 +30,28 @@ optional<unique_ref<DataTree>> DataTreeStore::load(const blockstore::BlockId &bl
 }
 
 unique_ref<DataTree> DataTreeStore::createNewTree() {
-  auto newleaf = _nodeStore->createNewLeafNode(Data(0));
+  auto newleaf = _nodeStore->createNewLeafNode(_nodeStore->layout(), Data(0));
   return make_unique_ref<DataTree>(_nodeStore.get(), std::move(newleaf));
 }
 
+unique_ref<DataTree> DataTreeStore::createCopyOf(const DataTree &source, const DataNodeStore::CopyObserver &onNodeCopied) {
+  return _createCopyOf(source, false, onNodeCopied);
+}
+
+unique_ref<DataTree> DataTreeStore::createCloneOf(const DataTree &source) {
+  return _createCopyOf(source, true, nullptr);
+}
+
+unique_ref<DataTree> DataTreeStore::_createCopyOf(const DataTree &source, bool shareNodes, const DataNodeStore::CopyObserver &onNodeCopied) {
+  // Writing bytes changes the structure of the tree, so it can't happen while we copy
+  const boost::shared_lock<boost::shared_mutex> lock(source._treeStructureMutex);
+  auto rootCopy = shareNodes ? _nodeStore->createNewNodeAsSharedCopyFrom(*source._rootNode) : _nodeStore->createNewSubtreeAsCopyFrom(*source._rootNode, onNodeCopied);
+  auto copy = make_unique_ref<DataTree>(_nodeStore.get(), std::move(rootCopy));
+  // Copying doesn't copy the tree size stored in the root node
+  copy->_setSize(source._getOrComputeSizeCache());
+  return copy;
+}
+
 void DataTreeStore::remove(unique_ref<DataTree> tree) {
   _nodeStore->removeSubtree(tree->releaseRootNode());
 }
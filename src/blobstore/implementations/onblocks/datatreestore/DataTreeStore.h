@@ -22,6 +22,12 @@ public:
   boost::optional<cpputils::unique_ref<DataTree>> load(const blockstore::BlockId &blockId);
 
   cpputils::unique_ref<DataTree> createNewTree();
+  // Creates a new tree with the same contents. Copies all nodes, but doesn't need to traverse the source tree leaf by leaf.
+  // See DataNodeStore::createNewSubtreeAsCopyFrom() for onNodeCopied.
+  cpputils::unique_ref<DataTree> createCopyOf(const DataTree &source, const datanodestore::DataNodeStore::CopyObserver &onNodeCopied);
+  // Creates a new tree that shares all nodes except the root with the source. Only writing to one of the trees
+  // copies the nodes it writes to.
+  cpputils::unique_ref<DataTree> createCloneOf(const DataTree &source);
 
   void remove(cpputils::unique_ref<DataTree> tree);
   void remove(const blockstore::BlockId &blockId);
@@ -32,6 +38,8 @@ public:
   uint64_t estimateSpaceForNumNodesLeft() const;
 
 private:
+  cpputils::unique_ref<DataTree> _createCopyOf(const DataTree &source, bool shareNodes, const datanodestore::DataNodeStore::CopyObserver &onNodeCopied);
+
   cpputils::unique_ref<datanodestore::DataNodeStore> _nodeStore;
 
   DISALLOW_COPY_AND_ASSIGN(DataTreeStore);
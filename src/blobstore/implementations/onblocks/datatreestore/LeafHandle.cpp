@@ -1,6 +1,7 @@
 #include "LeafHandle.h"
 #include "../datanodestore/DataLeafNode.h"
 #include "../datanodestore/DataNodeStore.h"
+#include "../datanodestore/DataInnerNode_ChildEntry.h"
 
 using cpputils::WithOwnership;
 using cpputils::WithoutOwnership;
@@ -23,7 +24,12 @@ namespace blobstore {
                       _leaf(WithoutOwnership<DataLeafNode>(node)) {
             }
 
+            bool LeafHandle::isHole() const {
+                return _leaf.get() == nullptr && datanodestore::DataInnerNode_ChildEntry(_blockId).isHole();
+            }
+
             DataLeafNode *LeafHandle::node() {
+                ASSERT(!isHole(), "Holes don't have a leaf node");
                 if (_leaf.get() == nullptr) {
                     auto loaded = _nodeStore->load(_blockId);
                     ASSERT(loaded != none, "Leaf not found");
@@ -24,6 +24,9 @@ namespace blobstore {
                     return _blockId;
                 }
 
+                // Holes are leaves that only contain zeroes and aren't stored. They don't have a node.
+                bool isHole() const;
+
                 datanodestore::DataLeafNode *node();
 
                 datanodestore::DataNodeStore *nodeStore() {
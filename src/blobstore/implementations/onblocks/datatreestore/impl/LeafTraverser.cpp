@@ -12,6 +12,7 @@ using cpputils::Data;
 using cpputils::unique_ref;
 using cpputils::dynamic_pointer_move;
 using blobstore::onblocks::datanodestore::DataNodeStore;
+using blobstore::onblocks::datanodestore::DataNodeLayout;
 using blobstore::onblocks::datanodestore::DataNode;
 using blobstore::onblocks::datanodestore::DataInnerNode;
 using blobstore::onblocks::datanodestore::DataLeafNode;
@@ -20,8 +21,8 @@ namespace blobstore {
     namespace onblocks {
         namespace datatreestore {
 
-            LeafTraverser::LeafTraverser(DataNodeStore *nodeStore, bool readOnlyTraversal)
-                : _nodeStore(nodeStore), _readOnlyTraversal(readOnlyTraversal) {
+            LeafTraverser::LeafTraverser(DataNodeStore *nodeStore, const DataNodeLayout &leafLayout, bool readOnlyTraversal)
+                : _nodeStore(nodeStore), _leafLayout(leafLayout), _readOnlyTraversal(readOnlyTraversal) {
             }
 
             void LeafTraverser::traverseAndUpdateRoot(unique_ref<DataNode>* root, uint32_t beginIndex, uint32_t endIndex, function<void (uint32_t index, bool isRightBorderLeaf, LeafHandle leaf)> onExistingLeaf, function<Data (uint32_t index)> onCreateLeaf, function<void (DataInnerNode *node)> onBacktrackFromSubtree) {
@@ -45,8 +46,8 @@ namespace blobstore {
                     DataLeafNode *leaf = dynamic_cast<DataLeafNode*>(root->get());
                     ASSERT(leaf != nullptr, "Depth 0 has to be leaf node");
 
-                    if (increaseTreeDepth && leaf->numBytes() != _nodeStore->layout().maxBytesPerLeaf()) {
-                        leaf->resize(_nodeStore->layout().maxBytesPerLeaf());
+                    if (increaseTreeDepth && leaf->numBytes() != _leafLayout.maxBytesPerLeaf()) {
+                        leaf->resize(_leafLayout.maxBytesPerLeaf());
                     }
                     if (beginIndex == 0 && endIndex >= 1) {
                         const bool isRightBorderLeaf = (endIndex == 1);
@@ -90,10 +91,11 @@ namespace blobstore {
                     ASSERT(beginIndex <= 1 && endIndex <= 1,
                            "If root node is a leaf, the (sub)tree has only one leaf - access indices must be 0 or 1.");
                     LeafHandle leafHandle(_nodeStore, blockId);
+                    ASSERT(_readOnlyTraversal || !leafHandle.isHole(), "Holes have to be filled before a writing traversal visits them");
                     if (growLastLeaf) {
-                        if (leafHandle.node()->numBytes() != _nodeStore->layout().maxBytesPerLeaf()) {
+                        if (leafHandle.node()->numBytes() != _leafLayout.maxBytesPerLeaf()) {
                             ASSERT(!_readOnlyTraversal, "Can't grow the last leaf in a read-only traversal");
-                            leafHandle.node()->resize(_nodeStore->layout().maxBytesPerLeaf());
+                            leafHandle.node()->resize(_leafLayout.maxBytesPerLeaf());
                         }
                     }
                     if (beginIndex == 0 && endIndex == 1) {
@@ -132,7 +134,7 @@ namespace blobstore {
                 // we still have to descend to the last old child to fill it with leaves and grow the last old leaf.
                 if (isLeftBorderOfTraversal && beginChild >= numChildren) {
                     ASSERT(numChildren > 0, "Node doesn't have children.");
-                    auto childBlockId = root->readLastChild().blockId();
+                    auto childBlockId = _unshareChildIfWriting(root, numChildren-1, root->readLastChild().blockId());
                     const uint32_t childOffset = (numChildren-1) * leavesPerChild;
                     _traverseExistingSubtree(childBlockId, root->depth()-1, leavesPerChild, leavesPerChild, childOffset, true, false, true,
                                              [] (uint32_t /*index*/, bool /*isRightBorderNode*/, LeafHandle /*leaf*/) {ASSERT(false, "We don't actually traverse any leaves.");},
@@ -142,7 +144,14 @@ namespace blobstore {
 
                 // Traverse existing children
                 for (uint32_t childIndex = beginChild; childIndex < std::min(endChild, numChildren); ++childIndex) {
-                    auto childBlockId = root->readChild(childIndex).blockId();
+                    auto child = root->readChild(childIndex);
+                    if (child.isHole() && !_readOnlyTraversal) {
+                        // The traversal could write to this leaf, so it has to be stored from now on.
+                        auto leaf = _createZeroLeaf();
+                        root->fillHoleChild(childIndex, *leaf);
+                        child = DataInnerNode::ChildEntry(leaf->blockId());
+                    }
+                    auto childBlockId = _unshareChildIfWriting(root, childIndex, child.blockId());
                     const uint32_t childOffset = childIndex * leavesPerChild;
                     const uint32_t localBeginIndex = utils::maxZeroSubtraction(beginIndex, childOffset);
                     const uint32_t localEndIndex = std::min(leavesPerChild, endIndex - childOffset);
@@ -161,8 +170,16 @@ namespace blobstore {
                     const uint32_t childOffset = childIndex * leavesPerChild;
                     const uint32_t localBeginIndex = std::min(leavesPerChild, utils::maxZeroSubtraction(beginIndex, childOffset));
                     const uint32_t localEndIndex = std::min(leavesPerChild, endIndex - childOffset);
-                    auto leafCreator = (childIndex >= beginChild) ? onCreateLeaf : _createMaxSizeLeaf();
-                    auto child = _createNewSubtree(localBeginIndex, localEndIndex, leafOffset + childOffset, root->depth() - 1, leafCreator, onBacktrackFromSubtree);
+                    if (root->depth() == 1 && childIndex < beginChild) {
+                        // Gap leaves only contain zeroes, don't store them
+                        if (_nodeStore->legacyNodeFormat()) {
+                            root->addChild(*_createZeroLeaf());
+                        } else {
+                            root->addHoleChild();
+                        }
+                        continue;
+                    }
+                    auto child = _createNewSubtree(localBeginIndex, localEndIndex, leafOffset + childOffset, root->depth() - 1, onCreateLeaf, onBacktrackFromSubtree);
                     root->addChild(*child);
                 }
 
@@ -178,10 +195,8 @@ namespace blobstore {
 
                 ASSERT(beginIndex <= endIndex, "Invalid parameters");
                 if (0 == depth) {
-                    ASSERT(beginIndex <= 1 && endIndex == 1, "With depth 0, we can only traverse one or zero leaves (i.e. traverse one leaf or traverse a gap leaf).");
-                    auto leafCreator = (beginIndex
-                     == 0) ? onCreateLeaf : _createMaxSizeLeaf();
-                    return _nodeStore->createNewLeafNode(leafCreator(leafOffset));
+                    ASSERT(beginIndex == 0 && endIndex == 1, "With depth 0, we can only traverse one leaf. Gap leaves are created as holes by the parent.");
+                    return _nodeStore->createNewLeafNode(_leafLayout, onCreateLeaf(leafOffset));
                 }
 
                 const uint8_t minNeededDepth = utils::ceilLog(_nodeStore->layout().maxChildrenPerInnerNode(), static_cast<uint64_t>(endIndex));
@@ -195,6 +210,15 @@ namespace blobstore {
                 // TODO Remove redundancy of following two for loops by using min/max for calculating the parameters of the recursive call.
                 // Create gap children (i.e. children before the traversal but after the current size)
                 for (uint32_t childIndex = 0; childIndex < beginChild; ++childIndex) {
+                    if (depth == 1) {
+                        // Gap leaves only contain zeroes, don't store them
+                        if (_nodeStore->legacyNodeFormat()) {
+                            children.push_back(_createZeroLeaf()->blockId());
+                        } else {
+                            children.push_back(DataInnerNode::ChildEntry::Hole().blockId());
+                        }
+                        continue;
+                    }
                     const uint32_t childOffset = childIndex * leavesPerChild;
                     auto child = _createNewSubtree(leavesPerChild, leavesPerChild, leafOffset + childOffset, depth - 1,
                                                    [] (uint32_t /*index*/)->Data {ASSERT(false, "We're only creating gap leaves here, not traversing any.");},
@@ -222,17 +246,26 @@ namespace blobstore {
                 return newNode;
             }
 
+            blockstore::BlockId LeafTraverser::_unshareChildIfWriting(DataInnerNode *parent, uint32_t childIndex, const blockstore::BlockId &childBlockId) {
+                if (_readOnlyTraversal || !_nodeStore->isShared(childBlockId)) {
+                    return childBlockId;
+                }
+                auto child = _nodeStore->load(childBlockId);
+                if (child == none) {
+                    throw std::runtime_error("Couldn't find child node " + childBlockId.ToString());
+                }
+                auto copy = _nodeStore->unshare(std::move(*child));
+                parent->replaceChild(childIndex, *copy);
+                return copy->blockId();
+            }
+
             uint32_t LeafTraverser::_maxLeavesForTreeDepth(uint8_t depth) const {
                 return utils::intPow(_nodeStore->layout().maxChildrenPerInnerNode(), static_cast<uint64_t>(depth));
             }
 
-            function<Data (uint32_t index)> LeafTraverser::_createMaxSizeLeaf() const {
+            unique_ref<DataLeafNode> LeafTraverser::_createZeroLeaf() {
                 ASSERT(!_readOnlyTraversal, "Can't create a new leaf in a read-only traversal");
-
-                const uint64_t maxBytesPerLeaf = _nodeStore->layout().maxBytesPerLeaf();
-                return [maxBytesPerLeaf] (uint32_t /*index*/) -> Data {
-                   return Data(maxBytesPerLeaf).FillWithZeroes();
-                };
+                return _nodeStore->createNewLeafNode(_leafLayout, Data(_leafLayout.maxBytesPerLeaf()).FillWithZeroes());
             }
 
             void LeafTraverser::_whileRootHasOnlyOneChildReplaceRootWithItsChild(unique_ref<DataNode>* root) {
@@ -252,6 +285,10 @@ namespace blobstore {
 
                 auto current = _nodeStore->load(blockId);
                 ASSERT(current != none, "Node not found");
+                if (_nodeStore->isShared(blockId)) {
+                    // Its children are moved into the root, so it has to be a node that can be removed afterwards
+                    *current = _nodeStore->unshare(std::move(*current));
+                }
                 auto inner = dynamic_pointer_move<DataInnerNode>(*current);
                 if (inner == none) {
                     return std::move(*current);
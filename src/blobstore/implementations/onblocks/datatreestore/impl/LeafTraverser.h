@@ -7,6 +7,7 @@
 #include <cpp-utils/data/Data.h>
 #include <blockstore/utils/BlockId.h>
 #include "blobstore/implementations/onblocks/datatreestore/LeafHandle.h"
+#include "blobstore/implementations/onblocks/datanodestore/DataNodeView.h"
 
 namespace blobstore {
     namespace onblocks {
@@ -22,10 +23,13 @@ namespace blobstore {
              * LeafTraverser can create leaves if they don't exist yet (i.e. endIndex > numLeaves), but
              * it cannot increase the tree depth. That is, the tree has to be deep enough to allow
              * creating the number of leaves.
+             * Writing traversals replace nodes shared with cloned trees by copies before descending into them,
+             * so the callbacks can modify all nodes they get.
              */
             class LeafTraverser final {
             public:
-                LeafTraverser(datanodestore::DataNodeStore *nodeStore, bool readOnlyTraversal);
+                // Inner nodes use the layout of the node store, but leaves can be larger
+                LeafTraverser(datanodestore::DataNodeStore *nodeStore, const datanodestore::DataNodeLayout &leafLayout, bool readOnlyTraversal);
 
                 void traverseAndUpdateRoot(
                       cpputils::unique_ref<datanodestore::DataNode>* root, uint32_t beginIndex, uint32_t endIndex,
@@ -35,6 +39,7 @@ namespace blobstore {
 
             private:
                 datanodestore::DataNodeStore *_nodeStore;
+                const datanodestore::DataNodeLayout _leafLayout;
                 const bool _readOnlyTraversal;
 
                 void _traverseAndUpdateRoot(
@@ -55,7 +60,10 @@ namespace blobstore {
                                                                                 std::function<cpputils::Data (uint32_t index)> onCreateLeaf,
                                                                                 std::function<void (datanodestore::DataInnerNode *node)> onBacktrackFromSubtree);
                 uint32_t _maxLeavesForTreeDepth(uint8_t depth) const;
-                std::function<cpputils::Data (uint32_t index)> _createMaxSizeLeaf() const;
+                // Stored leaf for a hole or, in the legacy node format, a gap leaf
+                cpputils::unique_ref<datanodestore::DataLeafNode> _createZeroLeaf();
+                // Returns the id of the child to descend into
+                blockstore::BlockId _unshareChildIfWriting(datanodestore::DataInnerNode *parent, uint32_t childIndex, const blockstore::BlockId &childBlockId);
                 void _whileRootHasOnlyOneChildReplaceRootWithItsChild(cpputils::unique_ref<datanodestore::DataNode>* root);
                 cpputils::unique_ref<datanodestore::DataNode> _whileRootHasOnlyOneChildRemoveRootReturnChild(const blockstore::BlockId &blockId);
 
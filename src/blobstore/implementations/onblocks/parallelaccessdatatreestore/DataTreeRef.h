@@ -9,6 +9,7 @@
 namespace blobstore {
 namespace onblocks {
 namespace parallelaccessdatatreestore {
+class ParallelAccessDataTreeStore;
 
 class DataTreeRef final: public parallelaccessstore::ParallelAccessStore<datatreestore::DataTree, DataTreeRef, blockstore::BlockId>::ResourceRefBase {
 public:
@@ -22,6 +23,10 @@ public:
     return _baseTree->maxBytesPerLeaf();
   }
 
+  void allowLargeLeaves() {
+    return _baseTree->allowLargeLeaves();
+  }
+
   uint32_t numLeaves() const {
     return _baseTree->numLeaves();
   }
@@ -62,6 +67,8 @@ private:
 
   datatreestore::DataTree *_baseTree;
 
+  friend class ParallelAccessDataTreeStore;
+
   DISALLOW_COPY_AND_ASSIGN(DataTreeRef);
 };
 
@@ -35,6 +35,18 @@ unique_ref<DataTreeRef> ParallelAccessDataTreeStore::createNewTree() {
   return _parallelAccessStore.add(blockId, std::move(dataTree));  // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
 }
 
+unique_ref<DataTreeRef> ParallelAccessDataTreeStore::createCopyOf(const DataTreeRef &source, const std::function<void ()> &onNodeCopied) {
+  auto dataTree = _dataTreeStore->createCopyOf(*source._baseTree, onNodeCopied);
+  const BlockId blockId = dataTree->blockId();
+  return _parallelAccessStore.add(blockId, std::move(dataTree));  // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
+}
+
+unique_ref<DataTreeRef> ParallelAccessDataTreeStore::createCloneOf(const DataTreeRef &source) {
+  auto dataTree = _dataTreeStore->createCloneOf(*source._baseTree);
+  const BlockId blockId = dataTree->blockId();
+  return _parallelAccessStore.add(blockId, std::move(dataTree));  // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
+}
+
 void ParallelAccessDataTreeStore::remove(unique_ref<DataTreeRef> tree) {
   const BlockId blockId = tree->blockId();
   return _parallelAccessStore.remove(blockId, std::move(tree));
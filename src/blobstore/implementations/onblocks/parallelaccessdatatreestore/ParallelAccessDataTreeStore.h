@@ -23,6 +23,8 @@ public:
   boost::optional<cpputils::unique_ref<DataTreeRef>> load(const blockstore::BlockId &blockId);
 
   cpputils::unique_ref<DataTreeRef> createNewTree();
+  cpputils::unique_ref<DataTreeRef> createCopyOf(const DataTreeRef &source, const std::function<void ()> &onNodeCopied);
+  cpputils::unique_ref<DataTreeRef> createCloneOf(const DataTreeRef &source);
 
   void remove(cpputils::unique_ref<DataTreeRef> tree);
   void remove(const blockstore::BlockId &blockId);
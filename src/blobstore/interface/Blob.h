@@ -28,6 +28,10 @@ public:
 
   virtual uint32_t numNodes() const = 0;
 
+  // Allows the blob to store its data in larger blocks once it is large enough. This is good for large data that
+  // is mostly read and written sequentially, but bad for data with small random writes.
+  virtual void allowLargeLeaves() = 0;
+
   //TODO Test tryRead
 };
 
@@ -5,6 +5,7 @@
 #include "Blob.h"
 #include <string>
 #include <memory>
+#include <functional>
 
 #include <blockstore/utils/BlockId.h>
 #include <cpp-utils/pointer/unique_ref.h>
@@ -18,6 +19,12 @@ public:
 
   virtual cpputils::unique_ref<Blob> create() = 0;
   virtual boost::optional<cpputils::unique_ref<Blob>> load(const blockstore::BlockId &blockId) = 0;
+  // Creates a new blob with the same contents as the given blob, which has to be from this blob store.
+  // onBlockCopied is called after each copied block, possibly from several threads at once. If it throws, copying
+  // stops, the partial copy is removed and the exception is passed on.
+  virtual cpputils::unique_ref<Blob> createCopyOf(const Blob &source, const std::function<void ()> &onBlockCopied) = 0;
+  // Like createCopyOf(), but the new blob shares its storage with the source until one of them is modified
+  virtual cpputils::unique_ref<Blob> createCloneOf(const Blob &source) = 0;
   virtual void remove(cpputils::unique_ref<Blob> blob) = 0;
   virtual void remove(const blockstore::BlockId &blockId) = 0;
 
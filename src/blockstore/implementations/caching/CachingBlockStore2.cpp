@@ -43,8 +43,22 @@ void CachingBlockStore2::CachedBlock::write(Data data) {
   _dirty = true;
 }
 
-CachingBlockStore2::CachingBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore)
-: _baseBlockStore(std::move(baseBlockStore)), _cachedBlocksNotInBaseStoreMutex(), _cachedBlocksNotInBaseStore(), _cache("blockstore") {
+CachingBlockStore2::CachingBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore, PinPredicate isPinned, uint64_t pinnedCacheMaxBytes, uint64_t maxCacheBytes)
+: _baseBlockStore(std::move(baseBlockStore)), _cachedBlocksNotInBaseStoreMutex(), _cachedBlocksNotInBaseStore(),
+  _cache("blockstore", maxCacheBytes, [] (const unique_ref<CachedBlock> &block) -> uint64_t {return block->read().size();}),
+  _isPinned(std::move(isPinned)), _pinnedCache(pinnedCacheMaxBytes), _metrics("caching") {
+}
+
+void CachingBlockStore2::_updatePinnedCache(const BlockId &blockId, const Data &data) const {
+  if (!_isPinned) {
+    return;
+  }
+  if (_isPinned(data)) {
+    _pinnedCache.store(blockId, data);
+  } else {
+    // The block could have been pinned with its previous content
+    _pinnedCache.remove(blockId);
+  }
 }
 
 bool CachingBlockStore2::tryCreate(const BlockId &blockId, const Data &data) {
@@ -55,15 +69,18 @@ bool CachingBlockStore2::tryCreate(const BlockId &blockId, const Data &data) {
     _cache.push(blockId, std::move(*popped)); // push the just popped element back to the cache
     return false;
   } else {
+    _updatePinnedCache(blockId, data);
     _cache.push(blockId, make_unique_ref<CachingBlockStore2::CachedBlock>(this, blockId, data.copy(), true));
     const unique_lock<mutex> lock(_cachedBlocksNotInBaseStoreMutex);
     _cachedBlocksNotInBaseStore.insert(blockId);
+    _metrics.stored(data);
     return true;
   }
 }
 
 bool CachingBlockStore2::remove(const BlockId &blockId) {
   // TODO Don't write-through but cache remove operations
+  _pinnedCache.remove(blockId);
   auto popped = _cache.pop(blockId);
   if (popped != boost::none) {
     // Remove from base store if it exists in the base store
@@ -78,18 +95,80 @@ bool CachingBlockStore2::remove(const BlockId &blockId) {
     }
     // Don't write back the cached block when it is destructed
     std::move(**popped).markNotDirty();
+    _metrics.removed(1);
     return true;
   } else {
-    return _baseBlockStore->remove(blockId);
+    const bool removed = _baseBlockStore->remove(blockId);
+    if (removed) {
+      _metrics.removed(1);
+    }
+    return removed;
+  }
+}
+
+size_t CachingBlockStore2::removeMany(const std::vector<BlockId> &blockIds) {
+  std::vector<unique_ref<CachedBlock>> popped;
+  std::vector<BlockId> poppedIds;
+  std::vector<BlockId> cachedAndInBaseStore;
+  std::vector<BlockId> notCached;
+  for (const BlockId &blockId : blockIds) {
+    _pinnedCache.remove(blockId);
+    auto block = _cache.pop(blockId);
+    if (block != boost::none) {
+      popped.push_back(std::move(*block));
+      poppedIds.push_back(blockId);
+    } else {
+      notCached.push_back(blockId);
+    }
+  }
+  {
+    const unique_lock<mutex> lock(_cachedBlocksNotInBaseStoreMutex);
+    for (size_t i = 0; i < popped.size(); ++i) {
+      if (_cachedBlocksNotInBaseStore.count(poppedIds[i]) == 0) {
+        cachedAndInBaseStore.push_back(poppedIds[i]);
+      }
+      // Don't write back the cached block when it is destructed
+      std::move(*popped[i]).markNotDirty();
+    }
+  }
+  if (_baseBlockStore->removeMany(cachedAndInBaseStore) != cachedAndInBaseStore.size()) {
+    throw std::runtime_error("Tried to remove blocks. Blocks existed in cache and stated they exist in base store, but weren't found there.");
   }
+  const size_t numRemoved = popped.size() + _baseBlockStore->removeMany(notCached);
+  _metrics.removed(numRemoved);
+  return numRemoved;
 }
 
 optional<unique_ref<CachingBlockStore2::CachedBlock>> CachingBlockStore2::_loadFromCacheOrBaseStore(const BlockId &blockId) const {
-  auto popped = _cache.pop(blockId);
+  auto popped = _cache.popForLoad(blockId);
   if (popped != boost::none) {
     return std::move(*popped);
   } else {
-    auto loaded = _baseBlockStore->load(blockId);
+    if (!_isPinned) {
+      auto loaded = _baseBlockStore->load(blockId);
+      if (loaded == boost::none) {
+        return boost::none;
+      }
+      return make_unique_ref<CachingBlockStore2::CachedBlock>(this, blockId, std::move(*loaded), false);
+    }
+    auto pinned = _pinnedCache.loadOrBeginLoad(blockId);
+    if (pinned != boost::none) {
+      return make_unique_ref<CachingBlockStore2::CachedBlock>(this, blockId, std::move(*pinned), false);
+    }
+    // A store() or remove() running concurrently could change the block after we loaded it. The pinned cache
+    // notices that and doesn't take our (then outdated) copy.
+    optional<Data> loaded = boost::none;
+    try {
+      loaded = _baseBlockStore->load(blockId);
+    } catch (...) {
+      _pinnedCache.abortLoad(blockId);
+      throw;
+    }
+    if (loaded != boost::none && _isPinned(*loaded)) {
+      _pinnedCache.finishLoad(blockId, *loaded);
+    } else {
+      _pinnedCache.abortLoad(blockId);
+    }
     if (loaded == boost::none) {
       return boost::none;
     }
@@ -101,14 +180,17 @@ optional<Data> CachingBlockStore2::load(const BlockId &blockId) const {
   auto loaded = _loadFromCacheOrBaseStore(blockId);
   if (loaded == boost::none) {
     // TODO Cache non-existence?
+    _metrics.loaded(boost::none);
     return boost::none;
   }
   optional<Data> result = (*loaded)->read().copy();
   _cache.push(blockId, std::move(*loaded));
+  _metrics.loaded(result);
   return result;
 }
 
 void CachingBlockStore2::store(const BlockId &blockId, const Data &data) {
+  _updatePinnedCache(blockId, data);
   auto popped = _cache.pop(blockId);
   if (popped != boost::none) {
     (*popped)->write(data.copy());
@@ -119,6 +201,7 @@ void CachingBlockStore2::store(const BlockId &blockId, const Data &data) {
     _baseBlockStore->store(blockId, data);
   }
   _cache.push(blockId, std::move(*popped));
+  _metrics.stored(data);
 }
 
 uint64_t CachingBlockStore2::numBlocks() const {
@@ -3,8 +3,11 @@
 #define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_CACHING_CACHINGBLOCKSTORE2_H_
 
 #include "../../interface/BlockStore2.h"
+#include "../../utils/BlockStoreMetrics.h"
 #include <cpp-utils/macros.h>
 #include "../caching/cache/Cache.h"
+#include "PinnedBlockCache.h"
+#include <functional>
 #include <unordered_set>
 
 namespace blockstore {
@@ -12,10 +15,16 @@ namespace caching {
 
 class CachingBlockStore2 final: public BlockStore2 {
 public:
-  CachingBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore);
+  // Blocks for which isPinned() returns true are additionally kept in a separate cache with a budget of
+  // pinnedCacheMaxBytes, so that they stay in memory even if many other blocks pass through the main cache.
+  // If maxCacheBytes isn't zero, the main cache also evicts blocks to stay below that many bytes. Its number of
+  // entries is limited anyway, but that isn't enough to bound its memory if blocks can be large.
+  using PinPredicate = std::function<bool (const cpputils::Data &data)>;
+  CachingBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore, PinPredicate isPinned = nullptr, uint64_t pinnedCacheMaxBytes = 0, uint64_t maxCacheBytes = 0);
 
   bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
   bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
   boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
   void store(const BlockId &blockId, const cpputils::Data &data) override;
   uint64_t numBlocks() const override;
@@ -45,6 +54,7 @@ private:
   };
 
   boost::optional<cpputils::unique_ref<CachedBlock>> _loadFromCacheOrBaseStore(const BlockId &blockId) const;
+  void _updatePinnedCache(const BlockId &blockId, const cpputils::Data &data) const;
 
   cpputils::unique_ref<BlockStore2> _baseBlockStore;
   friend class CachedBlock;
@@ -53,6 +63,9 @@ private:
   mutable std::mutex _cachedBlocksNotInBaseStoreMutex;
   mutable std::unordered_set<BlockId> _cachedBlocksNotInBaseStore;
   mutable Cache<BlockId, cpputils::unique_ref<CachedBlock>, 1000> _cache;
+  PinPredicate _isPinned;
+  mutable PinnedBlockCache _pinnedCache;
+  mutable BlockStoreMetrics _metrics;
 
 public:
   static constexpr double MAX_LIFETIME_SEC = decltype(_cache)::MAX_LIFETIME_SEC;
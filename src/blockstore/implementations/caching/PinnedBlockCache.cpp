@@ -0,0 +1,108 @@
+#include "PinnedBlockCache.h"
+
+using cpputils::Data;
+using boost::optional;
+using boost::none;
+using std::unique_lock;
+using std::mutex;
+
+namespace blockstore {
+namespace caching {
+
+PinnedBlockCache::PinnedBlockCache(uint64_t maxBytes)
+: _maxBytes(maxBytes), _mutex(), _usedBytes(0), _blocks(), _pendingLoads(),
+  _hits(cpputils::metrics::counter("cache.pinned_blocks.hits")), _misses(cpputils::metrics::counter("cache.pinned_blocks.misses")),
+  _evictions(cpputils::metrics::counter("cache.pinned_blocks.evictions")) {
+}
+
+optional<Data> PinnedBlockCache::loadOrBeginLoad(const BlockId &blockId) {
+  const unique_lock<mutex> lock(_mutex);
+  auto found = _blocks.pop(blockId);
+  if (found == none) {
+    _misses.increment();
+    auto inserted = _pendingLoads.emplace(blockId, PendingLoad{0, false});
+    ++inserted.first->second.numLoaders;
+    return none;
+  }
+  _hits.increment();
+  optional<Data> result = found->copy();
+  // Push it back to the end of the queue because it was just used
+  _blocks.push(blockId, std::move(*found));
+  return result;
+}
+
+void PinnedBlockCache::finishLoad(const BlockId &blockId, const Data &data) {
+  const unique_lock<mutex> lock(_mutex);
+  if (_endPendingLoad(blockId) && data.size() <= _maxBytes) {
+    _insert(blockId, data);
+  }
+}
+
+void PinnedBlockCache::abortLoad(const BlockId &blockId) {
+  const unique_lock<mutex> lock(_mutex);
+  _endPendingLoad(blockId);
+}
+
+void PinnedBlockCache::store(const BlockId &blockId, const Data &data) {
+  if (data.size() > _maxBytes) {
+    remove(blockId);
+    return;
+  }
+  const unique_lock<mutex> lock(_mutex);
+  _invalidatePendingLoad(blockId);
+  _insert(blockId, data);
+}
+
+void PinnedBlockCache::remove(const BlockId &blockId) {
+  const unique_lock<mutex> lock(_mutex);
+  _invalidatePendingLoad(blockId);
+  auto removed = _blocks.pop(blockId);
+  if (removed != none) {
+    _usedBytes -= removed->size();
+  }
+}
+
+uint64_t PinnedBlockCache::usedBytes() const {
+  const unique_lock<mutex> lock(_mutex);
+  return _usedBytes;
+}
+
+void PinnedBlockCache::_insert(const BlockId &blockId, const Data &data) {
+  auto previous = _blocks.pop(blockId);
+  if (previous != none) {
+    _usedBytes -= previous->size();
+  }
+  _usedBytes += data.size();
+  _blocks.push(blockId, data.copy());
+  _evictUntilBelowBudget();
+}
+
+void PinnedBlockCache::_invalidatePendingLoad(const BlockId &blockId) {
+  auto found = _pendingLoads.find(blockId);
+  if (found != _pendingLoads.end()) {
+    found->second.invalidated = true;
+  }
+}
+
+// Returns true if the loaded data is still up to date
+bool PinnedBlockCache::_endPendingLoad(const BlockId &blockId) {
+  auto found = _pendingLoads.find(blockId);
+  ASSERT(found != _pendingLoads.end(), "Load wasn't registered with loadOrBeginLoad()");
+  const bool upToDate = !found->second.invalidated;
+  if (--found->second.numLoaders == 0) {
+    _pendingLoads.erase(found);
+  }
+  return upToDate;
+}
+
+void PinnedBlockCache::_evictUntilBelowBudget() {
+  while (_usedBytes > _maxBytes) {
+    auto evicted = _blocks.pop();
+    ASSERT(evicted != none, "Used bytes are counted but there are no blocks left");
+    _evictions.increment();
+    _usedBytes -= evicted->size();
+  }
+}
+
+}
+}
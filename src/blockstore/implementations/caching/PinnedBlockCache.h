@@ -0,0 +1,62 @@
+#pragma once
+#ifndef MESSMER_BLOCKSTORE_IMPLEMENTATIONS_CACHING_PINNEDBLOCKCACHE_H_
+#define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_CACHING_PINNEDBLOCKCACHE_H_
+
+#include "../../utils/BlockId.h"
+#include "cache/QueueMap.h"
+#include <cpp-utils/data/Data.h>
+#include <cpp-utils/metrics/Metrics.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace blockstore {
+namespace caching {
+
+// Keeps copies of blocks in memory until its memory budget is exhausted, then evicts the least recently used ones.
+// In contrast to Cache, entries don't expire after some time and aren't evicted by the traffic of other blocks.
+// The copies are never dirty, callers have to update them whenever the block is written or removed.
+class PinnedBlockCache final {
+public:
+  explicit PinnedBlockCache(uint64_t maxBytes);
+
+  // Returns the cached copy. If the block isn't cached, registers a pending load instead, which the caller
+  // has to complete with finishLoad() or abortLoad() after loading the block from the base store.
+  boost::optional<cpputils::Data> loadOrBeginLoad(const BlockId &blockId);
+  // Caches the block that was loaded from the base store, unless it was stored or removed since
+  // loadOrBeginLoad() because the loaded data could then already be outdated.
+  void finishLoad(const BlockId &blockId, const cpputils::Data &data);
+  void abortLoad(const BlockId &blockId);
+  // Inserts the block or replaces the copy that is already cached
+  void store(const BlockId &blockId, const cpputils::Data &data);
+  void remove(const BlockId &blockId);
+
+  uint64_t usedBytes() const;
+
+private:
+  void _insert(const BlockId &blockId, const cpputils::Data &data);
+  void _evictUntilBelowBudget();
+  void _invalidatePendingLoad(const BlockId &blockId);
+  bool _endPendingLoad(const BlockId &blockId);
+
+  struct PendingLoad final {
+    size_t numLoaders;
+    bool invalidated;
+  };
+
+  const uint64_t _maxBytes;
+  mutable std::mutex _mutex;
+  uint64_t _usedBytes;
+  // The front of the queue is the least recently used block
+  QueueMap<BlockId, cpputils::Data> _blocks;
+  std::unordered_map<BlockId, PendingLoad> _pendingLoads;
+  cpputils::metrics::Counter &_hits;
+  cpputils::metrics::Counter &_misses;
+  cpputils::metrics::Counter &_evictions;
+
+  DISALLOW_COPY_AND_ASSIGN(PinnedBlockCache);
+};
+
+}
+}
+
+#endif
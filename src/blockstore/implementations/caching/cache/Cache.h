@@ -8,9 +8,12 @@
 #include <memory>
 #include <boost/optional.hpp>
 #include <future>
+#include <functional>
 #include <cpp-utils/assert/assert.h>
 #include <cpp-utils/lock/MutexPoolLock.h>
+#include <cpp-utils/metrics/Metrics.h>
 #include <cpp-utils/pointer/gcc_4_8_compatibility.h>
+#include <cpp-utils/thread/parallel.h>
 
 namespace blockstore {
 namespace caching {
@@ -24,18 +27,23 @@ public:
   static constexpr double PURGE_INTERVAL = 0.5; // With this interval, we check for entries to purge
   static constexpr double MAX_LIFETIME_SEC = PURGE_LIFETIME_SEC + PURGE_INTERVAL; // This is the oldest age an entry can reach (given purging works in an ideal world, i.e. with the ideal interval and in zero time)
 
-  Cache(const std::string& cacheName);
+  // If maxBytes isn't zero, entries are also evicted to keep the sum of their sizes, as given by entrySize, below it
+  Cache(const std::string& cacheName, uint64_t maxBytes = 0, std::function<uint64_t (const Value &)> entrySize = nullptr);
   ~Cache();
 
   uint32_t size() const;
 
   void push(const Key &key, Value value);
   boost::optional<Value> pop(const Key &key);
+  // Like pop(), but also counts the lookup as a cache hit or miss. Use this when the entry is popped to read it,
+  // not when it is only popped to overwrite or remove it.
+  boost::optional<Value> popForLoad(const Key &key);
 
   void flush();
 
 private:
-  void _makeSpaceForEntry(std::unique_lock<std::mutex> *lock);
+  void _makeSpaceForEntry(std::unique_lock<std::mutex> *lock, uint64_t entrySizeBytes);
+  bool _isFullFor(uint64_t entrySizeBytes) const;
   void _deleteEntry(std::unique_lock<std::mutex> *lock);
   void _deleteOldEntriesParallel();
   void _deleteAllEntriesParallel();
@@ -46,7 +54,14 @@ private:
   mutable std::mutex _mutex;
   cpputils::LockPool<Key> _currentlyFlushingEntries;
   QueueMap<Key, CacheEntry<Key, Value>> _cachedBlocks;
+  const uint64_t _maxBytes;
+  const std::function<uint64_t (const Value &)> _entrySize;
+  uint64_t _usedBytes;
   std::unique_ptr<PeriodicTask> _timeoutFlusher;
+  cpputils::metrics::Counter &_hits;
+  cpputils::metrics::Counter &_misses;
+  // Entries that had to be removed to make space for new ones, before their lifetime was over
+  cpputils::metrics::Counter &_evictions;
 
   DISALLOW_COPY_AND_ASSIGN(Cache);
 };
@@ -56,7 +71,10 @@ template<class Key, class Value, uint32_t MAX_ENTRIES> constexpr double Cache<Ke
 template<class Key, class Value, uint32_t MAX_ENTRIES> constexpr double Cache<Key, Value, MAX_ENTRIES>::MAX_LIFETIME_SEC;
 
 template<class Key, class Value, uint32_t MAX_ENTRIES>
-Cache<Key, Value, MAX_ENTRIES>::Cache(const std::string& cacheName): _mutex(), _currentlyFlushingEntries(), _cachedBlocks(), _timeoutFlusher(nullptr) {
+Cache<Key, Value, MAX_ENTRIES>::Cache(const std::string& cacheName, uint64_t maxBytes, std::function<uint64_t (const Value &)> entrySize)
+  : _mutex(), _currentlyFlushingEntries(), _cachedBlocks(), _maxBytes(maxBytes), _entrySize(std::move(entrySize)), _usedBytes(0), _timeoutFlusher(nullptr),
+  _hits(cpputils::metrics::counter("cache." + cacheName + ".hits")), _misses(cpputils::metrics::counter("cache." + cacheName + ".misses")),
+  _evictions(cpputils::metrics::counter("cache." + cacheName + ".evictions")) {
   //Don't initialize timeoutFlusher in the initializer list,
   //because it then might already call Cache::popOldEntries() before Cache is done constructing.
   _timeoutFlusher = std::make_unique<PeriodicTask>(std::bind(&Cache::_deleteOldEntriesParallel, this), PURGE_INTERVAL, "flush_" + cacheName);
@@ -77,29 +95,53 @@ boost::optional<Value> Cache<Key, Value, MAX_ENTRIES>::pop(const Key &key) {
   if (!found) {
     return boost::none;
   }
+  _usedBytes -= found->sizeBytes();
   return found->releaseValue();
 }
 
+template<class Key, class Value, uint32_t MAX_ENTRIES>
+boost::optional<Value> Cache<Key, Value, MAX_ENTRIES>::popForLoad(const Key &key) {
+  auto found = pop(key);
+  if (found == boost::none) {
+    _misses.increment();
+  } else {
+    _hits.increment();
+  }
+  return found;
+}
+
 template<class Key, class Value, uint32_t MAX_ENTRIES>
 void Cache<Key, Value, MAX_ENTRIES>::push(const Key &key, Value value) {
+  const uint64_t sizeBytes = (_maxBytes == 0) ? 0 : _entrySize(value);
   std::unique_lock<std::mutex> lock(_mutex);
   ASSERT(_cachedBlocks.size() <= MAX_ENTRIES, "Cache too full");
-  _makeSpaceForEntry(&lock);
-  _cachedBlocks.push(key, CacheEntry<Key, Value>(std::move(value)));
+  _makeSpaceForEntry(&lock, sizeBytes);
+  _usedBytes += sizeBytes;
+  _cachedBlocks.push(key, CacheEntry<Key, Value>(std::move(value), sizeBytes));
 }
 
 template<class Key, class Value, uint32_t MAX_ENTRIES>
-void Cache<Key, Value, MAX_ENTRIES>::_makeSpaceForEntry(std::unique_lock<std::mutex> *lock) {
+void Cache<Key, Value, MAX_ENTRIES>::_makeSpaceForEntry(std::unique_lock<std::mutex> *lock, uint64_t entrySizeBytes) {
   // _deleteEntry releases the lock while the Value destructor is running.
   // So we can destruct multiple entries in parallel and also call pop() or push() while doing so.
   // However, if another thread calls push() before we get the lock back, the cache is full again.
   // That's why we need the while() loop here.
-  while (_cachedBlocks.size() == MAX_ENTRIES) {
+  while (_isFullFor(entrySizeBytes)) {
+    _evictions.increment();
     _deleteEntry(lock);
   }
   ASSERT(_cachedBlocks.size() < MAX_ENTRIES, "Removing entry from cache didn't work");
 };
 
+template<class Key, class Value, uint32_t MAX_ENTRIES>
+bool Cache<Key, Value, MAX_ENTRIES>::_isFullFor(uint64_t entrySizeBytes) const {
+  if (_cachedBlocks.size() == MAX_ENTRIES) {
+    return true;
+  }
+  // An entry larger than maxBytes is still cached, it just evicts everything else
+  return _maxBytes != 0 && _cachedBlocks.size() > 0 && _usedBytes + entrySizeBytes > _maxBytes;
+}
+
 template<class Key, class Value, uint32_t MAX_ENTRIES>
 void Cache<Key, Value, MAX_ENTRIES>::_deleteEntry(std::unique_lock<std::mutex> *lock) {
   ASSERT(lock->owns_lock(), "The operations in this function require a locked mutex");
@@ -107,6 +149,7 @@ void Cache<Key, Value, MAX_ENTRIES>::_deleteEntry(std::unique_lock<std::mutex> *
   ASSERT(key != boost::none, "There was no entry to delete");
   cpputils::MutexPoolLock<Key> lockEntryFromBeingPopped(&_currentlyFlushingEntries, *key);
   auto value = _cachedBlocks.pop();
+  _usedBytes -= value->sizeBytes();
   // Call destructor outside of the unique_lock,
   // i.e. pop() and push() can be called here, except for pop() on the element in _currentlyFlushingEntries
   lock->unlock();
@@ -131,8 +174,7 @@ void Cache<Key, Value, MAX_ENTRIES>::_deleteOldEntriesParallel() {
 
 template<class Key, class Value, uint32_t MAX_ENTRIES>
 void Cache<Key, Value, MAX_ENTRIES>::_deleteMatchingEntriesAtBeginningParallel(std::function<bool (const CacheEntry<Key, Value> &)> matches) {
-  // Twice the number of cores, so we use full CPU even if half the threads are doing I/O
-  const unsigned int numThreads = 2 * (std::max)(1u, std::thread::hardware_concurrency());
+  const unsigned int numThreads = cpputils::numThreadsForIoBoundWork();
   std::vector<std::future<void>> waitHandles;
   for (unsigned int i = 0; i < numThreads; ++i) {
     waitHandles.push_back(std::async(std::launch::async, [this, matches] {
@@ -13,10 +13,10 @@ namespace caching {
 template<class Key, class Value>
 class CacheEntry final {
 public:
-  explicit CacheEntry(Value value): _lastAccess(currentTime()), _value(std::move(value)) {
+  explicit CacheEntry(Value value, uint64_t sizeBytes = 0): _lastAccess(currentTime()), _value(std::move(value)), _sizeBytes(sizeBytes) {
   }
 
-  CacheEntry(CacheEntry&& rhs) noexcept: _lastAccess(std::move(rhs._lastAccess)), _value(std::move(rhs._value)) {}
+  CacheEntry(CacheEntry&& rhs) noexcept: _lastAccess(std::move(rhs._lastAccess)), _value(std::move(rhs._value)), _sizeBytes(rhs._sizeBytes) {}
 
   double ageSeconds() const {
     return static_cast<double>((currentTime() - _lastAccess).total_nanoseconds()) / static_cast<double>(1000000000);
@@ -26,9 +26,14 @@ public:
     return std::move(_value);
   }
 
+  uint64_t sizeBytes() const {
+    return _sizeBytes;
+  }
+
 private:
   boost::posix_time::ptime _lastAccess;
   Value _value;
+  uint64_t _sizeBytes;
 
   static boost::posix_time::ptime currentTime() {
 	return boost::posix_time::microsec_clock::local_time();
@@ -3,6 +3,7 @@
 #define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_ENCRYPTED_ENCRYPTEDBLOCKSTORE2_H_
 
 #include "../../interface/BlockStore2.h"
+#include "../../utils/BlockStoreMetrics.h"
 #include <cpp-utils/macros.h>
 #include <cpp-utils/crypto/symmetric/Cipher.h>
 #include <cpp-utils/data/SerializationHelper.h>
@@ -21,6 +22,7 @@ public:
 
   bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
   bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
   boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
   void store(const BlockId &blockId, const cpputils::Data &data) override;
   uint64_t numBlocks() const override;
@@ -52,6 +54,9 @@ private:
 
   cpputils::unique_ref<BlockStore2> _baseBlockStore;
   typename Cipher::EncryptionKey _encKey;
+  mutable BlockStoreMetrics _metrics;
+  cpputils::metrics::Histogram &_encryptLatency;
+  cpputils::metrics::Histogram &_decryptLatency;
 
   DISALLOW_COPY_AND_ASSIGN(EncryptedBlockStore2);
 };
@@ -66,18 +71,34 @@ constexpr uint16_t EncryptedBlockStore2<Cipher>::FORMAT_VERSION_HEADER;
 
 template<class Cipher>
 inline EncryptedBlockStore2<Cipher>::EncryptedBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore, const typename Cipher::EncryptionKey &encKey)
-: _baseBlockStore(std::move(baseBlockStore)), _encKey(encKey) {
+: _baseBlockStore(std::move(baseBlockStore)), _encKey(encKey), _metrics("encrypted"),
+  _encryptLatency(cpputils::metrics::histogram("crypto.encrypt.latency_ns")), _decryptLatency(cpputils::metrics::histogram("crypto.decrypt.latency_ns")) {
 }
 
 template<class Cipher>
 inline bool EncryptedBlockStore2<Cipher>::tryCreate(const BlockId &blockId, const cpputils::Data &data) {
   const cpputils::Data encrypted = _encrypt(data);
-  return _baseBlockStore->tryCreate(blockId, encrypted);
+  const bool created = _baseBlockStore->tryCreate(blockId, encrypted);
+  if (created) {
+    _metrics.stored(data);
+  }
+  return created;
 }
 
 template<class Cipher>
 inline bool EncryptedBlockStore2<Cipher>::remove(const BlockId &blockId) {
-  return _baseBlockStore->remove(blockId);
+  const bool removed = _baseBlockStore->remove(blockId);
+  if (removed) {
+    _metrics.removed(1);
+  }
+  return removed;
+}
+
+template<class Cipher>
+inline size_t EncryptedBlockStore2<Cipher>::removeMany(const std::vector<BlockId> &blockIds) {
+  const size_t numRemoved = _baseBlockStore->removeMany(blockIds);
+  _metrics.removed(numRemoved);
+  return numRemoved;
 }
 
 template<class Cipher>
@@ -85,15 +106,19 @@ inline boost::optional<cpputils::Data> EncryptedBlockStore2<Cipher>::load(const
   auto loaded = _baseBlockStore->load(blockId);
 
   if (boost::none == loaded) {
+    _metrics.loaded(boost::none);
     return boost::optional<cpputils::Data>(boost::none);
   }
-  return _tryDecrypt(blockId, *loaded);
+  boost::optional<cpputils::Data> result = _tryDecrypt(blockId, *loaded);
+  _metrics.loaded(result);
+  return result;
 }
 
 template<class Cipher>
 inline void EncryptedBlockStore2<Cipher>::store(const BlockId &blockId, const cpputils::Data &data) {
   const cpputils::Data encrypted = _encrypt(data);
-  return _baseBlockStore->store(blockId, encrypted);
+  _baseBlockStore->store(blockId, encrypted);
+  _metrics.stored(data);
 }
 
 template<class Cipher>
@@ -122,14 +147,20 @@ inline void EncryptedBlockStore2<Cipher>::forEachBlock(std::function<void (const
 
 template<class Cipher>
 inline cpputils::Data EncryptedBlockStore2<Cipher>::_encrypt(const cpputils::Data &data) const {
-  const cpputils::Data encrypted = Cipher::encrypt(static_cast<const CryptoPP::byte*>(data.data()), data.size(), _encKey);
+  const cpputils::Data encrypted = [&] {
+    const cpputils::metrics::ScopedTimer timer(&_encryptLatency);
+    return Cipher::encrypt(static_cast<const CryptoPP::byte*>(data.data()), data.size(), _encKey);
+  }();
   return _prependFormatHeaderToData(encrypted);
 }
 
 template<class Cipher>
 inline boost::optional<cpputils::Data> EncryptedBlockStore2<Cipher>::_tryDecrypt(const BlockId &blockId, const cpputils::Data &data) const {
   _checkFormatHeader(data);
-  boost::optional<cpputils::Data> decrypted = Cipher::decrypt(static_cast<const CryptoPP::byte*>(data.dataOffset(sizeof(FORMAT_VERSION_HEADER))), data.size() - sizeof(FORMAT_VERSION_HEADER), _encKey);
+  boost::optional<cpputils::Data> decrypted = [&] {
+    const cpputils::metrics::ScopedTimer timer(&_decryptLatency);
+    return Cipher::decrypt(static_cast<const CryptoPP::byte*>(data.dataOffset(sizeof(FORMAT_VERSION_HEADER))), data.size() - sizeof(FORMAT_VERSION_HEADER), _encKey);
+  }();
   if (decrypted == boost::none) {
     // TODO Log warning
     return boost::none;
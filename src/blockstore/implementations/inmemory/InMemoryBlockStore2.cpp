@@ -38,6 +38,15 @@ bool InMemoryBlockStore2::remove(const BlockId &blockId) {
   return true;
 }
 
+size_t InMemoryBlockStore2::removeMany(const std::vector<BlockId> &blockIds) {
+  const std::unique_lock<std::mutex> lock(_mutex);
+  size_t numRemoved = 0;
+  for (const BlockId &blockId : blockIds) {
+    numRemoved += _blocks.erase(blockId);
+  }
+  return numRemoved;
+}
+
 optional<Data> InMemoryBlockStore2::load(const BlockId &blockId) const {
   const std::unique_lock<std::mutex> lock(_mutex);
   auto found = _blocks.find(blockId);
@@ -15,6 +15,7 @@ public:
 
   bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
   bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
   boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
   void store(const BlockId &blockId, const cpputils::Data &data) override;
   uint64_t numBlocks() const override;
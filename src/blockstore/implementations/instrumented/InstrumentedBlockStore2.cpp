@@ -0,0 +1,85 @@
+#include "InstrumentedBlockStore2.h"
+
+using cpputils::Data;
+using cpputils::unique_ref;
+using boost::optional;
+using boost::none;
+using std::string;
+namespace metrics = cpputils::metrics;
+
+namespace blockstore {
+namespace instrumented {
+
+InstrumentedBlockStore2::InstrumentedBlockStore2(unique_ref<BlockStore2> baseBlockStore, const string &name)
+: _baseBlockStore(std::move(baseBlockStore)),
+  _tryCreateLatency(_latency(name, "tryCreate")), _removeLatency(_latency(name, "remove")),
+  _removeManyLatency(_latency(name, "removeMany")), _loadLatency(_latency(name, "load")),
+  _storeLatency(_latency(name, "store")), _numBlocksLatency(_latency(name, "numBlocks")),
+  _estimateNumFreeBytesLatency(_latency(name, "estimateNumFreeBytes")), _forEachBlockLatency(_latency(name, "forEachBlock")),
+  _loadedBytes(_counter(name, "loaded_bytes")), _storedBytes(_counter(name, "stored_bytes")) {
+}
+
+metrics::Histogram &InstrumentedBlockStore2::_latency(const string &name, const string &method) {
+  return metrics::histogram("blockstore.instrumented." + name + "." + method + ".latency_ns");
+}
+
+metrics::Counter &InstrumentedBlockStore2::_counter(const string &name, const string &metric) {
+  return metrics::counter("blockstore.instrumented." + name + "." + metric);
+}
+
+BlockId InstrumentedBlockStore2::createBlockId() const {
+  return _baseBlockStore->createBlockId();
+}
+
+bool InstrumentedBlockStore2::tryCreate(const BlockId &blockId, const Data &data) {
+  const metrics::ScopedTimer timer(&_tryCreateLatency);
+  _storedBytes.add(data.size());
+  return _baseBlockStore->tryCreate(blockId, data);
+}
+
+bool InstrumentedBlockStore2::remove(const BlockId &blockId) {
+  const metrics::ScopedTimer timer(&_removeLatency);
+  return _baseBlockStore->remove(blockId);
+}
+
+size_t InstrumentedBlockStore2::removeMany(const std::vector<BlockId> &blockIds) {
+  const metrics::ScopedTimer timer(&_removeManyLatency);
+  return _baseBlockStore->removeMany(blockIds);
+}
+
+optional<Data> InstrumentedBlockStore2::load(const BlockId &blockId) const {
+  const metrics::ScopedTimer timer(&_loadLatency);
+  auto loaded = _baseBlockStore->load(blockId);
+  if (loaded != none) {
+    _loadedBytes.add(loaded->size());
+  }
+  return loaded;
+}
+
+void InstrumentedBlockStore2::store(const BlockId &blockId, const Data &data) {
+  const metrics::ScopedTimer timer(&_storeLatency);
+  _storedBytes.add(data.size());
+  _baseBlockStore->store(blockId, data);
+}
+
+uint64_t InstrumentedBlockStore2::numBlocks() const {
+  const metrics::ScopedTimer timer(&_numBlocksLatency);
+  return _baseBlockStore->numBlocks();
+}
+
+uint64_t InstrumentedBlockStore2::estimateNumFreeBytes() const {
+  const metrics::ScopedTimer timer(&_estimateNumFreeBytesLatency);
+  return _baseBlockStore->estimateNumFreeBytes();
+}
+
+uint64_t InstrumentedBlockStore2::blockSizeFromPhysicalBlockSize(uint64_t blockSize) const {
+  return _baseBlockStore->blockSizeFromPhysicalBlockSize(blockSize);
+}
+
+void InstrumentedBlockStore2::forEachBlock(std::function<void (const BlockId &)> callback) const {
+  const metrics::ScopedTimer timer(&_forEachBlockLatency);
+  return _baseBlockStore->forEachBlock(std::move(callback));
+}
+
+}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef MESSMER_BLOCKSTORE_IMPLEMENTATIONS_INSTRUMENTED_INSTRUMENTEDBLOCKSTORE2_H_
+#define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_INSTRUMENTED_INSTRUMENTEDBLOCKSTORE2_H_
+
+#include "../../interface/BlockStore2.h"
+#include <cpp-utils/macros.h>
+#include <cpp-utils/metrics/Metrics.h>
+
+namespace blockstore {
+namespace instrumented {
+
+/**
+ * Wraps another block store and records call counts and latency histograms for each method, and the number of bytes
+ * loaded and stored. It can be inserted between any two layers of the block store stack. Since the latency includes
+ * all layers below, the time spent in one layer is the difference to the instrumented layer below it.
+ * The metrics are named "blockstore.instrumented.<name>.<method>.latency_ns" and
+ * "blockstore.instrumented.<name>.{loaded,stored}_bytes".
+ */
+class InstrumentedBlockStore2 final: public BlockStore2 {
+public:
+  InstrumentedBlockStore2(cpputils::unique_ref<BlockStore2> baseBlockStore, const std::string &name);
+
+  BlockId createBlockId() const override;
+  bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
+  bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
+  boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
+  void store(const BlockId &blockId, const cpputils::Data &data) override;
+  uint64_t numBlocks() const override;
+  uint64_t estimateNumFreeBytes() const override;
+  uint64_t blockSizeFromPhysicalBlockSize(uint64_t blockSize) const override;
+  void forEachBlock(std::function<void (const BlockId &)> callback) const override;
+
+private:
+  static cpputils::metrics::Histogram &_latency(const std::string &name, const std::string &method);
+  static cpputils::metrics::Counter &_counter(const std::string &name, const std::string &metric);
+
+  cpputils::unique_ref<BlockStore2> _baseBlockStore;
+  cpputils::metrics::Histogram &_tryCreateLatency;
+  cpputils::metrics::Histogram &_removeLatency;
+  cpputils::metrics::Histogram &_removeManyLatency;
+  cpputils::metrics::Histogram &_loadLatency;
+  cpputils::metrics::Histogram &_storeLatency;
+  cpputils::metrics::Histogram &_numBlocksLatency;
+  cpputils::metrics::Histogram &_estimateNumFreeBytesLatency;
+  cpputils::metrics::Histogram &_forEachBlockLatency;
+  cpputils::metrics::Counter &_loadedBytes;
+  cpputils::metrics::Counter &_storedBytes;
+
+  DISALLOW_COPY_AND_ASSIGN(InstrumentedBlockStore2);
+};
+
+}
+}
+
+#endif
@@ -103,7 +103,7 @@ void IntegrityBlockStore2::integrityViolationDetected(const string &reason) cons
 }
 
 IntegrityBlockStore2::IntegrityBlockStore2(unique_ref<BlockStore2> baseBlockStore, const boost::filesystem::path &integrityFilePath, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void ()> onIntegrityViolation)
-: _baseBlockStore(std::move(baseBlockStore)), _knownBlockVersions(integrityFilePath, myClientId), _allowIntegrityViolations(allowIntegrityViolations), _missingBlockIsIntegrityViolation(missingBlockIsIntegrityViolation), _onIntegrityViolation(std::move(onIntegrityViolation)) {
+: _baseBlockStore(std::move(baseBlockStore)), _knownBlockVersions(integrityFilePath, myClientId), _allowIntegrityViolations(allowIntegrityViolations), _missingBlockIsIntegrityViolation(missingBlockIsIntegrityViolation), _onIntegrityViolation(std::move(onIntegrityViolation)), _metrics("integrity") {
   if (_knownBlockVersions.integrityViolationOnPreviousRun()) {
     throw IntegrityViolationOnPreviousRun(_knownBlockVersions.path());
   }
@@ -112,15 +112,36 @@ IntegrityBlockStore2::IntegrityBlockStore2(unique_ref<BlockStore2> baseBlockStor
 bool IntegrityBlockStore2::tryCreate(const BlockId &blockId, const Data &data) {
   const uint64_t version = _knownBlockVersions.incrementVersion(blockId);
   const Data dataWithHeader = _prependHeaderToData(blockId, _knownBlockVersions.myClientId(), version, data);
-  return _baseBlockStore->tryCreate(blockId, dataWithHeader);
+  const bool created = _baseBlockStore->tryCreate(blockId, dataWithHeader);
+  if (created) {
+    _metrics.stored(data);
+  }
+  return created;
 }
 
 bool IntegrityBlockStore2::remove(const BlockId &blockId) {
   _knownBlockVersions.markBlockAsDeleted(blockId);
-  return _baseBlockStore->remove(blockId);
+  const bool removed = _baseBlockStore->remove(blockId);
+  if (removed) {
+    _metrics.removed(1);
+  }
+  return removed;
+}
+
+size_t IntegrityBlockStore2::removeMany(const std::vector<BlockId> &blockIds) {
+  _knownBlockVersions.markBlocksAsDeleted(blockIds);
+  const size_t numRemoved = _baseBlockStore->removeMany(blockIds);
+  _metrics.removed(numRemoved);
+  return numRemoved;
 }
 
 optional<Data> IntegrityBlockStore2::load(const BlockId &blockId) const {
+  optional<Data> result = _load(blockId);
+  _metrics.loaded(result);
+  return result;
+}
+
+optional<Data> IntegrityBlockStore2::_load(const BlockId &blockId) const {
   auto loaded = _baseBlockStore->load(blockId);
   if (none == loaded) {
     if (_missingBlockIsIntegrityViolation && _knownBlockVersions.blockShouldExist(blockId)) {
@@ -159,7 +180,8 @@ Data IntegrityBlockStore2::_migrateBlock(const BlockId &blockId, const Data &dat
 void IntegrityBlockStore2::store(const BlockId &blockId, const Data &data) {
   const uint64_t version = _knownBlockVersions.incrementVersion(blockId);
   const Data dataWithHeader = _prependHeaderToData(blockId, _knownBlockVersions.myClientId(), version, data);
-  return _baseBlockStore->store(blockId, dataWithHeader);
+  _baseBlockStore->store(blockId, dataWithHeader);
+  _metrics.stored(data);
 }
 
 uint64_t IntegrityBlockStore2::numBlocks() const {
@@ -3,6 +3,7 @@
 #define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_INTEGRITY_INTEGRITYBLOCKSTORE2_H_
 
 #include "../../interface/BlockStore2.h"
+#include "../../utils/BlockStoreMetrics.h"
 #include <cpp-utils/macros.h>
 #include "KnownBlockVersions.h"
 
@@ -36,6 +37,7 @@ public:
 
   bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
   bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
   boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
   void store(const BlockId &blockId, const cpputils::Data &data) override;
   uint64_t numBlocks() const override;
@@ -78,12 +80,14 @@ private:
 #endif
   static cpputils::Data _removeHeader(const cpputils::Data &data);
   void integrityViolationDetected(const std::string &reason) const;
+  boost::optional<cpputils::Data> _load(const BlockId &blockId) const;
 
   cpputils::unique_ref<BlockStore2> _baseBlockStore;
   mutable KnownBlockVersions _knownBlockVersions;
   const bool _allowIntegrityViolations;
   const bool _missingBlockIsIntegrityViolation;
   std::function<void ()> _onIntegrityViolation;
+  mutable BlockStoreMetrics _metrics;
 
   DISALLOW_COPY_AND_ASSIGN(IntegrityBlockStore2);
 };
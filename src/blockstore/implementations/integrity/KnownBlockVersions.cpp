@@ -216,9 +216,17 @@ uint64_t KnownBlockVersions::getBlockVersion(uint32_t clientId, const BlockId &b
 }
 
 void KnownBlockVersions::markBlockAsDeleted(const BlockId &blockId) {
+    const unique_lock<mutex> lock(_mutex);
     _lastUpdateClientId[blockId] = CLIENT_ID_FOR_DELETED_BLOCK;
 }
 
+void KnownBlockVersions::markBlocksAsDeleted(const std::vector<BlockId> &blockIds) {
+    const unique_lock<mutex> lock(_mutex);
+    for (const BlockId &blockId : blockIds) {
+        _lastUpdateClientId[blockId] = CLIENT_ID_FOR_DELETED_BLOCK;
+    }
+}
+
 bool KnownBlockVersions::blockShouldExist(const BlockId &blockId) const {
     auto found = _lastUpdateClientId.find(blockId);
     if (found == _lastUpdateClientId.end()) {
@@ -11,6 +11,7 @@
 #include <cpp-utils/data/Serializer.h>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace blockstore {
     namespace integrity {
@@ -27,6 +28,7 @@ namespace blockstore {
             uint64_t incrementVersion(const BlockId &blockId);
 
             void markBlockAsDeleted(const BlockId &blockId);
+            void markBlocksAsDeleted(const std::vector<BlockId> &blockIds);
 
             bool blockShouldExist(const BlockId &blockId) const;
             std::unordered_set<BlockId> existingBlocks() const;
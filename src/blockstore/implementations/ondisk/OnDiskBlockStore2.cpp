@@ -1,6 +1,7 @@
 #include "OnDiskBlockStore2.h"
 #include <boost/filesystem.hpp>
 #include <cpp-utils/system/diskspace.h>
+#include <algorithm>
 
 using std::string;
 using boost::optional;
@@ -49,7 +50,7 @@ unsigned int OnDiskBlockStore2::formatVersionHeaderSize() {
 }
 
 OnDiskBlockStore2::OnDiskBlockStore2(const boost::filesystem::path& path)
-    : _rootDir(path) {}
+    : _rootDir(path), _metrics("ondisk") {}
 
 bool OnDiskBlockStore2::tryCreate(const BlockId &blockId, const Data &data) {
   auto filepath = _getFilepath(blockId);
@@ -74,11 +75,43 @@ bool OnDiskBlockStore2::remove(const BlockId &blockId) {
   if (boost::filesystem::is_empty(filepath.parent_path())) {
     boost::filesystem::remove(filepath.parent_path());
   }
+  _metrics.removed(1);
   return true;
 }
 
+size_t OnDiskBlockStore2::removeMany(const std::vector<BlockId> &blockIds) {
+  // Group the blocks by their prefix directory, so that each directory is only visited once
+  std::vector<boost::filesystem::path> filepaths;
+  filepaths.reserve(blockIds.size());
+  for (const BlockId &blockId : blockIds) {
+    filepaths.push_back(_getFilepath(blockId));
+  }
+  std::sort(filepaths.begin(), filepaths.end());
+  size_t numRemoved = 0;
+  for (auto groupBegin = filepaths.begin(); groupBegin != filepaths.end();) {
+    const boost::filesystem::path prefixDir = groupBegin->parent_path();
+    auto groupEnd = groupBegin;
+    for (; groupEnd != filepaths.end() && groupEnd->parent_path() == prefixDir; ++groupEnd) {
+      // Blocks that don't exist are skipped, the error code tells us about them without an extra stat() call
+      boost::system::error_code ec;
+      if (boost::filesystem::remove(*groupEnd, ec)) {
+        ++numRemoved;
+      }
+    }
+    // One check per prefix directory instead of one per block
+    boost::system::error_code ec;
+    if (boost::filesystem::is_empty(prefixDir, ec)) {
+      boost::filesystem::remove(prefixDir, ec);
+    }
+    groupBegin = groupEnd;
+  }
+  _metrics.removed(numRemoved);
+  return numRemoved;
+}
+
 optional<Data> OnDiskBlockStore2::load(const BlockId &blockId) const {
   auto fileContent = Data::LoadFromFile(_getFilepath(blockId));
+  _metrics.loaded(fileContent);
   if (fileContent == none) {
     return boost::none;
   }
@@ -92,6 +125,7 @@ void OnDiskBlockStore2::store(const BlockId &blockId, const Data &data) {
   auto filepath = _getFilepath(blockId);
   boost::filesystem::create_directory(filepath.parent_path()); // TODO Instead create all of them once at fs creation time?
   fileContent.StoreToFile(filepath);
+  _metrics.stored(fileContent);
 }
 
 uint64_t OnDiskBlockStore2::numBlocks() const {
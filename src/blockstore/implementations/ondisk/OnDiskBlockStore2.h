@@ -3,6 +3,7 @@
 #define MESSMER_BLOCKSTORE_IMPLEMENTATIONS_ONDISK_ONDISKBLOCKSTORE2_H_
 
 #include "../../interface/BlockStore2.h"
+#include "../../utils/BlockStoreMetrics.h"
 #include <boost/filesystem/path.hpp>
 #include <cpp-utils/macros.h>
 #include <cpp-utils/pointer/unique_ref.h>
@@ -17,6 +18,7 @@ public:
 
   bool tryCreate(const BlockId &blockId, const cpputils::Data &data) override;
   bool remove(const BlockId &blockId) override;
+  size_t removeMany(const std::vector<BlockId> &blockIds) override;
   boost::optional<cpputils::Data> load(const BlockId &blockId) const override;
   void store(const BlockId &blockId, const cpputils::Data &data) override;
   uint64_t numBlocks() const override;
@@ -26,6 +28,8 @@ public:
 
 private:
   boost::filesystem::path _rootDir;
+  // Counts the bytes read from and written to disk, including the format header
+  mutable BlockStoreMetrics _metrics;
 
   static const std::string FORMAT_VERSION_HEADER_PREFIX;
   static const std::string FORMAT_VERSION_HEADER;
@@ -70,6 +70,10 @@ void ParallelAccessBlockStore::remove(const BlockId &blockId) {
   return _parallelAccessStore.remove(blockId);
 }
 
+void ParallelAccessBlockStore::removeMany(const std::vector<BlockId> &blockIds) {
+  return _parallelAccessStore.removeMany(blockIds);
+}
+
 uint64_t ParallelAccessBlockStore::numBlocks() const {
   return _baseBlockStore->numBlocks();
 }
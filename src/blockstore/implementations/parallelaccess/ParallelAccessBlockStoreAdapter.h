@@ -27,6 +27,10 @@ public:
     return _baseBlockStore->remove(blockId);
   }
 
+  void removeManyFromBaseStore(const std::vector<BlockId> &blockIds) override {
+    return _baseBlockStore->removeMany(blockIds);
+  }
+
 private:
   BlockStore *_baseBlockStore;
 
@@ -7,6 +7,7 @@
 #include <boost/optional.hpp>
 #include <cpp-utils/pointer/unique_ref.h>
 #include <cpp-utils/data/Data.h>
+#include <vector>
 
 namespace blockstore {
 
@@ -23,6 +24,12 @@ public:
   virtual boost::optional<cpputils::unique_ref<Block>> load(const BlockId &blockId) = 0;
   virtual cpputils::unique_ref<Block> overwrite(const blockstore::BlockId &blockId, cpputils::Data data) = 0;
   virtual void remove(const BlockId &blockId) = 0;
+  // Removes several blocks at once, which allows implementations to do their bookkeeping once for all of them.
+  virtual void removeMany(const std::vector<BlockId> &blockIds) {
+    for (const BlockId &blockId : blockIds) {
+      remove(blockId);
+    }
+  }
   virtual uint64_t numBlocks() const = 0;
   //TODO Test estimateNumFreeBytes in all block stores
   virtual uint64_t estimateNumFreeBytes() const = 0;
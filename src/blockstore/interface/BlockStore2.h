@@ -8,6 +8,7 @@
 #include <cpp-utils/pointer/unique_ref.h>
 #include <cpp-utils/data/Data.h>
 #include <cpp-utils/random/Random.h>
+#include <vector>
 
 namespace blockstore {
 
@@ -23,6 +24,18 @@ public:
   virtual bool tryCreate(const BlockId &blockId, const cpputils::Data &data) = 0;
   WARN_UNUSED_RESULT
   virtual bool remove(const BlockId &blockId) = 0;
+  // Removes several blocks at once, which allows implementations to do their bookkeeping once for all of them.
+  // Blocks that don't exist are skipped. Returns the number of blocks that were removed.
+  WARN_UNUSED_RESULT
+  virtual size_t removeMany(const std::vector<BlockId> &blockIds) {
+    size_t numRemoved = 0;
+    for (const BlockId &blockId : blockIds) {
+      if (remove(blockId)) {
+        ++numRemoved;
+      }
+    }
+    return numRemoved;
+  }
 
   WARN_UNUSED_RESULT
   virtual boost::optional<cpputils::Data> load(const BlockId &blockId) const = 0;
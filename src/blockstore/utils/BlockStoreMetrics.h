@@ -0,0 +1,58 @@
+#pragma once
+#ifndef MESSMER_BLOCKSTORE_UTILS_BLOCKSTOREMETRICS_H_
+#define MESSMER_BLOCKSTORE_UTILS_BLOCKSTOREMETRICS_H_
+
+#include <boost/optional.hpp>
+#include <cpp-utils/data/Data.h>
+#include <cpp-utils/metrics/Metrics.h>
+#include <cpp-utils/macros.h>
+#include <string>
+
+namespace blockstore {
+
+// Counts the blocks and bytes going through one layer of the block store stack.
+// The metrics are named "blockstore.<layerName>.<metric>", e.g. "blockstore.ondisk.loaded_bytes".
+class BlockStoreMetrics final {
+public:
+  explicit BlockStoreMetrics(const std::string &layerName)
+  : _loadedBlocks(_counter(layerName, "loaded_blocks")), _loadedBytes(_counter(layerName, "loaded_bytes")),
+    _notFoundBlocks(_counter(layerName, "not_found_blocks")), _storedBlocks(_counter(layerName, "stored_blocks")),
+    _storedBytes(_counter(layerName, "stored_bytes")), _removedBlocks(_counter(layerName, "removed_blocks")) {
+  }
+
+  void loaded(const boost::optional<cpputils::Data> &data) {
+    if (data == boost::none) {
+      _notFoundBlocks.increment();
+    } else {
+      _loadedBlocks.increment();
+      _loadedBytes.add(data->size());
+    }
+  }
+
+  void stored(const cpputils::Data &data) {
+    _storedBlocks.increment();
+    _storedBytes.add(data.size());
+  }
+
+  void removed(size_t numBlocks) {
+    _removedBlocks.add(numBlocks);
+  }
+
+private:
+  static cpputils::metrics::Counter &_counter(const std::string &layerName, const std::string &metric) {
+    return cpputils::metrics::counter("blockstore." + layerName + "." + metric);
+  }
+
+  cpputils::metrics::Counter &_loadedBlocks;
+  cpputils::metrics::Counter &_loadedBytes;
+  cpputils::metrics::Counter &_notFoundBlocks;
+  cpputils::metrics::Counter &_storedBlocks;
+  cpputils::metrics::Counter &_storedBytes;
+  cpputils::metrics::Counter &_removedBlocks;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockStoreMetrics);
+};
+
+}
+
+#endif
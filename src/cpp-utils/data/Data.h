@@ -33,9 +33,34 @@ public:
     }
 };
 
+/**
+ * Allocator that keeps freed buffers of block-like sizes in a pool and reuses them, so that the block store layers
+ * don't do a malloc/free pair for each intermediate buffer of each block access.
+ * Buffers are grouped in size classes (four per power of two, i.e. at most 25% overhead). Each thread has a small
+ * cache per size class, which exchanges buffers in batches with a global pool. Sizes outside of the pooled range
+ * are passed through to DefaultAllocator.
+ */
+class PooledAllocator final : public Allocator {
+public:
+    PooledAllocator(): _unswappable(false) {}
+
+    void* allocate(size_t size) override;
+    void free(void* data, size_t size) override;
+
+    // If enabled, buffers allocated afterwards are taken from UnswappableArenaAllocator instead, i.e. they're locked
+    // into RAM and wiped when freed. Since Data uses PooledAllocator by default, this covers all decrypted block data.
+    // Buffers allocated before the call aren't affected. The setting is process wide, it applies to all Data instances
+    // no matter which filesystem they belong to.
+    static void setUseUnswappableMemory(bool enabled);
+
+private:
+    // Where the buffer of this allocator instance came from. Data uses each allocator instance for one buffer only.
+    bool _unswappable;
+};
+
 class Data final {
 public:
-  explicit Data(size_t size, unique_ref<Allocator> allocator = make_unique_ref<DefaultAllocator>());
+  explicit Data(size_t size, unique_ref<Allocator> allocator = make_unique_ref<PooledAllocator>());
   ~Data();
 
   Data(Data &&rhs) noexcept;
@@ -67,7 +92,7 @@ public:
   void StoreToStream(std::ostream &stream) const;
 
   // TODO Unify ToString/FromString functions from Data/FixedSizeData using free functions
-  static Data FromString(const std::string &data, unique_ref<Allocator> allocator = make_unique_ref<DefaultAllocator>());
+  static Data FromString(const std::string &data, unique_ref<Allocator> allocator = make_unique_ref<PooledAllocator>());
   std::string ToString() const;
 
 private:
@@ -0,0 +1,192 @@
+#include "Data.h"
+#include "SizeClasses.h"
+#include "../system/memory.h"
+#include <atomic>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <vector>
+
+namespace cpputils {
+
+namespace {
+
+// Buffers with sizes in (2^MIN_SIZE_LOG2, 2^MAX_SIZE_LOG2] are pooled. This covers blocks with the default block size
+// and large leaves, including the headers the different block store layers add.
+constexpr unsigned MIN_SIZE_LOG2 = 11;
+constexpr unsigned MAX_SIZE_LOG2 = 23;
+constexpr unsigned NUM_SIZE_CLASSES = (MAX_SIZE_LOG2 - MIN_SIZE_LOG2) * sizeclasses::SIZE_CLASSES_PER_POWER_OF_TWO;
+// Each thread caches this many bytes per size class, but at least one buffer
+constexpr size_t THREAD_CACHE_BYTES_PER_SIZE_CLASS = 512 * 1024;
+// Buffers freed while the global pool is full are returned to the system
+constexpr size_t GLOBAL_POOL_MAX_BYTES = 64 * 1024 * 1024;
+
+std::atomic<bool> useUnswappableMemory(false);
+
+bool isPooledSize(size_t size) {
+  return size > (static_cast<size_t>(1) << MIN_SIZE_LOG2) && size <= (static_cast<size_t>(1) << MAX_SIZE_LOG2);
+}
+
+unsigned sizeClassOf(size_t size) {
+  return sizeclasses::sizeClassOf(size, MIN_SIZE_LOG2);
+}
+
+size_t sizeClassBytes(unsigned sizeClass) {
+  return sizeclasses::sizeClassBytes(sizeClass, MIN_SIZE_LOG2);
+}
+
+size_t threadCacheCapacity(unsigned sizeClass) {
+  return std::max<size_t>(1, THREAD_CACHE_BYTES_PER_SIZE_CLASS / sizeClassBytes(sizeClass));
+}
+
+// Thread caches exchange buffers with the global pool in batches of half their capacity,
+// so that a thread alternating between allocating and freeing doesn't take the lock each time.
+size_t batchSize(unsigned sizeClass) {
+  return (threadCacheCapacity(sizeClass) + 1) / 2;
+}
+
+class GlobalPool final {
+public:
+  GlobalPool(): _mutex(), _buffers(), _numBytes(0) {}
+
+  // Moves up to maxCount buffers from the pool to the end of target
+  void take(unsigned sizeClass, std::vector<void*> *target, size_t maxCount) {
+    const std::unique_lock<std::mutex> lock(_mutex);
+    std::vector<void*> &pooled = _buffers[sizeClass];
+    for (; maxCount > 0 && !pooled.empty(); --maxCount) {
+      target->push_back(pooled.back());
+      pooled.pop_back();
+      _numBytes -= sizeClassBytes(sizeClass);
+    }
+  }
+
+  // Moves count buffers from the end of source to the pool, or frees them if the pool is full
+  void give(unsigned sizeClass, std::vector<void*> *source, size_t count) {
+    ASSERT(count <= source->size(), "Can't give more buffers than there are");
+    {
+      const std::unique_lock<std::mutex> lock(_mutex);
+      for (; count > 0 && _numBytes + sizeClassBytes(sizeClass) <= GLOBAL_POOL_MAX_BYTES; --count) {
+        _buffers[sizeClass].push_back(source->back());
+        source->pop_back();
+        _numBytes += sizeClassBytes(sizeClass);
+      }
+    }
+    for (; count > 0; --count) {
+      DefaultAllocator().free(source->back(), sizeClassBytes(sizeClass));
+      source->pop_back();
+    }
+  }
+
+private:
+  std::mutex _mutex;
+  std::array<std::vector<void*>, NUM_SIZE_CLASSES> _buffers;
+  size_t _numBytes;
+
+  DISALLOW_COPY_AND_ASSIGN(GlobalPool);
+};
+
+GlobalPool &globalPool() {
+  // Intentionally never destructed, Data objects with static storage duration can still free their buffers
+  // when static objects are destructed.
+  static GlobalPool *pool = new GlobalPool;
+  return *pool;
+}
+
+thread_local bool threadCacheAlive = false;
+
+class ThreadCache final {
+public:
+  ThreadCache(): _buffers() {
+    threadCacheAlive = true;
+  }
+
+  ~ThreadCache() {
+    threadCacheAlive = false;
+    for (unsigned sizeClass = 0; sizeClass < NUM_SIZE_CLASSES; ++sizeClass) {
+      globalPool().give(sizeClass, &_buffers[sizeClass], _buffers[sizeClass].size());
+    }
+  }
+
+  void *allocate(unsigned sizeClass) {
+    std::vector<void*> &buffers = _buffers[sizeClass];
+    if (buffers.empty()) {
+      globalPool().take(sizeClass, &buffers, batchSize(sizeClass));
+      if (buffers.empty()) {
+        return DefaultAllocator().allocate(sizeClassBytes(sizeClass));
+      }
+    }
+    void *result = buffers.back();
+    buffers.pop_back();
+    return result;
+  }
+
+  void free(unsigned sizeClass, void *data) {
+    std::vector<void*> &buffers = _buffers[sizeClass];
+    if (buffers.size() >= threadCacheCapacity(sizeClass)) {
+      globalPool().give(sizeClass, &buffers, batchSize(sizeClass));
+    }
+    buffers.push_back(data);
+  }
+
+private:
+  std::array<std::vector<void*>, NUM_SIZE_CLASSES> _buffers;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadCache);
+};
+
+// Returns nullptr if the calling thread is exiting and its cache was already destructed
+ThreadCache *threadCache() {
+  thread_local ThreadCache cache;
+  if (!threadCacheAlive) {
+    return nullptr;
+  }
+  return &cache;
+}
+
+}
+
+void PooledAllocator::setUseUnswappableMemory(bool enabled) {
+  useUnswappableMemory = enabled;
+}
+
+void* PooledAllocator::allocate(size_t size) {
+  _unswappable = useUnswappableMemory.load(std::memory_order_relaxed);
+  if (_unswappable) {
+    return UnswappableArenaAllocator().allocate(size);
+  }
+  if (!isPooledSize(size)) {
+    return DefaultAllocator().allocate(size);
+  }
+  const unsigned sizeClass = sizeClassOf(size);
+  ThreadCache *cache = threadCache();
+  if (nullptr != cache) {
+    return cache->allocate(sizeClass);
+  }
+  std::vector<void*> taken;
+  globalPool().take(sizeClass, &taken, 1);
+  if (taken.empty()) {
+    return DefaultAllocator().allocate(sizeClassBytes(sizeClass));
+  }
+  return taken.back();
+}
+
+void PooledAllocator::free(void* data, size_t size) {
+  if (_unswappable) {
+    UnswappableArenaAllocator().free(data, size);
+    return;
+  }
+  if (!isPooledSize(size)) {
+    DefaultAllocator().free(data, size);
+    return;
+  }
+  const unsigned sizeClass = sizeClassOf(size);
+  ThreadCache *cache = threadCache();
+  if (nullptr != cache) {
+    cache->free(sizeClass, data);
+    return;
+  }
+  std::vector<void*> given {data};
+  globalPool().give(sizeClass, &given, 1);
+}
+
+}
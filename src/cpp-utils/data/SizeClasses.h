@@ -0,0 +1,42 @@
+#pragma once
+#ifndef MESSMER_CPPUTILS_DATA_SIZECLASSES_H_
+#define MESSMER_CPPUTILS_DATA_SIZECLASSES_H_
+
+#include <cstddef>
+#include "../assert/assert.h"
+
+namespace cpputils {
+namespace sizeclasses {
+
+// Size classes used by the pooling allocators. There are four size classes per power of two, i.e. for sizes in
+// (2^k, 2^(k+1)], the size classes are 2^k + j * 2^(k-2) for j=1..4, which wastes at most 25% of an allocation.
+// Size class 0 is the smallest size class above 2^minSizeLog2.
+
+constexpr unsigned SIZE_CLASSES_PER_POWER_OF_TWO = 4;
+
+inline unsigned highestBit(size_t value) {
+  unsigned result = 0;
+  while (value >>= 1) {
+    ++result;
+  }
+  return result;
+}
+
+inline unsigned sizeClassOf(size_t size, unsigned minSizeLog2) {
+  ASSERT(minSizeLog2 >= 2 && size > (static_cast<size_t>(1) << minSizeLog2), "Size is below the smallest size class");
+  const unsigned k = highestBit(size - 1);
+  const size_t step = static_cast<size_t>(1) << (k - 2);
+  const size_t j = ((size - 1) - (static_cast<size_t>(1) << k)) / step;
+  return (k - minSizeLog2) * SIZE_CLASSES_PER_POWER_OF_TWO + static_cast<unsigned>(j);
+}
+
+inline size_t sizeClassBytes(unsigned sizeClass, unsigned minSizeLog2) {
+  const unsigned k = minSizeLog2 + sizeClass / SIZE_CLASSES_PER_POWER_OF_TWO;
+  const size_t j = sizeClass % SIZE_CLASSES_PER_POWER_OF_TWO + 1;
+  return (static_cast<size_t>(1) << k) + j * (static_cast<size_t>(1) << (k - 2));
+}
+
+}
+}
+
+#endif
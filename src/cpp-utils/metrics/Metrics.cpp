@@ -0,0 +1,179 @@
+#include "Metrics.h"
+#include <sstream>
+
+namespace cpputils {
+namespace metrics {
+
+namespace detail {
+unsigned assignShard() {
+  static std::atomic<unsigned> nextShard(0);
+  return nextShard.fetch_add(1, std::memory_order_relaxed) % NUM_SHARDS;
+}
+}
+
+Counter::Counter(): _shards() {
+  for (Shard &shard : _shards) {
+    shard.value = 0;
+  }
+}
+
+uint64_t Counter::value() const {
+  uint64_t result = 0;
+  for (const Shard &shard : _shards) {
+    result += shard.value.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+constexpr unsigned Histogram::MAX_VALUE_LOG2;
+constexpr unsigned Histogram::NUM_BUCKETS;
+
+Histogram::Histogram(): _shards() {
+  for (Shard &shard : _shards) {
+    shard.count = 0;
+    shard.sum = 0;
+    for (auto &bucket : shard.buckets) {
+      bucket = 0;
+    }
+  }
+}
+
+unsigned Histogram::bucketOf(uint64_t value) {
+  if (value < 4) {
+    return static_cast<unsigned>(value);
+  }
+  unsigned k = 0;
+  for (uint64_t v = value; v >>= 1;) {
+    ++k;
+  }
+  if (k >= MAX_VALUE_LOG2) {
+    return NUM_BUCKETS - 1;
+  }
+  // value is in [2^k, 2^(k+1)), which is split into four buckets starting at (4+j) * 2^(k-2) for j=0..3
+  const unsigned j = static_cast<unsigned>(value >> (k - 2)) & 3u;
+  return 4 + (k - 2) * 4 + j;
+}
+
+uint64_t Histogram::bucketLowerBound(unsigned bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  const unsigned k = (bucket - 4) / 4 + 2;
+  const uint64_t j = (bucket - 4) % 4;
+  return (4 + j) << (k - 2);
+}
+
+uint64_t Histogram::count() const {
+  uint64_t result = 0;
+  for (const Shard &shard : _shards) {
+    result += shard.count.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+uint64_t Histogram::sum() const {
+  uint64_t result = 0;
+  for (const Shard &shard : _shards) {
+    result += shard.sum.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+std::vector<Histogram::Bucket> Histogram::buckets() const {
+  std::vector<Bucket> result;
+  for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+    uint64_t count = 0;
+    for (const Shard &shard : _shards) {
+      count += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+    if (count != 0) {
+      result.push_back(Bucket{bucketLowerBound(i), count});
+    }
+  }
+  return result;
+}
+
+namespace {
+void writeJsonString(std::ostringstream *stream, const std::string &str) {
+  *stream << '"';
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      *stream << '\\';
+    }
+    *stream << c;
+  }
+  *stream << '"';
+}
+}
+
+std::string MetricsSnapshot::toJson() const {
+  std::ostringstream result;
+  result << "{\"counters\":{";
+  for (size_t i = 0; i < counters.size(); ++i) {
+    if (i != 0) {
+      result << ',';
+    }
+    writeJsonString(&result, counters[i].name);
+    result << ':' << counters[i].value;
+  }
+  result << "},\"histograms\":{";
+  for (size_t i = 0; i < histograms.size(); ++i) {
+    if (i != 0) {
+      result << ',';
+    }
+    writeJsonString(&result, histograms[i].name);
+    result << ":{\"count\":" << histograms[i].count << ",\"sum\":" << histograms[i].sum << ",\"buckets\":[";
+    for (size_t j = 0; j < histograms[i].buckets.size(); ++j) {
+      if (j != 0) {
+        result << ',';
+      }
+      result << '[' << histograms[i].buckets[j].lowerBound << ',' << histograms[i].buckets[j].count << ']';
+    }
+    result << "]}";
+  }
+  result << "}}";
+  return result.str();
+}
+
+Metrics &Metrics::singleton() {
+  // Intentionally never destructed, metrics can still be updated while static objects are destructed.
+  static Metrics *instance = new Metrics;
+  return *instance;
+}
+
+Metrics::Metrics(): _mutex(), _counters(), _histograms() {}
+
+Counter &Metrics::counter(const std::string &name) {
+  const std::unique_lock<std::mutex> lock(_mutex);
+  auto &found = _counters[name];
+  if (found == nullptr) {
+    found = std::make_unique<Counter>();
+  }
+  return *found;
+}
+
+Histogram &Metrics::histogram(const std::string &name) {
+  const std::unique_lock<std::mutex> lock(_mutex);
+  auto &found = _histograms[name];
+  if (found == nullptr) {
+    found = std::make_unique<Histogram>();
+  }
+  return *found;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+  const std::unique_lock<std::mutex> lock(_mutex);
+  MetricsSnapshot result;
+  result.counters.reserve(_counters.size());
+  for (const auto &counter : _counters) {
+    result.counters.push_back(MetricsSnapshot::CounterValue{counter.first, counter.second->value()});
+  }
+  result.histograms.reserve(_histograms.size());
+  for (const auto &histogram : _histograms) {
+    result.histograms.push_back(MetricsSnapshot::HistogramValue{histogram.first, histogram.second->count(), histogram.second->sum(), histogram.second->buckets()});
+  }
+  return result;
+}
+
+}
+}
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef MESSMER_CPPUTILS_METRICS_METRICS_H_
+#define MESSMER_CPPUTILS_METRICS_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../macros.h"
+
+namespace cpputils {
+namespace metrics {
+
+namespace detail {
+// Number of shards each metric is split into. Every thread writes to one shard, so threads running on different
+// cores usually don't contend on the same cache line. Reading a metric sums up all shards.
+constexpr unsigned NUM_SHARDS = 8;
+
+unsigned assignShard();
+
+// Index of the shard the current thread writes to. Threads get shards assigned round robin.
+inline unsigned currentShard() {
+  static thread_local const unsigned shard = assignShard();
+  return shard;
+}
+}
+
+/**
+ * Monotonic counter, e.g. for the number of cache hits or the number of bytes loaded.
+ * Adding is a relaxed atomic add on a thread-local shard, so it is cheap enough to be always enabled.
+ */
+class Counter final {
+public:
+  Counter();
+
+  void add(uint64_t value) {
+    _shards[detail::currentShard()].value.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void increment() {
+    add(1);
+  }
+
+  uint64_t value() const;
+
+private:
+  // Padded to a cache line so that threads writing to neighbouring shards don't contend
+  struct Shard final {
+    std::atomic<uint64_t> value;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+  };
+  std::array<Shard, detail::NUM_SHARDS> _shards;
+
+  DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+/**
+ * Histogram with log-linear buckets, e.g. for the latency of an operation in nanoseconds.
+ * Values below 4 have a bucket each. Above that, there are four buckets per power of two, i.e. the bucket a value
+ * is counted in is at most 25% off. Values from 2^MAX_VALUE_LOG2 on are counted in the last bucket.
+ */
+class Histogram final {
+public:
+  static constexpr unsigned MAX_VALUE_LOG2 = 40;
+  static constexpr unsigned NUM_BUCKETS = 4 + (MAX_VALUE_LOG2 - 2) * 4;
+
+  Histogram();
+
+  void record(uint64_t value) {
+    Shard &shard = _shards[detail::currentShard()];
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+    shard.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  struct Bucket final {
+    uint64_t lowerBound;
+    uint64_t count;
+  };
+
+  uint64_t count() const;
+  uint64_t sum() const;
+  // Only returns buckets with a nonzero count, sorted by lowerBound
+  std::vector<Bucket> buckets() const;
+
+  static unsigned bucketOf(uint64_t value);
+  static uint64_t bucketLowerBound(unsigned bucket);
+
+private:
+  struct Shard final {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets;
+    char padding[64];
+  };
+  std::array<Shard, detail::NUM_SHARDS> _shards;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+/**
+ * Records the time between its construction and destruction in nanoseconds into a histogram.
+ */
+class ScopedTimer final {
+public:
+  explicit ScopedTimer(Histogram *target)
+  : _target(target), _beginTime(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() {
+    _target->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _beginTime).count());
+  }
+
+private:
+  Histogram *_target;
+  std::chrono::steady_clock::time_point _beginTime;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedTimer);
+};
+
+struct MetricsSnapshot final {
+  struct CounterValue final {
+    std::string name;
+    uint64_t value;
+  };
+  struct HistogramValue final {
+    std::string name;
+    uint64_t count;
+    uint64_t sum;
+    std::vector<Histogram::Bucket> buckets;
+  };
+
+  std::vector<CounterValue> counters;
+  std::vector<HistogramValue> histograms;
+
+  // Returns the snapshot as a JSON object {"counters": {name: value, ...}, "histograms": {name: {"count": ...,
+  // "sum": ..., "buckets": [[lowerBound, count], ...]}, ...}}
+  std::string toJson() const;
+};
+
+/**
+ * Process wide registry of all metrics. Metrics are created when they're first requested and live until the
+ * process exits, so callers can keep the returned references. Looking a metric up takes a lock, so hot code paths
+ * should look it up once and keep the reference, e.g. in a member or a function-local static.
+ */
+class Metrics final {
+public:
+  static Metrics &singleton();
+
+  Counter &counter(const std::string &name);
+  Histogram &histogram(const std::string &name);
+
+  MetricsSnapshot snapshot() const;
+
+private:
+  Metrics();
+
+  mutable std::mutex _mutex;
+  std::map<std::string, std::unique_ptr<Counter>> _counters;
+  std::map<std::string, std::unique_ptr<Histogram>> _histograms;
+
+  DISALLOW_COPY_AND_ASSIGN(Metrics);
+};
+
+inline Counter &counter(const std::string &name) {
+  return Metrics::singleton().counter(name);
+}
+
+inline Histogram &histogram(const std::string &name) {
+  return Metrics::singleton().histogram(name);
+}
+
+}
+}
+
+#endif
@@ -1,5 +1 @@
 #include "Random.h"
-
-namespace cpputils {
-    std::mutex Random::_mutex;
-}
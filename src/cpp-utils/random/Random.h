@@ -6,26 +6,24 @@
 #include "OSRandomGenerator.h"
 #include "../data/FixedSizeData.h"
 #include "../data/Data.h"
-#include <mutex>
 
 namespace cpputils {
+    // Initialization of the function local statics is thread safe. The generators synchronize their accesses themselves,
+    // so getting them doesn't need a lock. PseudoRandom() is called for every encrypted block, a global lock here would
+    // serialize all threads of all mounted filesystems.
     class Random final {
     public:
         static PseudoRandomPool &PseudoRandom() {
-            const std::unique_lock <std::mutex> lock(_mutex);
             static PseudoRandomPool random;
             return random;
         }
 
         static OSRandomGenerator &OSRandom() {
-            const std::unique_lock <std::mutex> lock(_mutex);
             static OSRandomGenerator random;
             return random;
         }
 
     private:
-        static std::mutex _mutex;
-
         DISALLOW_COPY_AND_ASSIGN(Random);
     };
 }
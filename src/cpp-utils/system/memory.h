@@ -19,6 +19,20 @@ public:
     void free(void* data, size_t size) override;
 };
 
+/**
+* Allocator for larger amounts of security relevant memory like decrypted block data.
+* Like UnswappableAllocator, memory is locked into RAM and zeroed out when deallocated. But instead of locking and
+* unlocking memory for each allocation, buffers are taken from chunks of locked pages that are reserved once and
+* then reused. Buffers of the same size class are grouped on the same pages. Chunks are never given back to the
+* operating system. If pages can't be locked, e.g. because RLIMIT_MEMLOCK is too low, a warning is logged
+* and the memory is still used and wiped, but might be swapped out.
+*/
+class UnswappableArenaAllocator final : public Allocator {
+public:
+    void* allocate(size_t size) override;
+    void free(void* data, size_t size) override;
+};
+
 }
 
 #endif
@@ -0,0 +1,135 @@
+#include "memory.h"
+#include "../data/SizeClasses.h"
+#include <cpp-utils/logging/logging.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#if defined(_MSC_VER)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <errno.h>
+#endif
+
+using namespace cpputils::logging;
+
+namespace cpputils {
+
+namespace {
+
+// Buffers of up to 2^MAX_SIZE_LOG2 bytes are taken from the arena, larger ones are passed through to UnswappableAllocator.
+constexpr unsigned MIN_SIZE_LOG2 = 5;
+constexpr unsigned MAX_SIZE_LOG2 = 23;
+constexpr unsigned NUM_SIZE_CLASSES = (MAX_SIZE_LOG2 - MIN_SIZE_LOG2) * sizeclasses::SIZE_CLASSES_PER_POWER_OF_TWO;
+// New chunks are reserved with about this size, or with the size of one buffer if that is larger
+constexpr size_t CHUNK_BYTES = 1024 * 1024;
+
+unsigned sizeClassOf(size_t size) {
+  return sizeclasses::sizeClassOf(std::max(size, (static_cast<size_t>(1) << MIN_SIZE_LOG2) + 1), MIN_SIZE_LOG2);
+}
+
+size_t sizeClassBytes(unsigned sizeClass) {
+  return sizeclasses::sizeClassBytes(sizeClass, MIN_SIZE_LOG2);
+}
+
+void *allocateChunk(size_t size, bool *locked) {
+#if defined(_MSC_VER)
+  void *data = ::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if (nullptr == data) {
+    throw std::runtime_error("Error calling VirtualAlloc. Errno: " + std::to_string(GetLastError()));
+  }
+  *locked = (0 != ::VirtualLock(data, size));
+#else
+  void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == data) {
+    throw std::runtime_error("Error calling mmap. Errno: " + std::to_string(errno));
+  }
+  *locked = (0 == ::mlock(data, size));
+#if defined(MADV_DONTDUMP)
+  // Also keep the memory out of core dumps. This is only a hint, ignore errors.
+  ::madvise(data, size, MADV_DONTDUMP);
+#endif
+#endif
+  return data;
+}
+
+class UnswappableArena final {
+public:
+  UnswappableArena(): _sizeClasses(), _warnedNotLocked() {}
+
+  void *allocate(unsigned sizeClass) {
+    SizeClassArena &arena = _sizeClasses[sizeClass];
+    const std::unique_lock<std::mutex> lock(arena.mutex);
+    if (arena.freeBuffers.empty()) {
+      _reserveChunk(sizeClass, &arena);
+    }
+    void *result = arena.freeBuffers.back();
+    arena.freeBuffers.pop_back();
+    return result;
+  }
+
+  void free(unsigned sizeClass, void *data) {
+    SizeClassArena &arena = _sizeClasses[sizeClass];
+    const std::unique_lock<std::mutex> lock(arena.mutex);
+    arena.freeBuffers.push_back(data);
+  }
+
+private:
+  struct SizeClassArena final {
+    std::mutex mutex;
+    std::vector<void*> freeBuffers;
+  };
+
+  void _reserveChunk(unsigned sizeClass, SizeClassArena *arena) {
+    const size_t bufferBytes = sizeClassBytes(sizeClass);
+    const size_t numBuffers = std::max<size_t>(1, CHUNK_BYTES / bufferBytes);
+    bool locked = false;
+    uint8_t *chunk = static_cast<uint8_t*>(allocateChunk(numBuffers * bufferBytes, &locked));
+    if (!locked) {
+      std::call_once(_warnedNotLocked, [] {
+        LOG(WARN, "Could not lock memory for decrypted data into RAM, it might be swapped to disk. Consider increasing RLIMIT_MEMLOCK.");
+      });
+    }
+    arena->freeBuffers.reserve(arena->freeBuffers.size() + numBuffers);
+    for (size_t i = 0; i < numBuffers; ++i) {
+      arena->freeBuffers.push_back(chunk + i * bufferBytes);
+    }
+  }
+
+  std::array<SizeClassArena, NUM_SIZE_CLASSES> _sizeClasses;
+  std::once_flag _warnedNotLocked;
+
+  DISALLOW_COPY_AND_ASSIGN(UnswappableArena);
+};
+
+UnswappableArena &arena() {
+  // Intentionally never destructed, Data objects with static storage duration can still free their buffers
+  // when static objects are destructed.
+  static UnswappableArena *instance = new UnswappableArena;
+  return *instance;
+}
+
+}
+
+void* UnswappableArenaAllocator::allocate(size_t size) {
+  if (size > (static_cast<size_t>(1) << MAX_SIZE_LOG2)) {
+    return UnswappableAllocator().allocate(size);
+  }
+  return arena().allocate(sizeClassOf(size));
+}
+
+void UnswappableArenaAllocator::free(void* data, size_t size) {
+  if (size > (static_cast<size_t>(1) << MAX_SIZE_LOG2)) {
+    UnswappableAllocator().free(data, size);
+    return;
+  }
+  // overwrite the memory with zeroes before we give it back to the arena
+  std::memset(data, 0, size);
+  arena().free(sizeClassOf(size), data);
+}
+
+}
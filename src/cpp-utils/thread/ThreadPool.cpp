@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+#include "debugging.h"
+#include "../logging/logging.h"
+
+using std::function;
+using std::string;
+using namespace cpputils::logging;
+
+namespace cpputils {
+
+namespace {
+// The pool and worker index of the current thread, if it is a worker thread. Lets tasks that submit other tasks
+// put them into their own worker's queue.
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local unsigned int currentWorkerIndex = 0;
+
+unsigned int numThreadsOrDefault(unsigned int numThreads) {
+  if (numThreads != 0) {
+    return numThreads;
+  }
+  const unsigned int numCores = std::thread::hardware_concurrency();
+  return (numCores == 0) ? 1 : numCores;
+}
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads, const string &threadName)
+: _workers(), _submittedTasksMutex(), _submittedTasks(), _numQueuedTasks(0), _idleMutex(), _taskAvailable(), _stopping(false), _threads() {
+  numThreads = numThreadsOrDefault(numThreads);
+  _workers.reserve(numThreads);
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    _workers.push_back(std::make_unique<Worker>());
+  }
+  _threads.reserve(numThreads);
+  for (unsigned int i = 0; i < numThreads; ++i) {
+    _threads.emplace_back([this, i, threadName] {
+      set_thread_name(threadName.c_str());
+      _run(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard<std::mutex> lock(_idleMutex);
+    _stopping = true;
+  }
+  _taskAvailable.notify_all();
+  for (std::thread &thread : _threads) {
+    thread.join();
+  }
+}
+
+unsigned int ThreadPool::numThreads() const {
+  return _workers.size();
+}
+
+void ThreadPool::submit(function<void()> task) {
+  if (currentPool == this) {
+    Worker &worker = *_workers[currentWorkerIndex];
+    const std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  } else {
+    const std::lock_guard<std::mutex> lock(_submittedTasksMutex);
+    _submittedTasks.push_back(std::move(task));
+  }
+  {
+    // Taking the lock makes sure a worker that is about to go idle either sees the new task or gets notified
+    const std::lock_guard<std::mutex> lock(_idleMutex);
+    _numQueuedTasks.fetch_add(1);
+  }
+  _taskAvailable.notify_one();
+}
+
+void ThreadPool::_run(unsigned int workerIndex) {
+  currentPool = this;
+  currentWorkerIndex = workerIndex;
+  while (true) {
+    if (_runNextTask(workerIndex)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(_idleMutex);
+    _taskAvailable.wait(lock, [this] {
+      return _stopping || _numQueuedTasks.load() != 0;
+    });
+    if (_stopping && _numQueuedTasks.load() == 0) {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::_runNextTask(unsigned int workerIndex) {
+  function<void()> task;
+  if (!_popTask(workerIndex, &task) && !_popSubmittedTask(&task) && !_stealTask(workerIndex, &task)) {
+    return false;
+  }
+  _numQueuedTasks.fetch_sub(1);
+  try {
+    task();
+  } catch (const std::exception &e) {
+    LOG(ERR, "ThreadPool task threw an exception: {}", e.what());
+  } catch (...) {
+    LOG(ERR, "ThreadPool task threw an unknown exception");
+  }
+  return true;
+}
+
+bool ThreadPool::_popTask(unsigned int workerIndex, function<void()> *result) {
+  Worker &worker = *_workers[workerIndex];
+  const std::lock_guard<std::mutex> lock(worker.mutex);
+  if (worker.tasks.empty()) {
+    return false;
+  }
+  *result = std::move(worker.tasks.back());
+  worker.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::_popSubmittedTask(function<void()> *result) {
+  const std::lock_guard<std::mutex> lock(_submittedTasksMutex);
+  if (_submittedTasks.empty()) {
+    return false;
+  }
+  *result = std::move(_submittedTasks.front());
+  _submittedTasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::_stealTask(unsigned int workerIndex, function<void()> *result) {
+  for (unsigned int offset = 1; offset < _workers.size(); ++offset) {
+    Worker &victim = *_workers[(workerIndex + offset) % _workers.size()];
+    const std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *result = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef MESSMER_CPPUTILS_THREAD_THREADPOOL_H
+#define MESSMER_CPPUTILS_THREAD_THREADPOOL_H
+
+#include "../macros.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cpputils {
+
+/**
+ * Fixed size pool of worker threads with work stealing.
+ *
+ * Tasks submitted from outside the pool go to a shared queue and are started in the order they were submitted, so
+ * under load the oldest request isn't served last. Tasks submitted from within a task go to the own queue of the
+ * worker running it. Workers take the newest task from their own queue first, which finishes recursive work
+ * depth-first, then the oldest task from the shared queue and finally steal the oldest task of another worker.
+ *
+ * The destructor runs all tasks that were already submitted before it returns.
+ */
+class ThreadPool final {
+public:
+  // numThreads == 0 starts one thread per CPU core
+  ThreadPool(unsigned int numThreads, const std::string &threadName);
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  unsigned int numThreads() const;
+
+private:
+  struct Worker final {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void _run(unsigned int workerIndex);
+  bool _runNextTask(unsigned int workerIndex);
+  bool _popTask(unsigned int workerIndex, std::function<void()> *result);
+  bool _popSubmittedTask(std::function<void()> *result);
+  bool _stealTask(unsigned int workerIndex, std::function<void()> *result);
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  // Tasks submitted from outside the pool
+  std::mutex _submittedTasksMutex;
+  std::deque<std::function<void()>> _submittedTasks;
+
+  // Number of tasks that are submitted but not yet taken by a worker
+  std::atomic<size_t> _numQueuedTasks;
+  // Idle workers wait on _taskAvailable
+  std::mutex _idleMutex;
+  std::condition_variable _taskAvailable;
+  bool _stopping;
+
+  std::vector<std::thread> _threads;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}
+
+#endif
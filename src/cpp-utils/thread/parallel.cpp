@@ -0,0 +1,67 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+namespace cpputils {
+
+namespace {
+std::atomic<size_t> numHelperThreads(0);
+}
+
+unsigned int numThreadsForIoBoundWork() {
+  // Twice the number of cores, so we use full CPU even if half the threads are doing I/O
+  return 2 * (std::max)(1u, std::thread::hardware_concurrency());
+}
+
+void runInParallel(size_t maxThreads, const std::function<void ()> &work) {
+  const size_t maxHelperThreads = numThreadsForIoBoundWork();
+  vector<std::future<void>> waitHandles;
+  for (size_t i = 1; i < maxThreads; ++i) {
+    if (numHelperThreads++ >= maxHelperThreads) {
+      // Other operations use up the budget, the threads we already have do the rest of the work
+      --numHelperThreads;
+      break;
+    }
+    try {
+      waitHandles.push_back(std::async(std::launch::async, [&work] {
+        try {
+          work();
+        } catch (...) {
+          --numHelperThreads;
+          throw;
+        }
+        --numHelperThreads;
+      }));
+    } catch (...) {
+      --numHelperThreads;
+      break;
+    }
+  }
+  // Wait for all threads before rethrowing, because work references the caller's local variables
+  std::exception_ptr error;
+  try {
+    work();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (auto &waitHandle : waitHandles) {
+    try {
+      waitHandle.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+#ifndef MESSMER_CPPUTILS_THREAD_PARALLEL_H
+#define MESSMER_CPPUTILS_THREAD_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+namespace cpputils {
+
+// Number of threads to use for work that alternates between CPU and I/O
+unsigned int numThreadsForIoBoundWork();
+
+// Runs work on the calling thread and on up to maxThreads-1 helper threads, then rethrows the first exception of any
+// of them. work is expected to take its tasks from state shared between the threads until none are left.
+// All callers in the process share one budget of numThreadsForIoBoundWork() helper threads, so callers that already
+// run on a thread pool or in parallel to each other don't multiply the number of threads. If the budget is used up,
+// the calling thread does the work alone.
+void runInParallel(size_t maxThreads, const std::function<void ()> &work);
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "Environment.h"
 #include <cryfs/impl/CryfsException.h>
 #include <cpp-utils/thread/debugging.h>
+#include <cpp-utils/data/Data.h>
 
 //TODO Many functions accessing the ProgramOptions object. Factor out into class that stores it as a member.
 //TODO Factor out class handling askPassword
@@ -62,7 +63,6 @@ using boost::chrono::milliseconds;
 using cpputils::dynamic_pointer_move;
 using gitversion::VersionCompare;
 
-//TODO Delete a large file in parallel possible? Takes a long time right now...
 //TODO Improve parallelity.
 //TODO Replace ASSERTs with other error handling when it is not a programming error but an environment influence (e.g. a block is missing)
 //TODO Can we improve performance by setting compiler parameter -maes for scrypt?
@@ -126,15 +126,21 @@ namespace cryfs_cli {
         cpputils::set_thread_name("cryfs");
         try {
 	    _sanityChecks(options);
+            const InstrumentedLayers instrumentedLayers = _parseInstrumentedLayers(options.instrumentedBlockStoreLayers());
+            // Keep decrypted block data out of swap and wipe it when it's freed. This is process wide, callers that mount
+            // several filesystems in one process have to make sure they agree on it.
+            cpputils::PooledAllocator::setUseUnswappableMemory(options.protectPlaintextMemory());
             const LocalStateDir localStateDir(options.localStateDir());
             auto blockStore = make_unique_ref<OnDiskBlockStore2>(options.baseDir());
             auto config = _loadOrCreateConfig(options, localStateDir, credentials);
-            fspp::fuse::Fuse* fuse = nullptr;
+            // The device keeps onIntegrityViolation for as long as the filesystem is mounted, i.e. longer than this
+            // function runs. It can't reference local variables, so the Fuse pointer is shared with it.
+            auto mountedFuse = std::make_shared<fspp::fuse::Fuse*>(nullptr);
 
-            auto onIntegrityViolation = [&fuse] () {
-              if (fuse != nullptr) {
+            auto onIntegrityViolation = [mountedFuse] () {
+              if (*mountedFuse != nullptr) {
                 LOG(ERR, "Integrity violation detected. Unmounting.");
-                fuse->destroy();
+                (*mountedFuse)->destroy();
               } else {
                 // Usually on an integrity violation, the file system is unmounted.
                 // Here, the file system isn't initialized yet, i.e. we failed in the initial steps when
@@ -144,7 +150,7 @@ namespace cryfs_cli {
               }
             };
             const bool missingBlockIsIntegrityViolation = config.configFile->config()->missingBlockIsIntegrityViolation();
-            _device = optional<unique_ref<CryDevice>>(make_unique_ref<CryDevice>(std::move(config.configFile), std::move(blockStore), std::move(localStateDir), config.myClientId, options.allowIntegrityViolations(), missingBlockIsIntegrityViolation, std::move(onIntegrityViolation)));
+            _device = optional<unique_ref<CryDevice>>(make_unique_ref<CryDevice>(std::move(config.configFile), std::move(blockStore), std::move(localStateDir), config.myClientId, options.allowIntegrityViolations(), missingBlockIsIntegrityViolation, std::move(onIntegrityViolation), instrumentedLayers));
             _sanityCheckFilesystem(_device->get());
 
             auto initFilesystem = [&] (){
@@ -152,7 +158,8 @@ namespace cryfs_cli {
                 return make_shared<fspp::FilesystemImpl>(std::move(*_device));
             };
 
-            fuse = new fspp::fuse::Fuse(initFilesystem);
+            fspp::fuse::Fuse* fuse = new fspp::fuse::Fuse(initFilesystem);
+            *mountedFuse = fuse;
 
 	    fuse->init();
 	    return fuse;
@@ -184,6 +191,24 @@ namespace cryfs_cli {
 		_checkDirAccessible(bf::absolute(options.baseDir()), "base directory", options.createMissingBasedir(), ErrorCode::InaccessibleBaseDir);
     }
 
+    InstrumentedLayers Cli::_parseInstrumentedLayers(const std::vector<std::string> &layers) {
+        InstrumentedLayers result;
+        for (const std::string &layer : layers) {
+            if (layer == "ondisk") {
+                result.onDisk = true;
+            } else if (layer == "encrypted") {
+                result.encrypted = true;
+            } else if (layer == "integrity") {
+                result.integrity = true;
+            } else if (layer == "caching") {
+                result.caching = true;
+            } else {
+                throw CryfsException("Unknown block store layer to instrument: " + layer + ". Valid layers are ondisk, encrypted, integrity and caching.", ErrorCode::InvalidArguments);
+            }
+        }
+        return result;
+    }
+
     void Cli::_checkDirAccessible(const bf::path &dir, const std::string &name, bool createMissingDir, ErrorCode errorCode) {
         if (!bf::exists(dir)) {
             if (createMissingDir) {
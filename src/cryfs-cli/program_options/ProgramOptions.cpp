@@ -16,14 +16,18 @@ ProgramOptions::ProgramOptions(bf::path baseDir, optional<bf::path> configFile,
                                optional<string> cipher,
                                optional<uint32_t> blocksizeBytes,
                                bool allowIntegrityViolations,
-                               boost::optional<bool> missingBlockIsIntegrityViolation)
+                               boost::optional<bool> missingBlockIsIntegrityViolation,
+                               bool protectPlaintextMemory,
+                               vector<string> instrumentedBlockStoreLayers)
     : _baseDir(bf::absolute(std::move(baseDir))), _configFile(std::move(configFile)),
 	_localStateDir(std::move(localStateDir)),
 	  _allowFilesystemUpgrade(allowFilesystemUpgrade), _allowReplacedFilesystem(allowReplacedFilesystem),
       _createMissingBasedir(createMissingBasedir),
       _cipher(std::move(cipher)), _blocksizeBytes(std::move(blocksizeBytes)),
       _allowIntegrityViolations(allowIntegrityViolations),
-      _missingBlockIsIntegrityViolation(std::move(missingBlockIsIntegrityViolation)) {
+      _missingBlockIsIntegrityViolation(std::move(missingBlockIsIntegrityViolation)),
+      _protectPlaintextMemory(protectPlaintextMemory),
+      _instrumentedBlockStoreLayers(std::move(instrumentedBlockStoreLayers)) {
 }
 
 const bf::path &ProgramOptions::baseDir() const {
@@ -65,3 +69,11 @@ bool ProgramOptions::allowReplacedFilesystem() const {
 const optional<bool> &ProgramOptions::missingBlockIsIntegrityViolation() const {
     return _missingBlockIsIntegrityViolation;
 }
+
+bool ProgramOptions::protectPlaintextMemory() const {
+    return _protectPlaintextMemory;
+}
+
+const vector<string> &ProgramOptions::instrumentedBlockStoreLayers() const {
+    return _instrumentedBlockStoreLayers;
+}
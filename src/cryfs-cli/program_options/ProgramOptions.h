@@ -20,7 +20,9 @@ namespace cryfs_cli {
                            boost::optional<std::string> cipher,
                            boost::optional<uint32_t> blocksizeBytes,
                            bool allowIntegrityViolations,
-                           boost::optional<bool> missingBlockIsIntegrityViolation);
+                           boost::optional<bool> missingBlockIsIntegrityViolation,
+                           bool protectPlaintextMemory,
+                           std::vector<std::string> instrumentedBlockStoreLayers);
             ProgramOptions(ProgramOptions &&rhs) = default;
 
             const boost::filesystem::path &baseDir() const;
@@ -33,6 +35,9 @@ namespace cryfs_cli {
             const boost::optional<uint32_t> &blocksizeBytes() const;
             bool allowIntegrityViolations() const;
             const boost::optional<bool> &missingBlockIsIntegrityViolation() const;
+            bool protectPlaintextMemory() const;
+            // Names of the block store layers whose latency is recorded in the metrics, see cryfs::InstrumentedLayers
+            const std::vector<std::string> &instrumentedBlockStoreLayers() const;
 
         private:
             boost::filesystem::path _baseDir; // this is always absolute
@@ -45,6 +50,8 @@ namespace cryfs_cli {
             boost::optional<uint32_t> _blocksizeBytes;
             bool _allowIntegrityViolations;
             boost::optional<bool> _missingBlockIsIntegrityViolation;
+            bool _protectPlaintextMemory;
+            std::vector<std::string> _instrumentedBlockStoreLayers;
 
             DISALLOW_COPY_AND_ASSIGN(ProgramOptions);
         };
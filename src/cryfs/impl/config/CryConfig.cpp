@@ -19,6 +19,7 @@ using cpputils::Random;
 namespace cryfs {
 
 constexpr const char* CryConfig::FilesystemFormatVersion;
+constexpr const char* CryConfig::LegacyFilesystemFormatVersion;
 
 CryConfig::CryConfig()
 : _rootBlob("")
@@ -30,6 +31,8 @@ CryConfig::CryConfig()
 , _blocksizeBytes(0)
 , _filesystemId(FilesystemID::Null())
 , _exclusiveClientId(none)
+, _hashedDirectories(false)
+, _largeLeafBlocksizeBytes(none)
 #ifndef CRYFS_NO_COMPATIBILITY
 , _hasVersionNumbers(true)
 , _hasParentPointers(true)
@@ -53,6 +56,8 @@ CryConfig CryConfig::load(const Data &data) {
   cfg._lastOpenedWithVersion = pt.get<string>("cryfs.lastOpenedWithVersion", cfg._version); // In CryFS <= 0.9.8, we didn't have this field, but used the cryfs.version field for this purpose.
   cfg._blocksizeBytes = pt.get<uint64_t>("cryfs.blocksizeBytes", 32832); // CryFS <= 0.9.2 used a 32KB block size which was this physical block size.
   cfg._exclusiveClientId = pt.get_optional<uint32_t>("cryfs.exclusiveClientId");
+  cfg._hashedDirectories = pt.get<bool>("cryfs.hashedDirectories", false); // File systems created before this option only have flat directories
+  cfg._largeLeafBlocksizeBytes = pt.get_optional<uint64_t>("cryfs.largeLeafBlocksizeBytes");
 #ifndef CRYFS_NO_COMPATIBILITY
   cfg._hasVersionNumbers = pt.get<bool>("cryfs.migrations.hasVersionNumbers", false);
   cfg._hasParentPointers = pt.get<bool>("cryfs.migrations.hasParentPointers", false);
@@ -82,6 +87,10 @@ Data CryConfig::save() const {
   if (_exclusiveClientId != none) {
     pt.put<uint32_t>("cryfs.exclusiveClientId", *_exclusiveClientId);
   }
+  pt.put<bool>("cryfs.hashedDirectories", _hashedDirectories);
+  if (_largeLeafBlocksizeBytes != none) {
+    pt.put<uint64_t>("cryfs.largeLeafBlocksizeBytes", *_largeLeafBlocksizeBytes);
+  }
 #ifndef CRYFS_NO_COMPATIBILITY
   pt.put<bool>("cryfs.migrations.hasVersionNumbers", _hasVersionNumbers);
   pt.put<bool>("cryfs.migrations.hasParentPointers", _hasParentPointers);
@@ -168,6 +177,26 @@ bool CryConfig::missingBlockIsIntegrityViolation() const {
     return _exclusiveClientId != boost::none;
 }
 
+bool CryConfig::UsesLegacyFormat() const {
+  return gitversion::VersionCompare::isOlderThan(_version, FilesystemFormatVersion);
+}
+
+bool CryConfig::HashedDirectories() const {
+  return _hashedDirectories;
+}
+
+void CryConfig::SetHashedDirectories(bool value) {
+  _hashedDirectories = value;
+}
+
+const optional<uint64_t> &CryConfig::LargeLeafBlocksizeBytes() const {
+  return _largeLeafBlocksizeBytes;
+}
+
+void CryConfig::SetLargeLeafBlocksizeBytes(optional<uint64_t> value) {
+  _largeLeafBlocksizeBytes = value;
+}
+
 #ifndef CRYFS_NO_COMPATIBILITY
 bool CryConfig::HasVersionNumbers() const {
   return _hasVersionNumbers;
@@ -12,7 +12,11 @@ namespace cryfs {
 
 class CryConfig final {
 public:
-  static constexpr const char* FilesystemFormatVersion = "0.10";
+  // Format of new file systems. Older versions can't read hashed directories, large leaves, holes, tree sizes
+  // in root nodes, size hints in directory entries and cloned files, so these are only used in this format.
+  static constexpr const char* FilesystemFormatVersion = "0.11";
+  // File systems in this format are opened without upgrading them, but only written in a way it supports
+  static constexpr const char* LegacyFilesystemFormatVersion = "0.10";
 
   //TODO No default constructor, pass in config values instead!
   CryConfig();
@@ -51,6 +55,19 @@ public:
 
   bool missingBlockIsIntegrityViolation() const;
 
+  // True if the file system has to stay readable by versions that only know LegacyFilesystemFormatVersion
+  bool UsesLegacyFormat() const;
+
+  // If set, directories that outgrow a single leaf are stored in hash-bucketed pages so that modifying an entry
+  // doesn't rewrite the whole directory. Directories in the old, flat format stay readable either way.
+  bool HashedDirectories() const;
+  void SetHashedDirectories(bool value);
+
+  // If set, files that grow beyond a few MB store their content in leaves of this (physical) size instead of BlocksizeBytes.
+  // Directories, small files and inner nodes of the block trees always use BlocksizeBytes.
+  const boost::optional<uint64_t> &LargeLeafBlocksizeBytes() const;
+  void SetLargeLeafBlocksizeBytes(boost::optional<uint64_t> value);
+
 #ifndef CRYFS_NO_COMPATIBILITY
   // This is a trigger to recognize old file systems that didn't have version numbers.
   // Version numbers cannot be disabled, but the file system will be migrated to version numbers automatically.
@@ -76,6 +93,8 @@ private:
   uint64_t _blocksizeBytes;
   FilesystemID _filesystemId;
   boost::optional<uint32_t> _exclusiveClientId;
+  bool _hashedDirectories;
+  boost::optional<uint64_t> _largeLeafBlocksizeBytes;
 #ifndef CRYFS_NO_COMPATIBILITY
   bool _hasVersionNumbers;
   bool _hasParentPointers;
@@ -15,6 +15,8 @@ using boost::none;
 
 namespace cryfs {
 
+    constexpr uint64_t CryConfigCreator::DEFAULT_LARGE_LEAF_BLOCKSIZE_BYTES;
+
     CryConfigCreator::CryConfigCreator(RandomGenerator &encryptionKeyGenerator, LocalStateDir localStateDir)
         :_configConsole(), _encryptionKeyGenerator(encryptionKeyGenerator), _localStateDir(std::move(localStateDir)) {
     }
@@ -33,6 +35,8 @@ namespace cryfs {
         const uint32_t myClientId = localState.myClientId();
         config.SetEncryptionKey(std::move(encryptionKey));
         config.SetExclusiveClientId(_generateExclusiveClientId(missingBlockIsIntegrityViolationFromCommandLine, myClientId));
+        config.SetHashedDirectories(true);
+        config.SetLargeLeafBlocksizeBytes(_generateLargeLeafBlocksizeBytes(config.BlocksizeBytes()));
 #ifndef CRYFS_NO_COMPATIBILITY
         config.SetHasVersionNumbers(true);
 #endif
@@ -48,6 +52,14 @@ namespace cryfs {
         }
     }
 
+    optional<uint64_t> CryConfigCreator::_generateLargeLeafBlocksizeBytes(uint64_t blocksizeBytes) {
+        if (blocksizeBytes >= DEFAULT_LARGE_LEAF_BLOCKSIZE_BYTES) {
+            // The blocks are already large, larger leaves wouldn't help
+            return none;
+        }
+        return DEFAULT_LARGE_LEAF_BLOCKSIZE_BYTES;
+    }
+
     string CryConfigCreator::_generateCipher(const optional<string> &cipherFromCommandLine) {
         if (cipherFromCommandLine != none) {
             ASSERT(std::find(CryCiphers::supportedCipherNames().begin(), CryCiphers::supportedCipherNames().end(), *cipherFromCommandLine) != CryCiphers::supportedCipherNames().end(), "Invalid cipher");
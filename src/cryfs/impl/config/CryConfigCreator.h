@@ -22,10 +22,14 @@ namespace cryfs {
 
         ConfigCreateResult create(const boost::optional<std::string> &cipherFromCommandLine, const boost::optional<uint32_t> &blocksizeBytesFromCommandLine, const boost::optional<bool> &missingBlockIsIntegrityViolationFromCommandLine, bool allowReplacedFilesystem);
     private:
+        // Leaf size for large files in new file systems
+        static constexpr uint64_t DEFAULT_LARGE_LEAF_BLOCKSIZE_BYTES = 1024 * 1024;
+
         std::string _generateCipher(const boost::optional<std::string> &cipherFromCommandLine);
         std::string _generateEncKey(const std::string &cipher);
         std::string _generateRootBlobId();
         uint32_t _generateBlocksizeBytes(const boost::optional<uint32_t> &blocksizeBytesFromCommandLine);
+        boost::optional<uint64_t> _generateLargeLeafBlocksizeBytes(uint64_t blocksizeBytes);
         CryConfig::FilesystemID _generateFilesystemID();
         boost::optional<uint32_t> _generateExclusiveClientId(const boost::optional<bool> &missingBlockIsIntegrityViolationFromCommandLine, uint32_t myClientId);
         bool _generateMissingBlockIsIntegrityViolation(const boost::optional<bool> &missingBlockIsIntegrityViolationFromCommandLine);
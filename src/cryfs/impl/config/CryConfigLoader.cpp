@@ -43,7 +43,8 @@ either<CryConfigFile::LoadError, CryConfigLoader::ConfigLoadResult> CryConfigLoa
   }
 #endif
   _checkVersion(*config.right()->config(), allowFilesystemUpgrade);
-  if (config.right()->config()->Version() != CryConfig::FilesystemFormatVersion) {
+  // File systems in the legacy format are only upgraded if allowed, so older versions can still open them otherwise
+  if (allowFilesystemUpgrade && config.right()->config()->Version() != CryConfig::FilesystemFormatVersion) {
     config.right()->config()->SetVersion(CryConfig::FilesystemFormatVersion);
     if (access == CryConfigFile::Access::ReadWrite) {
       config.right()->save();
@@ -69,7 +70,7 @@ void CryConfigLoader::_checkVersion(const CryConfig &config, bool allowFilesyste
   if (gitversion::VersionCompare::isOlderThan(CryConfig::FilesystemFormatVersion, config.Version())) {
     throw CryfsException("This filesystem is for CryFS " + config.Version() + " or later. Please update your CryFS version.", ErrorCode::TooNewFilesystemFormat);
   }
-  if (!allowFilesystemUpgrade && gitversion::VersionCompare::isOlderThan(config.Version(), CryConfig::FilesystemFormatVersion)) {
+  if (!allowFilesystemUpgrade && gitversion::VersionCompare::isOlderThan(config.Version(), CryConfig::LegacyFilesystemFormatVersion)) {
     throw CryfsException("This filesystem is for CryFS " + config.Version() + " (or a later version with the same storage format). It has to be migrated.", ErrorCode::TooOldFilesystemFormat);
   }
 }
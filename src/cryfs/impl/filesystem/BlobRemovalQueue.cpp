@@ -0,0 +1,198 @@
+#include "BlobRemovalQueue.h"
+#include "cryfs/impl/filesystem/parallelaccessfsblobstore/ParallelAccessFsBlobStore.h"
+#include <boost/filesystem.hpp>
+#include <cpp-utils/logging/logging.h>
+#include <cpp-utils/pointer/cast.h>
+#include <algorithm>
+
+using blockstore::BlockId;
+using cpputils::dynamic_pointer_move;
+using cryfs::parallelaccessfsblobstore::ParallelAccessFsBlobStore;
+using cryfs::parallelaccessfsblobstore::DirBlobRef;
+using boost::none;
+using std::string;
+using std::vector;
+using namespace cpputils::logging;
+namespace bf = boost::filesystem;
+
+namespace cryfs {
+
+constexpr uint32_t BlobRemovalQueue::NUM_WORKERS;
+constexpr uint32_t BlobRemovalQueue::MAX_ATTEMPTS;
+
+BlobRemovalQueue::BlobRemovalQueue(ParallelAccessFsBlobStore *fsBlobStore, bf::path journalPath)
+  : _fsBlobStore(fsBlobStore), _journalPath(std::move(journalPath)), _mutex(), _itemAddedOrStopping(), _queue(),
+    _failed(), _numRunning(0), _stopping(false), _journal(), _workers() {
+  const vector<Item> unfinished = _loadJournal();
+  // Rewrite the journal so that it only contains the removals that still have to be done
+  _openJournal(std::ios::trunc);
+  for (const Item &item : unfinished) {
+    if (item.failedAttempts >= MAX_ATTEMPTS) {
+      LOG(ERR, "Giving up removing blob {} after {} failed attempts. Its blocks are leaked.", item.blockId.ToString(), item.failedAttempts);
+      continue;
+    }
+    _queue.push_back(item);
+    _appendItemToJournal(item);
+  }
+  if (!_queue.empty()) {
+    LOG(INFO, "Resuming removal of {} blobs", _queue.size());
+  }
+  for (uint32_t i = 0; i < NUM_WORKERS; ++i) {
+    _workers.emplace_back([this] {_runWorker();});
+  }
+}
+
+BlobRemovalQueue::~BlobRemovalQueue() {
+  {
+    const std::unique_lock<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _itemAddedOrStopping.notify_all();
+  for (auto &worker : _workers) {
+    worker.join();
+  }
+}
+
+void BlobRemovalQueue::add(const BlockId &blockId) {
+  {
+    const std::unique_lock<std::mutex> lock(_mutex);
+    _appendToJournal('+', blockId);
+    _queue.push_back(Item{blockId, false, 0});
+  }
+  _itemAddedOrStopping.notify_one();
+}
+
+void BlobRemovalQueue::add(const vector<BlockId> &blockIds) {
+  if (blockIds.empty()) {
+    return;
+  }
+  {
+    const std::unique_lock<std::mutex> lock(_mutex);
+    for (const BlockId &blockId : blockIds) {
+      _journal << '+' << blockId.ToString() << '\n';
+      _queue.push_back(Item{blockId, false, 0});
+    }
+    _journal << std::flush;
+  }
+  _itemAddedOrStopping.notify_all();
+}
+
+size_t BlobRemovalQueue::size() const {
+  const std::unique_lock<std::mutex> lock(_mutex);
+  return _queue.size() + _numRunning;
+}
+
+void BlobRemovalQueue::_runWorker() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _itemAddedOrStopping.wait(lock, [this] {return _stopping || !_queue.empty();});
+    if (_stopping) {
+      return;
+    }
+    const Item item = _queue.front();
+    _queue.pop_front();
+    ++_numRunning;
+    lock.unlock();
+    bool removed = false;
+    try {
+      _remove(item);
+      removed = true;
+    } catch (const std::exception &e) {
+      // The error might be transient, e.g. the storage went away. Keep the blob in the journal so it's retried on the
+      // next mount, otherwise its blocks would be leaked for good.
+      LOG(ERR, "Could not remove blob {}, retrying on the next mount: {}", item.blockId.ToString(), e.what());
+    }
+    lock.lock();
+    --_numRunning;
+    if (removed) {
+      _appendToJournal('-', item.blockId);
+    } else {
+      _failed.push_back(Item{item.blockId, true, item.failedAttempts + 1});
+      _appendToJournal('!', item.blockId);
+    }
+    if (_queue.empty() && _numRunning == 0) {
+      // Nothing left to do, don't let the journal grow forever
+      _openJournal(std::ios::trunc);
+      for (const Item &failed : _failed) {
+        _appendItemToJournal(failed);
+      }
+    }
+  }
+}
+
+void BlobRemovalQueue::_remove(const Item &item) {
+  auto blob = _fsBlobStore->load(item.blockId);
+  if (blob == none) {
+    // The blob was removed before the journal entry could be marked as done
+    return;
+  }
+  if (item.checkIfStillReferenced && _isStillReferenced(item.blockId, (*blob)->parentPointer())) {
+    LOG(WARN, "Not removing blob {} because its directory entry still exists", item.blockId.ToString());
+    return;
+  }
+  _fsBlobStore->remove(std::move(*blob));
+}
+
+bool BlobRemovalQueue::_isStillReferenced(const BlockId &blockId, const BlockId &parent) {
+  auto parentBlob = _fsBlobStore->load(parent);
+  if (parentBlob == none) {
+    return false;
+  }
+  auto parentDir = dynamic_pointer_move<DirBlobRef>(*parentBlob);
+  if (parentDir == none) {
+    return false;
+  }
+  return (*parentDir)->GetChild(blockId) != none;
+}
+
+vector<BlobRemovalQueue::Item> BlobRemovalQueue::_loadJournal() {
+  // The journal is a list of lines "+<blockId>" for queued blobs, "!<blockId>" for each failed attempt to remove one
+  // and "-<blockId>" for removed ones
+  vector<Item> unfinished;
+  std::ifstream journal(_journalPath.string());
+  string line;
+  while (std::getline(journal, line)) {
+    if (line.size() != 1 + BlockId::STRING_LENGTH || (line[0] != '+' && line[0] != '!' && line[0] != '-')) {
+      LOG(WARN, "Ignoring invalid line in blob removal journal: {}", line);
+      continue;
+    }
+    const BlockId blockId = BlockId::FromString(line.substr(1));
+    auto found = std::find_if(unfinished.begin(), unfinished.end(), [&blockId] (const Item &item) {
+      return item.blockId == blockId;
+    });
+    if (line[0] == '+') {
+      if (found == unfinished.end()) {
+        unfinished.push_back(Item{blockId, true, 0});
+      }
+    } else if (line[0] == '!') {
+      if (found != unfinished.end()) {
+        ++found->failedAttempts;
+      }
+    } else if (found != unfinished.end()) {
+      unfinished.erase(found);
+    }
+  }
+  return unfinished;
+}
+
+void BlobRemovalQueue::_openJournal(std::ios::openmode mode) {
+  _journal.close();
+  _journal.open(_journalPath.string(), std::ios::out | mode);
+  if (!_journal.good()) {
+    LOG(ERR, "Could not open blob removal journal {}. Unfinished removals won't be resumed.", _journalPath.string());
+  }
+}
+
+void BlobRemovalQueue::_appendToJournal(char operation, const BlockId &blockId) {
+  _journal << operation << blockId.ToString() << '\n' << std::flush;
+}
+
+void BlobRemovalQueue::_appendItemToJournal(const Item &item) {
+  _journal << '+' << item.blockId.ToString() << '\n';
+  for (uint32_t i = 0; i < item.failedAttempts; ++i) {
+    _journal << '!' << item.blockId.ToString() << '\n';
+  }
+  _journal << std::flush;
+}
+
+}
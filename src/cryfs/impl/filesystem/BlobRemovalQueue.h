@@ -0,0 +1,77 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_BLOBREMOVALQUEUE_H_
+#define MESSMER_CRYFS_FILESYSTEM_BLOBREMOVALQUEUE_H_
+
+#include <blockstore/utils/BlockId.h>
+#include <boost/filesystem/path.hpp>
+#include <cpp-utils/macros.h>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cryfs {
+namespace parallelaccessfsblobstore {
+class ParallelAccessFsBlobStore;
+}
+
+// Removes blobs in background threads, so that removing a large file doesn't have to wait until all of its blocks
+// are removed. Queued blobs are recorded in a journal file, so that removals that didn't finish before the file system
+// was unmounted or crashed are resumed the next time it is mounted. A removal that fails is also retried the next time
+// the file system is mounted, up to MAX_ATTEMPTS times.
+class BlobRemovalQueue final {
+public:
+  static constexpr uint32_t NUM_WORKERS = 2;
+  static constexpr uint32_t MAX_ATTEMPTS = 3;
+
+  BlobRemovalQueue(parallelaccessfsblobstore::ParallelAccessFsBlobStore *fsBlobStore, boost::filesystem::path journalPath);
+  // Waits for the removals that are currently running. Blobs that are still queued stay in the journal.
+  ~BlobRemovalQueue();
+
+  // The blob has to be detached from its parent directory already.
+  void add(const blockstore::BlockId &blockId);
+  // Like add(), but only writes and flushes the journal once for all blobs
+  void add(const std::vector<blockstore::BlockId> &blockIds);
+
+  // Number of blobs that are queued or currently being removed
+  size_t size() const;
+
+private:
+  struct Item final {
+    blockstore::BlockId blockId;
+    // Items read from the journal could still be referenced if the directory entry removal wasn't written back
+    // before the file system crashed.
+    bool checkIfStillReferenced;
+    uint32_t failedAttempts;
+  };
+
+  void _runWorker();
+  void _remove(const Item &item);
+  bool _isStillReferenced(const blockstore::BlockId &blockId, const blockstore::BlockId &parent);
+
+  std::vector<Item> _loadJournal();
+  void _openJournal(std::ios::openmode mode);
+  void _appendToJournal(char operation, const blockstore::BlockId &blockId);
+  void _appendItemToJournal(const Item &item);
+
+  parallelaccessfsblobstore::ParallelAccessFsBlobStore *_fsBlobStore;
+  boost::filesystem::path _journalPath;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _itemAddedOrStopping;
+  std::deque<Item> _queue;
+  // Removals that failed in this session. They stay in the journal, so they're retried on the next mount.
+  std::vector<Item> _failed;
+  size_t _numRunning;
+  bool _stopping;
+  std::ofstream _journal;
+  std::vector<std::thread> _workers;
+
+  DISALLOW_COPY_AND_ASSIGN(BlobRemovalQueue);
+};
+
+}
+
+#endif
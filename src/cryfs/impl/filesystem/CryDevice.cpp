@@ -6,17 +6,21 @@
 #include "CryDir.h"
 #include "CryFile.h"
 #include "CrySymlink.h"
+#include "TreeOperations.h"
 
 #include <fspp/fs_interface/FuseErrnoException.h>
 #include <blobstore/implementations/onblocks/BlobStoreOnBlocks.h>
 #include <blobstore/implementations/onblocks/BlobOnBlocks.h>
+#include <blobstore/implementations/onblocks/datanodestore/DataNodeStore.h>
 #include <blockstore/implementations/low2highlevel/LowToHighLevelBlockStore.h>
 #include <blockstore/implementations/encrypted/EncryptedBlockStore2.h>
 #include <blockstore/implementations/integrity/IntegrityBlockStore2.h>
+#include <blockstore/implementations/instrumented/InstrumentedBlockStore2.h>
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/ParallelAccessFsBlobStore.h"
 #include "cryfs/impl/filesystem/cachingfsblobstore/CachingFsBlobStore.h"
 #include "cryfs/impl/config/CryCipher.h"
 #include <cpp-utils/system/homedir.h>
+#include <cpp-utils/system/time.h>
 #include <gitversion/VersionCompare.h>
 #include <blockstore/interface/BlockStore2.h>
 #include "cryfs/impl/localstate/LocalStateDir.h"
@@ -24,6 +28,7 @@
 
 
 using std::string;
+using std::vector;
 
 
 //TODO Get rid of this in favor of exception hierarchy
@@ -34,8 +39,10 @@ using blockstore::BlockId;
 using blobstore::BlobStore;
 using blockstore::lowtohighlevel::LowToHighLevelBlockStore;
 using blobstore::onblocks::BlobStoreOnBlocks;
+using blobstore::onblocks::datanodestore::DataNodeStore;
 using blockstore::caching::CachingBlockStore2;
 using blockstore::integrity::IntegrityBlockStore2;
+using blockstore::instrumented::InstrumentedBlockStore2;
 using cpputils::unique_ref;
 using cpputils::make_unique_ref;
 using cpputils::dynamic_pointer_move;
@@ -54,19 +61,36 @@ namespace bf = boost::filesystem;
 
 namespace cryfs {
 
-CryDevice::CryDevice(std::shared_ptr<CryConfigFile> configFile, unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation)
-: _fsBlobStore(CreateFsBlobStore(std::move(blockStore), configFile.get(), localStateDir, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation))),
+namespace {
+// Inner nodes are needed to find any leaf of a blob, so keep them in memory independently of the leaves passing
+// through the block cache. With 32KB blocks, this covers the inner nodes of about 64GB of file data.
+constexpr uint64_t INNER_NODE_CACHE_SIZE_BYTES = 32 * 1024 * 1024;
+// With large leaves, the 1000 entries of the block cache could hold gigabytes. This is about what they hold with
+// normal 32KB blocks.
+constexpr uint64_t BLOCK_CACHE_SIZE_BYTES = 32 * 1024 * 1024;
+
+unique_ref<BlockStore2> InstrumentIfEnabled(bool enabled, const string &name, unique_ref<BlockStore2> blockStore) {
+  if (!enabled) {
+    return blockStore;
+  }
+  return make_unique_ref<InstrumentedBlockStore2>(std::move(blockStore), name);
+}
+}
+
+CryDevice::CryDevice(std::shared_ptr<CryConfigFile> configFile, unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers)
+: _fsBlobStore(CreateFsBlobStore(std::move(blockStore), configFile.get(), localStateDir, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation), instrumentedLayers)),
   _rootBlobId(GetOrCreateRootBlobId(configFile.get())), _configFile(std::move(configFile)),
-  _onFsAction() {
+  _clonesSupported(ClonesSupported(*_configFile->config(), myClientId)), _onFsAction(), _dentryCache(),
+  _blobRemovalQueue(_fsBlobStore.get(), localStateDir.forFilesystemId(_configFile->config()->FilesystemId()) / "blobremovaljournal") {
 }
 
-unique_ref<parallelaccessfsblobstore::ParallelAccessFsBlobStore> CryDevice::CreateFsBlobStore(unique_ref<BlockStore2> blockStore, CryConfigFile *configFile, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation) {
-  auto blobStore = CreateBlobStore(std::move(blockStore), localStateDir, configFile, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation));
+unique_ref<parallelaccessfsblobstore::ParallelAccessFsBlobStore> CryDevice::CreateFsBlobStore(unique_ref<BlockStore2> blockStore, CryConfigFile *configFile, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers) {
+  auto blobStore = CreateBlobStore(std::move(blockStore), localStateDir, configFile, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation), instrumentedLayers);
 
 #ifndef CRYFS_NO_COMPATIBILITY
   auto fsBlobStore = MigrateOrCreateFsBlobStore(std::move(blobStore), configFile);
 #else
-  auto fsBlobStore = make_unique_ref<FsBlobStore>(std::move(blobStore));
+  auto fsBlobStore = make_unique_ref<FsBlobStore>(std::move(blobStore), HashedDirectories(*configFile->config()), !configFile->config()->UsesLegacyFormat());
 #endif
 
   return make_unique_ref<ParallelAccessFsBlobStore>(
@@ -79,35 +103,56 @@ unique_ref<parallelaccessfsblobstore::ParallelAccessFsBlobStore> CryDevice::Crea
 #ifndef CRYFS_NO_COMPATIBILITY
 unique_ref<fsblobstore::FsBlobStore> CryDevice::MigrateOrCreateFsBlobStore(unique_ref<BlobStore> blobStore, CryConfigFile *configFile) {
   const string rootBlobId = configFile->config()->RootBlob();
+  const bool hashedDirectories = HashedDirectories(*configFile->config());
+  const bool sizeHints = !configFile->config()->UsesLegacyFormat();
   if ("" == rootBlobId) {
-    return make_unique_ref<FsBlobStore>(std::move(blobStore));
+    return make_unique_ref<FsBlobStore>(std::move(blobStore), hashedDirectories, sizeHints);
   }
   if (!configFile->config()->HasParentPointers()) {
-    auto result = FsBlobStore::migrate(std::move(blobStore), BlockId::FromString(rootBlobId));
+    auto result = FsBlobStore::migrate(std::move(blobStore), BlockId::FromString(rootBlobId), hashedDirectories, sizeHints);
     // Don't migrate again if it was successful
     configFile->config()->SetHasParentPointers(true);
     configFile->save();
     return result;
   }
-  return make_unique_ref<FsBlobStore>(std::move(blobStore));
+  return make_unique_ref<FsBlobStore>(std::move(blobStore), hashedDirectories, sizeHints);
 }
 #endif
 
-unique_ref<blobstore::BlobStore> CryDevice::CreateBlobStore(unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation) {
-  auto integrityEncryptedBlockStore = CreateIntegrityEncryptedBlockStore(std::move(blockStore), localStateDir, configFile, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation));
+unique_ref<blobstore::BlobStore> CryDevice::CreateBlobStore(unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers) {
+  auto integrityEncryptedBlockStore = CreateIntegrityEncryptedBlockStore(std::move(blockStore), localStateDir, configFile, myClientId, allowIntegrityViolations, missingBlockIsIntegrityViolation, std::move(onIntegrityViolation), instrumentedLayers);
   // Create integrityEncryptedBlockStore not in the same line as BlobStoreOnBlocks, because it can modify BlocksizeBytes
   // in the configFile and therefore has to be run before the second parameter to the BlobStoreOnBlocks parameter is evaluated.
   return make_unique_ref<BlobStoreOnBlocks>(
      make_unique_ref<LowToHighLevelBlockStore>(
-         make_unique_ref<CachingBlockStore2>(
-             std::move(integrityEncryptedBlockStore)
-         )
+         InstrumentIfEnabled(instrumentedLayers.caching, "caching", make_unique_ref<CachingBlockStore2>(
+             std::move(integrityEncryptedBlockStore),
+             &DataNodeStore::isInnerNode,
+             INNER_NODE_CACHE_SIZE_BYTES,
+             BLOCK_CACHE_SIZE_BYTES
+         ))
      ),
-     configFile->config()->BlocksizeBytes());
+     configFile->config()->BlocksizeBytes(),
+     configFile->config()->UsesLegacyFormat() ? none : configFile->config()->LargeLeafBlocksizeBytes(),
+     localStateDir.forFilesystemId(configFile->config()->FilesystemId()) / "blockrefcounts",
+     configFile->config()->UsesLegacyFormat());
+}
+
+bool CryDevice::HashedDirectories(const CryConfig &config) {
+  // Only new file systems set the flag, but older versions can't read hashed directories, so never trust it in the legacy format
+  return config.HashedDirectories() && !config.UsesLegacyFormat();
+}
+
+bool CryDevice::ClonesSupported(const CryConfig &config, uint32_t myClientId) {
+  // Clones share blocks, which is tracked in block reference counts that are only stored in the local state dir.
+  // Another client wouldn't see them and could free blocks that a clone still uses. So only allow clones if
+  // this client is the only one that can ever access the file system.
+  return config.ExclusiveClientId() == myClientId && !config.UsesLegacyFormat();
 }
 
-unique_ref<BlockStore2> CryDevice::CreateIntegrityEncryptedBlockStore(unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation) {
-  auto encryptedBlockStore = CreateEncryptedBlockStore(*configFile->config(), std::move(blockStore));
+unique_ref<BlockStore2> CryDevice::CreateIntegrityEncryptedBlockStore(unique_ref<BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers) {
+  auto encryptedBlockStore = InstrumentIfEnabled(instrumentedLayers.encrypted, "encrypted",
+      CreateEncryptedBlockStore(*configFile->config(), InstrumentIfEnabled(instrumentedLayers.onDisk, "ondisk", std::move(blockStore))));
   auto statePath = localStateDir.forFilesystemId(configFile->config()->FilesystemId());
   auto integrityFilePath = statePath / "integritydata";
 
@@ -122,9 +167,10 @@ unique_ref<BlockStore2> CryDevice::CreateIntegrityEncryptedBlockStore(unique_ref
 #endif
 
   try {
-    return make_unique_ref<IntegrityBlockStore2>(std::move(encryptedBlockStore), integrityFilePath, myClientId,
-                                                 allowIntegrityViolations, missingBlockIsIntegrityViolation,
-                                                 std::move(onIntegrityViolation));
+    return InstrumentIfEnabled(instrumentedLayers.integrity, "integrity",
+        make_unique_ref<IntegrityBlockStore2>(std::move(encryptedBlockStore), integrityFilePath, myClientId,
+                                              allowIntegrityViolations, missingBlockIsIntegrityViolation,
+                                              std::move(onIntegrityViolation)));
   } catch (const blockstore::integrity::IntegrityViolationOnPreviousRun& e) {
     throw CryfsException(string() +
                         "There was an integrity violation detected. Preventing any further access to the file system. " +
@@ -194,26 +240,24 @@ optional<unique_ref<fspp::Node>> CryDevice::Load(const bf::path &path) {
     return optional<unique_ref<fspp::Node>>(make_unique_ref<CryDir>(this, none, none, _rootBlobId));
   }
 
-  auto parentWithAncestors = LoadDirBlobWithAncestors(path.parent_path(), [](const BlockId&){});
-  if (parentWithAncestors == none) {
+  auto resolved = ResolvePath(path, [](const BlockId&){});
+  if (resolved == none) {
     return none;
   }
-  auto parent = std::move(parentWithAncestors->blob);
-  auto grandparent = std::move(parentWithAncestors->parent);
-
-  auto optEntry = parent->GetChild(path.filename().string());
-  if (optEntry == boost::none) {
-    return boost::none;
+  ASSERT(resolved->parent != none, "Only the root directory doesn't have a parent");
+  auto parent = LoadDirBlob(*resolved->parent);
+  optional<unique_ref<DirBlobRef>> grandparent = none;
+  if (resolved->grandparent != none) {
+    grandparent = LoadDirBlob(*resolved->grandparent);
   }
-  const auto &entry = *optEntry;
 
-  switch(entry.type()) {
+  switch(resolved->type) {
     case fspp::Dir::EntryType::DIR:
-      return optional<unique_ref<fspp::Node>>(make_unique_ref<CryDir>(this, std::move(parent), std::move(grandparent), entry.blockId()));
+      return optional<unique_ref<fspp::Node>>(make_unique_ref<CryDir>(this, std::move(parent), std::move(grandparent), resolved->blockId));
     case fspp::Dir::EntryType::FILE:
-      return optional<unique_ref<fspp::Node>>(make_unique_ref<CryFile>(this, std::move(parent), std::move(grandparent), entry.blockId()));
+      return optional<unique_ref<fspp::Node>>(make_unique_ref<CryFile>(this, std::move(parent), std::move(grandparent), resolved->blockId));
     case  fspp::Dir::EntryType::SYMLINK:
-	  return optional<unique_ref<fspp::Node>>(make_unique_ref<CrySymlink>(this, std::move(parent), std::move(grandparent), entry.blockId()));
+	  return optional<unique_ref<fspp::Node>>(make_unique_ref<CrySymlink>(this, std::move(parent), std::move(grandparent), resolved->blockId));
   }
   ASSERT(false, "Switch/case not exhaustive");
 }
@@ -231,43 +275,79 @@ optional<CryDevice::DirBlobWithAncestors> CryDevice::LoadDirBlobWithAncestors(co
 }
 
 optional<CryDevice::BlobWithAncestors> CryDevice::LoadBlobWithAncestors(const bf::path &path, std::function<void (const blockstore::BlockId&)> ancestor_callback) {
+  auto resolved = ResolvePath(path, std::move(ancestor_callback));
+  if (resolved == none) {
+    return none;
+  }
+  unique_ref<FsBlobRef> blob = LoadBlob(resolved->blockId);
   optional<unique_ref<DirBlobRef>> parentBlob = none;
-  optional<unique_ref<FsBlobRef>> currentBlobOpt = _fsBlobStore->load(_rootBlobId);
-  if (currentBlobOpt == none) {
-    LOG(ERR, "Could not load root blob. Is the base directory accessible?");
-    throw FuseErrnoException(EIO);
+  if (resolved->parent == none) {
+    ASSERT(blob->parentPointer() == BlockId::Null(), "Root Blob should have a nullptr as parent");
+  } else {
+    parentBlob = LoadDirBlob(*resolved->parent);
+    ASSERT(blob->parentPointer() == (*parentBlob)->blockId(), "Blob has wrong parent pointer");
   }
-  unique_ref<FsBlobRef> currentBlob = std::move(*currentBlobOpt);
-  ASSERT(currentBlob->parentPointer() == BlockId::Null(), "Root Blob should have a nullptr as parent");
 
+  return BlobWithAncestors{std::move(blob), std::move(parentBlob)};
+
+  //TODO (I think this is resolved, but I should test it)
+  //     Running the python script, waiting for "Create files in sequential order...", then going into dir ~/tmp/cryfs-mount-.../Bonnie.../ and calling "ls"
+  //     crashes cryfs with a sigsegv.
+  //     Possible reason: Many parallel changes to a directory blob are a race condition. Need something like ParallelAccessStore!
+}
+
+optional<CryDevice::ResolvedPath> CryDevice::ResolvePath(const bf::path &path, std::function<void (const blockstore::BlockId&)> ancestor_callback) {
+  // Path components are resolved using the dentry cache, so only directories with uncached entries have to be loaded.
+  ResolvedPath result{_rootBlobId, fspp::Dir::EntryType::DIR, none, none};
   for (const bf::path &component : path.relative_path()) {
-    ancestor_callback(currentBlob->blockId());
-    auto currentDir = dynamic_pointer_move<DirBlobRef>(currentBlob);
-    if (currentDir == none) {
+    ancestor_callback(result.blockId);
+    if (result.type != fspp::Dir::EntryType::DIR) {
       throw FuseErrnoException(ENOTDIR); // Path component is not a dir
     }
-
-    auto childOpt = (*currentDir)->GetChild(component.string());
-    if (childOpt == boost::none) {
+    auto child = LookupChild(result.blockId, component.string());
+    if (child == none) {
       // Child entry in directory not found
       return none;
     }
-    const BlockId childId = childOpt->blockId();
-    auto nextBlob = _fsBlobStore->load(childId);
-    if (nextBlob == none) {
-      throw FuseErrnoException(EIO); // Blob for directory entry not found
-    }
-    parentBlob = std::move(*currentDir);
-    currentBlob = std::move(*nextBlob);
-    ASSERT(currentBlob->parentPointer() == (*parentBlob)->blockId(), "Blob has wrong parent pointer");
+    result.grandparent = result.parent;
+    result.parent = result.blockId;
+    result.blockId = child->blockId;
+    result.type = child->type;
   }
+  return result;
+}
 
-  return BlobWithAncestors{std::move(currentBlob), std::move(parentBlob)};
+optional<DentryCache::Entry> CryDevice::LookupChild(const BlockId &parent, const string &name) {
+  auto cached = _dentryCache.lookup(parent, name);
+  if (cached != none) {
+    return *cached;
+  }
+  const uint64_t generation = _dentryCache.generation();
+  auto parentDir = LoadDirBlob(parent);
+  auto child = parentDir->GetChild(name);
+  optional<DentryCache::Entry> result = none;
+  if (child != none) {
+    result = DentryCache::Entry{child->blockId(), child->type()};
+  }
+  _dentryCache.insert(generation, parent, name, result);
+  return result;
+}
 
-  //TODO (I think this is resolved, but I should test it)
-  //     Running the python script, waiting for "Create files in sequential order...", then going into dir ~/tmp/cryfs-mount-.../Bonnie.../ and calling "ls"
-  //     crashes cryfs with a sigsegv.
-  //     Possible reason: Many parallel changes to a directory blob are a race condition. Need something like ParallelAccessStore!
+unique_ref<DirBlobRef> CryDevice::LoadDirBlob(const BlockId &blockId) {
+  auto blob = LoadBlob(blockId);
+  auto dir = dynamic_pointer_move<DirBlobRef>(blob);
+  if (dir == none) {
+    throw FuseErrnoException(ENOTDIR); // Loaded blob is not a directory
+  }
+  return std::move(*dir);
+}
+
+void CryDevice::InvalidateDentry(const BlockId &parent, const string &name) {
+  _dentryCache.invalidate(parent, name);
+}
+
+void CryDevice::InvalidateDentryOf(const BlockId &child) {
+  _dentryCache.invalidateChild(child);
 }
 
 CryDevice::statvfs CryDevice::statfs() {
@@ -295,6 +375,14 @@ unique_ref<FileBlobRef> CryDevice::CreateFileBlob(const blockstore::BlockId &par
   return _fsBlobStore->createFileBlob(parent);
 }
 
+unique_ref<FileBlobRef> CryDevice::CopyFileBlob(const FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied) {
+  return _fsBlobStore->createFileBlobAsCopyOf(source, parent, onBlockCopied);
+}
+
+unique_ref<FileBlobRef> CryDevice::CloneFileBlob(const FileBlobRef &source, const blockstore::BlockId &parent) {
+  return _fsBlobStore->createFileBlobAsCloneOf(source, parent);
+}
+
 unique_ref<DirBlobRef> CryDevice::CreateDirBlob(const blockstore::BlockId &parent) {
   return _fsBlobStore->createDirBlob(parent);
 }
@@ -313,12 +401,112 @@ unique_ref<FsBlobRef> CryDevice::LoadBlob(const blockstore::BlockId &blockId) {
 }
 
 void CryDevice::RemoveBlob(const blockstore::BlockId &blockId) {
-  auto blob = _fsBlobStore->load(blockId);
-  if (blob == none) {
-    LOG(ERR, "Could not load blob {}. Is the base directory accessible?", blockId.ToString());
-    throw FuseErrnoException(EIO);
+  _blobRemovalQueue.add(blockId);
+}
+
+void CryDevice::RemoveBlobs(const vector<blockstore::BlockId> &blockIds) {
+  _blobRemovalQueue.add(blockIds);
+}
+
+void CryDevice::removeTree(const bf::path &path, const ProgressCallback &progress) {
+  callFsActionCallbacks();
+  if (path.parent_path().empty()) {
+    throw FuseErrnoException(EBUSY); // Can't remove the root directory
+  }
+  auto parent = LoadDirBlobWithAncestors(path.parent_path(), [](const BlockId&){});
+  if (parent == none) {
+    throw FuseErrnoException(ENOENT);
+  }
+  auto entry = parent->blob->GetChild(path.filename().string());
+  if (entry == none) {
+    throw FuseErrnoException(ENOENT);
+  }
+  if (parent->parent != none) {
+    //TODO Instead of doing nothing when we're in the root directory, handle timestamps in the root dir correctly
+    (*parent->parent)->updateModificationTimestampForChild(parent->blob->blockId(), cpputils::time::now());
+  }
+  TreeOperations(this, progress).removeTree(parent->blob.get(), *entry);
+}
+
+void CryDevice::copyTree(const bf::path &from, const bf::path &to, const ProgressCallback &progress) {
+  CopyNode(from, to, progress, CopyMode::TREE);
+}
+
+void CryDevice::copyFile(const bf::path &from, const bf::path &to) {
+  CopyNode(from, to, ProgressCallback(), CopyMode::FILE);
+}
+
+void CryDevice::cloneFile(const bf::path &from, const bf::path &to) {
+  if (!_clonesSupported) {
+    throw FuseErrnoException(EOPNOTSUPP);
+  }
+  CopyNode(from, to, ProgressCallback(), CopyMode::FILE_CLONE);
+}
+
+void CryDevice::CopyNode(const bf::path &from, const bf::path &to, const ProgressCallback &progress, CopyMode mode) {
+  callFsActionCallbacks();
+  if (to.parent_path().empty()) {
+    throw FuseErrnoException(EEXIST);
+  }
+  for (bf::path ancestor = to; !ancestor.empty(); ancestor = ancestor.parent_path()) {
+    if (ancestor == from) {
+      throw FuseErrnoException(EINVAL); // Can't copy a directory into itself
+    }
+  }
+  auto sourceParent = LoadDirBlobWithAncestors(from.parent_path(), [](const BlockId&){});
+  if (sourceParent == none) {
+    throw FuseErrnoException(ENOENT);
+  }
+  auto source = sourceParent->blob->GetChild(from.filename().string());
+  if (source == none) {
+    throw FuseErrnoException(ENOENT);
+  }
+  if (mode != CopyMode::TREE && source->type() != fspp::Dir::EntryType::FILE) {
+    throw FuseErrnoException((source->type() == fspp::Dir::EntryType::DIR) ? EISDIR : EINVAL);
+  }
+  auto targetParent = LoadDirBlobWithAncestors(to.parent_path(), [](const BlockId&){});
+  if (targetParent == none) {
+    throw FuseErrnoException(ENOENT);
+  }
+  const string name = to.filename().string();
+  if (targetParent->blob->GetChild(name) != none) {
+    throw FuseErrnoException(EEXIST);
+  }
+
+  if (mode == CopyMode::TREE) {
+    TreeOperations operations(this, progress);
+    const BlockId copy = operations.copyTree(*source, targetParent->blob->blockId());
+    try {
+      TreeOperations::addCopiedEntry(targetParent->blob.get(), name, *source, copy);
+    } catch (...) {
+      // Somebody else created an entry with that name in the meantime
+      operations.removeDetachedTree(copy, source->type());
+      throw;
+    }
+  } else {
+    // A single file is copied by the block store layers, which parallelize it themselves, so there's no need for
+    // the thread pool of TreeOperations. Without a progress callback, there's also nothing to cancel.
+    auto loaded = LoadBlob(source->blockId());
+    auto sourceBlob = dynamic_pointer_move<FileBlobRef>(loaded);
+    if (sourceBlob == none) {
+      throw FuseErrnoException(EIO);
+    }
+    const BlockId copy = (mode == CopyMode::FILE_CLONE)
+        ? CloneFileBlob(**sourceBlob, targetParent->blob->blockId())->blockId()
+        : CopyFileBlob(**sourceBlob, targetParent->blob->blockId(), [] {})->blockId();
+    try {
+      TreeOperations::addCopiedEntry(targetParent->blob.get(), name, *source, copy);
+    } catch (...) {
+      // Somebody else created an entry with that name in the meantime
+      RemoveBlob(copy);
+      throw;
+    }
+  }
+  InvalidateDentry(targetParent->blob->blockId(), name);
+  if (targetParent->parent != none) {
+    //TODO Instead of doing nothing when we're in the root directory, handle timestamps in the root dir correctly
+    (*targetParent->parent)->updateModificationTimestampForChild(targetParent->blob->blockId(), cpputils::time::now());
   }
-  _fsBlobStore->remove(std::move(*blob));
 }
 
 BlockId CryDevice::GetOrCreateRootBlobId(CryConfigFile *configFile) {
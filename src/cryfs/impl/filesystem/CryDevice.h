@@ -14,17 +14,32 @@
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/DirBlobRef.h"
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/FileBlobRef.h"
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/SymlinkBlobRef.h"
+#include "DentryCache.h"
+#include "BlobRemovalQueue.h"
 
 
 namespace cryfs {
 
+// Block store layers that get wrapped in an InstrumentedBlockStore2, so that their latency shows up in the metrics.
+// Each one measures the time spent in the layer and all layers below it.
+struct InstrumentedLayers final {
+  bool onDisk = false;
+  bool encrypted = false;
+  bool integrity = false;
+  bool caching = false;
+};
+
 class CryDevice final: public fspp::Device {
 public:
-  CryDevice(std::shared_ptr<CryConfigFile> config, cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void ()> onIntegrityViolation);
+  CryDevice(std::shared_ptr<CryConfigFile> config, cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void ()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers);
 
   statvfs statfs() override;
 
   cpputils::unique_ref<parallelaccessfsblobstore::FileBlobRef> CreateFileBlob(const blockstore::BlockId &parent);
+  // The copy isn't added to the parent directory yet. See blobstore::BlobStore::createCopyOf() for onBlockCopied.
+  cpputils::unique_ref<parallelaccessfsblobstore::FileBlobRef> CopyFileBlob(const parallelaccessfsblobstore::FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied);
+  // Like CopyFileBlob(), but the clone shares the blocks of the source until one of them is modified
+  cpputils::unique_ref<parallelaccessfsblobstore::FileBlobRef> CloneFileBlob(const parallelaccessfsblobstore::FileBlobRef &source, const blockstore::BlockId &parent);
   cpputils::unique_ref<parallelaccessfsblobstore::DirBlobRef> CreateDirBlob(const blockstore::BlockId &parent);
   cpputils::unique_ref<parallelaccessfsblobstore::SymlinkBlobRef> CreateSymlinkBlob(const boost::filesystem::path &target, const blockstore::BlockId &parent);
   cpputils::unique_ref<parallelaccessfsblobstore::FsBlobRef> LoadBlob(const blockstore::BlockId &blockId);
@@ -33,7 +48,14 @@ public:
     boost::optional<cpputils::unique_ref<parallelaccessfsblobstore::DirBlobRef>> parent;
   };
   boost::optional<DirBlobWithAncestors> LoadDirBlobWithAncestors(const boost::filesystem::path &path, std::function<void (const blockstore::BlockId&)> ancestor_callback);
+  // Only queues the blob for removal, its blocks are removed in the background.
+  // The blob has to be detached from its parent directory already.
   void RemoveBlob(const blockstore::BlockId &blockId);
+  void RemoveBlobs(const std::vector<blockstore::BlockId> &blockIds);
+
+  // Have to be called after modifying a directory entry, so that path lookups don't use outdated cached entries
+  void InvalidateDentry(const blockstore::BlockId &parent, const std::string &name);
+  void InvalidateDentryOf(const blockstore::BlockId &child);
 
   void onFsAction(std::function<void()> callback);
 
@@ -42,6 +64,11 @@ public:
   boost::optional<cpputils::unique_ref<fspp::Dir>> LoadDir(const boost::filesystem::path &path) override;
   boost::optional<cpputils::unique_ref<fspp::Symlink>> LoadSymlink(const boost::filesystem::path &path) override;
 
+  void removeTree(const boost::filesystem::path &path, const ProgressCallback &progress) override;
+  void copyTree(const boost::filesystem::path &from, const boost::filesystem::path &to, const ProgressCallback &progress) override;
+  void copyFile(const boost::filesystem::path &from, const boost::filesystem::path &to) override;
+  void cloneFile(const boost::filesystem::path &from, const boost::filesystem::path &to) override;
+
   const CryConfig &config() const;
   void callFsActionCallbacks() const;
 
@@ -53,16 +80,28 @@ private:
 
   blockstore::BlockId _rootBlobId;
   std::shared_ptr<CryConfigFile> _configFile;
+  const bool _clonesSupported;
   std::vector<std::function<void()>> _onFsAction;
+  DentryCache _dentryCache;
+  // Has to be destructed before _fsBlobStore, it removes blobs from it in background threads
+  BlobRemovalQueue _blobRemovalQueue;
 
   blockstore::BlockId GetOrCreateRootBlobId(CryConfigFile *config);
   blockstore::BlockId CreateRootBlobAndReturnId();
-  static cpputils::unique_ref<parallelaccessfsblobstore::ParallelAccessFsBlobStore> CreateFsBlobStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, CryConfigFile *configFile, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation);
+  enum class CopyMode {
+    TREE, // copyTree()
+    FILE, // copyFile()
+    FILE_CLONE // cloneFile()
+  };
+  void CopyNode(const boost::filesystem::path &from, const boost::filesystem::path &to, const ProgressCallback &progress, CopyMode mode);
+  static cpputils::unique_ref<parallelaccessfsblobstore::ParallelAccessFsBlobStore> CreateFsBlobStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, CryConfigFile *configFile, const LocalStateDir& localStateDir, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers);
 #ifndef CRYFS_NO_COMPATIBILITY
   static cpputils::unique_ref<fsblobstore::FsBlobStore> MigrateOrCreateFsBlobStore(cpputils::unique_ref<blobstore::BlobStore> blobStore, CryConfigFile *configFile);
 #endif
-  static cpputils::unique_ref<blobstore::BlobStore> CreateBlobStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation);
-  static cpputils::unique_ref<blockstore::BlockStore2> CreateIntegrityEncryptedBlockStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation);
+  static bool HashedDirectories(const CryConfig &config);
+  static bool ClonesSupported(const CryConfig &config, uint32_t myClientId);
+  static cpputils::unique_ref<blobstore::BlobStore> CreateBlobStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers);
+  static cpputils::unique_ref<blockstore::BlockStore2> CreateIntegrityEncryptedBlockStore(cpputils::unique_ref<blockstore::BlockStore2> blockStore, const LocalStateDir& localStateDir, CryConfigFile *configFile, uint32_t myClientId, bool allowIntegrityViolations, bool missingBlockIsIntegrityViolation, std::function<void()> onIntegrityViolation, const InstrumentedLayers &instrumentedLayers);
   static cpputils::unique_ref<blockstore::BlockStore2> CreateEncryptedBlockStore(const CryConfig &config, cpputils::unique_ref<blockstore::BlockStore2> baseBlockStore);
 
   struct BlobWithAncestors {
@@ -71,6 +110,16 @@ private:
   };
   boost::optional<BlobWithAncestors> LoadBlobWithAncestors(const boost::filesystem::path &path, std::function<void (const blockstore::BlockId&)> ancestor_callback);
 
+  struct ResolvedPath {
+    blockstore::BlockId blockId;
+    fspp::Dir::EntryType type;
+    boost::optional<blockstore::BlockId> parent;
+    boost::optional<blockstore::BlockId> grandparent;
+  };
+  boost::optional<ResolvedPath> ResolvePath(const boost::filesystem::path &path, std::function<void (const blockstore::BlockId&)> ancestor_callback);
+  boost::optional<DentryCache::Entry> LookupChild(const blockstore::BlockId &parent, const std::string &name);
+  cpputils::unique_ref<parallelaccessfsblobstore::DirBlobRef> LoadDirBlob(const blockstore::BlockId &blockId);
+
   DISALLOW_COPY_AND_ASSIGN(CryDevice);
 };
 
@@ -8,7 +8,11 @@
 #include "CryDevice.h"
 #include "CryFile.h"
 #include "CryOpenFile.h"
+#include "entry_helper.h"
 #include <cpp-utils/system/time.h>
+#include <cpp-utils/logging/logging.h>
+#include <cpp-utils/thread/parallel.h>
+#include <atomic>
 
 //TODO Get rid of this in favor of exception hierarchy
 using fspp::fuse::FuseErrnoException;
@@ -25,6 +29,7 @@ using cpputils::dynamic_pointer_move;
 using boost::optional;
 using boost::none;
 using cryfs::parallelaccessfsblobstore::DirBlobRef;
+using namespace cpputils::logging;
 
 namespace cryfs {
 
@@ -39,12 +44,13 @@ unique_ref<fspp::OpenFile> CryDir::createAndOpenFile(const string &name, fspp::m
   device()->callFsActionCallbacks();
   if (!isRootDir()) {
     //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
-    parent()->updateModificationTimestampForChild(blockId());
+    parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
   }
   auto child = device()->CreateFileBlob(blockId());
   auto now = cpputils::time::now();
   auto dirBlob = LoadBlob();
   dirBlob->AddChildFile(name, child->blockId(), mode, uid, gid, now, now);
+  device()->InvalidateDentry(blockId(), name);
   return make_unique_ref<CryOpenFile>(device(), std::move(dirBlob), std::move(child));
 }
 
@@ -52,12 +58,13 @@ void CryDir::createDir(const string &name, fspp::mode_t mode, fspp::uid_t uid, f
   device()->callFsActionCallbacks();
   if (!isRootDir()) {
     //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
-    parent()->updateModificationTimestampForChild(blockId());
+    parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
   }
   auto blob = LoadBlob();
   auto child = device()->CreateDirBlob(blockId());
   auto now = cpputils::time::now();
   blob->AddChildDir(name, child->blockId(), mode, uid, gid, now, now);
+  device()->InvalidateDentry(blockId(), name);
 }
 
 unique_ref<DirBlobRef> CryDir::LoadBlob() const {
@@ -71,7 +78,7 @@ vector<fspp::Dir::Entry> CryDir::children() {
   device()->callFsActionCallbacks();
   if (!isRootDir()) { // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
     //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
-    parent()->updateAccessTimestampForChild(blockId(), timestampUpdateBehavior());
+    parent()->updateAccessTimestampForChild(blockId(), timestampUpdateBehavior(), cpputils::time::now());
   }
   vector<fspp::Dir::Entry> children;
   children.push_back(fspp::Dir::Entry(fspp::Dir::EntryType::DIR, "."));
@@ -81,6 +88,56 @@ vector<fspp::Dir::Entry> CryDir::children() {
   return children;
 }
 
+vector<fspp::Dir::EntryWithStat> CryDir::childrenWithStat() {
+  device()->callFsActionCallbacks();
+  if (!isRootDir()) { // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
+    //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
+    parent()->updateAccessTimestampForChild(blockId(), timestampUpdateBehavior(), cpputils::time::now());
+  }
+  vector<fsblobstore::DirEntry> entries;
+  LoadBlob()->AppendChildEntriesTo(&entries);
+  const vector<fspp::num_bytes_t> sizes = _loadSizes(entries);
+  vector<fspp::Dir::EntryWithStat> children;
+  children.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    children.emplace_back(entries[i].type(), entries[i].name(), dirEntryToStatInfo(entries[i], sizes[i]));
+  }
+  return children;
+}
+
+vector<fspp::num_bytes_t> CryDir::_loadSizes(const vector<fsblobstore::DirEntry> &entries) {
+  // The size of a directory is constant and files usually have a size hint in their entry, but the size of symlinks
+  // and of files that are being written to is only known after loading their blob.
+  // Load them in parallel, so that the latency of loading the blobs doesn't add up.
+  vector<fspp::num_bytes_t> sizes(entries.size(), fsblobstore::DirBlob::DIR_LSTAT_SIZE);
+  vector<size_t> toLoad;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].sizeHint() != boost::none) {
+      sizes[i] = *entries[i].sizeHint();
+    } else if (entries[i].type() != fspp::Dir::EntryType::DIR) {
+      toLoad.push_back(i);
+    }
+  }
+  std::atomic<size_t> next(0);
+  auto loadNext = [&] {
+    for (size_t task = next++; task < toLoad.size(); task = next++) {
+      const fsblobstore::DirEntry &entry = entries[toLoad[task]];
+      try {
+        sizes[toLoad[task]] = device()->LoadBlob(entry.blockId())->lstat_size();
+      } catch (const FuseErrnoException &e) {
+        // Don't let a single broken entry make the whole directory unlistable
+        LOG(ERR, "Could not load size of {}: errno {}", entry.name(), e.getErrno());
+        sizes[toLoad[task]] = fspp::num_bytes_t(0);
+      } catch (const std::exception &e) {
+        LOG(ERR, "Could not load size of {}: {}", entry.name(), e.what());
+        sizes[toLoad[task]] = fspp::num_bytes_t(0);
+      }
+    }
+  };
+  cpputils::runInParallel(toLoad.size(), loadNext);
+  return sizes;
+}
+
 size_t CryDir::numChildren() {
   auto blob = LoadBlob();
   return blob->NumChildren();
@@ -95,19 +152,113 @@ void CryDir::createSymlink(const string &name, const bf::path &target, fspp::uid
   device()->callFsActionCallbacks();
   if (!isRootDir()) {
     //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
-    parent()->updateModificationTimestampForChild(blockId());
+    parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
   }
   auto blob = LoadBlob();
   auto child = device()->CreateSymlinkBlob(target, blockId());
   auto now = cpputils::time::now();
   blob->AddChildSymlink(name, child->blockId(), uid, gid, now, now);
+  device()->InvalidateDentry(blockId(), name);
+}
+
+vector<int> CryDir::createDirs(const vector<string> &names, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, bool existingDirsAreOk) {
+  device()->callFsActionCallbacks();
+  vector<int> results(names.size(), 0);
+  bool createdAny = false;
+  {
+    auto blob = LoadBlob();
+    for (size_t i = 0; i < names.size(); ++i) {
+      try {
+        auto existing = blob->GetChild(names[i]);
+        if (existing != none) {
+          if (!existingDirsAreOk || existing->type() != fspp::Dir::EntryType::DIR) {
+            results[i] = EEXIST;
+          }
+          continue;
+        }
+        auto child = device()->CreateDirBlob(blockId());
+        auto now = cpputils::time::now();
+        blob->AddChildDir(names[i], child->blockId(), mode, uid, gid, now, now);
+        device()->InvalidateDentry(blockId(), names[i]);
+        createdAny = true;
+      } catch (const FuseErrnoException &e) {
+        results[i] = e.getErrno();
+      }
+    }
+  }
+  if (createdAny && !isRootDir()) {
+    //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
+    parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
+  }
+  return results;
+}
+
+vector<int> CryDir::removeChildren(const vector<string> &names) {
+  device()->callFsActionCallbacks();
+  vector<int> results(names.size(), 0);
+  bool removedAny = false;
+  {
+    auto blob = LoadBlob();
+    for (size_t i = 0; i < names.size(); ++i) {
+      try {
+        auto child = blob->GetChild(names[i]);
+        if (child == none) {
+          results[i] = ENOENT;
+          continue;
+        }
+        const BlockId childId = child->blockId();
+        if (child->type() == fspp::Dir::EntryType::DIR) {
+          auto childBlob = device()->LoadBlob(childId);
+          auto childDirBlob = dynamic_pointer_move<DirBlobRef>(childBlob);
+          ASSERT(childDirBlob != none, "Blob does not store a directory");
+          if (0 != (*childDirBlob)->NumChildren()) {
+            results[i] = ENOTEMPTY;
+            continue;
+          }
+        }
+        blob->RemoveChild(childId);
+        device()->InvalidateDentryOf(childId);
+        device()->RemoveBlob(childId);
+        removedAny = true;
+      } catch (const FuseErrnoException &e) {
+        results[i] = e.getErrno();
+      }
+    }
+  }
+  if (removedAny && !isRootDir()) {
+    //TODO Instead of doing nothing when we're the root directory, handle timestamps in the root dir correctly (and delete isRootDir() function)
+    parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
+  }
+  return results;
+}
+
+vector<optional<fspp::stat_info>> CryDir::statChildren(const vector<string> &names) {
+  device()->callFsActionCallbacks();
+  vector<fsblobstore::DirEntry> entries;
+  vector<size_t> found;
+  {
+    auto blob = LoadBlob();
+    for (size_t i = 0; i < names.size(); ++i) {
+      auto entry = blob->GetChild(names[i]);
+      if (entry != none) {
+        entries.push_back(std::move(*entry));
+        found.push_back(i);
+      }
+    }
+  }
+  const vector<fspp::num_bytes_t> sizes = _loadSizes(entries);
+  vector<optional<fspp::stat_info>> results(names.size(), none);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    results[found[i]] = dirEntryToStatInfo(entries[i], sizes[i]);
+  }
+  return results;
 }
 
 void CryDir::remove() {
   device()->callFsActionCallbacks();
   if (grandparent() != none) {
     //TODO Instead of doing nothing when we're in the root directory, handle timestamps in the root dir correctly
-    (*grandparent())->updateModificationTimestampForChild(parent()->blockId());
+    (*grandparent())->updateModificationTimestampForChild(parent()->blockId(), cpputils::time::now());
   }
   {
     auto blob = LoadBlob();
@@ -115,7 +266,6 @@ void CryDir::remove() {
       throw FuseErrnoException(ENOTEMPTY);
     }
   }
-  //TODO removeNode() calls CryDevice::RemoveBlob, which loads the blob again. So we're loading it twice. Should be optimized.
   removeNode();
 }
 
@@ -17,9 +17,13 @@ public:
   cpputils::unique_ref<fspp::OpenFile> createAndOpenFile(const std::string &name, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid) override;
   void createDir(const std::string &name, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid) override;
   void createSymlink(const std::string &name, const boost::filesystem::path &target, fspp::uid_t uid, fspp::gid_t gid) override;
+  std::vector<int> createDirs(const std::vector<std::string> &names, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, bool existingDirsAreOk) override;
+  std::vector<int> removeChildren(const std::vector<std::string> &names) override;
+  std::vector<boost::optional<fspp::stat_info>> statChildren(const std::vector<std::string> &names) override;
 
   //TODO Make Entry a public class instead of hidden in DirBlob (which is not publicly visible)
   std::vector<fspp::Dir::Entry> children() override;
+  std::vector<fspp::Dir::EntryWithStat> childrenWithStat() override;
   size_t numChildren();
 
   fspp::Dir::EntryType getType() const override;
@@ -28,6 +32,7 @@ public:
 
 private:
   cpputils::unique_ref<parallelaccessfsblobstore::DirBlobRef> LoadBlob() const;
+  std::vector<fspp::num_bytes_t> _loadSizes(const std::vector<fsblobstore::DirEntry> &entries);
 
   DISALLOW_COPY_AND_ASSIGN(CryDir);
 };
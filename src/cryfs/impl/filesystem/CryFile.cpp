@@ -3,6 +3,7 @@
 #include "CryDevice.h"
 #include "CryOpenFile.h"
 #include <fspp/fs_interface/FuseErrnoException.h>
+#include <cpp-utils/system/time.h>
 
 
 //TODO Get rid of this in favor of exception hierarchy
@@ -44,7 +45,8 @@ void CryFile::truncate(fspp::num_bytes_t size) {
   device()->callFsActionCallbacks();
   auto blob = LoadBlob(); // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
   blob->resize(size);
-  parent()->updateModificationTimestampForChild(blockId());
+  parent()->updateModificationTimestampForChild(blockId(), cpputils::time::now());
+  parent()->setSizeHintForChild(blockId(), size);
 }
 
 fspp::Dir::EntryType CryFile::getType() const {
@@ -56,7 +58,7 @@ void CryFile::remove() {
   device()->callFsActionCallbacks();
   if (grandparent() != none) {
     //TODO Instead of doing nothing when we're in the root directory, handle timestamps in the root dir correctly
-    (*grandparent())->updateModificationTimestampForChild(parent()->blockId());
+    (*grandparent())->updateModificationTimestampForChild(parent()->blockId(), cpputils::time::now());
   }
   removeNode();
 }
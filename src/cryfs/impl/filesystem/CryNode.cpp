@@ -108,13 +108,15 @@ void CryNode::rename(const bf::path &to) {
   if (old == boost::none) {
     throw FuseErrnoException(EIO);
   }
-  const fsblobstore::DirEntry oldEntry = *old; // Copying this (instead of only keeping the reference) is necessary, because the operations below (i.e. RenameChild()) might make a reference invalid.
+  const fsblobstore::DirEntry oldEntry = std::move(*old);
   auto onOverwritten = [this] (const blockstore::BlockId &blockId) {
       device()->RemoveBlob(blockId);
   };
   if (targetParent->blockId() == (*_parent)->blockId()) {
     _updateParentModificationTimestamp();
     targetParent->RenameChild(oldEntry.blockId(), to.filename().string(), onOverwritten);
+    device()->InvalidateDentry(targetParent->blockId(), oldEntry.name());
+    device()->InvalidateDentry(targetParent->blockId(), to.filename().string());
   } else {
     auto preexistingTargetEntry = targetParent->GetChild(to.filename().string());
     if (preexistingTargetEntry != boost::none && preexistingTargetEntry->type() == fspp::Dir::EntryType::DIR) {
@@ -139,6 +141,8 @@ void CryNode::rename(const bf::path &to) {
     targetParent->AddOrOverwriteChild(to.filename().string(), oldEntry.blockId(), oldEntry.type(), oldEntry.mode(), oldEntry.uid(), oldEntry.gid(),
                                   oldEntry.lastAccessTime(), oldEntry.lastModificationTime(), onOverwritten);
     (*_parent)->RemoveChild(oldEntry.name());
+    device()->InvalidateDentry(targetParent->blockId(), to.filename().string());
+    device()->InvalidateDentry((*_parent)->blockId(), oldEntry.name());
     // targetParent is now the new parent for this node. Adapt to it, so we can call further operations on this node object.
     LoadBlob()->setParentPointer(targetParent->blockId());
     _parent = std::move(targetParent);
@@ -149,14 +153,14 @@ void CryNode::_updateParentModificationTimestamp() {
   if (_grandparent != none) {
     // TODO Handle timestamps of the root directory (_grandparent == none) correctly.
     ASSERT(_parent != none, "Grandparent is set, so also parent has to be set");
-    (*_grandparent)->updateModificationTimestampForChild((*_parent)->blockId());
+    (*_grandparent)->updateModificationTimestampForChild((*_parent)->blockId(), cpputils::time::now());
   }
 }
 
 void CryNode::_updateTargetDirModificationTimestamp(const DirBlobRef &targetDir, optional<unique_ref<DirBlobRef>> targetDirParent) {
   if (targetDirParent != none) {
     // TODO Handle timestamps of the root directory (targetDirParent == none) correctly.
-    (*targetDirParent)->updateModificationTimestampForChild(targetDir.blockId());
+    (*targetDirParent)->updateModificationTimestampForChild(targetDir.blockId(), cpputils::time::now());
   }
 }
 
@@ -179,6 +183,7 @@ void CryNode::removeNode() {
     throw FuseErrnoException(EIO);
   }
   (*_parent)->RemoveChild(_blockId);
+  _device->InvalidateDentryOf(_blockId);
   _device->RemoveBlob(_blockId);
 }
 
@@ -228,6 +233,10 @@ CryNode::stat_info CryNode::stat() const {
     if (childOpt == boost::none) {
       throw fspp::fuse::FuseErrnoException(ENOENT);
     }
+    if (childOpt->sizeHint() != boost::none) {
+      // Only files have a size hint. It is valid, otherwise it would be none.
+      return dirEntryToStatInfo(*childOpt, *childOpt->sizeHint());
+    }
     return dirEntryToStatInfo(*childOpt, LoadBlob()->lstat_size());
   }
 }
@@ -6,33 +6,128 @@
 #include "CryDevice.h"
 #include <fspp/fs_interface/FuseErrnoException.h>
 #include "entry_helper.h"
+#include <cpp-utils/logging/logging.h>
+#include <cpp-utils/system/time.h>
 
 
 using std::shared_ptr;
 using cpputils::unique_ref;
 using cryfs::parallelaccessfsblobstore::FileBlobRef;
 using cryfs::parallelaccessfsblobstore::DirBlobRef;
+using namespace cpputils::logging;
 
 //TODO Get rid of this in favor of a exception hierarchy
 
 namespace cryfs {
 
+namespace {
+// While a file is read or written continuously, its timestamps are stored in the parent directory at most this often
+constexpr std::chrono::seconds TIMESTAMP_STORE_INTERVAL(1);
+}
+
 CryOpenFile::CryOpenFile(const CryDevice *device, shared_ptr<DirBlobRef> parent, unique_ref<FileBlobRef> fileBlob)
-: _device(device), _parent(parent), _fileBlob(std::move(fileBlob)) {
+: _device(device), _parent(parent), _fileBlob(std::move(fileBlob)), _modified(false), _pendingTimestampsMutex(),
+  _pendingAccessTime(boost::none), _pendingModificationTime(boost::none),
+  _lastTimestampStore(std::chrono::steady_clock::now()), _sizeHintInvalidated(false) {
 }
 
 CryOpenFile::~CryOpenFile() {
-  //TODO
+  try {
+    _flushPendingTimestamps();
+  } catch (const std::exception &e) {
+    LOG(ERR, "Could not store timestamps for {}: {}", _fileBlob->blockId().ToString(), e.what());
+  }
+  try {
+    _updateSizeHint();
+  } catch (const std::exception &e) {
+    // The size hint is only an optimization, stat() falls back to loading the blob.
+    LOG(ERR, "Could not store size hint for {}: {}", _fileBlob->blockId().ToString(), e.what());
+  }
 } // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
 
+void CryOpenFile::_updateSizeHint() {
+  auto childOpt = _parent->GetChild(_fileBlob->blockId());
+  if (childOpt == boost::none) {
+    // The file was removed while it was open
+    return;
+  }
+  // A valid hint could only have been stored by another open file after our last modification invalidated it,
+  // which means it might not contain that modification. If we didn't modify the file, a valid hint is up to date.
+  if (!_modified && childOpt->sizeHint() != boost::none) {
+    return;
+  }
+  const fspp::num_bytes_t size = _fileBlob->size();
+  if (childOpt->sizeHint() != size) {
+    _parent->setSizeHintForChild(_fileBlob->blockId(), size);
+  }
+  const std::lock_guard<std::mutex> lock(_pendingTimestampsMutex);
+  _sizeHintInvalidated = false;
+}
+
+void CryOpenFile::_recordAccess() const {
+  const timespec now = cpputils::time::now();
+  const std::lock_guard<std::mutex> lock(_pendingTimestampsMutex);
+  _pendingAccessTime = now;
+  if (std::chrono::steady_clock::now() - _lastTimestampStore >= TIMESTAMP_STORE_INTERVAL) {
+    _storePendingTimestamps();
+  }
+}
+
+void CryOpenFile::_recordModification(bool storeImmediately) const {
+  const timespec now = cpputils::time::now();
+  const std::lock_guard<std::mutex> lock(_pendingTimestampsMutex);
+  _pendingModificationTime = now;
+  if (storeImmediately || !_sizeHintInvalidated || std::chrono::steady_clock::now() - _lastTimestampStore >= TIMESTAMP_STORE_INTERVAL) {
+    _storePendingTimestamps();
+  }
+}
+
+void CryOpenFile::_flushPendingTimestamps() const {
+  const std::lock_guard<std::mutex> lock(_pendingTimestampsMutex);
+  _storePendingTimestamps();
+}
+
+void CryOpenFile::_storePendingTimestamps() const {
+  _lastTimestampStore = std::chrono::steady_clock::now();
+  if (_pendingAccessTime == boost::none && _pendingModificationTime == boost::none) {
+    return;
+  }
+  const boost::optional<timespec> accessTime = _pendingAccessTime;
+  const boost::optional<timespec> modificationTime = _pendingModificationTime;
+  _pendingAccessTime = boost::none;
+  _pendingModificationTime = boost::none;
+
+  if (_parent->GetChild(_fileBlob->blockId()) == boost::none) {
+    // The file was removed while it was open
+    return;
+  }
+  // Apply them in the order they happened, relatime decides based on whether the access was after the modification
+  if (accessTime != boost::none && modificationTime != boost::none && *accessTime < *modificationTime) {
+    _parent->updateAccessTimestampForChild(_fileBlob->blockId(), timestampUpdateBehavior(), *accessTime);
+    _parent->updateModificationTimestampForChild(_fileBlob->blockId(), *modificationTime);
+    _sizeHintInvalidated = true;
+    return;
+  }
+  if (modificationTime != boost::none) {
+    _parent->updateModificationTimestampForChild(_fileBlob->blockId(), *modificationTime);
+    _sizeHintInvalidated = true;
+  }
+  if (accessTime != boost::none) {
+    _parent->updateAccessTimestampForChild(_fileBlob->blockId(), timestampUpdateBehavior(), *accessTime);
+  }
+}
+
 void CryOpenFile::flush() {
   _device->callFsActionCallbacks();
+  _flushPendingTimestamps();
   _fileBlob->flush();
+  _updateSizeHint();
   _parent->flush();
 }
 
 fspp::Node::stat_info CryOpenFile::stat() const {
   _device->callFsActionCallbacks();
+  _flushPendingTimestamps();
   auto childOpt = _parent->GetChild(_fileBlob->blockId());
   if (childOpt == boost::none) {
     throw fspp::fuse::FuseErrnoException(ENOENT);
@@ -42,25 +137,29 @@ fspp::Node::stat_info CryOpenFile::stat() const {
 
 void CryOpenFile::truncate(fspp::num_bytes_t size) const {
   _device->callFsActionCallbacks();
+  _modified = true;
   _fileBlob->resize(size);
-  _parent->updateModificationTimestampForChild(_fileBlob->blockId());
+  _recordModification(true);
 }
 
 fspp::num_bytes_t CryOpenFile::read(void *buf, fspp::num_bytes_t count, fspp::num_bytes_t offset) const {
   _device->callFsActionCallbacks();
-  _parent->updateAccessTimestampForChild(_fileBlob->blockId(), timestampUpdateBehavior());
+  _recordAccess();
   return _fileBlob->read(buf, offset, count);
 }
 
 void CryOpenFile::write(const void *buf, fspp::num_bytes_t count, fspp::num_bytes_t offset) {
   _device->callFsActionCallbacks();
-  _parent->updateModificationTimestampForChild(_fileBlob->blockId());
+  _modified = true;
+  _recordModification(false);
   _fileBlob->write(buf, offset, count);
 }
 
 void CryOpenFile::fsync() {
   _device->callFsActionCallbacks();
+  _flushPendingTimestamps();
   _fileBlob->flush();
+  _updateSizeHint();
   _parent->flush();
 }
 
@@ -5,6 +5,10 @@
 #include <fspp/fs_interface/OpenFile.h>
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/FileBlobRef.h"
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/DirBlobRef.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <boost/optional.hpp>
 
 namespace cryfs {
 class CryDevice;
@@ -24,9 +28,30 @@ public:
   fspp::TimestampUpdateBehavior timestampUpdateBehavior() const;
 
 private:
+  void _updateSizeHint();
+  void _recordAccess() const;
+  void _recordModification(bool storeImmediately) const;
+  void _flushPendingTimestamps() const;
+  // Needs _pendingTimestampsMutex to be locked
+  void _storePendingTimestamps() const;
+
   const CryDevice *_device;
   std::shared_ptr<parallelaccessfsblobstore::DirBlobRef> _parent;
   cpputils::unique_ref<parallelaccessfsblobstore::FileBlobRef> _fileBlob;
+  // Set once this file was written to or truncated. The size hint in the dir entry is invalid from then on.
+  mutable std::atomic<bool> _modified;
+
+  // Reads and writes don't update the timestamps in the parent directory every time, because that locks the parent
+  // and rewrites its blob. They only remember the time of the last access and modification here. These are stored
+  // in the parent on flush, fsync, stat, close, or when a read or write happens after TIMESTAMP_STORE_INTERVAL.
+  mutable std::mutex _pendingTimestampsMutex;
+  mutable boost::optional<timespec> _pendingAccessTime;
+  mutable boost::optional<timespec> _pendingModificationTime;
+  mutable std::chrono::steady_clock::time_point _lastTimestampStore;
+  // Whether the dir entry in the parent was updated for a modification since the size hint was last stored.
+  // The first modification after that is stored right away, because it invalidates the size hint that directory
+  // listings would otherwise still use.
+  mutable bool _sizeHintInvalidated;
 
   DISALLOW_COPY_AND_ASSIGN(CryOpenFile);
 };
@@ -1,6 +1,7 @@
 #include "CrySymlink.h"
 
 #include <fspp/fs_interface/FuseErrnoException.h>
+#include <cpp-utils/system/time.h>
 #include "CryDevice.h"
 #include "CrySymlink.h"
 #include "cryfs/impl/filesystem/parallelaccessfsblobstore/SymlinkBlobRef.h"
@@ -42,7 +43,7 @@ fspp::Dir::EntryType CrySymlink::getType() const {
 
 bf::path CrySymlink::target() {
   device()->callFsActionCallbacks();
-  parent()->updateAccessTimestampForChild(blockId(), timestampUpdateBehavior());
+  parent()->updateAccessTimestampForChild(blockId(), timestampUpdateBehavior(), cpputils::time::now());
   auto blob = LoadBlob(); // NOLINT (workaround https://gcc.gnu.org/bugzilla/show_bug.cgi?id=82481 )
   return blob->target();
 }
@@ -51,7 +52,7 @@ void CrySymlink::remove() {
   device()->callFsActionCallbacks();
   if (grandparent() != none) {
     //TODO Instead of doing nothing when we're in the root directory, handle timestamps in the root dir correctly
-    (*grandparent())->updateModificationTimestampForChild(parent()->blockId());
+    (*grandparent())->updateModificationTimestampForChild(parent()->blockId(), cpputils::time::now());
   }
   removeNode();
 }
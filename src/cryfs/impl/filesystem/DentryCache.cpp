@@ -0,0 +1,78 @@
+#include "DentryCache.h"
+
+using blockstore::BlockId;
+using boost::optional;
+using boost::none;
+using std::string;
+
+namespace cryfs {
+
+constexpr uint32_t DentryCache::MAX_ENTRIES;
+
+DentryCache::DentryCache()
+  : _mutex(), _generation(0), _entries(), _keyOfChild() {
+}
+
+optional<optional<DentryCache::Entry>> DentryCache::lookup(const BlockId &parent, const string &name) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  DentryCacheKey key{parent, name};
+  auto found = _entries.pop(key);
+  if (found == none) {
+    return none;
+  }
+  // Move it to the end of the queue, it is the most recently used entry now.
+  _entries.push(key, *found);
+  return *found;
+}
+
+uint64_t DentryCache::generation() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _generation;
+}
+
+void DentryCache::insert(uint64_t generation, const BlockId &parent, const string &name, const optional<Entry> &entry) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (generation != _generation) {
+    // The directory could have been modified after the caller looked up the entry
+    return;
+  }
+  DentryCacheKey key{parent, name};
+  _erase(key);
+  while (_entries.size() >= MAX_ENTRIES) {
+    _erase(*_entries.peekKey());
+  }
+  if (entry != none) {
+    auto previous = _keyOfChild.find(entry->blockId);
+    if (previous != _keyOfChild.end()) {
+      DentryCacheKey previousKey = previous->second;
+      _erase(previousKey);
+    }
+    _keyOfChild.emplace(entry->blockId, key);
+  }
+  _entries.push(key, entry);
+}
+
+void DentryCache::invalidate(const BlockId &parent, const string &name) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  ++_generation;
+  _erase(DentryCacheKey{parent, name});
+}
+
+void DentryCache::invalidateChild(const BlockId &child) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  ++_generation;
+  auto found = _keyOfChild.find(child);
+  if (found != _keyOfChild.end()) {
+    DentryCacheKey key = found->second;
+    _erase(key);
+  }
+}
+
+void DentryCache::_erase(const DentryCacheKey &key) {
+  auto erased = _entries.pop(key);
+  if (erased != none && *erased != none) {
+    _keyOfChild.erase((*erased)->blockId);
+  }
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_DENTRYCACHE_H_
+#define MESSMER_CRYFS_FILESYSTEM_DENTRYCACHE_H_
+
+#include <blockstore/utils/BlockId.h>
+#include <blockstore/implementations/caching/cache/QueueMap.h>
+#include <fspp/fs_interface/Dir.h>
+#include <boost/optional.hpp>
+#include <cpp-utils/macros.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cryfs {
+
+struct DentryCacheKey final {
+  blockstore::BlockId parent;
+  std::string name;
+
+  bool operator==(const DentryCacheKey &rhs) const {
+    return parent == rhs.parent && name == rhs.name;
+  }
+};
+
+}
+
+namespace std {
+  template<> struct hash<cryfs::DentryCacheKey> final {
+    size_t operator()(const cryfs::DentryCacheKey &key) const {
+      // Combining like boost::hash_combine does
+      size_t result = std::hash<blockstore::BlockId>()(key.parent);
+      result ^= std::hash<std::string>()(key.name) + 0x9e3779b9 + (result << 6) + (result >> 2);
+      return result;
+    }
+  };
+}
+
+namespace cryfs {
+
+// Caches the results of looking up a name in a directory, so that resolving a path doesn't have to load every
+// ancestor directory blob. Entries are keyed by the blockId of the parent directory and the name of the child,
+// which means renaming or removing a directory doesn't invalidate the entries of its descendants, they just become
+// unreachable and are evicted eventually. Lookups of names that don't exist are cached as negative entries.
+//
+// Callers have to invalidate an entry after every modification of the corresponding directory entry. To avoid caching
+// a result that was looked up while a concurrent modification happened, insert() takes the generation returned by
+// generation() before the lookup started and ignores the result if an invalidation happened in the meantime.
+class DentryCache final {
+public:
+  static constexpr uint32_t MAX_ENTRIES = 10000;
+
+  struct Entry final {
+    blockstore::BlockId blockId;
+    fspp::Dir::EntryType type;
+  };
+
+  DentryCache();
+
+  // Returns none if the lookup isn't cached. Otherwise, returns the cached result, which is none itself for a negative entry.
+  boost::optional<boost::optional<Entry>> lookup(const blockstore::BlockId &parent, const std::string &name);
+  uint64_t generation() const;
+  void insert(uint64_t generation, const blockstore::BlockId &parent, const std::string &name, const boost::optional<Entry> &entry);
+
+  void invalidate(const blockstore::BlockId &parent, const std::string &name);
+  // Invalidates the positive entry pointing to the given blob, if there is one
+  void invalidateChild(const blockstore::BlockId &child);
+
+private:
+  void _erase(const DentryCacheKey &key);
+
+  mutable std::mutex _mutex;
+  uint64_t _generation;
+  // Ordered by last use, so that the least recently used entry is evicted first
+  blockstore::caching::QueueMap<DentryCacheKey, boost::optional<Entry>> _entries;
+  std::unordered_map<blockstore::BlockId, DentryCacheKey> _keyOfChild;
+
+  DISALLOW_COPY_AND_ASSIGN(DentryCache);
+};
+
+}
+
+#endif
@@ -0,0 +1,300 @@
+#include "TreeOperations.h"
+#include "CryDevice.h"
+#include <fspp/fs_interface/FuseErrnoException.h>
+#include <cpp-utils/pointer/cast.h>
+#include <cpp-utils/system/time.h>
+#include <cpp-utils/thread/parallel.h>
+
+using blockstore::BlockId;
+using cpputils::dynamic_pointer_move;
+using cpputils::unique_ref;
+using cryfs::fsblobstore::DirEntry;
+using cryfs::parallelaccessfsblobstore::DirBlobRef;
+using cryfs::parallelaccessfsblobstore::FileBlobRef;
+using cryfs::parallelaccessfsblobstore::SymlinkBlobRef;
+using fspp::fuse::FuseErrnoException;
+using std::string;
+using std::vector;
+
+namespace cryfs {
+
+constexpr std::chrono::milliseconds TreeOperations::PROGRESS_INTERVAL;
+
+TreeOperations::TreeOperations(CryDevice *device, fspp::Device::ProgressCallback progress)
+: _device(device), _progress(std::move(progress)), _lastProgress(std::chrono::steady_clock::now()), _numNodesDone(0),
+  _cancelled(false), _mutex(), _tasksDone(), _numPendingTasks(0), _error(), _dirsToRemove(), _pool(cpputils::numThreadsForIoBoundWork(), "cryfs_tree") {
+}
+
+void TreeOperations::removeTree(DirBlobRef *parent, const DirEntry &entry) {
+  if (entry.type() == fspp::Dir::EntryType::DIR) {
+    _removeContents(entry.blockId());
+  }
+  parent->RemoveChild(entry.blockId());
+  _device->InvalidateDentryOf(entry.blockId());
+  _device->RemoveBlob(entry.blockId());
+  ++_numNodesDone;
+  _reportProgress(true);
+}
+
+void TreeOperations::_removeContents(const BlockId &dirId) {
+  // First remove all files and symlinks, walking the directories in parallel and remembering them
+  _submit([this, dirId] {
+    _removeFilesAndQueueSubdirs(dirId);
+  });
+  _waitForTasks();
+
+  // Then remove the now empty directories. A directory is always found after its parent, so going backwards
+  // removes subdirectories before their parents.
+  vector<BlockId> removed;
+  removed.reserve(_dirsToRemove.size());
+  try {
+    for (auto dir = _dirsToRemove.rbegin(); dir != _dirsToRemove.rend(); ++dir) {
+      _reportProgress(false);
+      if (_cancelled) {
+        throw FuseErrnoException(ECANCELED);
+      }
+      _loadDir(dir->parent)->RemoveChild(dir->blockId);
+      _device->InvalidateDentryOf(dir->blockId);
+      removed.push_back(dir->blockId);
+      ++_numNodesDone;
+    }
+  } catch (...) {
+    _device->RemoveBlobs(removed);
+    throw;
+  }
+  _device->RemoveBlobs(removed);
+  _dirsToRemove.clear();
+}
+
+void TreeOperations::_removeFilesAndQueueSubdirs(const BlockId &dirId) {
+  auto dir = _loadDir(dirId);
+  vector<DirEntry> entries;
+  dir->AppendChildEntriesTo(&entries);
+  vector<BlockId> removed;
+  for (const DirEntry &entry : entries) {
+    if (_stopped()) {
+      break;
+    }
+    if (entry.type() == fspp::Dir::EntryType::DIR) {
+      {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        _dirsToRemove.push_back(DirToRemove{entry.blockId(), dirId});
+      }
+      const BlockId subdirId = entry.blockId();
+      _submit([this, subdirId] {
+        _removeFilesAndQueueSubdirs(subdirId);
+      });
+    } else {
+      dir->RemoveChild(entry.blockId());
+      _device->InvalidateDentryOf(entry.blockId());
+      removed.push_back(entry.blockId());
+      ++_numNodesDone;
+    }
+  }
+  // Queue all blobs of this directory at once instead of one journal write per blob
+  _device->RemoveBlobs(removed);
+}
+
+BlockId TreeOperations::copyTree(const DirEntry &source, const BlockId &targetParent) {
+  switch (source.type()) {
+    case fspp::Dir::EntryType::SYMLINK: {
+      return _copySymlink(source, targetParent);
+    }
+    case fspp::Dir::EntryType::FILE: {
+      // Copy in a task as well, so that this thread keeps reporting progress and can cancel a large file
+      boost::optional<BlockId> copy = boost::none;
+      _submit([this, &source, &targetParent, &copy] {
+        copy = _copyFile(source, targetParent)->blockId();
+      });
+      try {
+        _waitForTasks();
+      } catch (...) {
+        if (copy != boost::none) {
+          _device->RemoveBlob(*copy);
+        }
+        throw;
+      }
+      ++_numNodesDone;
+      _reportProgress(true);
+      return *copy;
+    }
+    case fspp::Dir::EntryType::DIR: {
+      const BlockId copy = _device->CreateDirBlob(targetParent)->blockId();
+      try {
+        const BlockId sourceId = source.blockId();
+        _submit([this, sourceId, copy] {
+          _copyContents(sourceId, copy);
+        });
+        _waitForTasks();
+      } catch (...) {
+        // Cleaning up can't be cancelled, otherwise the partial copy would leak
+        TreeOperations(_device, [] (uint64_t) {return true;}).removeDetachedTree(copy, fspp::Dir::EntryType::DIR);
+        throw;
+      }
+      ++_numNodesDone;
+      _reportProgress(true);
+      return copy;
+    }
+  }
+  ASSERT(false, "Switch/case not exhaustive");
+}
+
+void TreeOperations::_copyContents(const BlockId &source, const BlockId &target) {
+  vector<DirEntry> entries;
+  _loadDir(source)->AppendChildEntriesTo(&entries);
+  auto targetDir = _loadDir(target);
+  for (const DirEntry &entry : entries) {
+    if (_stopped()) {
+      break;
+    }
+    switch (entry.type()) {
+      case fspp::Dir::EntryType::DIR: {
+        const BlockId copy = _device->CreateDirBlob(target)->blockId();
+        addCopiedEntry(targetDir.get(), entry.name(), entry, copy);
+        ++_numNodesDone;
+        const BlockId sourceId = entry.blockId();
+        _submit([this, sourceId, copy] {
+          _copyContents(sourceId, copy);
+        });
+        break;
+      }
+      case fspp::Dir::EntryType::FILE: {
+        // Files are copied by their own task, so a directory with a few large files is still copied in parallel
+        _submit([this, entry, target] {
+          auto copy = _copyFile(entry, target);
+          const BlockId copyId = copy->blockId();
+          const fspp::num_bytes_t size = copy->size();
+          cpputils::destruct(std::move(copy));
+          try {
+            auto dir = _loadDir(target);
+            addCopiedEntry(dir.get(), entry.name(), entry, copyId);
+            dir->setSizeHintForChild(copyId, size);
+          } catch (...) {
+            _device->RemoveBlob(copyId);
+            throw;
+          }
+          ++_numNodesDone;
+        });
+        break;
+      }
+      case fspp::Dir::EntryType::SYMLINK: {
+        addCopiedEntry(targetDir.get(), entry.name(), entry, _copySymlink(entry, target));
+        break;
+      }
+    }
+  }
+}
+
+BlockId TreeOperations::_copySymlink(const DirEntry &source, const BlockId &targetParent) {
+  auto loaded = _device->LoadBlob(source.blockId());
+  auto sourceBlob = dynamic_pointer_move<SymlinkBlobRef>(loaded);
+  ASSERT(sourceBlob != boost::none, "Blob does not store a symlink");
+  const BlockId copy = _device->CreateSymlinkBlob((*sourceBlob)->target(), targetParent)->blockId();
+  ++_numNodesDone;
+  return copy;
+}
+
+unique_ref<FileBlobRef> TreeOperations::_copyFile(const DirEntry &source, const BlockId &targetParent) {
+  auto loaded = _device->LoadBlob(source.blockId());
+  auto sourceBlob = dynamic_pointer_move<FileBlobRef>(loaded);
+  ASSERT(sourceBlob != boost::none, "Blob does not store a file");
+  return _device->CopyFileBlob(**sourceBlob, targetParent, [this] {
+    if (_stopped()) {
+      throw FuseErrnoException(ECANCELED);
+    }
+  });
+}
+
+void TreeOperations::addCopiedEntry(DirBlobRef *targetParent, const string &name, const DirEntry &source, const BlockId &copy) {
+  switch (source.type()) {
+    case fspp::Dir::EntryType::DIR:
+      return targetParent->AddChildDir(name, copy, source.mode(), source.uid(), source.gid(), source.lastAccessTime(), source.lastModificationTime());
+    case fspp::Dir::EntryType::FILE:
+      return targetParent->AddChildFile(name, copy, source.mode(), source.uid(), source.gid(), source.lastAccessTime(), source.lastModificationTime());
+    case fspp::Dir::EntryType::SYMLINK:
+      return targetParent->AddChildSymlink(name, copy, source.uid(), source.gid(), source.lastAccessTime(), source.lastModificationTime());
+  }
+  ASSERT(false, "Switch/case not exhaustive");
+}
+
+void TreeOperations::removeDetachedTree(const BlockId &blockId, fspp::Dir::EntryType type) {
+  if (type == fspp::Dir::EntryType::DIR) {
+    _removeContents(blockId);
+  }
+  _device->RemoveBlob(blockId);
+}
+
+unique_ref<DirBlobRef> TreeOperations::_loadDir(const BlockId &blockId) {
+  auto loaded = _device->LoadBlob(blockId);
+  auto dir = dynamic_pointer_move<DirBlobRef>(loaded);
+  ASSERT(dir != boost::none, "Blob does not store a directory");
+  return std::move(*dir);
+}
+
+void TreeOperations::_submit(std::function<void()> task) {
+  {
+    const std::lock_guard<std::mutex> lock(_mutex);
+    ++_numPendingTasks;
+  }
+  _pool.submit([this, task = std::move(task)] {
+    if (!_stopped()) {
+      try {
+        task();
+      } catch (...) {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        if (!_error) {
+          _error = std::current_exception();
+        }
+      }
+    }
+    {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      --_numPendingTasks;
+    }
+    _tasksDone.notify_all();
+  });
+}
+
+void TreeOperations::_waitForTasks() {
+  while (true) {
+    bool done = false;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      done = _tasksDone.wait_for(lock, PROGRESS_INTERVAL, [this] {
+        return _numPendingTasks == 0;
+      });
+    }
+    _reportProgress(done);
+    if (done) {
+      break;
+    }
+  }
+  const std::lock_guard<std::mutex> lock(_mutex);
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+  if (_cancelled) {
+    throw FuseErrnoException(ECANCELED);
+  }
+}
+
+void TreeOperations::_reportProgress(bool force) {
+  const auto now = std::chrono::steady_clock::now();
+  if (!force && now - _lastProgress < PROGRESS_INTERVAL) {
+    return;
+  }
+  _lastProgress = now;
+  if (_progress && !_progress(_numNodesDone.load())) {
+    _cancelled = true;
+  }
+}
+
+bool TreeOperations::_stopped() const {
+  if (_cancelled) {
+    return true;
+  }
+  const std::lock_guard<std::mutex> lock(_mutex);
+  return static_cast<bool>(_error);
+}
+
+}
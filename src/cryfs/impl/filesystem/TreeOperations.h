@@ -0,0 +1,92 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_TREEOPERATIONS_H_
+#define MESSMER_CRYFS_FILESYSTEM_TREEOPERATIONS_H_
+
+#include <blockstore/utils/BlockId.h>
+#include <cpp-utils/macros.h>
+#include <cpp-utils/pointer/unique_ref.h>
+#include <cpp-utils/thread/ThreadPool.h>
+#include <fspp/fs_interface/Device.h>
+#include "cryfs/impl/filesystem/parallelaccessfsblobstore/DirBlobRef.h"
+#include "cryfs/impl/filesystem/parallelaccessfsblobstore/FileBlobRef.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace cryfs {
+class CryDevice;
+
+// Removes or copies a node together with everything below it. The tree is walked by BlockId, so only the path of the
+// node itself has to be resolved, and subdirectories are processed in parallel on a thread pool.
+// The progress callback is only called on the thread that started the operation, so it doesn't have to be thread
+// safe. If it returns false, the operation stops and throws ECANCELED.
+class TreeOperations final {
+public:
+  TreeOperations(CryDevice *device, fspp::Device::ProgressCallback progress);
+
+  // Removes the node of the given entry and all of its descendants. Directories are only removed after their contents,
+  // so cancelling leaves the nodes that weren't removed yet in place.
+  void removeTree(parallelaccessfsblobstore::DirBlobRef *parent, const fsblobstore::DirEntry &entry);
+
+  // Copies the node of the given entry with all of its descendants and returns the copy. The copy isn't added to any
+  // directory yet, the caller has to add an entry for it to targetParent. If copying fails or is cancelled, the
+  // partial copy is removed again.
+  blockstore::BlockId copyTree(const fsblobstore::DirEntry &source, const blockstore::BlockId &targetParent);
+
+  // Adds an entry for a node created by copyTree() with the metadata of the source entry
+  static void addCopiedEntry(parallelaccessfsblobstore::DirBlobRef *targetParent, const std::string &name, const fsblobstore::DirEntry &source, const blockstore::BlockId &copy);
+
+  // Removes a node created by copyTree() that isn't referenced by any directory entry
+  void removeDetachedTree(const blockstore::BlockId &blockId, fspp::Dir::EntryType type);
+
+private:
+  static constexpr std::chrono::milliseconds PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+  struct DirToRemove final {
+    blockstore::BlockId blockId;
+    blockstore::BlockId parent;
+  };
+
+  // Removes everything below the given directory, but not the directory itself
+  void _removeContents(const blockstore::BlockId &dirId);
+  void _removeFilesAndQueueSubdirs(const blockstore::BlockId &dirId);
+  void _copyContents(const blockstore::BlockId &source, const blockstore::BlockId &target);
+  blockstore::BlockId _copySymlink(const fsblobstore::DirEntry &source, const blockstore::BlockId &targetParent);
+  // Copies the blocks of the file, see CryDevice::CopyFileBlob(). The copy isn't added to targetParent yet.
+  // Stops between blocks if the operation is cancelled or another task failed.
+  cpputils::unique_ref<parallelaccessfsblobstore::FileBlobRef> _copyFile(const fsblobstore::DirEntry &source, const blockstore::BlockId &targetParent);
+
+  cpputils::unique_ref<parallelaccessfsblobstore::DirBlobRef> _loadDir(const blockstore::BlockId &blockId);
+
+  void _submit(std::function<void()> task);
+  // Waits until all submitted tasks are done, reporting progress in the meantime. Rethrows the first error of a task.
+  void _waitForTasks();
+  void _reportProgress(bool force);
+  bool _stopped() const;
+
+  CryDevice *_device;
+  fspp::Device::ProgressCallback _progress;
+  std::chrono::steady_clock::time_point _lastProgress;
+
+  std::atomic<uint64_t> _numNodesDone;
+  std::atomic<bool> _cancelled;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _tasksDone;
+  size_t _numPendingTasks;
+  std::exception_ptr _error;
+  std::vector<DirToRemove> _dirsToRemove;
+
+  // Declared last so it is destroyed, and finishes its tasks, first
+  cpputils::ThreadPool _pool;
+
+  DISALLOW_COPY_AND_ASSIGN(TreeOperations);
+};
+
+}
+
+#endif
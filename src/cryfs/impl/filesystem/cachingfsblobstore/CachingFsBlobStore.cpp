@@ -18,7 +18,7 @@ namespace cachingfsblobstore {
     constexpr double CachingFsBlobStore::MAX_LIFETIME_SEC;
 
     optional<unique_ref<FsBlobRef>> CachingFsBlobStore::load(const BlockId &blockId) {
-        auto fromCache = _cache.pop(blockId);
+        auto fromCache = _cache.popForLoad(blockId);
         if (fromCache != none) {
             return _makeRef(std::move(*fromCache));
         }
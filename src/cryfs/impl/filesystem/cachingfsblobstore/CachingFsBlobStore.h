@@ -20,6 +20,8 @@ namespace cryfs {
             ~CachingFsBlobStore();
 
             cpputils::unique_ref<FileBlobRef> createFileBlob(const blockstore::BlockId &parent);
+            cpputils::unique_ref<FileBlobRef> createFileBlobAsCopyOf(const FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied);
+            cpputils::unique_ref<FileBlobRef> createFileBlobAsCloneOf(const FileBlobRef &source, const blockstore::BlockId &parent);
             cpputils::unique_ref<DirBlobRef> createDirBlob(const blockstore::BlockId &parent);
             cpputils::unique_ref<SymlinkBlobRef> createSymlinkBlob(const boost::filesystem::path &target, const blockstore::BlockId &parent);
             boost::optional<cpputils::unique_ref<FsBlobRef>> load(const blockstore::BlockId &blockId);
@@ -63,6 +65,14 @@ namespace cryfs {
             return cpputils::make_unique_ref<FileBlobRef>(_baseBlobStore->createFileBlob(parent), this);
         }
 
+        inline cpputils::unique_ref<FileBlobRef> CachingFsBlobStore::createFileBlobAsCopyOf(const FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied) {
+            return cpputils::make_unique_ref<FileBlobRef>(_baseBlobStore->createFileBlobAsCopyOf(*source._base, parent, onBlockCopied), this);
+        }
+
+        inline cpputils::unique_ref<FileBlobRef> CachingFsBlobStore::createFileBlobAsCloneOf(const FileBlobRef &source, const blockstore::BlockId &parent) {
+            return cpputils::make_unique_ref<FileBlobRef>(_baseBlobStore->createFileBlobAsCloneOf(*source._base, parent), this);
+        }
+
         inline cpputils::unique_ref<DirBlobRef> CachingFsBlobStore::createDirBlob(const blockstore::BlockId &parent) {
             // This already creates the file blob in the underlying blobstore.
             // We could also cache this operation, but that is more complicated (blockstore::CachingBlockStore does it)
@@ -48,6 +48,8 @@ private:
 
     fsblobstore::FileBlob *_base;
 
+    friend class CachingFsBlobStore;
+
     DISALLOW_COPY_AND_ASSIGN(FileBlobRef);
 };
 
@@ -9,6 +9,8 @@
 #include "cryfs/impl/filesystem/CryDevice.h"
 #include "FileBlob.h"
 #include "SymlinkBlob.h"
+#include "utils/FlatDirEntryStorage.h"
+#include "utils/HashedDirEntryStorage.h"
 #include <cpp-utils/system/stat.h>
 
 using std::vector;
@@ -25,10 +27,9 @@ namespace fsblobstore {
 
 constexpr fspp::num_bytes_t DirBlob::DIR_LSTAT_SIZE;
 
-DirBlob::DirBlob(unique_ref<Blob> blob) :
-    FsBlob(std::move(blob)), _entries(), _entriesAndChangedMutex(), _changed(false) {
-  ASSERT(baseBlob().blobType() == FsBlobView::BlobType::DIR, "Loaded blob is not a directory");
-  _readEntriesFromBlob();
+DirBlob::DirBlob(unique_ref<Blob> blob, boost::optional<uint32_t> hashedDirectoryPageSize, bool sizeHints) :
+    FsBlob(std::move(blob)), _hashedDirectoryPageSize(hashedDirectoryPageSize), _sizeHints(sizeHints),
+    _isHashed(baseBlob().blobType() == FsBlobView::BlobType::HASHED_DIR), _entries(_loadEntries(&baseBlob())), _entriesAndChangedMutex() {
 }
 
 DirBlob::~DirBlob() {
@@ -42,24 +43,45 @@ void DirBlob::flush() {
   baseBlob().flush();
 }
 
-unique_ref<DirBlob> DirBlob::InitializeEmptyDir(unique_ref<Blob> blob, const blockstore::BlockId &parent) {
+unique_ref<DirBlob> DirBlob::InitializeEmptyDir(unique_ref<Blob> blob, const blockstore::BlockId &parent, boost::optional<uint32_t> hashedDirectoryPageSize, bool sizeHints) {
   InitializeBlob(blob.get(), FsBlobView::BlobType::DIR, parent);
-  return make_unique_ref<DirBlob>(std::move(blob));
+  return make_unique_ref<DirBlob>(std::move(blob), hashedDirectoryPageSize, sizeHints);
 }
 
-void DirBlob::_writeEntriesToBlob() {
-  if (_changed) {
-    Data serialized = _entries.serialize();
-    baseBlob().resize(serialized.size());
-    baseBlob().write(serialized.data(), 0, serialized.size());
-    _changed = false;
+unique_ref<DirEntryStorage> DirBlob::_loadEntries(FsBlobView *blob) {
+  //No lock needed, because this is only called from the constructor.
+  switch (blob->blobType()) {
+    case FsBlobView::BlobType::DIR:
+      return make_unique_ref<FlatDirEntryStorage>(blob);
+    case FsBlobView::BlobType::HASHED_DIR:
+      return make_unique_ref<HashedDirEntryStorage>(blob, FsBlobView::HEADER_SIZE);
+    default:
+      ASSERT(false, "Loaded blob is not a directory");
   }
 }
 
-void DirBlob::_readEntriesFromBlob() {
-  //No lock needed, because this is only called from the constructor.
-  Data data = baseBlob().readAll();
-  _entries.deserializeFrom(static_cast<uint8_t*>(data.data()), data.size());
+void DirBlob::_writeEntriesToBlob() {
+  if (!_isHashed && _hashedDirectoryPageSize != boost::none
+      && _entries->serializedSize() + FsBlobView::HEADER_SIZE > *_hashedDirectoryPageSize) {
+    _convertToHashedFormat();
+  }
+  _entries->flush();
+}
+
+void DirBlob::_convertToHashedFormat() {
+  // This rewrites the directory once. Afterwards, modifications only touch the pages holding the modified entries.
+  vector<DirEntry> entries;
+  entries.reserve(_entries->size());
+  _entries->forEach([&entries] (const DirEntryView &entry) {
+    entries.push_back(entry.materialize());
+  });
+  baseBlob().setBlobType(FsBlobView::BlobType::HASHED_DIR);
+  _isHashed = true;
+  HashedDirEntryStorage::initialize(&baseBlob(), FsBlobView::HEADER_SIZE, *_hashedDirectoryPageSize);
+  _entries = make_unique_ref<HashedDirEntryStorage>(&baseBlob(), FsBlobView::HEADER_SIZE);
+  for (const auto &entry : entries) {
+    _entries->add(entry);
+  }
 }
 
 void DirBlob::AddChildDir(const std::string &name, const BlockId &blobId, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
@@ -83,88 +105,92 @@ void DirBlob::AddChildSymlink(const std::string &name, const blockstore::BlockId
 
 void DirBlob::_addChild(const std::string &name, const BlockId &blobId,
     fspp::Dir::EntryType entryType, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
-  _entries.add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
-  _changed = true;
+  _entries->add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
 }
 
 void DirBlob::AddOrOverwriteChild(const std::string &name, const BlockId &blobId, fspp::Dir::EntryType entryType,
                                   fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
                                   std::function<void (const blockstore::BlockId &blockId)> onOverwritten) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.addOrOverwrite(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime, onOverwritten);
-  _changed = true;
+  _entries->addOrOverwrite(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime, onOverwritten);
 }
 
 void DirBlob::RenameChild(const blockstore::BlockId &blockId, const std::string &newName, std::function<void (const blockstore::BlockId &blockId)> onOverwritten) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.rename(blockId, newName, onOverwritten);
-  _changed = true;
+  _entries->rename(blockId, newName, onOverwritten);
 }
 
-boost::optional<const DirEntry&> DirBlob::GetChild(const string &name) const {
+boost::optional<DirEntry> DirBlob::GetChild(const string &name) const {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  return _entries.get(name);
+  return _entries->get(name);
 }
 
-boost::optional<const DirEntry&> DirBlob::GetChild(const BlockId &blockId) const {
+boost::optional<DirEntry> DirBlob::GetChild(const BlockId &blockId) const {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  return _entries.get(blockId);
+  return _entries->get(blockId);
 }
 
 void DirBlob::RemoveChild(const string &name) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.remove(name);
-  _changed = true;
+  _entries->remove(name);
 }
 
 void DirBlob::RemoveChild(const BlockId &blockId) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.remove(blockId);
-  _changed = true;
+  _entries->remove(blockId);
 }
 
 void DirBlob::AppendChildrenTo(vector<fspp::Dir::Entry> *result) const {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  result->reserve(result->size() + _entries.size());
-  for (const auto &entry : _entries) {
-    result->emplace_back(entry.type(), entry.name());
-  }
+  result->reserve(result->size() + _entries->size());
+  _entries->forEach([result] (const DirEntryView &entry) {
+    result->emplace_back(entry.type(), string(entry.name().data(), entry.name().size()));
+  });
+}
+
+void DirBlob::AppendChildEntriesTo(vector<DirEntry> *result) const {
+  const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
+  result->reserve(result->size() + _entries->size());
+  _entries->forEach([result] (const DirEntryView &entry) {
+    result->push_back(entry.materialize());
+  });
 }
 
 fspp::num_bytes_t DirBlob::lstat_size() const {
   return DIR_LSTAT_SIZE;
 }
 
-void DirBlob::updateAccessTimestampForChild(const BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior) {
+void DirBlob::updateAccessTimestampForChild(const BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  if (_entries.updateAccessTimestampForChild(blockId, timestampUpdateBehavior)) {
-    _changed = true;
-  }
+  _entries->updateAccessTimestampForChild(blockId, timestampUpdateBehavior, now);
+}
+
+void DirBlob::updateModificationTimestampForChild(const BlockId &blockId, timespec now) {
+  const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
+  _entries->updateModificationTimestampForChild(blockId, now);
 }
 
-void DirBlob::updateModificationTimestampForChild(const BlockId &blockId) {
+void DirBlob::setSizeHintForChild(const BlockId &blockId, fspp::num_bytes_t size) {
+  if (!_sizeHints) {
+    return;
+  }
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.updateModificationTimestampForChild(blockId);
-  _changed = true;
+  _entries->setSizeHintForChild(blockId, size);
 }
 
 void DirBlob::chmodChild(const BlockId &blockId, fspp::mode_t mode) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.setMode(blockId, mode);
-  _changed = true;
+  _entries->setMode(blockId, mode);
 }
 
 void DirBlob::chownChild(const BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  if(_entries.setUidGid(blockId, uid, gid)) {
-    _changed = true;
-  }
+  _entries->setUidGid(blockId, uid, gid);
 }
 
 void DirBlob::utimensChild(const BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) {
   const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
-  _entries.setAccessTimes(blockId, lastAccessTime, lastModificationTime);
-  _changed = true;
+  _entries->setAccessTimes(blockId, lastAccessTime, lastModificationTime);
 }
 
 cpputils::unique_ref<blobstore::Blob> DirBlob::releaseBaseBlob() {
@@ -174,7 +200,8 @@ cpputils::unique_ref<blobstore::Blob> DirBlob::releaseBaseBlob() {
 }
 
 size_t DirBlob::NumChildren() const {
-  return _entries.size();
+  const std::unique_lock<std::mutex> lock(_entriesAndChangedMutex);
+  return _entries->size();
 }
 
 }
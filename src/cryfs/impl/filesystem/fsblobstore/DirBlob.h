@@ -7,7 +7,7 @@
 #include <fspp/fs_interface/Dir.h>
 #include <fspp/fs_interface/Node.h>
 #include "FsBlob.h"
-#include "cryfs/impl/filesystem/fsblobstore/utils/DirEntryList.h"
+#include "cryfs/impl/filesystem/fsblobstore/utils/DirEntryStorage.h"
 #include <mutex>
 
 namespace cryfs {
@@ -18,23 +18,30 @@ namespace cryfs {
         public:
             constexpr static fspp::num_bytes_t DIR_LSTAT_SIZE = fspp::num_bytes_t(4096);
 
+            // If hashedDirectoryPageSize is set, the directory is converted to the hashed layout with pages of this size
+            // once it outgrows a single page. Otherwise, it is kept in the flat layout.
+            // Without sizeHints, setSizeHintForChild() does nothing, so entries stay readable by older versions.
             static cpputils::unique_ref<DirBlob> InitializeEmptyDir(cpputils::unique_ref<blobstore::Blob> blob,
-                                                                    const blockstore::BlockId &parent);
+                                                                    const blockstore::BlockId &parent,
+                                                                    boost::optional<uint32_t> hashedDirectoryPageSize,
+                                                                    bool sizeHints);
 
-            DirBlob(cpputils::unique_ref<blobstore::Blob> blob);
+            DirBlob(cpputils::unique_ref<blobstore::Blob> blob, boost::optional<uint32_t> hashedDirectoryPageSize, bool sizeHints);
 
             ~DirBlob() override;
 
             void AppendChildrenTo(std::vector<fspp::Dir::Entry> *result) const;
 
+            void AppendChildEntriesTo(std::vector<DirEntry> *result) const;
+
             fspp::num_bytes_t lstat_size() const override;
 
             //TODO Test NumChildren()
             size_t NumChildren() const;
 
-            boost::optional<const DirEntry&> GetChild(const std::string &name) const;
+            boost::optional<DirEntry> GetChild(const std::string &name) const;
 
-            boost::optional<const DirEntry&> GetChild(const blockstore::BlockId &blobId) const;
+            boost::optional<DirEntry> GetChild(const blockstore::BlockId &blobId) const;
 
             void AddChildDir(const std::string &name, const blockstore::BlockId &blobId, fspp::mode_t mode, fspp::uid_t uid,
                              fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime);
@@ -56,9 +63,11 @@ namespace cryfs {
 
             void flush();
 
-            void updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior);
+            void updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now);
+
+            void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now);
 
-            void updateModificationTimestampForChild(const blockstore::BlockId &blockId);
+            void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size);
 
             void chmodChild(const blockstore::BlockId &blockId, fspp::mode_t mode);
 
@@ -70,14 +79,17 @@ namespace cryfs {
 
             void _addChild(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType type,
                           fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime);
-            void _readEntriesFromBlob();
+            static cpputils::unique_ref<DirEntryStorage> _loadEntries(FsBlobView *blob);
             void _writeEntriesToBlob();
+            void _convertToHashedFormat();
 
             cpputils::unique_ref<blobstore::Blob> releaseBaseBlob() override;
 
-            DirEntryList _entries;
+            boost::optional<uint32_t> _hashedDirectoryPageSize;
+            bool _sizeHints;
+            bool _isHashed;
+            cpputils::unique_ref<DirEntryStorage> _entries;
             mutable std::mutex _entriesAndChangedMutex;
-            bool _changed;
 
             DISALLOW_COPY_AND_ASSIGN(DirBlob);
         };
@@ -14,6 +14,8 @@ namespace fsblobstore {
 FileBlob::FileBlob(unique_ref<Blob> blob)
 : FsBlob(std::move(blob)) {
   ASSERT(baseBlob().blobType() == FsBlobView::BlobType::FILE, "Loaded blob is not a file");
+  // Large files are mostly accessed sequentially. Directories stay with small leaves because they're rewritten often.
+  baseBlob().allowLargeLeaves();
 }
 
 unique_ref<FileBlob> FileBlob::InitializeEmptyFile(unique_ref<Blob> blob, const blockstore::BlockId &parent) {
@@ -2,6 +2,7 @@
 #include "FileBlob.h"
 #include "DirBlob.h"
 #include "SymlinkBlob.h"
+#include "utils/HashedDirEntryStorage.h"
 #include <cryfs/impl/config/CryConfigFile.h>
 #include <cpp-utils/process/SignalCatcher.h>
 
@@ -24,8 +25,8 @@ boost::optional<unique_ref<FsBlob>> FsBlobStore::load(const blockstore::BlockId
     const FsBlobView::BlobType blobType = FsBlobView::blobType(**blob);
     if (blobType == FsBlobView::BlobType::FILE) {
         return unique_ref<FsBlob>(make_unique_ref<FileBlob>(std::move(*blob)));
-    } else if (blobType == FsBlobView::BlobType::DIR) {
-        return unique_ref<FsBlob>(make_unique_ref<DirBlob>(std::move(*blob)));
+    } else if (blobType == FsBlobView::BlobType::DIR || blobType == FsBlobView::BlobType::HASHED_DIR) {
+        return unique_ref<FsBlob>(make_unique_ref<DirBlob>(std::move(*blob), _hashedDirectoryPageSize, _sizeHints));
     } else if (blobType == FsBlobView::BlobType::SYMLINK) {
         return unique_ref<FsBlob>(make_unique_ref<SymlinkBlob>(std::move(*blob)));
     } else {
@@ -33,8 +34,18 @@ boost::optional<unique_ref<FsBlob>> FsBlobStore::load(const blockstore::BlockId
     }
 }
 
+boost::optional<uint32_t> FsBlobStore::_calculateHashedDirectoryPageSize(const BlobStore &baseBlobStore, bool hashedDirectories) {
+    if (!hashedDirectories) {
+        return none;
+    }
+    // Pages are a whole number of leaves, so they are aligned to leaf boundaries
+    const uint64_t leafSize = baseBlobStore.virtualBlocksizeBytes();
+    const uint64_t leavesPerPage = (HashedDirEntryStorage::MIN_PAGE_SIZE + leafSize - 1) / leafSize;
+    return static_cast<uint32_t>(leavesPerPage * leafSize);
+}
+
 #ifndef CRYFS_NO_COMPATIBILITY
-    unique_ref<FsBlobStore> FsBlobStore::migrate(unique_ref<BlobStore> blobStore, const blockstore::BlockId &rootBlobId) {
+    unique_ref<FsBlobStore> FsBlobStore::migrate(unique_ref<BlobStore> blobStore, const blockstore::BlockId &rootBlobId, bool hashedDirectories, bool sizeHints) {
         SignalCatcher signalCatcher;
 
         auto rootBlob = blobStore->load(rootBlobId);
@@ -42,7 +53,7 @@ boost::optional<unique_ref<FsBlob>> FsBlobStore::load(const blockstore::BlockId
             throw std::runtime_error("Could not load root blob");
         }
 
-        auto fsBlobStore = make_unique_ref<FsBlobStore>(std::move(blobStore));
+        auto fsBlobStore = make_unique_ref<FsBlobStore>(std::move(blobStore), hashedDirectories, sizeHints);
 
         uint64_t migratedBlocks = 0;
         fsBlobStore->_migrate(std::move(*rootBlob), blockstore::BlockId::Null(), &signalCatcher, [&] (uint32_t numNodes) {
@@ -57,7 +68,7 @@ boost::optional<unique_ref<FsBlob>> FsBlobStore::load(const blockstore::BlockId
         FsBlobView::migrate(node.get(), parentId);
         perBlobCallback(node->numNodes());
         if (FsBlobView::blobType(*node) == FsBlobView::BlobType::DIR) {
-            const DirBlob dir(std::move(node));
+            const DirBlob dir(std::move(node), none, false);
             vector<fspp::Dir::Entry> children;
             dir.AppendChildrenTo(&children);
             for (const auto &child : children) {
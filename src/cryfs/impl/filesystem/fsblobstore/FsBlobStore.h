@@ -18,9 +18,16 @@ namespace cryfs {
 
         class FsBlobStore final {
         public:
-            FsBlobStore(cpputils::unique_ref<blobstore::BlobStore> baseBlobStore);
+            // If hashedDirectories is set, directories outgrowing a single leaf are converted to the hashed, paged layout.
+            // If sizeHints is set, directory entries store the size of the files they point to.
+            FsBlobStore(cpputils::unique_ref<blobstore::BlobStore> baseBlobStore, bool hashedDirectories, bool sizeHints);
 
             cpputils::unique_ref<FileBlob> createFileBlob(const blockstore::BlockId &parent);
+            // Copies the blocks of the source file directly, without going through its plaintext.
+            // See blobstore::BlobStore::createCopyOf() for onBlockCopied.
+            cpputils::unique_ref<FileBlob> createFileBlobAsCopyOf(const FileBlob &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied);
+            // The clone shares the blocks of the source until one of them is modified
+            cpputils::unique_ref<FileBlob> createFileBlobAsCloneOf(const FileBlob &source, const blockstore::BlockId &parent);
             cpputils::unique_ref<DirBlob> createDirBlob(const blockstore::BlockId &parent);
             cpputils::unique_ref<SymlinkBlob> createSymlinkBlob(const boost::filesystem::path &target, const blockstore::BlockId &parent);
             boost::optional<cpputils::unique_ref<FsBlob>> load(const blockstore::BlockId &blockId);
@@ -32,7 +39,7 @@ namespace cryfs {
             uint64_t virtualBlocksizeBytes() const;
 
 #ifndef CRYFS_NO_COMPATIBILITY
-            static cpputils::unique_ref<FsBlobStore> migrate(cpputils::unique_ref<blobstore::BlobStore> blobStore, const blockstore::BlockId &blockId);
+            static cpputils::unique_ref<FsBlobStore> migrate(cpputils::unique_ref<blobstore::BlobStore> blobStore, const blockstore::BlockId &blockId, bool hashedDirectories, bool sizeHints);
 #endif
 
         private:
@@ -42,14 +49,17 @@ namespace cryfs {
 #endif
 
             std::function<fspp::num_bytes_t(const blockstore::BlockId &)> _getLstatSize();
+            static boost::optional<uint32_t> _calculateHashedDirectoryPageSize(const blobstore::BlobStore &baseBlobStore, bool hashedDirectories);
 
             cpputils::unique_ref<blobstore::BlobStore> _baseBlobStore;
+            boost::optional<uint32_t> _hashedDirectoryPageSize;
+            bool _sizeHints;
 
             DISALLOW_COPY_AND_ASSIGN(FsBlobStore);
         };
 
-        inline FsBlobStore::FsBlobStore(cpputils::unique_ref<blobstore::BlobStore> baseBlobStore)
-                : _baseBlobStore(std::move(baseBlobStore)) {
+        inline FsBlobStore::FsBlobStore(cpputils::unique_ref<blobstore::BlobStore> baseBlobStore, bool hashedDirectories, bool sizeHints)
+                : _baseBlobStore(std::move(baseBlobStore)), _hashedDirectoryPageSize(_calculateHashedDirectoryPageSize(*_baseBlobStore, hashedDirectories)), _sizeHints(sizeHints) {
         }
 
         inline cpputils::unique_ref<FileBlob> FsBlobStore::createFileBlob(const blockstore::BlockId &parent) {
@@ -57,9 +67,21 @@ namespace cryfs {
             return FileBlob::InitializeEmptyFile(std::move(blob), parent);
         }
 
+        inline cpputils::unique_ref<FileBlob> FsBlobStore::createFileBlobAsCopyOf(const FileBlob &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied) {
+            auto blob = cpputils::make_unique_ref<FileBlob>(_baseBlobStore->createCopyOf(source.baseBlob().baseBlob(), onBlockCopied));
+            blob->setParentPointer(parent);
+            return blob;
+        }
+
+        inline cpputils::unique_ref<FileBlob> FsBlobStore::createFileBlobAsCloneOf(const FileBlob &source, const blockstore::BlockId &parent) {
+            auto blob = cpputils::make_unique_ref<FileBlob>(_baseBlobStore->createCloneOf(source.baseBlob().baseBlob()));
+            blob->setParentPointer(parent);
+            return blob;
+        }
+
         inline cpputils::unique_ref<DirBlob> FsBlobStore::createDirBlob(const blockstore::BlockId &parent) {
             auto blob = _baseBlobStore->create();
-            return DirBlob::InitializeEmptyDir(std::move(blob), parent);
+            return DirBlob::InitializeEmptyDir(std::move(blob), parent, _hashedDirectoryPageSize, _sizeHints);
         }
 
         inline cpputils::unique_ref<SymlinkBlob> FsBlobStore::createSymlinkBlob(const boost::filesystem::path &target, const blockstore::BlockId &parent) {
@@ -14,9 +14,14 @@ namespace cryfs {
         enum class BlobType : uint8_t {
             DIR = 0x00,
             FILE = 0x01,
-            SYMLINK = 0x02
+            SYMLINK = 0x02,
+            // Directory whose entries are stored in hash-bucketed pages (see HashedDirEntryStorage)
+            HASHED_DIR = 0x03
         };
 
+        static constexpr uint16_t FORMAT_VERSION_HEADER = 1;
+        static constexpr unsigned int HEADER_SIZE = sizeof(FORMAT_VERSION_HEADER) + sizeof(uint8_t) + blockstore::BlockId::BINARY_LENGTH;
+
         FsBlobView(cpputils::unique_ref<blobstore::Blob> baseBlob): _baseBlob(std::move(baseBlob)), _parentPointer(blockstore::BlockId::Null()) {
             _checkHeader(*_baseBlob);
             _loadParentPointer();
@@ -40,6 +45,11 @@ namespace cryfs {
             return _blobType(*_baseBlob);
         }
 
+        void setBlobType(BlobType blobType) {
+            uint8_t blobTypeInt = static_cast<uint8_t>(blobType);
+            _baseBlob->write(&blobTypeInt, sizeof(FORMAT_VERSION_HEADER), sizeof(uint8_t));
+        }
+
         const blockstore::BlockId &parentPointer() const {
             return _parentPointer;
         }
@@ -62,10 +72,9 @@ namespace cryfs {
         }
 
         cpputils::Data readAll() const override {
-            cpputils::Data data = _baseBlob->readAll();
-            cpputils::Data dataWithoutHeader(data.size() - HEADER_SIZE);
-            //Can we avoid this memcpy? Maybe by having Data::subdata() that returns a reference to the same memory region? Should we?
-            std::memcpy(dataWithoutHeader.data(), data.dataOffset(HEADER_SIZE), dataWithoutHeader.size());
+            // Read the payload directly into its target instead of reading the header along and copying it out afterwards
+            cpputils::Data dataWithoutHeader(size());
+            _baseBlob->read(dataWithoutHeader.data(), HEADER_SIZE, dataWithoutHeader.size());
             return dataWithoutHeader;
         }
 
@@ -89,6 +98,14 @@ namespace cryfs {
             return _baseBlob->numNodes();
         }
 
+        void allowLargeLeaves() override {
+            return _baseBlob->allowLargeLeaves();
+        }
+
+        const blobstore::Blob &baseBlob() const {
+            return *_baseBlob;
+        }
+
         cpputils::unique_ref<blobstore::Blob> releaseBaseBlob() {
             return std::move(_baseBlob);
         }
@@ -105,9 +122,6 @@ namespace cryfs {
 #endif
 
     private:
-        static constexpr uint16_t FORMAT_VERSION_HEADER = 1;
-        static constexpr unsigned int HEADER_SIZE = sizeof(FORMAT_VERSION_HEADER) + sizeof(uint8_t) + blockstore::BlockId::BINARY_LENGTH;
-
         static void _checkHeader(const blobstore::Blob &blob) {
             const uint16_t actualFormatVersion = getFormatVersionHeader(blob);
             if (FORMAT_VERSION_HEADER != actualFormatVersion) {
@@ -7,19 +7,26 @@
 #include <fspp/fs_interface/Types.h>
 #include <cpp-utils/system/time.h>
 #include <sys/stat.h>
+#include <boost/optional.hpp>
+#include <limits>
 
 namespace cryfs {
     namespace fsblobstore {
 
         class DirEntry final {
         public:
+            // Entries that have a size hint field are marked by this flag in the serialized type byte.
+            // The field is stored behind the blockId. Entries without the flag use the original serialization format.
+            static constexpr uint8_t SIZE_HINT_FLAG = 0x80;
+            // Value of the size hint field if the file was modified after the hint was stored
+            static constexpr uint64_t INVALID_SIZE_HINT = std::numeric_limits<uint64_t>::max();
+
             DirEntry(fspp::Dir::EntryType type, const std::string &name, const blockstore::BlockId &blockId, fspp::mode_t mode,
                   fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
-                  timespec lastMetadataChangeTime);
+                  timespec lastMetadataChangeTime, boost::optional<uint64_t> sizeHintField = boost::none);
 
             void serialize(uint8_t* dest) const;
             size_t serializedSize() const;
-            static const char *deserializeAndAddToVector(const char *pos, std::vector<DirEntry> *result);
 
             fspp::Dir::EntryType type() const;
             void setType(fspp::Dir::EntryType value);
@@ -46,6 +53,14 @@ namespace cryfs {
 
             timespec lastMetadataChangeTime() const;
 
+            // Size of the file at the time it was last closed. Is none if the entry doesn't have a hint
+            // or if the file was modified afterwards, callers then have to load the file blob to get its size.
+            boost::optional<fspp::num_bytes_t> sizeHint() const;
+            void setSizeHint(fspp::num_bytes_t value);
+            // Keeps the size hint field, so that the entry keeps its size and can be updated in place.
+            void invalidateSizeHint();
+            boost::optional<uint64_t> sizeHintField() const;
+
         private:
 
             void _updateLastMetadataChangeTime();
@@ -59,13 +74,14 @@ namespace cryfs {
             timespec _lastAccessTime;
             timespec _lastModificationTime;
             timespec _lastMetadataChangeTime;
+            boost::optional<uint64_t> _sizeHintField;
         };
 
         inline DirEntry::DirEntry(fspp::Dir::EntryType type, const std::string &name, const blockstore::BlockId &blockId, fspp::mode_t mode,
             fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
-            timespec lastMetadataChangeTime)
+            timespec lastMetadataChangeTime, boost::optional<uint64_t> sizeHintField)
                 : _type(type), _name(name), _blockId(blockId), _mode(mode), _uid(uid), _gid(gid), _lastAccessTime(lastAccessTime),
-                _lastModificationTime(lastModificationTime), _lastMetadataChangeTime(lastMetadataChangeTime) {
+                _lastModificationTime(lastModificationTime), _lastMetadataChangeTime(lastMetadataChangeTime), _sizeHintField(sizeHintField) {
             switch (_type) {
                 case fspp::Dir::EntryType::FILE:
                     _mode.addFileFlag();
@@ -118,6 +134,28 @@ namespace cryfs {
             return _lastMetadataChangeTime;
         }
 
+        inline boost::optional<fspp::num_bytes_t> DirEntry::sizeHint() const {
+            if (_sizeHintField == boost::none || *_sizeHintField == INVALID_SIZE_HINT) {
+                return boost::none;
+            }
+            return fspp::num_bytes_t(static_cast<int64_t>(*_sizeHintField));
+        }
+
+        inline void DirEntry::setSizeHint(fspp::num_bytes_t value) {
+            ASSERT(value.value() >= 0, "Invalid size");
+            _sizeHintField = static_cast<uint64_t>(value.value());
+        }
+
+        inline void DirEntry::invalidateSizeHint() {
+            if (_sizeHintField != boost::none) {
+                _sizeHintField = INVALID_SIZE_HINT;
+            }
+        }
+
+        inline boost::optional<uint64_t> DirEntry::sizeHintField() const {
+            return _sizeHintField;
+        }
+
         inline void DirEntry::setType(fspp::Dir::EntryType value) {
             _type = value;
             _updateLastMetadataChangeTime();
@@ -1,5 +1,7 @@
 #include "DirEntryList.h"
 #include <limits>
+#include <algorithm>
+#include <cstring>
 #include <cpp-utils/system/time.h>
 
 //TODO Get rid of that in favor of better error handling
@@ -8,44 +10,136 @@
 using cpputils::Data;
 using std::string;
 using std::vector;
+using std::pair;
 using blockstore::BlockId;
+using boost::optional;
+using boost::none;
 
 namespace cryfs {
 namespace fsblobstore {
 
-DirEntryList::DirEntryList() : _entries() {
+DirEntryList::DirEntryList() : _serialized(0), _serializedSize(0), _slots(), _dirtyRanges() {
 }
 
 Data DirEntryList::serialize() const {
-    Data serialized(_serializedSize());
-    unsigned int offset = 0;
-    for (auto iter = _entries.begin(); iter != _entries.end(); ++iter) {
-        ASSERT(iter == _entries.begin() || std::less<BlockId>()((iter-1)->blockId(), iter->blockId()), "Invariant hurt: Directory entries should be ordered by blockId and not have duplicate blockIds.");
-        iter->serialize(static_cast<uint8_t*>(serialized.dataOffset(offset)));
-        offset += iter->serializedSize();
-    }
+    Data serialized(_serializedSize);
+    std::memcpy(serialized.data(), _serialized.data(), _serializedSize);
     return serialized;
 }
 
-uint64_t DirEntryList::_serializedSize() const {
-    uint64_t serializedSize = 0;
-    for (const auto &entry : _entries) {
-        serializedSize += entry.serializedSize();
+uint64_t DirEntryList::serializedSize() const {
+    return _serializedSize;
+}
+
+void DirEntryList::deserializeFrom(Data data) {
+    _slots.clear();
+    _dirtyRanges.clear();
+    _serializedSize = data.size();
+    _serialized = std::move(data);
+    uint64_t offset = 0;
+    while (offset < _serializedSize) {
+        const size_t entrySize = DirEntryView::serializedSizeAt(_serialized.dataOffset(offset), _serializedSize - offset);
+        _slots.push_back(Slot{offset, entrySize});
+        ASSERT(_slots.size() == 1 || std::less<BlockId>()(_blockIdAt(_slots.size()-2), _blockIdAt(_slots.size()-1)), "Invariant hurt: Directory entries should be ordered by blockId and not have duplicate blockIds.");
+        offset += entrySize;
+    }
+}
+
+bool DirEntryList::hasChanges() const {
+    return !_dirtyRanges.empty();
+}
+
+void DirEntryList::serializeChanges(std::function<void (uint64_t offset, const void *data, uint64_t size)> writer) {
+    std::sort(_dirtyRanges.begin(), _dirtyRanges.end());
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    for (const auto &range : _dirtyRanges) {
+        const uint64_t rangeBegin = std::min(range.first, _serializedSize);
+        const uint64_t rangeEnd = std::min(range.second, _serializedSize);
+        if (rangeBegin > end) {
+            if (end > begin) {
+                writer(begin, _serialized.dataOffset(begin), end - begin);
+            }
+            begin = rangeBegin;
+        }
+        end = std::max(end, rangeEnd);
+    }
+    if (end > begin) {
+        writer(begin, _serialized.dataOffset(begin), end - begin);
+    }
+    _dirtyRanges.clear();
+}
+
+void DirEntryList::_markDirty(uint64_t begin, uint64_t end) {
+    if (!_dirtyRanges.empty() && _dirtyRanges.back().second >= begin && _dirtyRanges.back().first <= end) {
+        // Most modifications hit the same or an adjacent region as the last one, merge them right away
+        _dirtyRanges.back() = std::make_pair(std::min(begin, _dirtyRanges.back().first), std::max(end, _dirtyRanges.back().second));
+    } else {
+        _dirtyRanges.emplace_back(begin, end);
+    }
+}
+
+DirEntryView DirEntryList::_view(size_t index) const {
+    ASSERT(index < _slots.size(), "Index out of range");
+    return DirEntryView(_serialized.dataOffset(_slots[index].offset), _slots[index].size);
+}
+
+BlockId DirEntryList::_blockIdAt(size_t index) const {
+    return _view(index).blockId();
+}
+
+void DirEntryList::_store(size_t index, const DirEntry &entry) {
+    ASSERT(index < _slots.size(), "Index out of range");
+    if (entry.serializedSize() == _slots[index].size) {
+        // Only fixed size fields changed, we can overwrite the entry in place.
+        entry.serialize(static_cast<uint8_t*>(_serialized.dataOffset(_slots[index].offset)));
+        _markDirty(_slots[index].offset, _slots[index].offset + _slots[index].size);
+    } else {
+        _splice(index, _slots[index].size, &entry);
     }
-    return serializedSize;
 }
 
-void DirEntryList::deserializeFrom(const void *data, uint64_t size) {
-    _entries.clear();
-    const char *pos = static_cast<const char*>(data);
-    while (pos < static_cast<const char*>(data) + size) {
-        pos = DirEntry::deserializeAndAddToVector(pos, &_entries);
-        ASSERT(_entries.size() == 1 || std::less<BlockId>()(_entries[_entries.size()-2].blockId(), _entries[_entries.size()-1].blockId()), "Invariant hurt: Directory entries should be ordered by blockId and not have duplicate blockIds.");
+void DirEntryList::_insert(size_t index, const DirEntry &entry) {
+    ASSERT(index <= _slots.size(), "Index out of range");
+    const uint64_t offset = (index == _slots.size()) ? _serializedSize : _slots[index].offset;
+    _slots.insert(_slots.begin() + index, Slot{offset, 0});
+    _splice(index, 0, &entry);
+}
+
+void DirEntryList::_erase(size_t index) {
+    _splice(index, _slots[index].size, nullptr);
+    _slots.erase(_slots.begin() + index);
+}
+
+void DirEntryList::_splice(size_t index, uint64_t oldSize, const DirEntry *newEntry) {
+    // Replaces the oldSize bytes at the slot with the serialized newEntry (or with nothing if newEntry is nullptr).
+    // All entries behind it are moved, so everything from the slot on has to be written back.
+    const uint64_t offset = _slots[index].offset;
+    const uint64_t newSize = (newEntry == nullptr) ? 0 : newEntry->serializedSize();
+    const uint64_t newSerializedSize = _serializedSize - oldSize + newSize;
+    const uint64_t tailOffset = offset + oldSize;
+    const uint64_t tailSize = _serializedSize - tailOffset;
+    if (newSerializedSize > _serialized.size()) {
+        Data grown(std::max(newSerializedSize, static_cast<uint64_t>(2 * _serialized.size())));
+        std::memcpy(grown.data(), _serialized.data(), offset);
+        std::memcpy(grown.dataOffset(offset + newSize), _serialized.dataOffset(tailOffset), tailSize);
+        _serialized = std::move(grown);
+    } else {
+        std::memmove(_serialized.dataOffset(offset + newSize), _serialized.dataOffset(tailOffset), tailSize);
+    }
+    if (newEntry != nullptr) {
+        newEntry->serialize(static_cast<uint8_t*>(_serialized.dataOffset(offset)));
     }
+    _serializedSize = newSerializedSize;
+    _slots[index].size = newSize;
+    for (size_t i = index + 1; i < _slots.size(); ++i) {
+        _slots[i].offset = _slots[i].offset - oldSize + newSize;
+    }
+    _markDirty(offset, std::numeric_limits<uint64_t>::max());
 }
 
 bool DirEntryList::_hasChild(const string &name) const {
-    return _entries.end() != _findByName(name);
+    return _slots.size() != _findByName(name);
 }
 
 void DirEntryList::add(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
@@ -59,15 +153,22 @@ void DirEntryList::add(const string &name, const BlockId &blobId, fspp::Dir::Ent
 void DirEntryList::_add(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
                        fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
     auto insert_pos = _findUpperBound(blobId);
-    _entries.emplace(insert_pos, entryType, name, blobId, mode, uid, gid, lastAccessTime, lastModificationTime, cpputils::time::now());
+    _insert(insert_pos, DirEntry(entryType, name, blobId, mode, uid, gid, lastAccessTime, lastModificationTime, cpputils::time::now()));
+}
+
+void DirEntryList::add(const DirEntry &entry) {
+    if (_hasChild(entry.name())) {
+        throw fspp::fuse::FuseErrnoException(EEXIST);
+    }
+    _insert(_findUpperBound(entry.blockId()), entry);
 }
 
 void DirEntryList::addOrOverwrite(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
                        fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
                        std::function<void (const blockstore::BlockId &blockId)> onOverwritten) {
     auto found = _findByName(name);
-    if (found != _entries.end()) {
-        onOverwritten(found->blockId());
+    if (found != _slots.size()) {
+        onOverwritten(_blockIdAt(found));
         _overwrite(found, name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
     } else {
         _add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
@@ -76,24 +177,20 @@ void DirEntryList::addOrOverwrite(const string &name, const BlockId &blobId, fsp
 
 void DirEntryList::rename(const blockstore::BlockId &blockId, const std::string &name, std::function<void (const blockstore::BlockId &blockId)> onOverwritten) {
     auto foundSameName = _findByName(name);
-    if (foundSameName != _entries.end() && foundSameName->blockId() != blockId) {
-        auto found = _findById(blockId);
-        if (found == _entries.end()) {
-            throw fspp::fuse::FuseErrnoException(ENOENT);
-        }
-        _checkAllowedOverwrite(foundSameName->type(), found->type());
-        onOverwritten(foundSameName->blockId());
-        _entries.erase(foundSameName);
+    if (foundSameName != _slots.size() && _blockIdAt(foundSameName) != blockId) {
+        auto found = _findByIdOrThrow(blockId);
+        checkAllowedOverwrite(_view(foundSameName).type(), _view(found).type());
+        onOverwritten(_blockIdAt(foundSameName));
+        _erase(foundSameName);
     }
 
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
-    found->setName(name);
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
+    entry.setName(name);
+    _store(found, entry);
 }
 
-void DirEntryList::_checkAllowedOverwrite(fspp::Dir::EntryType oldType, fspp::Dir::EntryType newType) {
+void DirEntryList::checkAllowedOverwrite(fspp::Dir::EntryType oldType, fspp::Dir::EntryType newType) {
     if (oldType != newType) {
         if (oldType == fspp::Dir::EntryType::DIR) {
             // new path is an existing directory, but old path is not a directory
@@ -106,180 +203,186 @@ void DirEntryList::_checkAllowedOverwrite(fspp::Dir::EntryType oldType, fspp::Di
     }
 }
 
-void DirEntryList::_overwrite(vector<DirEntry>::iterator entry, const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
+void DirEntryList::_overwrite(size_t index, const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
                         fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
-    _checkAllowedOverwrite(entry->type(), entryType);
+    checkAllowedOverwrite(_view(index).type(), entryType);
     // The new entry has possibly a different blockId, so it has to be in a different list position (list is ordered by blockIds).
     // That's why we remove-and-add instead of just modifying the existing entry.
-    _entries.erase(entry);
+    _erase(index);
     _add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
 }
 
-boost::optional<const DirEntry&> DirEntryList::get(const string &name) const {
+optional<DirEntryView> DirEntryList::get(const string &name) const {
     auto found = _findByName(name);
-    if (found == _entries.end()) {
-        return boost::none;
+    if (found == _slots.size()) {
+        return none;
     }
-    return *found;
+    return _view(found);
 }
 
-boost::optional<const DirEntry&> DirEntryList::get(const BlockId &blockId) const {
+optional<DirEntryView> DirEntryList::get(const BlockId &blockId) const {
     auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        return boost::none;
+    if (found == _slots.size()) {
+        return none;
     }
-    return *found;
+    return _view(found);
 }
 
 void DirEntryList::remove(const string &name) {
     auto found = _findByName(name);
-    if (found == _entries.end()) {
+    if (found == _slots.size()) {
         throw fspp::fuse::FuseErrnoException(ENOENT);
     }
-    _entries.erase(found);
+    _erase(found);
 }
 
 void DirEntryList::remove(const BlockId &blockId) {
     auto lowerBound = _findLowerBound(blockId);
-    auto upperBound = std::find_if(lowerBound, _entries.end(), [&blockId] (const DirEntry &entry) {
-        return entry.blockId() != blockId;
-    });
-    _entries.erase(lowerBound, upperBound);
+    while (lowerBound != _slots.size() && _blockIdAt(lowerBound) == blockId) {
+        _erase(lowerBound);
+    }
 }
 
-vector<DirEntry>::iterator DirEntryList::_findByName(const string &name) {
-    return std::find_if(_entries.begin(), _entries.end(), [&name] (const DirEntry &entry) {
-        return entry.name() == name;
-    });
+size_t DirEntryList::_findByName(const string &name) const {
+    const boost::string_view nameView(name);
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        if (_view(i).name() == nameView) {
+            return i;
+        }
+    }
+    return _slots.size();
 }
 
-vector<DirEntry>::const_iterator DirEntryList::_findByName(const string &name) const {
-    return const_cast<DirEntryList*>(this)->_findByName(name);
+size_t DirEntryList::_findById(const BlockId &blockId) const {
+    auto found = _findLowerBound(blockId);
+    if (found == _slots.size() || _blockIdAt(found) != blockId) {
+        return _slots.size();
+    }
+    return found;
 }
 
-vector<DirEntry>::iterator DirEntryList::_findById(const BlockId &blockId) {
-    auto found = _findLowerBound(blockId);
-    if (found == _entries.end() || found->blockId() != blockId) {
-        return _entries.end();
+size_t DirEntryList::_findByIdOrThrow(const BlockId &blockId) const {
+    auto found = _findById(blockId);
+    if (found == _slots.size()) {
+        throw fspp::fuse::FuseErrnoException(ENOENT);
     }
     return found;
 }
 
-vector<DirEntry>::iterator DirEntryList::_findLowerBound(const BlockId &blockId) {
-    return _findFirst(blockId, [&blockId] (const DirEntry &entry) {
-        return !std::less<BlockId>()(entry.blockId(), blockId);
+size_t DirEntryList::_findLowerBound(const BlockId &blockId) const {
+    return _findFirst(blockId, [&blockId] (const BlockId &entryId) {
+        return !std::less<BlockId>()(entryId, blockId);
     });
 }
 
-vector<DirEntry>::iterator DirEntryList::_findUpperBound(const BlockId &blockId) {
-    return _findFirst(blockId, [&blockId] (const DirEntry &entry) {
-        return std::less<BlockId>()(blockId, entry.blockId());
+size_t DirEntryList::_findUpperBound(const BlockId &blockId) const {
+    return _findFirst(blockId, [&blockId] (const BlockId &entryId) {
+        return std::less<BlockId>()(blockId, entryId);
     });
 }
 
-vector<DirEntry>::iterator DirEntryList::_findFirst(const BlockId &hint, std::function<bool (const DirEntry&)> pred) {
+size_t DirEntryList::_findFirst(const BlockId &hint, std::function<bool (const BlockId&)> pred) const {
     //TODO Factor out a datastructure that keeps a sorted std::vector and allows these _findLowerBound()/_findUpperBound operations using this hinted linear search
-    if (_entries.size() == 0) {
-        return _entries.end();
+    if (_slots.size() == 0) {
+        return 0;
     }
     const double startpos_percent = static_cast<double>(*static_cast<const unsigned char*>(hint.data().data())) / std::numeric_limits<unsigned char>::max();
-    auto iter = _entries.begin() + static_cast<int>(startpos_percent * static_cast<double>(_entries.size()-1));
-    ASSERT(iter >= _entries.begin() && iter < _entries.end(), "Startpos out of range");
-    while(iter != _entries.begin() && pred(*iter)) {
-        --iter;
+    size_t index = static_cast<size_t>(startpos_percent * static_cast<double>(_slots.size()-1));
+    ASSERT(index < _slots.size(), "Startpos out of range");
+    while(index != 0 && pred(_blockIdAt(index))) {
+        --index;
     }
-    while(iter != _entries.end() && !pred(*iter)) {
-        ++iter;
+    while(index != _slots.size() && !pred(_blockIdAt(index))) {
+        ++index;
     }
-    return iter;
-}
-
-vector<DirEntry>::const_iterator DirEntryList::_findById(const BlockId &blockId) const {
-    return const_cast<DirEntryList*>(this)->_findById(blockId);
+    return index;
 }
 
 size_t DirEntryList::size() const {
-    return _entries.size();
-}
-
-DirEntryList::const_iterator DirEntryList::begin() const {
-    return _entries.begin();
+    return _slots.size();
 }
 
-DirEntryList::const_iterator DirEntryList::end() const {
-    return _entries.end();
+void DirEntryList::forEach(std::function<void (const DirEntryView &entry)> callback) const {
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        callback(_view(i));
+    }
 }
 
 void DirEntryList::setMode(const BlockId &blockId, fspp::mode_t mode) {
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
-    ASSERT ((mode.hasFileFlag() && found->mode().hasFileFlag()) || (mode.hasDirFlag() && found->mode().hasDirFlag()) || (mode.hasSymlinkFlag()), "Unknown mode in entry");
-    found->setMode(mode);
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
+    ASSERT ((mode.hasFileFlag() && entry.mode().hasFileFlag()) || (mode.hasDirFlag() && entry.mode().hasDirFlag()) || (mode.hasSymlinkFlag()), "Unknown mode in entry");
+    entry.setMode(mode);
+    _store(found, entry);
 }
 
 bool DirEntryList::setUidGid(const BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) {
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
     bool changed = false;
     if (uid != fspp::uid_t(-1)) {
-        found->setUid(uid);
+        entry.setUid(uid);
         changed = true;
     }
     if (gid != fspp::gid_t(-1)) {
-        found->setGid(gid);
+        entry.setGid(gid);
         changed = true;
     }
+    if (changed) {
+        _store(found, entry);
+    }
     return changed;
 }
 
 void DirEntryList::setAccessTimes(const blockstore::BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) {
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
-    found->setLastAccessTime(lastAccessTime);
-    found->setLastModificationTime(lastModificationTime);
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
+    entry.setLastAccessTime(lastAccessTime);
+    entry.setLastModificationTime(lastModificationTime);
+    _store(found, entry);
 }
 
-bool DirEntryList::updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior) {
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
+bool DirEntryList::updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) {
+    auto found = _findByIdOrThrow(blockId);
+    const DirEntryView view = _view(found);
 
-    const timespec lastAccessTime = found->lastAccessTime();
-    const timespec lastModificationTime = found->lastModificationTime();
-    const timespec now = cpputils::time::now();
+    const timespec lastAccessTime = view.lastAccessTime();
+    const timespec lastModificationTime = view.lastModificationTime();
 
-    switch (found->type()) {
+    bool shouldUpdate = false;
+    switch (view.type()) {
         case fspp::Dir::EntryType::FILE:
             // fallthrough
         case fspp::Dir::EntryType::SYMLINK:
-            if (timestampUpdateBehavior->shouldUpdateATimeOnFileRead(lastAccessTime, lastModificationTime, now)) {
-                found->setLastAccessTime(now);
-                return true;
-            }
-            return false;
+            shouldUpdate = timestampUpdateBehavior->shouldUpdateATimeOnFileRead(lastAccessTime, lastModificationTime, now);
+            break;
         case fspp::Dir::EntryType::DIR:
-            if (timestampUpdateBehavior->shouldUpdateATimeOnDirectoryRead(lastAccessTime, lastModificationTime, now)) {
-                found->setLastAccessTime(now);
-                return true;
-            }
-            return false;
+            shouldUpdate = timestampUpdateBehavior->shouldUpdateATimeOnDirectoryRead(lastAccessTime, lastModificationTime, now);
+            break;
+        default:
+            throw std::logic_error("Unhandled case");
     }
-    throw std::logic_error("Unhandled case");
+    if (shouldUpdate) {
+        DirEntry entry = view.materialize();
+        entry.setLastAccessTime(now);
+        _store(found, entry);
+    }
+    return shouldUpdate;
 }
 
-void DirEntryList::updateModificationTimestampForChild(const blockstore::BlockId &blockId) {
-    auto found = _findById(blockId);
-    if (found == _entries.end()) {
-        throw fspp::fuse::FuseErrnoException(ENOENT);
-    }
-    found->setLastModificationTime(cpputils::time::now());
+void DirEntryList::updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now) {
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
+    entry.setLastModificationTime(now);
+    entry.invalidateSizeHint();
+    _store(found, entry);
+}
+
+void DirEntryList::setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size) {
+    auto found = _findByIdOrThrow(blockId);
+    DirEntry entry = _view(found).materialize();
+    entry.setSizeHint(size);
+    _store(found, entry);
 }
 
 }
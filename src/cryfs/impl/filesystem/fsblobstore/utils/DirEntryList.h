@@ -5,6 +5,7 @@
 #include <cpp-utils/data/Data.h>
 #include <fspp/fs_interface/Context.h>
 #include "DirEntry.h"
+#include "DirEntryView.h"
 #include <vector>
 #include <string>
 
@@ -13,53 +14,76 @@
 namespace cryfs {
     namespace fsblobstore {
 
+        // Directory listing that is kept in its serialized form. Loading a listing only indexes the entry boundaries,
+        // lookups scan the serialized entries in place and an entry is only deserialized into a DirEntry when it is modified.
+        // Modifications are tracked as dirty byte ranges, so that writing back a listing only has to write the changed regions.
         class DirEntryList final {
         public:
-            using const_iterator = std::vector<DirEntry>::const_iterator;
-
             DirEntryList();
 
             cpputils::Data serialize() const;
-            void deserializeFrom(const void *data, uint64_t size);
+            void deserializeFrom(cpputils::Data data);
+
+            uint64_t serializedSize() const;
+            bool hasChanges() const;
+            // Calls the writer for each modified region of the serialized listing and marks the listing as clean.
+            // The caller is responsible for resizing the target to serializedSize() before.
+            void serializeChanges(std::function<void (uint64_t offset, const void *data, uint64_t size)> writer);
 
             void add(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
                      fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime);
+            // Adds an existing entry, keeping all of its timestamps
+            void add(const DirEntry &entry);
             void addOrOverwrite(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
                      fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
                      std::function<void (const blockstore::BlockId &blockId)> onOverwritten);
             void rename(const blockstore::BlockId &blockId, const std::string &name, std::function<void (const blockstore::BlockId &blockId)> onOverwritten);
-            boost::optional<const DirEntry&> get(const std::string &name) const;
-            boost::optional<const DirEntry&> get(const blockstore::BlockId &blockId) const;
+            boost::optional<DirEntryView> get(const std::string &name) const;
+            boost::optional<DirEntryView> get(const blockstore::BlockId &blockId) const;
             void remove(const std::string &name);
             void remove(const blockstore::BlockId &blockId);
 
             size_t size() const;
-            const_iterator begin() const;
-            const_iterator end() const;
+            void forEach(std::function<void (const DirEntryView &entry)> callback) const;
 
             void setMode(const blockstore::BlockId &blockId, fspp::mode_t mode);
             bool setUidGid(const blockstore::BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid);
             void setAccessTimes(const blockstore::BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime);
-            bool updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior);
-            void updateModificationTimestampForChild(const blockstore::BlockId &blockId);
+            bool updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now);
+            void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now);
+            void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size);
+
+            static void checkAllowedOverwrite(fspp::Dir::EntryType oldType, fspp::Dir::EntryType newType);
 
         private:
-            uint64_t _serializedSize() const;
+            struct Slot final {
+                uint64_t offset;
+                uint64_t size;
+            };
+
+            DirEntryView _view(size_t index) const;
+            blockstore::BlockId _blockIdAt(size_t index) const;
+            void _store(size_t index, const DirEntry &entry);
+            void _insert(size_t index, const DirEntry &entry);
+            void _erase(size_t index);
+            void _splice(size_t index, uint64_t oldSize, const DirEntry *newEntry);
+            void _markDirty(uint64_t begin, uint64_t end);
             bool _hasChild(const std::string &name) const;
-            std::vector<DirEntry>::iterator _findByName(const std::string &name);
-            std::vector<DirEntry>::const_iterator _findByName(const std::string &name) const;
-            std::vector<DirEntry>::iterator _findById(const blockstore::BlockId &blockId);
-            std::vector<DirEntry>::const_iterator _findById(const blockstore::BlockId &blockId) const;
-            std::vector<DirEntry>::iterator _findUpperBound(const blockstore::BlockId &blockId);
-            std::vector<DirEntry>::iterator _findLowerBound(const blockstore::BlockId &blockId);
-            std::vector<DirEntry>::iterator _findFirst(const blockstore::BlockId &hint, std::function<bool (const DirEntry&)> pred);
+            size_t _findByName(const std::string &name) const;
+            size_t _findById(const blockstore::BlockId &blockId) const;
+            size_t _findByIdOrThrow(const blockstore::BlockId &blockId) const;
+            size_t _findUpperBound(const blockstore::BlockId &blockId) const;
+            size_t _findLowerBound(const blockstore::BlockId &blockId) const;
+            size_t _findFirst(const blockstore::BlockId &hint, std::function<bool (const blockstore::BlockId&)> pred) const;
             void _add(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
                      fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime);
-            void _overwrite(std::vector<DirEntry>::iterator entry, const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+            void _overwrite(size_t index, const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
                       fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime);
-            static void _checkAllowedOverwrite(fspp::Dir::EntryType oldType, fspp::Dir::EntryType newType);
 
-            std::vector<DirEntry> _entries;
+            cpputils::Data _serialized;
+            uint64_t _serializedSize;
+            std::vector<Slot> _slots;
+            std::vector<std::pair<uint64_t, uint64_t>> _dirtyRanges;
 
             DISALLOW_COPY_AND_ASSIGN(DirEntryList);
         };
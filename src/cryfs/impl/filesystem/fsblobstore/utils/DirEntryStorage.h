@@ -0,0 +1,51 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_DIRENTRYSTORAGE_H
+#define MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_DIRENTRYSTORAGE_H
+
+#include <fspp/fs_interface/Context.h>
+#include "DirEntry.h"
+#include "DirEntryView.h"
+#include <functional>
+
+namespace cryfs {
+    namespace fsblobstore {
+
+        // On-disk layout of the entries of a directory blob. Implementations read lazily from and write back to the blob
+        // they were created for. They aren't thread safe, the DirBlob owning them is responsible for locking.
+        class DirEntryStorage {
+        public:
+            virtual ~DirEntryStorage() = default;
+
+            // Writes all changes back to the blob
+            virtual void flush() = 0;
+            // Number of bytes the entries take in the blob
+            virtual uint64_t serializedSize() const = 0;
+
+            virtual void add(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                             fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) = 0;
+            virtual void add(const DirEntry &entry) = 0;
+            virtual void addOrOverwrite(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                             fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
+                             std::function<void (const blockstore::BlockId &blockId)> onOverwritten) = 0;
+            virtual void rename(const blockstore::BlockId &blockId, const std::string &name, std::function<void (const blockstore::BlockId &blockId)> onOverwritten) = 0;
+            virtual boost::optional<DirEntry> get(const std::string &name) const = 0;
+            virtual boost::optional<DirEntry> get(const blockstore::BlockId &blockId) const = 0;
+            virtual void remove(const std::string &name) = 0;
+            virtual void remove(const blockstore::BlockId &blockId) = 0;
+
+            virtual size_t size() const = 0;
+            virtual void forEach(std::function<void (const DirEntryView &entry)> callback) const = 0;
+
+            virtual void setMode(const blockstore::BlockId &blockId, fspp::mode_t mode) = 0;
+            virtual bool setUidGid(const blockstore::BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) = 0;
+            virtual void setAccessTimes(const blockstore::BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) = 0;
+            virtual bool updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) = 0;
+            // Also invalidates the size hint of the entry
+            virtual void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now) = 0;
+            virtual void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size) = 0;
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "DirEntryView.h"
+#include <cstring>
+
+using std::string;
+
+namespace cryfs {
+    namespace fsblobstore {
+
+        constexpr size_t DirEntryView::TYPE_OFFSET;
+        constexpr size_t DirEntryView::MODE_OFFSET;
+        constexpr size_t DirEntryView::UID_OFFSET;
+        constexpr size_t DirEntryView::GID_OFFSET;
+        constexpr size_t DirEntryView::ATIME_OFFSET;
+        constexpr size_t DirEntryView::TIME_VALUE_SIZE;
+        constexpr size_t DirEntryView::MTIME_OFFSET;
+        constexpr size_t DirEntryView::CTIME_OFFSET;
+        constexpr size_t DirEntryView::NAME_OFFSET;
+
+        size_t DirEntryView::serializedSizeAt(const void *serialized, size_t available) {
+            if (available < NAME_OFFSET + 1 + blockstore::BlockId::BINARY_LENGTH) {
+                throw std::runtime_error("Directory entry is truncated");
+            }
+            const uint8_t typeByte = cpputils::deserializeWithOffset<uint8_t>(serialized, TYPE_OFFSET);
+            const size_t trailerSize = (0 != (typeByte & DirEntry::SIZE_HINT_FLAG)) ? sizeof(uint64_t) : 0;
+            if (available < NAME_OFFSET + 1 + blockstore::BlockId::BINARY_LENGTH + trailerSize) {
+                throw std::runtime_error("Directory entry is truncated");
+            }
+            const char *name = static_cast<const char*>(serialized) + NAME_OFFSET;
+            const void *nameEnd = std::memchr(name, '\0', available - NAME_OFFSET - blockstore::BlockId::BINARY_LENGTH - trailerSize);
+            if (nameEnd == nullptr) {
+                throw std::runtime_error("Directory entry name is not terminated");
+            }
+            return NAME_OFFSET + (static_cast<const char*>(nameEnd) - name) + 1 + blockstore::BlockId::BINARY_LENGTH + trailerSize;
+        }
+
+        DirEntry DirEntryView::materialize() const {
+            const boost::string_view nameView = name();
+            return DirEntry(type(), string(nameView.data(), nameView.size()), blockId(), mode(), uid(), gid(),
+                            lastAccessTime(), lastModificationTime(), lastMetadataChangeTime(), sizeHintField());
+        }
+
+    }
+}
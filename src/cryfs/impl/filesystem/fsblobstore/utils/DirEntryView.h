@@ -0,0 +1,128 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_DIRENTRYVIEW_H
+#define MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_DIRENTRYVIEW_H
+
+#include <boost/utility/string_view.hpp>
+#include <cpp-utils/data/SerializationHelper.h>
+#include "DirEntry.h"
+
+namespace cryfs {
+    namespace fsblobstore {
+
+        // Read-only view on a directory entry in its serialized form (see DirEntry::serialize()).
+        // This allows scanning a directory listing without deserializing all of its entries.
+        // The view is only valid as long as the underlying memory region isn't modified.
+        class DirEntryView final {
+        public:
+            DirEntryView(const void *serialized, size_t serializedSize);
+
+            // Returns the number of bytes the entry starting at the given position takes.
+            // The entry must not exceed the given number of bytes available.
+            static size_t serializedSizeAt(const void *serialized, size_t available);
+
+            fspp::Dir::EntryType type() const;
+            boost::string_view name() const;
+            blockstore::BlockId blockId() const;
+            fspp::mode_t mode() const;
+            fspp::uid_t uid() const;
+            fspp::gid_t gid() const;
+            timespec lastAccessTime() const;
+            timespec lastModificationTime() const;
+            timespec lastMetadataChangeTime() const;
+            boost::optional<uint64_t> sizeHintField() const;
+
+            size_t serializedSize() const;
+
+            DirEntry materialize() const;
+
+            static constexpr size_t TYPE_OFFSET = 0;
+            static constexpr size_t MODE_OFFSET = TYPE_OFFSET + sizeof(uint8_t);
+            static constexpr size_t UID_OFFSET = MODE_OFFSET + sizeof(uint32_t);
+            static constexpr size_t GID_OFFSET = UID_OFFSET + sizeof(uint32_t);
+            static constexpr size_t ATIME_OFFSET = GID_OFFSET + sizeof(uint32_t);
+            static constexpr size_t TIME_VALUE_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+            static constexpr size_t MTIME_OFFSET = ATIME_OFFSET + TIME_VALUE_SIZE;
+            static constexpr size_t CTIME_OFFSET = MTIME_OFFSET + TIME_VALUE_SIZE;
+            static constexpr size_t NAME_OFFSET = CTIME_OFFSET + TIME_VALUE_SIZE;
+
+        private:
+            bool _hasSizeHintField() const;
+            size_t _trailerSize() const;
+            timespec _timeValueAt(size_t offset) const;
+
+            const uint8_t *_serialized;
+            size_t _serializedSize;
+        };
+
+        inline DirEntryView::DirEntryView(const void *serialized, size_t serializedSize)
+            : _serialized(static_cast<const uint8_t*>(serialized)), _serializedSize(serializedSize) {
+            ASSERT(_serializedSize >= NAME_OFFSET + 1 + blockstore::BlockId::BINARY_LENGTH + _trailerSize(), "Serialized entry too small");
+        }
+
+        inline bool DirEntryView::_hasSizeHintField() const {
+            return 0 != (cpputils::deserializeWithOffset<uint8_t>(_serialized, TYPE_OFFSET) & DirEntry::SIZE_HINT_FLAG);
+        }
+
+        inline size_t DirEntryView::_trailerSize() const {
+            return _hasSizeHintField() ? sizeof(uint64_t) : 0;
+        }
+
+        inline fspp::Dir::EntryType DirEntryView::type() const {
+            const uint8_t type = cpputils::deserializeWithOffset<uint8_t>(_serialized, TYPE_OFFSET) & ~DirEntry::SIZE_HINT_FLAG;
+            return static_cast<fspp::Dir::EntryType>(type);
+        }
+
+        inline boost::string_view DirEntryView::name() const {
+            return boost::string_view(reinterpret_cast<const char*>(_serialized + NAME_OFFSET), _serializedSize - NAME_OFFSET - 1 - blockstore::BlockId::BINARY_LENGTH - _trailerSize());
+        }
+
+        inline blockstore::BlockId DirEntryView::blockId() const {
+            return blockstore::BlockId::FromBinary(_serialized + _serializedSize - _trailerSize() - blockstore::BlockId::BINARY_LENGTH);
+        }
+
+        inline boost::optional<uint64_t> DirEntryView::sizeHintField() const {
+            if (!_hasSizeHintField()) {
+                return boost::none;
+            }
+            return cpputils::deserializeWithOffset<uint64_t>(_serialized, _serializedSize - sizeof(uint64_t));
+        }
+
+        inline fspp::mode_t DirEntryView::mode() const {
+            return fspp::mode_t(cpputils::deserializeWithOffset<uint32_t>(_serialized, MODE_OFFSET));
+        }
+
+        inline fspp::uid_t DirEntryView::uid() const {
+            return fspp::uid_t(cpputils::deserializeWithOffset<uint32_t>(_serialized, UID_OFFSET));
+        }
+
+        inline fspp::gid_t DirEntryView::gid() const {
+            return fspp::gid_t(cpputils::deserializeWithOffset<uint32_t>(_serialized, GID_OFFSET));
+        }
+
+        inline timespec DirEntryView::lastAccessTime() const {
+            return _timeValueAt(ATIME_OFFSET);
+        }
+
+        inline timespec DirEntryView::lastModificationTime() const {
+            return _timeValueAt(MTIME_OFFSET);
+        }
+
+        inline timespec DirEntryView::lastMetadataChangeTime() const {
+            return _timeValueAt(CTIME_OFFSET);
+        }
+
+        inline timespec DirEntryView::_timeValueAt(size_t offset) const {
+            timespec value{};
+            value.tv_sec = static_cast<time_t>(cpputils::deserializeWithOffset<uint64_t>(_serialized, offset));
+            value.tv_nsec = cpputils::deserializeWithOffset<uint32_t>(_serialized, offset + sizeof(uint64_t));
+            return value;
+        }
+
+        inline size_t DirEntryView::serializedSize() const {
+            return _serializedSize;
+        }
+
+    }
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "FlatDirEntryStorage.h"
+
+using std::string;
+using blockstore::BlockId;
+using boost::optional;
+using boost::none;
+
+namespace cryfs {
+namespace fsblobstore {
+
+FlatDirEntryStorage::FlatDirEntryStorage(blobstore::Blob *blob)
+    : _blob(blob), _entries() {
+  _entries.deserializeFrom(_blob->readAll());
+}
+
+void FlatDirEntryStorage::flush() {
+  if (_entries.hasChanges()) {
+    if (_blob->size() != _entries.serializedSize()) {
+      _blob->resize(_entries.serializedSize());
+    }
+    _entries.serializeChanges([this] (uint64_t offset, const void *data, uint64_t size) {
+      _blob->write(data, offset, size);
+    });
+  }
+}
+
+uint64_t FlatDirEntryStorage::serializedSize() const {
+  return _entries.serializedSize();
+}
+
+void FlatDirEntryStorage::add(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
+                              fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
+  _entries.add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
+}
+
+void FlatDirEntryStorage::add(const DirEntry &entry) {
+  _entries.add(entry);
+}
+
+void FlatDirEntryStorage::addOrOverwrite(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
+                                         fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
+                                         std::function<void (const BlockId &blockId)> onOverwritten) {
+  _entries.addOrOverwrite(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime, std::move(onOverwritten));
+}
+
+void FlatDirEntryStorage::rename(const BlockId &blockId, const string &name, std::function<void (const BlockId &blockId)> onOverwritten) {
+  _entries.rename(blockId, name, std::move(onOverwritten));
+}
+
+optional<DirEntry> FlatDirEntryStorage::get(const string &name) const {
+  auto found = _entries.get(name);
+  if (found == none) {
+    return none;
+  }
+  return found->materialize();
+}
+
+optional<DirEntry> FlatDirEntryStorage::get(const BlockId &blockId) const {
+  auto found = _entries.get(blockId);
+  if (found == none) {
+    return none;
+  }
+  return found->materialize();
+}
+
+void FlatDirEntryStorage::remove(const string &name) {
+  _entries.remove(name);
+}
+
+void FlatDirEntryStorage::remove(const BlockId &blockId) {
+  _entries.remove(blockId);
+}
+
+size_t FlatDirEntryStorage::size() const {
+  return _entries.size();
+}
+
+void FlatDirEntryStorage::forEach(std::function<void (const DirEntryView &entry)> callback) const {
+  _entries.forEach(std::move(callback));
+}
+
+void FlatDirEntryStorage::setMode(const BlockId &blockId, fspp::mode_t mode) {
+  _entries.setMode(blockId, mode);
+}
+
+bool FlatDirEntryStorage::setUidGid(const BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) {
+  return _entries.setUidGid(blockId, uid, gid);
+}
+
+void FlatDirEntryStorage::setAccessTimes(const BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) {
+  _entries.setAccessTimes(blockId, lastAccessTime, lastModificationTime);
+}
+
+bool FlatDirEntryStorage::updateAccessTimestampForChild(const BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) {
+  return _entries.updateAccessTimestampForChild(blockId, timestampUpdateBehavior, now);
+}
+
+void FlatDirEntryStorage::updateModificationTimestampForChild(const BlockId &blockId, timespec now) {
+  _entries.updateModificationTimestampForChild(blockId, now);
+}
+
+void FlatDirEntryStorage::setSizeHintForChild(const BlockId &blockId, fspp::num_bytes_t size) {
+  _entries.setSizeHintForChild(blockId, size);
+}
+
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_FLATDIRENTRYSTORAGE_H
+#define MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_FLATDIRENTRYSTORAGE_H
+
+#include <blobstore/interface/Blob.h>
+#include "DirEntryStorage.h"
+#include "DirEntryList.h"
+
+namespace cryfs {
+    namespace fsblobstore {
+
+        // Original directory layout: All entries are stored as one DirEntryList that takes the whole blob.
+        class FlatDirEntryStorage final : public DirEntryStorage {
+        public:
+            explicit FlatDirEntryStorage(blobstore::Blob *blob);
+
+            void flush() override;
+            uint64_t serializedSize() const override;
+
+            void add(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                     fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) override;
+            void add(const DirEntry &entry) override;
+            void addOrOverwrite(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                     fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
+                     std::function<void (const blockstore::BlockId &blockId)> onOverwritten) override;
+            void rename(const blockstore::BlockId &blockId, const std::string &name, std::function<void (const blockstore::BlockId &blockId)> onOverwritten) override;
+            boost::optional<DirEntry> get(const std::string &name) const override;
+            boost::optional<DirEntry> get(const blockstore::BlockId &blockId) const override;
+            void remove(const std::string &name) override;
+            void remove(const blockstore::BlockId &blockId) override;
+
+            size_t size() const override;
+            void forEach(std::function<void (const DirEntryView &entry)> callback) const override;
+
+            void setMode(const blockstore::BlockId &blockId, fspp::mode_t mode) override;
+            bool setUidGid(const blockstore::BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) override;
+            void setAccessTimes(const blockstore::BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) override;
+            bool updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) override;
+            void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now) override;
+            void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size) override;
+
+        private:
+            blobstore::Blob *_blob;
+            DirEntryList _entries;
+
+            DISALLOW_COPY_AND_ASSIGN(FlatDirEntryStorage);
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,496 @@
+#include "HashedDirEntryStorage.h"
+#include <cpp-utils/data/SerializationHelper.h>
+#include <cpp-utils/system/time.h>
+
+//TODO Get rid of that in favor of better error handling
+#include <fspp/fs_interface/FuseErrnoException.h>
+
+using cpputils::Data;
+using cpputils::make_unique_ref;
+using std::string;
+using std::vector;
+using blockstore::BlockId;
+using boost::optional;
+using boost::none;
+
+namespace cryfs {
+namespace fsblobstore {
+
+namespace {
+    constexpr uint16_t FORMAT_VERSION = 1;
+
+    // Superblock layout
+    constexpr size_t VERSION_OFFSET = 0;
+    constexpr size_t PAGE_SIZE_OFFSET = VERSION_OFFSET + sizeof(uint16_t);
+    constexpr size_t LEVEL_OFFSET = PAGE_SIZE_OFFSET + sizeof(uint32_t);
+    constexpr size_t SPLIT_POINTER_OFFSET = LEVEL_OFFSET + sizeof(uint8_t);
+    constexpr size_t NUM_SLOTS_OFFSET = SPLIT_POINTER_OFFSET + sizeof(uint32_t);
+    constexpr size_t NUM_ENTRIES_OFFSET = NUM_SLOTS_OFFSET + sizeof(uint32_t);
+    constexpr size_t FREE_LIST_OFFSET = NUM_ENTRIES_OFFSET + sizeof(uint64_t);
+    constexpr size_t BUCKET_TABLE_OFFSET = FREE_LIST_OFFSET + sizeof(uint32_t);
+
+    // Page layout
+    constexpr size_t PAGE_USED_BYTES_OFFSET = 0;
+    constexpr size_t PAGE_NEXT_OFFSET = PAGE_USED_BYTES_OFFSET + sizeof(uint32_t);
+    constexpr size_t PAGE_HEADER_SIZE = PAGE_NEXT_OFFSET + sizeof(uint32_t);
+
+    // Slot 0 is the superblock, so it can be used to mark the end of a page chain
+    constexpr uint32_t NO_PAGE = 0;
+}
+
+constexpr uint32_t HashedDirEntryStorage::MIN_PAGE_SIZE;
+
+HashedDirEntryStorage::HashedDirEntryStorage(blobstore::Blob *blob, uint64_t blobHeaderSize)
+    : _blob(blob), _blobHeaderSize(blobHeaderSize), _pageSize(0), _level(0), _splitPointer(0), _numSlots(0), _numEntries(0),
+      _freeListHead(NO_PAGE), _buckets(), _superblockChanged(false), _pages(), _pageOfBlockId(), _allPagesLoaded(false) {
+    Data header(BUCKET_TABLE_OFFSET);
+    _blob->read(header.data(), 0, header.size());
+    if (FORMAT_VERSION != cpputils::deserializeWithOffset<uint16_t>(header.data(), VERSION_OFFSET)) {
+        throw std::runtime_error("This directory has the wrong format. Was it created with a newer version of CryFS?");
+    }
+    _pageSize = cpputils::deserializeWithOffset<uint32_t>(header.data(), PAGE_SIZE_OFFSET);
+    _level = cpputils::deserializeWithOffset<uint8_t>(header.data(), LEVEL_OFFSET);
+    _splitPointer = cpputils::deserializeWithOffset<uint32_t>(header.data(), SPLIT_POINTER_OFFSET);
+    _numSlots = cpputils::deserializeWithOffset<uint32_t>(header.data(), NUM_SLOTS_OFFSET);
+    _numEntries = cpputils::deserializeWithOffset<uint64_t>(header.data(), NUM_ENTRIES_OFFSET);
+    _freeListHead = cpputils::deserializeWithOffset<uint32_t>(header.data(), FREE_LIST_OFFSET);
+    if (_pageSize < MIN_PAGE_SIZE || _level >= 32 || _splitPointer >= (UINT32_C(1) << _level)) {
+        throw std::runtime_error("Directory superblock is corrupted");
+    }
+    const uint64_t numBuckets = (UINT64_C(1) << _level) + _splitPointer;
+    if (numBuckets > _maxNumBuckets()) {
+        throw std::runtime_error("Directory superblock is corrupted");
+    }
+
+    Data bucketTable(numBuckets * sizeof(uint32_t));
+    _blob->read(bucketTable.data(), BUCKET_TABLE_OFFSET, bucketTable.size());
+    _buckets.reserve(numBuckets);
+    for (uint64_t i = 0; i < numBuckets; ++i) {
+        _buckets.push_back(cpputils::deserializeWithOffset<uint32_t>(bucketTable.data(), i * sizeof(uint32_t)));
+    }
+}
+
+void HashedDirEntryStorage::initialize(blobstore::Blob *blob, uint64_t blobHeaderSize, uint32_t pageSize) {
+    ASSERT(pageSize >= MIN_PAGE_SIZE && pageSize > blobHeaderSize + BUCKET_TABLE_OFFSET + sizeof(uint32_t), "Page size too small");
+    // Superblock in slot 0 and an empty page for bucket 0 in slot 1
+    constexpr uint32_t numSlots = 2;
+    blob->resize(numSlots * pageSize - blobHeaderSize);
+
+    Data superblock(BUCKET_TABLE_OFFSET + sizeof(uint32_t));
+    cpputils::serialize<uint16_t>(superblock.dataOffset(VERSION_OFFSET), FORMAT_VERSION);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(PAGE_SIZE_OFFSET), pageSize);
+    cpputils::serialize<uint8_t>(superblock.dataOffset(LEVEL_OFFSET), 0);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(SPLIT_POINTER_OFFSET), 0);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(NUM_SLOTS_OFFSET), numSlots);
+    cpputils::serialize<uint64_t>(superblock.dataOffset(NUM_ENTRIES_OFFSET), 0);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(FREE_LIST_OFFSET), NO_PAGE);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(BUCKET_TABLE_OFFSET), 1);
+    blob->write(superblock.data(), 0, superblock.size());
+
+    Data pageHeader(PAGE_HEADER_SIZE);
+    pageHeader.FillWithZeroes();
+    blob->write(pageHeader.data(), pageSize - blobHeaderSize, pageHeader.size());
+}
+
+uint32_t HashedDirEntryStorage::_hash(const string &name) {
+    // FNV-1a. The hash decides which page an entry is stored in, so it must never change.
+    uint32_t hash = UINT32_C(2166136261);
+    for (const char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= UINT32_C(16777619);
+    }
+    return hash;
+}
+
+uint32_t HashedDirEntryStorage::_bucketFor(const string &name) const {
+    const uint32_t hash = _hash(name);
+    const uint32_t bucket = hash & ((UINT32_C(1) << _level) - 1);
+    if (bucket < _splitPointer) {
+        // This bucket was already split in the current round
+        return hash & ((UINT64_C(1) << (_level + 1)) - 1);
+    }
+    return bucket;
+}
+
+uint64_t HashedDirEntryStorage::_slotOffset(uint32_t slot) const {
+    ASSERT(slot != 0, "Slot 0 is the superblock");
+    return static_cast<uint64_t>(slot) * _pageSize - _blobHeaderSize;
+}
+
+uint64_t HashedDirEntryStorage::_pageCapacity() const {
+    return _pageSize - PAGE_HEADER_SIZE;
+}
+
+uint32_t HashedDirEntryStorage::_maxNumBuckets() const {
+    return (_pageSize - _blobHeaderSize - BUCKET_TABLE_OFFSET) / sizeof(uint32_t);
+}
+
+HashedDirEntryStorage::Page *HashedDirEntryStorage::_loadPage(uint32_t slot) const {
+    auto found = _pages.find(slot);
+    if (found != _pages.end()) {
+        return found->second.get();
+    }
+    if (slot == NO_PAGE || slot >= _numSlots) {
+        throw std::runtime_error("Directory page pointer is corrupted");
+    }
+
+    Data header(PAGE_HEADER_SIZE);
+    _blob->read(header.data(), _slotOffset(slot), header.size());
+    const uint32_t usedBytes = cpputils::deserializeWithOffset<uint32_t>(header.data(), PAGE_USED_BYTES_OFFSET);
+    const uint32_t next = cpputils::deserializeWithOffset<uint32_t>(header.data(), PAGE_NEXT_OFFSET);
+    if (usedBytes > _pageCapacity()) {
+        throw std::runtime_error("Directory page is corrupted");
+    }
+    Data content(usedBytes);
+    _blob->read(content.data(), _slotOffset(slot) + PAGE_HEADER_SIZE, usedBytes);
+
+    auto page = make_unique_ref<Page>(slot, next);
+    page->entries.deserializeFrom(std::move(content));
+    page->entries.forEach([this, slot] (const DirEntryView &entry) {
+        _pageOfBlockId[entry.blockId()] = slot;
+    });
+    Page *result = page.get();
+    _pages.emplace(slot, std::move(page));
+    return result;
+}
+
+void HashedDirEntryStorage::_loadAllPages() const {
+    if (_allPagesLoaded) {
+        return;
+    }
+    for (const uint32_t firstSlot : _buckets) {
+        for (uint32_t slot = firstSlot; slot != NO_PAGE; slot = _loadPage(slot)->next) {
+        }
+    }
+    _allPagesLoaded = true;
+}
+
+HashedDirEntryStorage::Page *HashedDirEntryStorage::_findPageWithName(const string &name) const {
+    for (uint32_t slot = _buckets[_bucketFor(name)]; slot != NO_PAGE;) {
+        Page *page = _loadPage(slot);
+        if (page->entries.get(name) != none) {
+            return page;
+        }
+        slot = page->next;
+    }
+    return nullptr;
+}
+
+HashedDirEntryStorage::Page *HashedDirEntryStorage::_findPageWithBlockId(const BlockId &blockId) const {
+    // _pageOfBlockId knows all entries of the pages loaded so far
+    auto found = _pageOfBlockId.find(blockId);
+    if (found == _pageOfBlockId.end() && !_allPagesLoaded) {
+        _loadAllPages();
+        found = _pageOfBlockId.find(blockId);
+    }
+    if (found == _pageOfBlockId.end()) {
+        return nullptr;
+    }
+    return _loadPage(found->second);
+}
+
+HashedDirEntryStorage::Page *HashedDirEntryStorage::_findPageWithBlockIdOrThrow(const BlockId &blockId) const {
+    Page *page = _findPageWithBlockId(blockId);
+    if (page == nullptr) {
+        throw fspp::fuse::FuseErrnoException(ENOENT);
+    }
+    return page;
+}
+
+void HashedDirEntryStorage::flush() {
+    for (auto &item : _pages) {
+        Page *page = item.second.get();
+        if (!page->headerChanged && !page->entries.hasChanges()) {
+            continue;
+        }
+        const uint64_t pageOffset = _slotOffset(page->slot);
+        Data header(PAGE_HEADER_SIZE);
+        cpputils::serialize<uint32_t>(header.dataOffset(PAGE_USED_BYTES_OFFSET), page->entries.serializedSize());
+        cpputils::serialize<uint32_t>(header.dataOffset(PAGE_NEXT_OFFSET), page->next);
+        _blob->write(header.data(), pageOffset, header.size());
+        page->entries.serializeChanges([this, pageOffset] (uint64_t offset, const void *data, uint64_t size) {
+            _blob->write(data, pageOffset + PAGE_HEADER_SIZE + offset, size);
+        });
+        page->headerChanged = false;
+    }
+    if (_superblockChanged) {
+        _writeSuperblock();
+    }
+}
+
+void HashedDirEntryStorage::_writeSuperblock() {
+    Data superblock(BUCKET_TABLE_OFFSET + _buckets.size() * sizeof(uint32_t));
+    cpputils::serialize<uint16_t>(superblock.dataOffset(VERSION_OFFSET), FORMAT_VERSION);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(PAGE_SIZE_OFFSET), _pageSize);
+    cpputils::serialize<uint8_t>(superblock.dataOffset(LEVEL_OFFSET), _level);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(SPLIT_POINTER_OFFSET), _splitPointer);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(NUM_SLOTS_OFFSET), _numSlots);
+    cpputils::serialize<uint64_t>(superblock.dataOffset(NUM_ENTRIES_OFFSET), _numEntries);
+    cpputils::serialize<uint32_t>(superblock.dataOffset(FREE_LIST_OFFSET), _freeListHead);
+    for (size_t i = 0; i < _buckets.size(); ++i) {
+        cpputils::serialize<uint32_t>(superblock.dataOffset(BUCKET_TABLE_OFFSET + i * sizeof(uint32_t)), _buckets[i]);
+    }
+    _blob->write(superblock.data(), 0, superblock.size());
+    _superblockChanged = false;
+}
+
+uint64_t HashedDirEntryStorage::serializedSize() const {
+    return static_cast<uint64_t>(_numSlots) * _pageSize - _blobHeaderSize;
+}
+
+void HashedDirEntryStorage::_setNumEntries(uint64_t value) {
+    _numEntries = value;
+    _superblockChanged = true;
+}
+
+uint32_t HashedDirEntryStorage::_allocatePage() {
+    _superblockChanged = true;
+    if (_freeListHead != NO_PAGE) {
+        Page *page = _loadPage(_freeListHead);
+        ASSERT(page->entries.size() == 0, "Page in free list isn't empty");
+        _freeListHead = page->next;
+        page->next = NO_PAGE;
+        page->headerChanged = true;
+        return page->slot;
+    }
+    const uint32_t slot = _numSlots;
+    _numSlots += 1;
+    _blob->resize(_slotOffset(_numSlots));
+    auto page = make_unique_ref<Page>(slot, NO_PAGE);
+    page->headerChanged = true;
+    _pages.emplace(slot, std::move(page));
+    return slot;
+}
+
+void HashedDirEntryStorage::_freePage(Page *page) {
+    ASSERT(page->entries.size() == 0, "Can only free empty pages");
+    page->next = _freeListHead;
+    page->headerChanged = true;
+    _freeListHead = page->slot;
+    _superblockChanged = true;
+}
+
+bool HashedDirEntryStorage::_insertIntoBucket(uint32_t bucket, const DirEntry &entry) {
+    // Returns true if the bucket had to grow by an overflow page
+    const uint64_t entrySize = entry.serializedSize();
+    Page *last = nullptr;
+    for (uint32_t slot = _buckets[bucket]; slot != NO_PAGE; slot = last->next) {
+        last = _loadPage(slot);
+        if (last->entries.serializedSize() + entrySize <= _pageCapacity()) {
+            last->entries.add(entry);
+            _pageOfBlockId[entry.blockId()] = last->slot;
+            return false;
+        }
+    }
+    ASSERT(last != nullptr, "Bucket without page");
+    const uint32_t overflowSlot = _allocatePage();
+    last->next = overflowSlot;
+    last->headerChanged = true;
+    Page *overflow = _loadPage(overflowSlot);
+    overflow->entries.add(entry);
+    _pageOfBlockId[entry.blockId()] = overflowSlot;
+    return true;
+}
+
+void HashedDirEntryStorage::_insert(const DirEntry &entry) {
+    const bool overflowed = _insertIntoBucket(_bucketFor(entry.name()), entry);
+    _setNumEntries(_numEntries + 1);
+    if (overflowed) {
+        _splitNextBucket();
+    }
+}
+
+void HashedDirEntryStorage::_takeEntries(Page *page, vector<DirEntry> *result) {
+    page->entries.forEach([this, result] (const DirEntryView &entry) {
+        result->push_back(entry.materialize());
+        _pageOfBlockId.erase(entry.blockId());
+    });
+    page->entries.deserializeFrom(Data(0));
+    page->headerChanged = true;
+}
+
+void HashedDirEntryStorage::_splitNextBucket() {
+    if (_buckets.size() >= _maxNumBuckets()) {
+        // The bucket table is full, buckets only grow their overflow chains from now on
+        return;
+    }
+    const uint32_t splitBucket = _splitPointer;
+    ASSERT(_buckets.size() == (UINT64_C(1) << _level) + _splitPointer, "Inconsistent bucket table");
+
+    vector<DirEntry> entries;
+    Page *first = _loadPage(_buckets[splitBucket]);
+    uint32_t overflowSlot = first->next;
+    _takeEntries(first, &entries);
+    first->next = NO_PAGE;
+    while (overflowSlot != NO_PAGE) {
+        Page *overflow = _loadPage(overflowSlot);
+        overflowSlot = overflow->next;
+        _takeEntries(overflow, &entries);
+        _freePage(overflow);
+    }
+
+    _buckets.push_back(_allocatePage());
+    _splitPointer += 1;
+    if (_splitPointer == (UINT64_C(1) << _level)) {
+        _level += 1;
+        _splitPointer = 0;
+    }
+    _superblockChanged = true;
+
+    // Each entry ends up either in the split bucket or in the new one
+    for (const auto &entry : entries) {
+        _insertIntoBucket(_bucketFor(entry.name()), entry);
+    }
+}
+
+void HashedDirEntryStorage::add(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
+                                fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) {
+    add(DirEntry(entryType, name, blobId, mode, uid, gid, lastAccessTime, lastModificationTime, cpputils::time::now()));
+}
+
+void HashedDirEntryStorage::add(const DirEntry &entry) {
+    if (_findPageWithName(entry.name()) != nullptr) {
+        throw fspp::fuse::FuseErrnoException(EEXIST);
+    }
+    _insert(entry);
+}
+
+void HashedDirEntryStorage::addOrOverwrite(const string &name, const BlockId &blobId, fspp::Dir::EntryType entryType, fspp::mode_t mode,
+                                           fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
+                                           std::function<void (const BlockId &blockId)> onOverwritten) {
+    Page *page = _findPageWithName(name);
+    if (page == nullptr) {
+        add(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime);
+        return;
+    }
+    // The new entry has the same name and therefore the same size, so it stays in this page.
+    const BlockId overwrittenId = page->entries.get(name)->blockId();
+    page->entries.addOrOverwrite(name, blobId, entryType, mode, uid, gid, lastAccessTime, lastModificationTime, std::move(onOverwritten));
+    _pageOfBlockId.erase(overwrittenId);
+    _pageOfBlockId[blobId] = page->slot;
+}
+
+void HashedDirEntryStorage::rename(const BlockId &blockId, const string &name, std::function<void (const BlockId &blockId)> onOverwritten) {
+    Page *pageWithSameName = _findPageWithName(name);
+    if (pageWithSameName != nullptr) {
+        const DirEntryView sameName = *pageWithSameName->entries.get(name);
+        if (sameName.blockId() != blockId) {
+            const Page *page = _findPageWithBlockIdOrThrow(blockId);
+            DirEntryList::checkAllowedOverwrite(sameName.type(), page->entries.get(blockId)->type());
+            const BlockId overwrittenId = sameName.blockId();
+            onOverwritten(overwrittenId);
+            pageWithSameName->entries.remove(name);
+            _pageOfBlockId.erase(overwrittenId);
+            _setNumEntries(_numEntries - 1);
+        }
+    }
+
+    Page *page = _findPageWithBlockIdOrThrow(blockId);
+    DirEntry entry = page->entries.get(blockId)->materialize();
+    const uint64_t newEntrySize = entry.serializedSize() - entry.name().size() + name.size();
+    if (_bucketFor(entry.name()) == _bucketFor(name) && page->entries.serializedSize() - entry.serializedSize() + newEntrySize <= _pageCapacity()) {
+        page->entries.rename(blockId, name, [] (const BlockId &) {
+            ASSERT(false, "Entries with the same name were already removed above");
+        });
+        return;
+    }
+    // The entry has to move to a different page
+    page->entries.remove(blockId);
+    _pageOfBlockId.erase(blockId);
+    entry.setName(name);
+    if (_insertIntoBucket(_bucketFor(name), entry)) {
+        _splitNextBucket();
+    }
+}
+
+optional<DirEntry> HashedDirEntryStorage::get(const string &name) const {
+    const Page *page = _findPageWithName(name);
+    if (page == nullptr) {
+        return none;
+    }
+    return page->entries.get(name)->materialize();
+}
+
+optional<DirEntry> HashedDirEntryStorage::get(const BlockId &blockId) const {
+    const Page *page = _findPageWithBlockId(blockId);
+    if (page == nullptr) {
+        return none;
+    }
+    return page->entries.get(blockId)->materialize();
+}
+
+void HashedDirEntryStorage::remove(const string &name) {
+    Page *page = _findPageWithName(name);
+    if (page == nullptr) {
+        throw fspp::fuse::FuseErrnoException(ENOENT);
+    }
+    const BlockId blockId = page->entries.get(name)->blockId();
+    page->entries.remove(name);
+    _pageOfBlockId.erase(blockId);
+    _setNumEntries(_numEntries - 1);
+}
+
+void HashedDirEntryStorage::remove(const BlockId &blockId) {
+    Page *page = _findPageWithBlockId(blockId);
+    if (page == nullptr) {
+        return;
+    }
+    page->entries.remove(blockId);
+    _pageOfBlockId.erase(blockId);
+    _setNumEntries(_numEntries - 1);
+}
+
+size_t HashedDirEntryStorage::size() const {
+    return _numEntries;
+}
+
+void HashedDirEntryStorage::forEach(std::function<void (const DirEntryView &entry)> callback) const {
+    _loadAllPages();
+    for (const uint32_t firstSlot : _buckets) {
+        for (uint32_t slot = firstSlot; slot != NO_PAGE;) {
+            const Page *page = _loadPage(slot);
+            page->entries.forEach(callback);
+            slot = page->next;
+        }
+    }
+}
+
+void HashedDirEntryStorage::setMode(const BlockId &blockId, fspp::mode_t mode) {
+    _findPageWithBlockIdOrThrow(blockId)->entries.setMode(blockId, mode);
+}
+
+bool HashedDirEntryStorage::setUidGid(const BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) {
+    return _findPageWithBlockIdOrThrow(blockId)->entries.setUidGid(blockId, uid, gid);
+}
+
+void HashedDirEntryStorage::setAccessTimes(const BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) {
+    _findPageWithBlockIdOrThrow(blockId)->entries.setAccessTimes(blockId, lastAccessTime, lastModificationTime);
+}
+
+bool HashedDirEntryStorage::updateAccessTimestampForChild(const BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) {
+    return _findPageWithBlockIdOrThrow(blockId)->entries.updateAccessTimestampForChild(blockId, timestampUpdateBehavior, now);
+}
+
+void HashedDirEntryStorage::updateModificationTimestampForChild(const BlockId &blockId, timespec now) {
+    _findPageWithBlockIdOrThrow(blockId)->entries.updateModificationTimestampForChild(blockId, now);
+}
+
+void HashedDirEntryStorage::setSizeHintForChild(const BlockId &blockId, fspp::num_bytes_t size) {
+    Page *page = _findPageWithBlockIdOrThrow(blockId);
+    DirEntry entry = page->entries.get(blockId)->materialize();
+    const uint64_t oldEntrySize = entry.serializedSize();
+    entry.setSizeHint(size);
+    if (page->entries.serializedSize() - oldEntrySize + entry.serializedSize() <= _pageCapacity()) {
+        page->entries.setSizeHintForChild(blockId, size);
+        return;
+    }
+    // Adding the size hint field grows the entry, it has to move to a different page of its bucket
+    page->entries.remove(blockId);
+    _pageOfBlockId.erase(blockId);
+    if (_insertIntoBucket(_bucketFor(entry.name()), entry)) {
+        _splitNextBucket();
+    }
+}
+
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#ifndef MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_HASHEDDIRENTRYSTORAGE_H
+#define MESSMER_CRYFS_FILESYSTEM_FSBLOBSTORE_UTILS_HASHEDDIRENTRYSTORAGE_H
+
+#include <blobstore/interface/Blob.h>
+#include <cpp-utils/pointer/unique_ref.h>
+#include "DirEntryStorage.h"
+#include "DirEntryList.h"
+#include <unordered_map>
+#include <vector>
+
+namespace cryfs {
+    namespace fsblobstore {
+
+        // Directory layout for large directories. Entries are distributed over pages by a hash of their name (linear hashing),
+        // so that a modification only touches the page holding the entry. Pages have the size of a leaf and are aligned to
+        // leaf boundaries, so small modifications only dirty one leaf instead of rewriting the whole directory.
+        //
+        // The blob is divided into slots of the page size. Slot 0 holds the superblock (hash state, number of entries and a
+        // table mapping each bucket to its first page). Every other slot holds a page with a small header (used bytes, next
+        // page of the same bucket) followed by the serialized DirEntryList of its entries. If all pages of a bucket are full,
+        // an overflow page is chained to it and the next bucket in line is split. Once the bucket table fills the superblock,
+        // buckets aren't split anymore and only grow their overflow chains.
+        //
+        // Pages are loaded lazily. Lookups by name only load the pages of one bucket. Lookups by blockId use the pages
+        // loaded so far and fall back to loading all pages.
+        class HashedDirEntryStorage final : public DirEntryStorage {
+        public:
+            static constexpr uint32_t MIN_PAGE_SIZE = 1024;
+
+            // blob is the payload the entries are stored in, blobHeaderSize the number of bytes the underlying blob stores
+            // before the payload. The latter is used to align pages to leaf boundaries of the underlying blob.
+            HashedDirEntryStorage(blobstore::Blob *blob, uint64_t blobHeaderSize);
+
+            // Overwrites the payload with an empty directory
+            static void initialize(blobstore::Blob *blob, uint64_t blobHeaderSize, uint32_t pageSize);
+
+            void flush() override;
+            uint64_t serializedSize() const override;
+
+            void add(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                     fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime) override;
+            void add(const DirEntry &entry) override;
+            void addOrOverwrite(const std::string &name, const blockstore::BlockId &blobId, fspp::Dir::EntryType entryType,
+                     fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, timespec lastAccessTime, timespec lastModificationTime,
+                     std::function<void (const blockstore::BlockId &blockId)> onOverwritten) override;
+            void rename(const blockstore::BlockId &blockId, const std::string &name, std::function<void (const blockstore::BlockId &blockId)> onOverwritten) override;
+            boost::optional<DirEntry> get(const std::string &name) const override;
+            boost::optional<DirEntry> get(const blockstore::BlockId &blockId) const override;
+            void remove(const std::string &name) override;
+            void remove(const blockstore::BlockId &blockId) override;
+
+            size_t size() const override;
+            void forEach(std::function<void (const DirEntryView &entry)> callback) const override;
+
+            void setMode(const blockstore::BlockId &blockId, fspp::mode_t mode) override;
+            bool setUidGid(const blockstore::BlockId &blockId, fspp::uid_t uid, fspp::gid_t gid) override;
+            void setAccessTimes(const blockstore::BlockId &blockId, timespec lastAccessTime, timespec lastModificationTime) override;
+            bool updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) override;
+            void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now) override;
+            void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size) override;
+
+        private:
+            struct Page final {
+                Page(uint32_t slot_, uint32_t next_): slot(slot_), next(next_), entries(), headerChanged(false) {}
+
+                uint32_t slot;
+                uint32_t next;
+                DirEntryList entries;
+                bool headerChanged;
+            };
+
+            static uint32_t _hash(const std::string &name);
+            uint32_t _bucketFor(const std::string &name) const;
+            uint64_t _slotOffset(uint32_t slot) const;
+            uint64_t _pageCapacity() const;
+            uint32_t _maxNumBuckets() const;
+
+            Page *_loadPage(uint32_t slot) const;
+            void _loadAllPages() const;
+            Page *_findPageWithName(const std::string &name) const;
+            Page *_findPageWithBlockId(const blockstore::BlockId &blockId) const;
+            Page *_findPageWithBlockIdOrThrow(const blockstore::BlockId &blockId) const;
+
+            bool _insertIntoBucket(uint32_t bucket, const DirEntry &entry);
+            void _insert(const DirEntry &entry);
+            void _splitNextBucket();
+            void _takeEntries(Page *page, std::vector<DirEntry> *result);
+            uint32_t _allocatePage();
+            void _freePage(Page *page);
+            void _setNumEntries(uint64_t value);
+            void _writeSuperblock();
+
+            blobstore::Blob *_blob;
+            uint64_t _blobHeaderSize;
+            uint32_t _pageSize;
+            uint8_t _level;
+            uint32_t _splitPointer;
+            uint32_t _numSlots;
+            uint64_t _numEntries;
+            uint32_t _freeListHead;
+            std::vector<uint32_t> _buckets;
+            bool _superblockChanged;
+
+            mutable std::unordered_map<uint32_t, cpputils::unique_ref<Page>> _pages;
+            mutable std::unordered_map<blockstore::BlockId, uint32_t> _pageOfBlockId;
+            mutable bool _allPagesLoaded;
+
+            DISALLOW_COPY_AND_ASSIGN(HashedDirEntryStorage);
+        };
+
+    }
+}
+
+#endif
@@ -15,11 +15,11 @@ public:
 
     using Entry = fsblobstore::DirEntry;
 
-    boost::optional<const Entry&> GetChild(const std::string &name) const {
+    boost::optional<Entry> GetChild(const std::string &name) const {
         return _base->GetChild(name);
     }
 
-    boost::optional<const Entry&> GetChild(const blockstore::BlockId &blockId) const {
+    boost::optional<Entry> GetChild(const blockstore::BlockId &blockId) const {
         return _base->GetChild(blockId);
     }
 
@@ -49,12 +49,16 @@ public:
         return _base->RenameChild(blockId, newName, onOverwritten);
     }
 
-    void updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior) {
-        return _base->updateAccessTimestampForChild(blockId, timestampUpdateBehavior);
+    void updateAccessTimestampForChild(const blockstore::BlockId &blockId, fspp::TimestampUpdateBehavior timestampUpdateBehavior, timespec now) {
+        return _base->updateAccessTimestampForChild(blockId, timestampUpdateBehavior, now);
     }
 
-    void updateModificationTimestampForChild(const blockstore::BlockId &blockId) {
-        return _base->updateModificationTimestampForChild(blockId);
+    void updateModificationTimestampForChild(const blockstore::BlockId &blockId, timespec now) {
+        return _base->updateModificationTimestampForChild(blockId, now);
+    }
+
+    void setSizeHintForChild(const blockstore::BlockId &blockId, fspp::num_bytes_t size) {
+        return _base->setSizeHintForChild(blockId, size);
     }
 
     void chmodChild(const blockstore::BlockId &blockId, fspp::mode_t mode) {
@@ -85,6 +89,10 @@ public:
         return _base->AppendChildrenTo(result);
     }
 
+    void AppendChildEntriesTo(std::vector<Entry> *result) const {
+        return _base->AppendChildEntriesTo(result);
+    }
+
     const blockstore::BlockId &blockId() const override {
         return _base->blockId();
     }
@@ -51,6 +51,8 @@ public:
 private:
     cachingfsblobstore::FileBlobRef *_base;
 
+    friend class ParallelAccessFsBlobStore;
+
     DISALLOW_COPY_AND_ASSIGN(FileBlobRef);
 };
 
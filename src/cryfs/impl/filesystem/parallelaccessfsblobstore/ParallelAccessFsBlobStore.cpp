@@ -49,6 +49,23 @@ unique_ref<FileBlobRef> ParallelAccessFsBlobStore::createFileBlob(const blocksto
     });
 }
 
+unique_ref<FileBlobRef> ParallelAccessFsBlobStore::createFileBlobAsCopyOf(const FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied) {
+    return _addFileBlob(_baseBlobStore->createFileBlobAsCopyOf(*source._base, parent, onBlockCopied));
+}
+
+unique_ref<FileBlobRef> ParallelAccessFsBlobStore::createFileBlobAsCloneOf(const FileBlobRef &source, const blockstore::BlockId &parent) {
+    return _addFileBlob(_baseBlobStore->createFileBlobAsCloneOf(*source._base, parent));
+}
+
+unique_ref<FileBlobRef> ParallelAccessFsBlobStore::_addFileBlob(unique_ref<cachingfsblobstore::FileBlobRef> blob) {
+    const BlockId blockId = blob->blockId();
+    return _parallelAccessStore.add<FileBlobRef>(blockId, std::move(blob), [] (cachingfsblobstore::FsBlobRef *resource) {
+        auto fileBlob = dynamic_cast<cachingfsblobstore::FileBlobRef*>(resource);
+        ASSERT(fileBlob != nullptr, "Wrong resource given");
+        return make_unique_ref<FileBlobRef>(fileBlob);
+    });
+}
+
 unique_ref<SymlinkBlobRef> ParallelAccessFsBlobStore::createSymlinkBlob(const bf::path &target, const blockstore::BlockId &parent) {
     auto blob = _baseBlobStore->createSymlinkBlob(target, parent);
     const BlockId blockId = blob->blockId();
@@ -22,6 +22,8 @@ namespace cryfs {
             ParallelAccessFsBlobStore(cpputils::unique_ref<cachingfsblobstore::CachingFsBlobStore> baseBlobStore);
 
             cpputils::unique_ref<FileBlobRef> createFileBlob(const blockstore::BlockId &parent);
+            cpputils::unique_ref<FileBlobRef> createFileBlobAsCopyOf(const FileBlobRef &source, const blockstore::BlockId &parent, const std::function<void ()> &onBlockCopied);
+            cpputils::unique_ref<FileBlobRef> createFileBlobAsCloneOf(const FileBlobRef &source, const blockstore::BlockId &parent);
             cpputils::unique_ref<DirBlobRef> createDirBlob(const blockstore::BlockId &parent);
             cpputils::unique_ref<SymlinkBlobRef> createSymlinkBlob(const boost::filesystem::path &target, const blockstore::BlockId &parent);
             boost::optional<cpputils::unique_ref<FsBlobRef>> load(const blockstore::BlockId &blockId);
@@ -36,6 +38,7 @@ namespace cryfs {
             parallelaccessstore::ParallelAccessStore<cachingfsblobstore::FsBlobRef, FsBlobRef, blockstore::BlockId> _parallelAccessStore;
 
             std::function<fspp::num_bytes_t (const blockstore::BlockId &)> _getLstatSize();
+            cpputils::unique_ref<FileBlobRef> _addFileBlob(cpputils::unique_ref<cachingfsblobstore::FileBlobRef> blob);
 
             DISALLOW_COPY_AND_ASSIGN(ParallelAccessFsBlobStore);
         };
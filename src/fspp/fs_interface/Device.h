@@ -7,6 +7,7 @@
 #include "Types.h"
 #include "Context.h"
 #include <boost/optional.hpp>
+#include <functional>
 
 namespace fspp {
 class Node;
@@ -30,6 +31,20 @@ public:
 	virtual boost::optional<cpputils::unique_ref<Dir>> LoadDir(const boost::filesystem::path &path) = 0;
 	virtual boost::optional<cpputils::unique_ref<Symlink>> LoadSymlink(const boost::filesystem::path &path) = 0;
 
+	// Called regularly by long running operations with the number of nodes processed so far. Returning false cancels
+	// the operation, which then throws ECANCELED. Only called on the thread that started the operation.
+	using ProgressCallback = std::function<bool (uint64_t numNodesDone)>;
+	// Removes a node and, if it is a directory, everything below it (like rm -r)
+	virtual void removeTree(const boost::filesystem::path &path, const ProgressCallback &progress) = 0;
+	// Copies a node and, if it is a directory, everything below it. to must not exist yet.
+	// If the copy fails or is cancelled, nothing is left at to.
+	virtual void copyTree(const boost::filesystem::path &from, const boost::filesystem::path &to, const ProgressCallback &progress) = 0;
+	// Copies a file by copying its encrypted blocks, without reading its plaintext. to must not exist yet.
+	virtual void copyFile(const boost::filesystem::path &from, const boost::filesystem::path &to) = 0;
+	// Creates a copy of a file that shares the blocks of the source until either of them is modified, so cloning
+	// doesn't depend on the file size. to must not exist yet.
+	virtual void cloneFile(const boost::filesystem::path &from, const boost::filesystem::path &to) = 0;
+
     const Context& getContext() const {
         ASSERT(_context != boost::none, "Tried to call getContext() but file system isn't running yet.");
         return *_context;
@@ -4,6 +4,8 @@
 
 #include <cpp-utils/pointer/unique_ref.h>
 #include <string>
+#include <vector>
+#include <boost/optional.hpp>
 #include <boost/filesystem/path.hpp>
 #include "Types.h"
 
@@ -27,13 +29,32 @@ public:
     std::string name;
   };
 
+  struct EntryWithStat {
+    EntryWithStat(EntryType type_, const std::string &name_, const fspp::stat_info &stat_): type(type_), name(name_), stat(stat_) {}
+    EntryType type;
+    std::string name;
+    fspp::stat_info stat;
+  };
+
   virtual cpputils::unique_ref<OpenFile> createAndOpenFile(const std::string &name, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid) = 0;
   virtual void createDir(const std::string &name, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid) = 0;
   virtual void createSymlink(const std::string &name, const boost::filesystem::path &target, fspp::uid_t uid, fspp::gid_t gid) = 0;
 
+  // Batched operations on many children of this directory. The directory is loaded once per batch and its own
+  // timestamps are updated once. They return one errno per name, 0 on success.
+  // With existingDirsAreOk, createDirs() doesn't fail for names that already are directories (like mkdir -p).
+  virtual std::vector<int> createDirs(const std::vector<std::string> &names, fspp::mode_t mode, fspp::uid_t uid, fspp::gid_t gid, bool existingDirsAreOk) = 0;
+  // Removes files, symlinks and empty directories
+  virtual std::vector<int> removeChildren(const std::vector<std::string> &names) = 0;
+  // Returns none for names that don't exist
+  virtual std::vector<boost::optional<fspp::stat_info>> statChildren(const std::vector<std::string> &names) = 0;
+
   //TODO Allow alternative implementation returning only children names without more information
   //virtual std::vector<std::string> children() const = 0;
   virtual std::vector<Entry> children() = 0;
+  // Like children(), but also returns the stat info of each child, so callers don't have to load each child by its path.
+  // Doesn't return the "." and ".." entries.
+  virtual std::vector<EntryWithStat> childrenWithStat() = 0;
 };
 
 }
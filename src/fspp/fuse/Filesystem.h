@@ -6,6 +6,7 @@
 #include <cpp-utils/pointer/unique_ref.h>
 #include <sys/stat.h>
 #include "../fs_interface/Dir.h"
+#include "../fs_interface/Device.h"
 #include "../fs_interface/Context.h"
 #if defined(_MSC_VER)
 #include <fuse/fuse.h>
@@ -45,10 +46,29 @@ public:
   virtual void rmdir(const boost::filesystem::path &path) = 0;
   virtual void unlink(const boost::filesystem::path &path) = 0;
   virtual void rename(const boost::filesystem::path &from, const boost::filesystem::path &to) = 0;
+  // Batched variants of mkdir, unlink and lstat. Paths with the same parent directory are handled together, so each
+  // parent is only looked up and written back once. They return one errno per path, 0 on success.
+  // With parents, missing ancestors are created and existing directories are not an error (like mkdir -p).
+  virtual std::vector<int> mkdirs(const std::vector<boost::filesystem::path> &paths, ::mode_t mode, ::uid_t uid, ::gid_t gid, bool parents) = 0;
+  // Removes files, symlinks and empty directories. Directories are processed deepest first, so a directory can be
+  // removed in the same batch as its contents.
+  virtual std::vector<int> unlinks(const std::vector<boost::filesystem::path> &paths) = 0;
+  virtual std::vector<int> lstats(const std::vector<boost::filesystem::path> &paths, std::vector<fspp::fuse::STAT> *stbufs) = 0;
+  // Recursive remove and copy, see Device::removeTree() and Device::copyTree()
+  virtual void removeTree(const boost::filesystem::path &path, const Device::ProgressCallback &progress) = 0;
+  virtual void copyTree(const boost::filesystem::path &from, const boost::filesystem::path &to, const Device::ProgressCallback &progress) = 0;
+  virtual void copyFile(const boost::filesystem::path &from, const boost::filesystem::path &to) = 0;
+  virtual void cloneFile(const boost::filesystem::path &from, const boost::filesystem::path &to) = 0;
   virtual void utimens(const boost::filesystem::path &path, timespec lastAccessTime, timespec lastModificationTime) = 0;
   virtual void statfs(struct ::statvfs *fsstat) = 0;
   //TODO We shouldn't use Dir::Entry here, that's in another layer
   virtual std::vector<Dir::Entry> readDir(const boost::filesystem::path &path) = 0;
+  struct DirEntryWithStat {
+    std::string name;
+    fspp::fuse::STAT stat;
+  };
+  // Like readDir(), but also returns the stat info of each entry. Doesn't return the "." and ".." entries.
+  virtual std::vector<DirEntryWithStat> readDirPlus(const boost::filesystem::path &path) = 0;
   //TODO Test createSymlink
   virtual void createSymlink(const boost::filesystem::path &to, const boost::filesystem::path &from, ::uid_t uid, ::gid_t gid) = 0;
   //TODO Test readSymlink
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <cpp-utils/assert/assert.h>
 #include <cpp-utils/logging/logging.h>
+#include <cpp-utils/metrics/Metrics.h>
 #include <cpp-utils/process/subprocess.h>
 #include <cpp-utils/thread/debugging.h>
 #include <csignal>
@@ -53,8 +54,20 @@ public:
     set_thread_name("fspp_idle");
   }
 };
+
+// The Filesystem returns positive errnos, fuse uses negative ones
+void negateErrnos_(vector<int> *results) {
+  for (int &result : *results) {
+    result = -result;
+  }
+}
 }
 
+// Records the number of calls and the latency of the fuse operation it is used in
+#define FUSE_OP_METRICS(name)                                                                                           \
+  static cpputils::metrics::Histogram &_opLatency = cpputils::metrics::histogram("fuse." name ".latency_ns");           \
+  const cpputils::metrics::ScopedTimer _opLatencyTimer(&_opLatency)
+
 // Remove the following line, if you don't want to output each fuse operation on the console
 //#define FSPP_LOG 1
 
@@ -88,6 +101,7 @@ bool Fuse::running() const {
 
 int Fuse::getattr(const bf::path &path, fspp::fuse::STAT *stbuf) {
   const ThreadNameForDebugging _threadName("getattr");
+  FUSE_OP_METRICS("getattr");
 #ifdef FSPP_LOG
   LOG(DEBUG, "getattr({}, _, _)", path);
 #endif
@@ -117,6 +131,7 @@ int Fuse::getattr(const bf::path &path, fspp::fuse::STAT *stbuf) {
 
 int Fuse::fgetattr(const bf::path &path, fspp::fuse::STAT *stbuf, uint64_t fh) {
   const ThreadNameForDebugging _threadName("fgetattr");
+  FUSE_OP_METRICS("fgetattr");
 #ifdef FSPP_LOG
   LOG(DEBUG, "fgetattr({}, _, _)", path);
 #endif
@@ -160,6 +175,7 @@ int Fuse::fgetattr(const bf::path &path, fspp::fuse::STAT *stbuf, uint64_t fh) {
 
 int Fuse::readlink(const bf::path &path, char *buf, size_t size) {
   const ThreadNameForDebugging _threadName("readlink");
+  FUSE_OP_METRICS("readlink");
 #ifdef FSPP_LOG
   LOG(DEBUG, "readlink({}, _, {})", path, size);
 #endif
@@ -189,6 +205,7 @@ int Fuse::readlink(const bf::path &path, char *buf, size_t size) {
 
 int Fuse::mkdir(const bf::path &path, ::mode_t mode) {
   const ThreadNameForDebugging _threadName("mkdir");
+  FUSE_OP_METRICS("mkdir");
 #ifdef FSPP_LOG
   LOG(DEBUG, "mkdir({}, {})", path.string(), mode);
 #endif
@@ -226,6 +243,7 @@ int Fuse::mkdir(const bf::path &path, ::mode_t mode) {
 
 int Fuse::unlink(const bf::path &path) {
   const ThreadNameForDebugging _threadName("unlink");
+  FUSE_OP_METRICS("unlink");
 #ifdef FSPP_LOG
   LOG(DEBUG, "unlink({})", path);
 #endif
@@ -255,6 +273,7 @@ int Fuse::unlink(const bf::path &path) {
 
 int Fuse::rmdir(const bf::path &path) {
   const ThreadNameForDebugging _threadName("rmdir");
+  FUSE_OP_METRICS("rmdir");
 #ifdef FSPP_LOG
   LOG(DEBUG, "rmdir({})", path);
 #endif
@@ -284,6 +303,7 @@ int Fuse::rmdir(const bf::path &path) {
 
 int Fuse::symlink(const bf::path &to, const bf::path &from) {
   const ThreadNameForDebugging _threadName("symlink");
+  FUSE_OP_METRICS("symlink");
 #ifdef FSPP_LOG
   LOG(DEBUG, "symlink({}, {})", to, from);
 #endif
@@ -313,6 +333,7 @@ int Fuse::symlink(const bf::path &to, const bf::path &from) {
 
 int Fuse::rename(const bf::path &from, const bf::path &to) {
   const ThreadNameForDebugging _threadName("rename");
+  FUSE_OP_METRICS("rename");
 #ifdef FSPP_LOG
   LOG(DEBUG, "rename({}, {})", from, to);
 #endif
@@ -344,6 +365,7 @@ int Fuse::rename(const bf::path &from, const bf::path &to) {
 //TODO
 int Fuse::link(const bf::path &from, const bf::path &to) {
   const ThreadNameForDebugging _threadName("link");
+  FUSE_OP_METRICS("link");
   LOG(WARN, "NOT IMPLEMENTED: link({}, {})", from.string(), to.string());
   //auto real_from = _impl->RootDir() / from;
   //auto real_to = _impl->RootDir() / to;
@@ -354,6 +376,7 @@ int Fuse::link(const bf::path &from, const bf::path &to) {
 
 int Fuse::chmod(const bf::path &path, ::mode_t mode) {
   const ThreadNameForDebugging _threadName("chmod");
+  FUSE_OP_METRICS("chmod");
 #ifdef FSPP_LOG
   LOG(DEBUG, "chmod({}, {})", path, mode);
 #endif
@@ -383,6 +406,7 @@ int Fuse::chmod(const bf::path &path, ::mode_t mode) {
 
 int Fuse::chown(const bf::path &path, ::uid_t uid, ::gid_t gid) {
   const ThreadNameForDebugging _threadName("chown");
+  FUSE_OP_METRICS("chown");
 #ifdef FSPP_LOG
   LOG(DEBUG, "chown({}, {}, {})", path, uid, gid);
 #endif
@@ -412,6 +436,7 @@ int Fuse::chown(const bf::path &path, ::uid_t uid, ::gid_t gid) {
 
 int Fuse::truncate(const bf::path &path, int64_t size) {
   const ThreadNameForDebugging _threadName("truncate");
+  FUSE_OP_METRICS("truncate");
 #ifdef FSPP_LOG
   LOG(DEBUG, "truncate({}, {})", path, size);
 #endif
@@ -441,6 +466,7 @@ int Fuse::truncate(const bf::path &path, int64_t size) {
 
 int Fuse::ftruncate(int64_t size, uint64_t fh) {
   const ThreadNameForDebugging _threadName("ftruncate");
+  FUSE_OP_METRICS("ftruncate");
 #ifdef FSPP_LOG
   LOG(DEBUG, "ftruncate({}, {})", fh, size);
 #endif
@@ -469,6 +495,7 @@ int Fuse::ftruncate(int64_t size, uint64_t fh) {
 
 int Fuse::utimens(const bf::path &path, const timespec lastAccessTime, const timespec lastModificationTime) {
   const ThreadNameForDebugging _threadName("utimens");
+  FUSE_OP_METRICS("utimens");
 #ifdef FSPP_LOG
   LOG(DEBUG, "utimens({}, _)", path);
 #endif
@@ -498,6 +525,7 @@ int Fuse::utimens(const bf::path &path, const timespec lastAccessTime, const tim
 
 int Fuse::open(const bf::path &path, uint64_t* fh, int flags) {
   const ThreadNameForDebugging _threadName("open");
+  FUSE_OP_METRICS("open");
 #ifdef FSPP_LOG
   LOG(DEBUG, "open({}, _)", path);
 #endif
@@ -527,6 +555,7 @@ int Fuse::open(const bf::path &path, uint64_t* fh, int flags) {
 
 int Fuse::release(uint64_t fh) {
   const ThreadNameForDebugging _threadName("release");
+  FUSE_OP_METRICS("release");
 #ifdef FSPP_LOG
   LOG(DEBUG, "release({}, _)", fh);
 #endif
@@ -555,6 +584,7 @@ int Fuse::release(uint64_t fh) {
 
 int Fuse::read(char *buf, size_t size, int64_t offset, uint64_t fh) {
   const ThreadNameForDebugging _threadName("read");
+  FUSE_OP_METRICS("read");
 #ifdef FSPP_LOG
   LOG(DEBUG, "read({}, _, {}, {}, _)", fh, size, offset);
 #endif
@@ -583,6 +613,7 @@ int Fuse::read(char *buf, size_t size, int64_t offset, uint64_t fh) {
 
 int Fuse::write(const char *buf, size_t size, int64_t offset, uint64_t fh) {
   const ThreadNameForDebugging _threadName("write");
+  FUSE_OP_METRICS("write");
 #ifdef FSPP_LOG
   LOG(DEBUG, "write({}, _, {}, {}, _)", fh, size, offset);
 #endif
@@ -611,6 +642,7 @@ int Fuse::write(const char *buf, size_t size, int64_t offset, uint64_t fh) {
 
 int Fuse::statfs(const bf::path &path, struct ::statvfs *fsstat) {
   const ThreadNameForDebugging _threadName("statfs");
+  FUSE_OP_METRICS("statfs");
 #ifdef FSPP_LOG
   LOG(DEBUG, "statfs({}, _)", path);
 #endif
@@ -640,6 +672,7 @@ int Fuse::statfs(const bf::path &path, struct ::statvfs *fsstat) {
 
 int Fuse::flush(uint64_t fh) {
   const ThreadNameForDebugging _threadName("flush");
+  FUSE_OP_METRICS("flush");
 #ifdef FSPP_LOG
   LOG(WARN, "flush({}, _)", fh);
 #endif
@@ -668,6 +701,7 @@ int Fuse::flush(uint64_t fh) {
 
 int Fuse::fsync(int datasync, uint64_t fh) {
   const ThreadNameForDebugging _threadName("fsync");
+  FUSE_OP_METRICS("fsync");
 #ifdef FSPP_LOG
   LOG(DEBUG, "fsync({}, {}, _)", fh, datasync);
 #endif
@@ -700,6 +734,7 @@ int Fuse::fsync(int datasync, uint64_t fh) {
 
 int Fuse::readdir(const bf::path &path, void *buf, fuse_fill_dir_t filler) {
   const ThreadNameForDebugging _threadName("readdir");
+  FUSE_OP_METRICS("readdir");
 #ifdef FSPP_LOG
   LOG(DEBUG, "readdir({}, _, _)", path);
 #endif
@@ -749,6 +784,271 @@ int Fuse::readdir(const bf::path &path, void *buf, fuse_fill_dir_t filler) {
   }
 }
 
+int Fuse::readdirplus(const bf::path &path, void *buf, fuse_fill_dir_t filler) {
+  const ThreadNameForDebugging _threadName("readdirplus");
+  FUSE_OP_METRICS("readdirplus");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "readdirplus({}, _, _)", path);
+#endif
+  try {
+    ASSERT(is_valid_fspp_path(path), "has to be an absolute path");
+    auto entries = _fs->readDirPlus(path);
+    fspp::fuse::STAT dirStbuf{};
+    dirStbuf.st_mode = S_IFDIR;
+    if (filler(buf, ".", &dirStbuf) != 0 || filler(buf, "..", &dirStbuf) != 0) {
+      return -ENOMEM;
+    }
+    for (auto &entry : entries) {
+      if (filler(buf, entry.name.c_str(), &entry.stat) != 0) {
+#ifdef FSPP_LOG
+        LOG(DEBUG, "readdirplus({}, _, _): failure with ENOMEM", path);
+#endif
+        return -ENOMEM;
+      }
+    }
+#ifdef FSPP_LOG
+    LOG(DEBUG, "readdirplus({}, _, _): success", path);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::readdirplus: {}", e.what());
+    return -EIO;
+  } catch (FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "readdirplus({}, _, _): failed with errno {}", path, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::mkdirs(const vector<bf::path> &paths, ::mode_t mode, bool parents, vector<int> *results) {
+  const ThreadNameForDebugging _threadName("mkdirs");
+  FUSE_OP_METRICS("mkdirs");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "mkdirs({} paths, {}, {})", paths.size(), mode, parents);
+#endif
+  try {
+    for (const bf::path &path : paths) {
+      ASSERT(is_valid_fspp_path(path), "has to be an absolute path");
+    }
+    *results = _fs->mkdirs(paths, mode, uid, gid, parents);
+    negateErrnos_(results);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "mkdirs({} paths, {}, {}): success", paths.size(), mode, parents);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::mkdirs: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "mkdirs({} paths, {}, {}): failed with errno {}", paths.size(), mode, parents, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::unlinks(const vector<bf::path> &paths, vector<int> *results) {
+  const ThreadNameForDebugging _threadName("unlinks");
+  FUSE_OP_METRICS("unlinks");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "unlinks({} paths)", paths.size());
+#endif
+  try {
+    for (const bf::path &path : paths) {
+      ASSERT(is_valid_fspp_path(path), "has to be an absolute path");
+    }
+    *results = _fs->unlinks(paths);
+    negateErrnos_(results);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "unlinks({} paths): success", paths.size());
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::unlinks: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "unlinks({} paths): failed with errno {}", paths.size(), e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::getattrs(const vector<bf::path> &paths, vector<fspp::fuse::STAT> *stbufs, vector<int> *results) {
+  const ThreadNameForDebugging _threadName("getattrs");
+  FUSE_OP_METRICS("getattrs");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "getattrs({} paths)", paths.size());
+#endif
+  try {
+    for (const bf::path &path : paths) {
+      ASSERT(is_valid_fspp_path(path), "has to be an absolute path");
+    }
+    *results = _fs->lstats(paths, stbufs);
+    negateErrnos_(results);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "getattrs({} paths): success", paths.size());
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::getattrs: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "getattrs({} paths): failed with errno {}", paths.size(), e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::removeTree(const bf::path &path, const Device::ProgressCallback &progress) {
+  const ThreadNameForDebugging _threadName("removeTree");
+  FUSE_OP_METRICS("removeTree");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "removeTree({}, _)", path);
+#endif
+  try {
+    ASSERT(is_valid_fspp_path(path), "has to be an absolute path");
+    _fs->removeTree(path, progress);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "removeTree({}, _): success", path);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::removeTree: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "removeTree({}, _): failed with errno {}", path, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::copyTree(const bf::path &from, const bf::path &to, const Device::ProgressCallback &progress) {
+  const ThreadNameForDebugging _threadName("copyTree");
+  FUSE_OP_METRICS("copyTree");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "copyTree({}, {}, _)", from, to);
+#endif
+  try {
+    ASSERT(is_valid_fspp_path(from), "has to be an absolute path");
+    ASSERT(is_valid_fspp_path(to), "has to be an absolute path");
+    _fs->copyTree(from, to, progress);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "copyTree({}, {}, _): success", from, to);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::copyTree: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "copyTree({}, {}, _): failed with errno {}", from, to, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::copyFile(const bf::path &from, const bf::path &to) {
+  const ThreadNameForDebugging _threadName("copyFile");
+  FUSE_OP_METRICS("copyFile");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "copyFile({}, {})", from, to);
+#endif
+  try {
+    ASSERT(is_valid_fspp_path(from), "has to be an absolute path");
+    ASSERT(is_valid_fspp_path(to), "has to be an absolute path");
+    _fs->copyFile(from, to);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "copyFile({}, {}): success", from, to);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::copyFile: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "copyFile({}, {}): failed with errno {}", from, to, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
+int Fuse::cloneFile(const bf::path &from, const bf::path &to) {
+  const ThreadNameForDebugging _threadName("cloneFile");
+  FUSE_OP_METRICS("cloneFile");
+#ifdef FSPP_LOG
+  LOG(DEBUG, "cloneFile({}, {})", from, to);
+#endif
+  try {
+    ASSERT(is_valid_fspp_path(from), "has to be an absolute path");
+    ASSERT(is_valid_fspp_path(to), "has to be an absolute path");
+    _fs->cloneFile(from, to);
+#ifdef FSPP_LOG
+    LOG(DEBUG, "cloneFile({}, {}): success", from, to);
+#endif
+    return 0;
+  } catch(const cpputils::AssertFailed &e) {
+    LOG(ERR, "AssertFailed in Fuse::cloneFile: {}", e.what());
+    return -EIO;
+  } catch(const fspp::fuse::FuseErrnoException &e) {
+#ifdef FSPP_LOG
+    LOG(WARN, "cloneFile({}, {}): failed with errno {}", from, to, e.getErrno());
+#endif
+    return -e.getErrno();
+  } catch(const std::exception &e) {
+    _logException(e);
+    return -EIO;
+  } catch(...) {
+    _logUnknownException();
+    return -EIO;
+  }
+}
+
 void Fuse::init() {
   const ThreadNameForDebugging _threadName("init");
   _fs = _init();
@@ -776,6 +1076,7 @@ void Fuse::destroy() {
 
 int Fuse::access(const bf::path &path, int mask) {
   const ThreadNameForDebugging _threadName("access");
+  FUSE_OP_METRICS("access");
 #ifdef FSPP_LOG
   LOG(DEBUG, "access({}, {})", path, mask);
 #endif
@@ -805,6 +1106,7 @@ int Fuse::access(const bf::path &path, int mask) {
 
 int Fuse::create(const bf::path &path, ::mode_t mode, uint64_t* fh) {
   const ThreadNameForDebugging _threadName("create");
+  FUSE_OP_METRICS("create");
 #ifdef FSPP_LOG
   LOG(DEBUG, "create({}, {}, _)", path, mode);
 #endif
@@ -14,6 +14,7 @@
 #include <memory>
 #include "stat_compatibility.h"
 #include <fspp/fs_interface/Context.h>
+#include <fspp/fs_interface/Device.h>
 
 typedef int (*fuse_fill_dir_t)(void*, const char*, fspp::fuse::STAT*);
 
@@ -53,6 +54,21 @@ public:
   int flush(uint64_t fh);
   int fsync(int flags, uint64_t fh);
   int readdir(const boost::filesystem::path &path, void *buf, fuse_fill_dir_t filler);
+  // Like readdir, but passes the full stat info of each entry to filler. "." and ".." only have the file type set.
+  int readdirplus(const boost::filesystem::path &path, void *buf, fuse_fill_dir_t filler);
+  // Batched mkdir, unlink and getattr, see Filesystem::mkdirs(). The return value is the error of the batch as a whole,
+  // results gets one entry per path: 0 on success or a negative errno.
+  int mkdirs(const std::vector<boost::filesystem::path> &paths, ::mode_t mode, bool parents, std::vector<int> *results);
+  int unlinks(const std::vector<boost::filesystem::path> &paths, std::vector<int> *results);
+  int getattrs(const std::vector<boost::filesystem::path> &paths, std::vector<fspp::fuse::STAT> *stbufs, std::vector<int> *results);
+  // Recursive remove and copy. progress is called regularly with the number of nodes processed so far,
+  // returning false cancels the operation with -ECANCELED.
+  int removeTree(const boost::filesystem::path &path, const Device::ProgressCallback &progress);
+  int copyTree(const boost::filesystem::path &from, const boost::filesystem::path &to, const Device::ProgressCallback &progress);
+  // Copies a regular file without passing its contents through the caller
+  int copyFile(const boost::filesystem::path &from, const boost::filesystem::path &to);
+  // Copies a regular file by sharing its blocks with the source until one of them is modified
+  int cloneFile(const boost::filesystem::path &from, const boost::filesystem::path &to);
   void init();
   void destroy();
   int access(const boost::filesystem::path &path, int mask);
@@ -87,6 +87,34 @@ namespace fspp {
                 throw std::logic_error("Filesystem not initialized yet");
             }
 
+            std::vector<int> mkdirs(const std::vector<boost::filesystem::path> &, ::mode_t , ::uid_t , ::gid_t , bool ) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            std::vector<int> unlinks(const std::vector<boost::filesystem::path> &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            std::vector<int> lstats(const std::vector<boost::filesystem::path> &, std::vector<fspp::fuse::STAT> *) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            void removeTree(const boost::filesystem::path &, const Device::ProgressCallback &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            void copyTree(const boost::filesystem::path &, const boost::filesystem::path &, const Device::ProgressCallback &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            void copyFile(const boost::filesystem::path &, const boost::filesystem::path &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
+            void cloneFile(const boost::filesystem::path &, const boost::filesystem::path &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
             void utimens(const boost::filesystem::path &, timespec , timespec ) override {
                 throw std::logic_error("Filesystem not initialized yet");
             }
@@ -99,6 +127,10 @@ namespace fspp {
                 throw std::logic_error("Filesystem not initialized yet");
             }
 
+            std::vector<DirEntryWithStat> readDirPlus(const boost::filesystem::path &) override {
+                throw std::logic_error("Filesystem not initialized yet");
+            }
+
             void createSymlink(const boost::filesystem::path &, const boost::filesystem::path &, ::uid_t , ::gid_t ) override {
                 throw std::logic_error("Filesystem not initialized yet");
             }
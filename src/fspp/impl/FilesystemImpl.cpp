@@ -1,6 +1,8 @@
 #include "FilesystemImpl.h"
 
 #include <fcntl.h>
+#include <exception>
+#include <map>
 #include "../fs_interface/Device.h"
 #include "../fs_interface/Dir.h"
 #include "../fs_interface/Symlink.h"
@@ -10,9 +12,9 @@
 #include "../fs_interface/Node.h"
 
 #include <cpp-utils/logging/logging.h>
+#include <cpp-utils/metrics/Metrics.h>
 #include <cpp-utils/pointer/unique_ref.h>
 #include <cpp-utils/system/stat.h>
-#include <sstream>
 
 using namespace fspp;
 using cpputils::unique_ref;
@@ -23,72 +25,17 @@ using boost::none;
 namespace bf = boost::filesystem;
 using namespace cpputils::logging;
 
-#ifdef FSPP_PROFILE
-#include "Profiler.h"
-#include <iomanip>
-#include <ios>
-#define PROFILE(name) Profiler profiler_##name(&name);
-#else
-#define PROFILE(name)
-#endif
+// The latency of the fuse operations is recorded in Fuse. This additionally records how much of it is spent loading nodes.
+#define PROFILE(name)                                                                                                  \
+  static cpputils::metrics::Histogram &_loadLatency = cpputils::metrics::histogram("fspp." name ".latency_ns");       \
+  const cpputils::metrics::ScopedTimer _loadLatencyTimer(&_loadLatency)
 
 FilesystemImpl::FilesystemImpl(cpputils::unique_ref<Device> device)
-  :
-#ifdef FSPP_PROFILE
-   _loadFileNanosec(0), _loadDirNanosec(0), _loadSymlinkNanosec(0), _openFileNanosec(0), _flushNanosec(0),
-   _closeFileNanosec(0), _lstatNanosec(0), _fstatNanosec(0), _chmodNanosec(0), _chownNanosec(0), _truncateNanosec(0),
-   _ftruncateNanosec(0), _readNanosec(0), _writeNanosec(0), _fsyncNanosec(0), _fdatasyncNanosec(0), _accessNanosec(0),
-   _createAndOpenFileNanosec(0), _createAndOpenFileNanosec_withoutLoading(0), _mkdirNanosec(0),
-   _mkdirNanosec_withoutLoading(0), _rmdirNanosec(0), _rmdirNanosec_withoutLoading(0), _unlinkNanosec(0),
-   _unlinkNanosec_withoutLoading(0), _renameNanosec(0), _readDirNanosec(0), _readDirNanosec_withoutLoading(0),
-   _utimensNanosec(0), _statfsNanosec(0), _createSymlinkNanosec(0), _createSymlinkNanosec_withoutLoading(0),
-   _readSymlinkNanosec(0), _readSymlinkNanosec_withoutLoading(0),
-#endif
-   _device(std::move(device)), _open_files()
+  : _device(std::move(device)), _open_files()
 {
 }
 
 FilesystemImpl::~FilesystemImpl() {
-#ifdef FSPP_PROFILE
-  std::ostringstream profilerInformation;
-  profilerInformation << "Profiler Information\n"
-    << std::fixed << std::setprecision(6)
-    << std::setw(40) << "LoadFile: " << static_cast<double>(_loadFileNanosec)/1000000000 << "\n"
-    << std::setw(40) << "LoadDir: " << static_cast<double>(_loadDirNanosec)/1000000000 << "\n"
-    << std::setw(40) << "LoadSymlink: " << static_cast<double>(_loadSymlinkNanosec)/1000000000 << "\n"
-    << std::setw(40) << "OpenFile: " << static_cast<double>(_openFileNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Flush: " << static_cast<double>(_flushNanosec)/1000000000 << "\n"
-    << std::setw(40) << "CloseFile: " << static_cast<double>(_closeFileNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Lstat: " << static_cast<double>(_lstatNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Fstat: " << static_cast<double>(_fstatNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Chmod: " << static_cast<double>(_chmodNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Chown: " << static_cast<double>(_chownNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Truncate: " << static_cast<double>(_truncateNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Ftruncate: " << static_cast<double>(_ftruncateNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Read: " << static_cast<double>(_readNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Write: " << static_cast<double>(_writeNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Fsync: " << static_cast<double>(_fsyncNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Fdatasync: " << static_cast<double>(_fdatasyncNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Access: " << static_cast<double>(_accessNanosec)/1000000000 << "\n"
-    << std::setw(40) << "CreateAndOpenFile: " << static_cast<double>(_createAndOpenFileNanosec)/1000000000 << "\n"
-    << std::setw(40) << "CreateAndOpenFile (without loading): " << static_cast<double>(_createAndOpenFileNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "Mkdir: " << static_cast<double>(_mkdirNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Mkdir (without loading): " << static_cast<double>(_mkdirNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "Rmdir: " << static_cast<double>(_rmdirNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Rmdir (without loading): " << static_cast<double>(_rmdirNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "Unlink: " << static_cast<double>(_unlinkNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Unlink (without loading): " << static_cast<double>(_unlinkNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "Rename: " << static_cast<double>(_renameNanosec)/1000000000 << "\n"
-    << std::setw(40) << "ReadDir: " << static_cast<double>(_readDirNanosec)/1000000000 << "\n"
-    << std::setw(40) << "ReadDir (without loading): " << static_cast<double>(_readDirNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "Utimens: " << static_cast<double>(_utimensNanosec)/1000000000 << "\n"
-    << std::setw(40) << "Statfs: " << static_cast<double>(_statfsNanosec)/1000000000 << "\n"
-    << std::setw(40) << "CreateSymlink: " << static_cast<double>(_createSymlinkNanosec)/1000000000 << "\n"
-    << std::setw(40) << "CreateSymlink (without loading): " << static_cast<double>(_createSymlinkNanosec_withoutLoading)/1000000000 << "\n"
-    << std::setw(40) << "ReadSymlink: " << static_cast<double>(_readSymlinkNanosec)/1000000000 << "\n"
-    << std::setw(40) << "ReadSymlink (without loading): " << static_cast<double>(_readSymlinkNanosec_withoutLoading)/1000000000 << "\n";
-  LOG(INFO, profilerInformation.str());
-#endif
 }
 
 void FilesystemImpl::setContext(Context&& context) {
@@ -96,7 +43,7 @@ void FilesystemImpl::setContext(Context&& context) {
 }
 
 unique_ref<File> FilesystemImpl::LoadFile(const bf::path &path) {
-  PROFILE(_loadFileNanosec);
+  PROFILE("load_file");
   auto file = _device->LoadFile(path);
   if (file == none) {
     throw fuse::FuseErrnoException(EIO);
@@ -105,7 +52,7 @@ unique_ref<File> FilesystemImpl::LoadFile(const bf::path &path) {
 }
 
 unique_ref<Dir> FilesystemImpl::LoadDir(const bf::path &path) {
-  PROFILE(_loadDirNanosec);
+  PROFILE("load_dir");
   auto dir = _device->LoadDir(path);
   if (dir == none) {
     throw fuse::FuseErrnoException(EIO);
@@ -114,7 +61,7 @@ unique_ref<Dir> FilesystemImpl::LoadDir(const bf::path &path) {
 }
 
 unique_ref<Symlink> FilesystemImpl::LoadSymlink(const bf::path &path) {
-  PROFILE(_loadSymlinkNanosec);
+  PROFILE("load_symlink");
   auto lnk = _device->LoadSymlink(path);
   if (lnk == none) {
     throw fuse::FuseErrnoException(EIO);
@@ -128,20 +75,29 @@ int FilesystemImpl::openFile(const bf::path &path, int flags) {
 }
 
 int FilesystemImpl::openFile(File *file, int flags) {
-  PROFILE(_openFileNanosec);
   return _open_files.open(file->open(fspp::openflags_t(flags)));
 }
 
 void FilesystemImpl::flush(int descriptor) {
-  PROFILE(_flushNanosec);
   _open_files.load(descriptor, [](OpenFile* openFile) {
 	  openFile->flush();
   });
 }
 
 void FilesystemImpl::closeFile(int descriptor) {
-  PROFILE(_closeFileNanosec);
+  // Not every caller flushes before closing (the JNI API has no flush call), so write buffered data here, where an
+  // error still reaches the caller instead of being dropped when the blob is destructed later. The descriptor is
+  // closed even if that fails.
+  std::exception_ptr flushError = nullptr;
+  try {
+    flush(descriptor);
+  } catch (...) {
+    flushError = std::current_exception();
+  }
   _open_files.close(descriptor);
+  if (flushError) {
+    std::rethrow_exception(flushError);
+  }
 }
 
 namespace {
@@ -159,7 +115,6 @@ void convert_stat_info_(const fspp::Node::stat_info& input, fspp::fuse::STAT *ou
 }
 
 void FilesystemImpl::lstat(const bf::path &path, fspp::fuse::STAT *stbuf) {
-  PROFILE(_lstatNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -170,7 +125,6 @@ void FilesystemImpl::lstat(const bf::path &path, fspp::fuse::STAT *stbuf) {
 }
 
 void FilesystemImpl::fstat(int descriptor, fspp::fuse::STAT *stbuf) {
-	PROFILE(_fstatNanosec);
 	auto stat_info = _open_files.load(descriptor, [] (OpenFile* openFile) {
 		return openFile->stat();
 	});
@@ -178,7 +132,6 @@ void FilesystemImpl::fstat(int descriptor, fspp::fuse::STAT *stbuf) {
 }
 
 void FilesystemImpl::chmod(const boost::filesystem::path &path, ::mode_t mode) {
-  PROFILE(_chmodNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -188,7 +141,6 @@ void FilesystemImpl::chmod(const boost::filesystem::path &path, ::mode_t mode) {
 }
 
 void FilesystemImpl::chown(const boost::filesystem::path &path, ::uid_t uid, ::gid_t gid) {
-  PROFILE(_chownNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -198,47 +150,40 @@ void FilesystemImpl::chown(const boost::filesystem::path &path, ::uid_t uid, ::g
 }
 
 void FilesystemImpl::truncate(const bf::path &path, fspp::num_bytes_t size) {
-  PROFILE(_truncateNanosec);
   LoadFile(path)->truncate(size);
 }
 
 void FilesystemImpl::ftruncate(int descriptor, fspp::num_bytes_t size) {
-  PROFILE(_ftruncateNanosec);
   _open_files.load(descriptor, [size] (OpenFile* openFile) {
 	  openFile->truncate(size);
   });
 }
 
 fspp::num_bytes_t FilesystemImpl::read(int descriptor, void *buf, fspp::num_bytes_t count, fspp::num_bytes_t offset) {
-  PROFILE(_readNanosec);
   return _open_files.load(descriptor, [buf, count, offset] (OpenFile* openFile) {
 	  return openFile->read(buf, count, offset);
   });
 }
 
 void FilesystemImpl::write(int descriptor, const void *buf, fspp::num_bytes_t count, fspp::num_bytes_t offset) {
-  PROFILE(_writeNanosec);
   return _open_files.load(descriptor, [buf, count, offset] (OpenFile* openFile) {
 	  return openFile->write(buf, count, offset);
   });
 }
 
 void FilesystemImpl::fsync(int descriptor) {
-  PROFILE(_fsyncNanosec);
   _open_files.load(descriptor, [] (OpenFile* openFile) {
 	  openFile->fsync();
   });
 }
 
 void FilesystemImpl::fdatasync(int descriptor) {
-  PROFILE(_fdatasyncNanosec);
   _open_files.load(descriptor, [] (OpenFile* openFile) {
 	  openFile->fdatasync();
   });
 }
 
 void FilesystemImpl::access(const bf::path &path, int mask) {
-  PROFILE(_accessNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -248,44 +193,35 @@ void FilesystemImpl::access(const bf::path &path, int mask) {
 }
 
 int FilesystemImpl::createAndOpenFile(const bf::path &path, ::mode_t mode, ::uid_t uid, ::gid_t gid) {
-  PROFILE(_createAndOpenFileNanosec);
   auto dir = LoadDir(path.parent_path());
-  PROFILE(_createAndOpenFileNanosec_withoutLoading);
   auto file = dir->createAndOpenFile(path.filename().string(), fspp::mode_t(mode), fspp::uid_t(uid), fspp::gid_t(gid));
   return _open_files.open(std::move(file));
 }
 
 void FilesystemImpl::mkdir(const bf::path &path, ::mode_t mode, ::uid_t uid, ::gid_t gid) {
-  PROFILE(_mkdirNanosec);
   auto dir = LoadDir(path.parent_path());
-  PROFILE(_mkdirNanosec_withoutLoading);
   dir->createDir(path.filename().string(), fspp::mode_t(mode), fspp::uid_t(uid), fspp::gid_t(gid));
 }
 
 void FilesystemImpl::rmdir(const bf::path &path) {
   //TODO Don't allow removing files/symlinks with this
-  PROFILE(_rmdirNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
   }
-  PROFILE(_rmdirNanosec_withoutLoading);
   (*node)->remove();
 }
 
 void FilesystemImpl::unlink(const bf::path &path) {
   //TODO Don't allow removing directories with this
-  PROFILE(_unlinkNanosec);
   auto node = _device->Load(path);
   if (node == none) {
     throw fuse::FuseErrnoException(ENOENT);
   }
-  PROFILE(_unlinkNanosec_withoutLoading);
   (*node)->remove();
 }
 
 void FilesystemImpl::rename(const bf::path &from, const bf::path &to) {
-  PROFILE(_renameNanosec);
   auto node = _device->Load(from);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -294,15 +230,174 @@ void FilesystemImpl::rename(const bf::path &from, const bf::path &to) {
   }
 }
 
+namespace {
+// Indices of the given paths grouped by their parent directory. The groups are sorted by the path of the parent,
+// so a directory always comes before its subdirectories. Paths without a parent (i.e. the root) are left out.
+std::map<bf::path, vector<size_t>> groupByParent_(const vector<bf::path> &paths) {
+  std::map<bf::path, vector<size_t>> groups;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (paths[i].has_parent_path()) {
+      groups[paths[i].parent_path()].push_back(i);
+    }
+  }
+  return groups;
+}
+
+vector<string> filenames_(const vector<bf::path> &paths, const vector<size_t> &indices) {
+  vector<string> result;
+  result.reserve(indices.size());
+  for (size_t index : indices) {
+    result.push_back(paths[index].filename().string());
+  }
+  return result;
+}
+}
+
+vector<int> FilesystemImpl::mkdirs(const vector<bf::path> &paths, ::mode_t mode, ::uid_t uid, ::gid_t gid, bool parents) {
+  // Every directory that has to be created, including the ancestors if parents is set, with its result
+  std::map<bf::path, int> results;
+  for (const bf::path &path : paths) {
+    results.emplace(path, 0);
+    if (parents) {
+      for (bf::path ancestor = path.parent_path(); ancestor.has_parent_path(); ancestor = ancestor.parent_path()) {
+        results.emplace(ancestor, 0);
+      }
+    }
+  }
+  vector<bf::path> targets;
+  targets.reserve(results.size());
+  for (auto &result : results) {
+    if (result.first.has_parent_path()) {
+      targets.push_back(result.first);
+    } else {
+      // The root directory always exists
+      result.second = parents ? 0 : EEXIST;
+    }
+  }
+
+  for (const auto &group : groupByParent_(targets)) {
+    // Directories whose parent couldn't be created fail with the same error.
+    // EEXIST is fine, LoadDir() below checks that the existing node is a directory.
+    auto parentResult = results.find(group.first);
+    if (parentResult != results.end() && parentResult->second != 0 && parentResult->second != EEXIST) {
+      for (size_t index : group.second) {
+        results[targets[index]] = parentResult->second;
+      }
+      continue;
+    }
+    try {
+      auto dir = LoadDir(group.first);
+      const vector<int> created = dir->createDirs(filenames_(targets, group.second), fspp::mode_t(mode), fspp::uid_t(uid), fspp::gid_t(gid), parents);
+      for (size_t i = 0; i < group.second.size(); ++i) {
+        results[targets[group.second[i]]] = created[i];
+      }
+    } catch (const fuse::FuseErrnoException &e) {
+      for (size_t index : group.second) {
+        results[targets[index]] = e.getErrno();
+      }
+    }
+  }
+
+  vector<int> result;
+  result.reserve(paths.size());
+  for (const bf::path &path : paths) {
+    result.push_back(results.at(path));
+  }
+  return result;
+}
+
+vector<int> FilesystemImpl::unlinks(const vector<bf::path> &paths) {
+  vector<int> results(paths.size(), 0);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!paths[i].has_parent_path()) {
+      // Can't remove the root directory
+      results[i] = EBUSY;
+    }
+  }
+  const auto groups = groupByParent_(paths);
+  // Subdirectories come after their parents in the map, so going backwards empties directories before they are removed
+  for (auto group = groups.rbegin(); group != groups.rend(); ++group) {
+    try {
+      auto dir = LoadDir(group->first);
+      const vector<int> removed = dir->removeChildren(filenames_(paths, group->second));
+      for (size_t i = 0; i < group->second.size(); ++i) {
+        results[group->second[i]] = removed[i];
+      }
+    } catch (const fuse::FuseErrnoException &e) {
+      for (size_t index : group->second) {
+        results[index] = e.getErrno();
+      }
+    }
+  }
+  return results;
+}
+
+vector<int> FilesystemImpl::lstats(const vector<bf::path> &paths, vector<fspp::fuse::STAT> *stbufs) {
+  vector<int> results(paths.size(), 0);
+  stbufs->assign(paths.size(), fspp::fuse::STAT{});
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!paths[i].has_parent_path()) {
+      try {
+        lstat(paths[i], &(*stbufs)[i]);
+      } catch (const fuse::FuseErrnoException &e) {
+        results[i] = e.getErrno();
+      }
+    }
+  }
+  for (const auto &group : groupByParent_(paths)) {
+    try {
+      auto dir = LoadDir(group.first);
+      const auto stats = dir->statChildren(filenames_(paths, group.second));
+      for (size_t i = 0; i < group.second.size(); ++i) {
+        if (stats[i] == none) {
+          results[group.second[i]] = ENOENT;
+        } else {
+          convert_stat_info_(*stats[i], &(*stbufs)[group.second[i]]);
+        }
+      }
+    } catch (const fuse::FuseErrnoException &e) {
+      for (size_t index : group.second) {
+        results[index] = e.getErrno();
+      }
+    }
+  }
+  return results;
+}
+
+void FilesystemImpl::removeTree(const bf::path &path, const Device::ProgressCallback &progress) {
+  _device->removeTree(path, progress);
+}
+
+void FilesystemImpl::copyTree(const bf::path &from, const bf::path &to, const Device::ProgressCallback &progress) {
+  _device->copyTree(from, to, progress);
+}
+
+void FilesystemImpl::copyFile(const bf::path &from, const bf::path &to) {
+  _device->copyFile(from, to);
+}
+
+void FilesystemImpl::cloneFile(const bf::path &from, const bf::path &to) {
+  _device->cloneFile(from, to);
+}
+
 vector<Dir::Entry> FilesystemImpl::readDir(const bf::path &path) {
-  PROFILE(_readDirNanosec);
   auto dir = LoadDir(path);
-  PROFILE(_readDirNanosec_withoutLoading);
   return dir->children();
 }
 
+vector<FilesystemImpl::DirEntryWithStat> FilesystemImpl::readDirPlus(const bf::path &path) {
+  auto dir = LoadDir(path);
+  auto children = dir->childrenWithStat();
+  vector<DirEntryWithStat> result;
+  result.reserve(children.size());
+  for (const auto &child : children) {
+    result.push_back(DirEntryWithStat{child.name, fspp::fuse::STAT{}});
+    convert_stat_info_(child.stat, &result.back().stat);
+  }
+  return result;
+}
+
 void FilesystemImpl::utimens(const bf::path &path, timespec lastAccessTime, timespec lastModificationTime) {
-  PROFILE(_utimensNanosec);
   auto node = _device->Load(path);
   if(node == none) {
     throw fuse::FuseErrnoException(ENOENT);
@@ -312,7 +407,6 @@ void FilesystemImpl::utimens(const bf::path &path, timespec lastAccessTime, time
 }
 
 void FilesystemImpl::statfs(struct ::statvfs *fsstat) {
-  PROFILE(_statfsNanosec);
   const Device::statvfs stat = _device->statfs();
 
   fsstat->f_bsize = stat.blocksize;
@@ -329,16 +423,12 @@ void FilesystemImpl::statfs(struct ::statvfs *fsstat) {
 }
 
 void FilesystemImpl::createSymlink(const bf::path &to, const bf::path &from, ::uid_t uid, ::gid_t gid) {
-  PROFILE(_createSymlinkNanosec);
   auto parent = LoadDir(from.parent_path());
-  PROFILE(_createSymlinkNanosec_withoutLoading);
   parent->createSymlink(from.filename().string(), to, fspp::uid_t(uid), fspp::gid_t(gid));
 }
 
 void FilesystemImpl::readSymlink(const bf::path &path, char *buf, fspp::num_bytes_t size) {
-  PROFILE(_readSymlinkNanosec);
   const string target = LoadSymlink(path)->target().string();
-  PROFILE(_readSymlinkNanosec_withoutLoading);
   std::memcpy(buf, target.c_str(), std::min(static_cast<int64_t>(target.size()+1), size.value()));
   buf[size.value()-1] = '\0';
 }
@@ -6,10 +6,6 @@
 #include "../fuse/Filesystem.h"
 
 #include <cpp-utils/pointer/unique_ref.h>
-#include <atomic>
-
-//Remove this line if you don't want profiling
-//#define FSPP_PROFILE 1
 
 //TODO Test
 
@@ -45,7 +41,15 @@ public:
 	void rmdir(const boost::filesystem::path &path) override;
 	void unlink(const boost::filesystem::path &path) override;
 	void rename(const boost::filesystem::path &from, const boost::filesystem::path &to) override;
+	std::vector<int> mkdirs(const std::vector<boost::filesystem::path> &paths, ::mode_t mode, ::uid_t uid, ::gid_t gid, bool parents) override;
+	std::vector<int> unlinks(const std::vector<boost::filesystem::path> &paths) override;
+	std::vector<int> lstats(const std::vector<boost::filesystem::path> &paths, std::vector<fspp::fuse::STAT> *stbufs) override;
+	void removeTree(const boost::filesystem::path &path, const Device::ProgressCallback &progress) override;
+	void copyTree(const boost::filesystem::path &from, const boost::filesystem::path &to, const Device::ProgressCallback &progress) override;
+	void copyFile(const boost::filesystem::path &from, const boost::filesystem::path &to) override;
+	void cloneFile(const boost::filesystem::path &from, const boost::filesystem::path &to) override;
 	std::vector<Dir::Entry> readDir(const boost::filesystem::path &path) override;
+	std::vector<DirEntryWithStat> readDirPlus(const boost::filesystem::path &path) override;
 	void utimens(const boost::filesystem::path &path, timespec lastAccessTime, timespec lastModificationTime) override;
 	void statfs(struct ::statvfs *fsstat) override;
     void createSymlink(const boost::filesystem::path &to, const boost::filesystem::path &from, ::uid_t uid, ::gid_t gid) override;
@@ -57,44 +61,6 @@ private:
 	cpputils::unique_ref<Symlink> LoadSymlink(const boost::filesystem::path &path);
 	int openFile(File *file, int flags);
 
-#ifdef FSPP_PROFILE
-    std::atomic<uint64_t> _loadFileNanosec;
-    std::atomic<uint64_t> _loadDirNanosec;
-    std::atomic<uint64_t> _loadSymlinkNanosec;
-    std::atomic<uint64_t> _loadFileOrSymlinkNanosec;
-    std::atomic<uint64_t> _openFileNanosec;
-    std::atomic<uint64_t> _flushNanosec;
-    std::atomic<uint64_t> _closeFileNanosec;
-    std::atomic<uint64_t> _lstatNanosec;
-    std::atomic<uint64_t> _fstatNanosec;
-    std::atomic<uint64_t> _chmodNanosec;
-    std::atomic<uint64_t> _chownNanosec;
-    std::atomic<uint64_t> _truncateNanosec;
-    std::atomic<uint64_t> _ftruncateNanosec;
-    std::atomic<uint64_t> _readNanosec;
-    std::atomic<uint64_t> _writeNanosec;
-    std::atomic<uint64_t> _fsyncNanosec;
-    std::atomic<uint64_t> _fdatasyncNanosec;
-    std::atomic<uint64_t> _accessNanosec;
-    std::atomic<uint64_t> _createAndOpenFileNanosec;
-    std::atomic<uint64_t> _createAndOpenFileNanosec_withoutLoading;
-    std::atomic<uint64_t> _mkdirNanosec;
-    std::atomic<uint64_t> _mkdirNanosec_withoutLoading;
-    std::atomic<uint64_t> _rmdirNanosec;
-    std::atomic<uint64_t> _rmdirNanosec_withoutLoading;
-    std::atomic<uint64_t> _unlinkNanosec;
-    std::atomic<uint64_t> _unlinkNanosec_withoutLoading;
-    std::atomic<uint64_t> _renameNanosec;
-    std::atomic<uint64_t> _readDirNanosec;
-    std::atomic<uint64_t> _readDirNanosec_withoutLoading;
-    std::atomic<uint64_t> _utimensNanosec;
-    std::atomic<uint64_t> _statfsNanosec;
-    std::atomic<uint64_t> _createSymlinkNanosec;
-    std::atomic<uint64_t> _createSymlinkNanosec_withoutLoading;
-    std::atomic<uint64_t> _readSymlinkNanosec;
-    std::atomic<uint64_t> _readSymlinkNanosec_withoutLoading;
-#endif
-
 	cpputils::unique_ref<Device> _device;
 	FuseOpenFileList _open_files;
 
@@ -7,8 +7,15 @@
 #include "../fs_interface/FuseErrnoException.h"
 #include <cpp-utils/macros.h>
 #include <cpp-utils/assert/assert.h>
-#include "IdList.h"
+#include <cpp-utils/pointer/unique_ref.h>
+#include <boost/optional.hpp>
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 namespace fspp {
 namespace detail {
@@ -26,6 +33,17 @@ private:
 };
 }
 
+/**
+ * Maps file descriptors to open files.
+ *
+ * Descriptors index into a table of slots. Each slot has an atomic state word holding an "open" flag and the number
+ * of load() calls currently using the file. load() only does an atomic increment and decrement on the slot of its
+ * descriptor, so reads and writes to different (or the same) files don't contend on a lock.
+ * close() clears the "open" flag, which makes new load() calls fail, waits until the pending ones drained the
+ * refcount, and only then destroys the file. Afterwards, the descriptor is reused by the next open().
+ * The table grows in segments that are never moved or freed before the list is destroyed, so load() can access a
+ * slot without synchronizing with open().
+ */
 class FuseOpenFileList final {
 public:
   FuseOpenFileList();
@@ -37,79 +55,166 @@ public:
   void close(int descriptor);
 
 private:
-  IdList<OpenFile> _open_files;
+  static constexpr int SLOTS_PER_SEGMENT = 256;
+  static constexpr int MAX_SEGMENTS = 4096;
+  static constexpr uint64_t OPEN_FLAG = static_cast<uint64_t>(1) << 63;
+  static constexpr uint64_t REFCOUNT_MASK = OPEN_FLAG - 1;
 
-  std::unordered_map<int, size_t> _refcounts;
+  struct Slot final {
+    Slot(): state(0), file(boost::none) {}
+
+    // OPEN_FLAG | number of pending load() calls
+    std::atomic<uint64_t> state;
+    // Only written by open() before setting OPEN_FLAG and by close() after the refcount drained
+    boost::optional<cpputils::unique_ref<OpenFile>> file;
+    // Segments are only guaranteed to be 16 byte aligned. Padding slots to twice the cache line size makes sure the
+    // state words of neighbouring descriptors never share a cache line.
+    char padding[128 - sizeof(std::atomic<uint64_t>) - sizeof(boost::optional<cpputils::unique_ref<OpenFile>>)];
+
+    DISALLOW_COPY_AND_ASSIGN(Slot);
+  };
+
+  struct Segment final {
+    std::array<Slot, SLOTS_PER_SEGMENT> slots;
+  };
+
+  Slot *_slot(int descriptor) const;
+  void _release(Slot *slot);
+  void _waitUntilDrained(const Slot *slot);
+
+  std::array<std::atomic<Segment*>, MAX_SEGMENTS> _segments;
+
+  // Taken by open() and close() to hand out descriptors. load() doesn't need it.
   std::mutex _mutex;
+  std::vector<int> _free_descriptors;
+  int _next_descriptor;
 
+  // Notified when the last pending load() on a closed slot finishes
+  std::mutex _refcount_zero_mutex;
   std::condition_variable _refcount_zero_cv;
 
   DISALLOW_COPY_AND_ASSIGN(FuseOpenFileList);
 };
 
 inline FuseOpenFileList::FuseOpenFileList()
-  :_open_files(), _refcounts(), _mutex(), _refcount_zero_cv() {
+  :_segments(), _mutex(), _free_descriptors(), _next_descriptor(1), _refcount_zero_mutex(), _refcount_zero_cv() {
+  for (auto& segment : _segments) {
+    segment.store(nullptr, std::memory_order_relaxed);
+  }
 }
 
 inline FuseOpenFileList::~FuseOpenFileList() {
-	std::unique_lock<std::mutex> lock(_mutex);
-
-	// Wait until all pending requests are done
-	_refcount_zero_cv.wait(lock, [&] {
-		for (const auto& refcount : _refcounts) {
-			if (0 != refcount.second) {
-				return false;
-			}
-		}
-		return true;
-	});
-
-	// There might still be open files when the file system is shutdown, so we can't assert it's empty.
-	// But to check that _refcounts has been updated correctly, we can assert the invariant that we have as many
-	// refcounts as open files.
-	ASSERT(_refcounts.size() == _refcounts.size(), "Didn't clean up refcounts properly");
+  // There might still be open files when the file system is shutdown. Make sure no new requests can start
+  // and wait until all pending requests are done before the files get destroyed.
+  for (auto& segment : _segments) {
+    Segment *loaded = segment.load(std::memory_order_acquire);
+    if (nullptr == loaded) {
+      break;
+    }
+    for (Slot& slot : loaded->slots) {
+      slot.state.fetch_and(REFCOUNT_MASK, std::memory_order_acq_rel);
+      _waitUntilDrained(&slot);
+    }
+  }
+
+  //The destructors of the stored FuseOpenFiles close the files
+  for (auto& segment : _segments) {
+    delete segment.load(std::memory_order_relaxed);
+  }
+}
+
+inline FuseOpenFileList::Slot *FuseOpenFileList::_slot(int descriptor) const {
+  if (descriptor < 0 || descriptor >= SLOTS_PER_SEGMENT * MAX_SEGMENTS) {
+    return nullptr;
+  }
+  Segment *segment = _segments[descriptor / SLOTS_PER_SEGMENT].load(std::memory_order_acquire);
+  if (nullptr == segment) {
+    return nullptr;
+  }
+  return &segment->slots[descriptor % SLOTS_PER_SEGMENT];
 }
 
 inline int FuseOpenFileList::open(cpputils::unique_ref<OpenFile> file) {
   const std::lock_guard<std::mutex> lock(_mutex);
 
-  const int descriptor = _open_files.add(std::move(file));
-  _refcounts.emplace(descriptor, 0);
+  int descriptor = 0;
+  if (!_free_descriptors.empty()) {
+    descriptor = _free_descriptors.back();
+    _free_descriptors.pop_back();
+  } else {
+    if (_next_descriptor >= SLOTS_PER_SEGMENT * MAX_SEGMENTS) {
+      throw fspp::fuse::FuseErrnoException(EMFILE);
+    }
+    std::atomic<Segment*> &segment = _segments[_next_descriptor / SLOTS_PER_SEGMENT];
+    if (nullptr == segment.load(std::memory_order_relaxed)) {
+      segment.store(new Segment, std::memory_order_release);
+    }
+    descriptor = _next_descriptor++;
+  }
+
+  Slot *slot = _slot(descriptor);
+  slot->file = std::move(file);
+  // Publishes the file to load() calls that see the flag
+  slot->state.fetch_or(OPEN_FLAG, std::memory_order_release);
   return descriptor;
 }
 
 template<class Func>
 inline auto FuseOpenFileList::load(int descriptor, Func&& callback) {
-  try {
-    std::unique_lock<std::mutex> lock(_mutex);
-	_refcounts.at(descriptor) += 1;
-	const detail::OnScopeExit _([&] {
-		if (!lock.owns_lock()) { // own_lock can be true when _open_files.get() below fails before the lock is unlocked
-		  lock.lock();
-		}
-		_refcounts.at(descriptor) -= 1;
-		_refcount_zero_cv.notify_all();
-	});
-
-	OpenFile* loaded = _open_files.get(descriptor);
-	lock.unlock();
-
-	return std::forward<Func>(callback)(loaded);
-  } catch (const std::out_of_range& e) {
+  Slot *slot = _slot(descriptor);
+  if (nullptr == slot) {
+    throw fspp::fuse::FuseErrnoException(EBADF);
+  }
+
+  const uint64_t previousState = slot->state.fetch_add(1, std::memory_order_acquire);
+  const detail::OnScopeExit _([&] {
+    _release(slot);
+  });
+  if (0 == (previousState & OPEN_FLAG)) {
     throw fspp::fuse::FuseErrnoException(EBADF);
   }
+
+  return std::forward<Func>(callback)(slot->file->get());
 }
 
-inline void FuseOpenFileList::close(int descriptor) {
-  std::unique_lock<std::mutex> lock(_mutex);
+inline void FuseOpenFileList::_release(Slot *slot) {
+  const uint64_t previousState = slot->state.fetch_sub(1, std::memory_order_release);
+  if (1 == previousState) {
+    // This was the last pending request on a slot that isn't open anymore. Wake up close() if it is waiting.
+    const std::lock_guard<std::mutex> lock(_refcount_zero_mutex);
+    _refcount_zero_cv.notify_all();
+  }
+}
 
+inline void FuseOpenFileList::_waitUntilDrained(const Slot *slot) {
+  if (0 == (slot->state.load(std::memory_order_acquire) & REFCOUNT_MASK)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_refcount_zero_mutex);
   _refcount_zero_cv.wait(lock, [&] {
-	  return 0 == _refcounts.at(descriptor);
+    return 0 == (slot->state.load(std::memory_order_acquire) & REFCOUNT_MASK);
   });
+}
+
+inline void FuseOpenFileList::close(int descriptor) {
+  Slot *slot = _slot(descriptor);
+  if (nullptr == slot) {
+    throw fspp::fuse::FuseErrnoException(EBADF);
+  }
+
+  const uint64_t previousState = slot->state.fetch_and(REFCOUNT_MASK, std::memory_order_acq_rel);
+  if (0 == (previousState & OPEN_FLAG)) {
+    // Not open or already being closed by another thread
+    throw fspp::fuse::FuseErrnoException(EBADF);
+  }
+
+  _waitUntilDrained(slot);
 
   //The destructor of the stored FuseOpenFile closes the file
-  _open_files.remove(descriptor);
-  _refcounts.erase(descriptor);
+  slot->file = boost::none;
+
+  const std::lock_guard<std::mutex> lock(_mutex);
+  _free_descriptors.push_back(descriptor);
 }
 
 }
@@ -1 +0,0 @@
-#include "Profiler.h"
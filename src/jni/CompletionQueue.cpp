@@ -0,0 +1,51 @@
+#include "CompletionQueue.h"
+#include <algorithm>
+#include <cerrno>
+
+CompletionQueue::CompletionQueue(unsigned int numThreads)
+: _mutex(), _completed(), _completions(), _numRunning(0), _pool(numThreads, "cryfs_async") {
+}
+
+void CompletionQueue::submit(jlong userData, jobject buffer, std::function<std::pair<jlong, jlong>()> operation) {
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+		++_numRunning;
+	}
+	_pool.submit([this, userData, buffer, operation = std::move(operation)] {
+		std::pair<jlong, jlong> result = {-EIO, 0};
+		try {
+			result = operation();
+		} catch (...) {
+			// Fuse already turns exceptions into error codes, this only happens on internal errors like bad_alloc
+		}
+		{
+			const std::lock_guard<std::mutex> lock(_mutex);
+			_completions.push_back(Completion{userData, result.first, result.second, buffer});
+			--_numRunning;
+		}
+		_completed.notify_all();
+	});
+}
+
+std::vector<CompletionQueue::Completion> CompletionQueue::poll(size_t maxCompletions, std::chrono::milliseconds timeout) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_completed.wait_for(lock, timeout, [this] {
+		return !_completions.empty();
+	});
+	return _take(maxCompletions);
+}
+
+std::vector<CompletionQueue::Completion> CompletionQueue::drain() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_completed.wait(lock, [this] {
+		return _numRunning == 0;
+	});
+	return _take(_completions.size());
+}
+
+std::vector<CompletionQueue::Completion> CompletionQueue::_take(size_t maxCompletions) {
+	const size_t count = std::min(maxCompletions, _completions.size());
+	std::vector<Completion> result(_completions.begin(), _completions.begin() + count);
+	_completions.erase(_completions.begin(), _completions.begin() + count);
+	return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef LIBCRYFS_JNI_COMPLETIONQUEUE_H
+#define LIBCRYFS_JNI_COMPLETIONQUEUE_H
+
+#include <jni.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cpp-utils/macros.h>
+#include <cpp-utils/thread/ThreadPool.h>
+
+/**
+ * Runs filesystem operations for JNI callers on a native thread pool and keeps their results until a Java thread
+ * polls them. Worker threads never call into Java, so they don't need to be attached to the JVM.
+ */
+class CompletionQueue final {
+public:
+	struct Completion final {
+		// Passed through from the submitting call so the caller can match completions to requests
+		jlong userData;
+		// Operation result, e.g. number of bytes read or a negative errno
+		jlong result;
+		// Operation specific result data, e.g. the entries of a readdir
+		jlong data;
+		// Global reference keeping the Java buffer of the operation alive. Has to be deleted by the thread polling it.
+		jobject buffer;
+	};
+
+	// numThreads == 0 starts one thread per CPU core
+	explicit CompletionQueue(unsigned int numThreads);
+
+	// The operation returns {result, data}
+	void submit(jlong userData, jobject buffer, std::function<std::pair<jlong, jlong>()> operation);
+
+	// Waits up to timeout for at least one completion and returns at most maxCompletions of them
+	std::vector<Completion> poll(size_t maxCompletions, std::chrono::milliseconds timeout);
+
+	// Waits until all submitted operations are done and returns the completions that weren't polled yet
+	std::vector<Completion> drain();
+
+private:
+	// Needs _mutex to be locked
+	std::vector<Completion> _take(size_t maxCompletions);
+
+	std::mutex _mutex;
+	std::condition_variable _completed;
+	std::deque<Completion> _completions;
+	size_t _numRunning;
+
+	// Declared last so it is destroyed, and finishes its tasks, first
+	cpputils::ThreadPool _pool;
+
+	DISALLOW_COPY_AND_ASSIGN(CompletionQueue);
+};
+
+#endif
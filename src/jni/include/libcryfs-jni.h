@@ -2,7 +2,8 @@
 
 jlong cryfs_init(JNIEnv *env, jstring jbaseDir, jstring jlocalSateDir, jbyteArray jpassword,
                  jbyteArray jgivenHash, jobject returnedHash, jboolean createBaseDir,
-                 jstring jcipher, jobject jerrorCode);
+                 jstring jcipher, jboolean protectPlaintextMemory, jobjectArray jinstrumentedLayers,
+                 jobject jerrorCode);
 jboolean cryfs_change_encryption_key(JNIEnv *env,
         jstring jbaseDir, jstring jlocalStateDir,
         jbyteArray jcurrentPassword, jbyteArray jgivenHash,
@@ -15,9 +16,24 @@ jint cryfs_truncate(JNIEnv* env, jlong fusePtr, jstring jpath, jlong size);
 jint cryfs_unlink(JNIEnv* env, jlong fusePtr, jstring jpath);
 jint cryfs_release(jlong fusePtr, jlong fileHandle);
 jlong cryfs_readdir(JNIEnv* env, jlong fusePtr, jstring jpath ,void* data, int(void*, const char*, const struct stat*));
+jlong cryfs_async_create(jint numThreads);
+void cryfs_async_destroy(JNIEnv* env, jlong queuePtr);
+jint cryfs_read_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jlong fileHandle, jlong fileOffset, jobject buffer, jlong dstOffset, jlong length, jlong userData);
+jint cryfs_write_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jlong fileHandle, jlong fileOffset, jobject buffer, jlong srcOffset, jlong length, jlong userData);
+jint cryfs_readdir_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jstring jpath, jlong userData);
+jint cryfs_readdir_async_result(jlong data, void* fillerData, int(void*, const char*, const struct stat*));
+jint cryfs_async_poll(JNIEnv* env, jlong queuePtr, jlongArray completions, jlong timeoutMs);
 jint cryfs_mkdir(JNIEnv* env, jlong fusePtr, jstring jpath, mode_t mode);
 jint cryfs_rmdir(JNIEnv* env, jlong fusePtr, jstring jpath);
 jint cryfs_getattr(JNIEnv* env, jlong fusePtr, jstring jpath, struct stat* stat);
+jint cryfs_mkdirs(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, mode_t mode, jboolean parents, jintArray jresults);
+jint cryfs_unlinks(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, jintArray jresults);
+jint cryfs_getattrs(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, struct stat* stats, jintArray jresults);
+jint cryfs_remove_tree(JNIEnv* env, jlong fusePtr, jstring jpath, void* data, jboolean(void*, jlong));
+jint cryfs_copy_tree(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath, void* data, jboolean(void*, jlong));
+jint cryfs_copy_file(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath);
+jint cryfs_clone_file(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath);
 jint cryfs_rename(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath);
 void cryfs_destroy(jlong fusePtr);
 jboolean cryfs_is_closed(jlong fusePtr);
+jstring cryfs_get_metrics(JNIEnv* env);
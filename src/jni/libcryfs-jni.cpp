@@ -5,6 +5,11 @@
 #include <cryfs/impl/config/CryKeyProvider.h>
 #include <cryfs/impl/config/CryDirectKeyProvider.h>
 #include <cryfs/impl/config/CryPresetPasswordBasedKeyProvider.h>
+#include <cpp-utils/metrics/Metrics.h>
+#include "CompletionQueue.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
 
 using boost::none;
 using cpputils::Random;
@@ -13,12 +18,82 @@ using cryfs_cli::Cli;
 using cryfs_cli::program_options::ProgramOptions;
 using fspp::fuse::Fuse;
 
-std::set<jlong> validFusePtrs;
+// Handles of the filesystems mounted through this library. Several filesystems can be mounted at the same time. Each
+// mount is a Fuse instance that owns all of its state (device, caches, background threads), so mounts only share
+// this registry, the metrics and the random generators. Java calls in from many threads, so it is synchronized.
+class MountRegistry final {
+public:
+	void add(jlong fusePtr) {
+		const std::lock_guard<std::mutex> lock(_mutex);
+		_fusePtrs.insert(fusePtr);
+	}
+
+	// Returns false if the handle wasn't registered, e.g. because it was already removed
+	bool remove(jlong fusePtr) {
+		const std::lock_guard<std::mutex> lock(_mutex);
+		return _fusePtrs.erase(fusePtr) != 0;
+	}
+
+	bool contains(jlong fusePtr) const {
+		const std::lock_guard<std::mutex> lock(_mutex);
+		return _fusePtrs.find(fusePtr) != _fusePtrs.end();
+	}
+
+	// Whether plaintext is kept in unswappable memory is a process wide setting of cpputils::PooledAllocator, so all
+	// filesystems mounted at the same time have to agree on it. Returns false if a filesystem that is mounted or
+	// being mounted uses the other setting. Each successful call has to be paired with releaseMemorySetting().
+	bool acquireMemorySetting(bool protectPlaintextMemory) {
+		const std::lock_guard<std::mutex> lock(_mutex);
+		if (_numMemorySettingUsers != 0 && _protectPlaintextMemory != protectPlaintextMemory) {
+			return false;
+		}
+		_protectPlaintextMemory = protectPlaintextMemory;
+		++_numMemorySettingUsers;
+		return true;
+	}
+
+	void releaseMemorySetting() {
+		const std::lock_guard<std::mutex> lock(_mutex);
+		--_numMemorySettingUsers;
+	}
+
+private:
+	mutable std::mutex _mutex;
+	std::set<jlong> _fusePtrs;
+	bool _protectPlaintextMemory = false;
+	size_t _numMemorySettingUsers = 0;
+};
+
+MountRegistry mountRegistry;
 
 jfieldID getValueField(JNIEnv* env, jobject object) {
 	return env->GetFieldID(env->GetObjectClass(object), "value", "Ljava/lang/Object;");
 }
 
+void setErrorCode(JNIEnv* env, jobject jerrorCode, int errorCode) {
+	jclass integerClass = env->FindClass("java/lang/Integer");
+	jobject integer = env->NewObject(integerClass, env->GetMethodID(integerClass, "<init>", "(I)V"), errorCode);
+	env->SetObjectField(jerrorCode, getValueField(env, jerrorCode), integer);
+}
+
+// jstrings can be NULL, which gives an empty list
+std::vector<string> getStrings(JNIEnv* env, jobjectArray jstrings) {
+	std::vector<string> strings;
+	if (jstrings == NULL) {
+		return strings;
+	}
+	const jsize count = env->GetArrayLength(jstrings);
+	strings.reserve(count);
+	for (jsize i = 0; i < count; ++i) {
+		jstring jstr = static_cast<jstring>(env->GetObjectArrayElement(jstrings, i));
+		const char* str = env->GetStringUTFChars(jstr, NULL);
+		strings.emplace_back(str);
+		env->ReleaseStringUTFChars(jstr, str);
+		env->DeleteLocalRef(jstr);
+	}
+	return strings;
+}
+
 void setReturnedPasswordHash(JNIEnv* env, jobject jreturnedHash, const SizedData& returnedHash) {
 	jbyteArray jpasswordHash = env->NewByteArray(returnedHash.size);
 	env->SetByteArrayRegion(jpasswordHash, 0, returnedHash.size, reinterpret_cast<const jbyte*>(returnedHash.data));
@@ -29,7 +104,12 @@ void setReturnedPasswordHash(JNIEnv* env, jobject jreturnedHash, const SizedData
 extern "C" jlong
 cryfs_init(JNIEnv *env, jstring jbaseDir, jstring jlocalStateDir, jbyteArray jpassword,
            jbyteArray jgivenHash, jobject jreturnedHash, jboolean createBaseDir,
-           jstring jcipher, jobject jerrorCode) {
+           jstring jcipher, jboolean protectPlaintextMemory, jobjectArray jinstrumentedLayers, jobject jerrorCode) {
+	if (!mountRegistry.acquireMemorySetting(protectPlaintextMemory)) {
+		LOG(cpputils::logging::ERR, "Another mounted filesystem uses a different protectPlaintextMemory setting. The setting is process wide.");
+		setErrorCode(env, jerrorCode, cryfs::exitCode(cryfs::ErrorCode::InvalidArguments));
+		return 0;
+	}
 	const char* baseDir = env->GetStringUTFChars(jbaseDir, NULL);
 	const char* localStateDir = env->GetStringUTFChars(jlocalStateDir, NULL);
 	boost::optional<string> cipher = none;
@@ -39,7 +119,7 @@ cryfs_init(JNIEnv *env, jstring jbaseDir, jstring jlocalStateDir, jbyteArray jpa
 		env->ReleaseStringUTFChars(jcipher, cipherName);
 	}
 	auto &keyGenerator = Random::OSRandom();
-	ProgramOptions options = ProgramOptions(baseDir, none, localStateDir, false, false, createBaseDir, cipher, none, false, none);
+	ProgramOptions options = ProgramOptions(baseDir, none, localStateDir, false, false, createBaseDir, cipher, none, false, none, protectPlaintextMemory, getStrings(env, jinstrumentedLayers));
 	env->ReleaseStringUTFChars(jbaseDir, baseDir);
 	env->ReleaseStringUTFChars(jlocalStateDir, localStateDir);
 	struct SizedData returnedHash;
@@ -66,9 +146,7 @@ cryfs_init(JNIEnv *env, jstring jbaseDir, jstring jlocalStateDir, jbyteArray jpa
 		if (e.what() != string()) {
 			LOG(cpputils::logging::ERR, "Error {}: {}", errorCode, e.what());
 		}
-		jclass integerClass = env->FindClass("java/lang/Integer");
-		jobject integer = env->NewObject(integerClass, env->GetMethodID(integerClass, "<init>", "(I)V"), errorCode);
-		env->SetObjectField(jerrorCode, getValueField(env, jerrorCode), integer);
+		setErrorCode(env, jerrorCode, errorCode);
 	}
 	if (jpassword == NULL) {
 		env->ReleaseByteArrayElements(jgivenHash, reinterpret_cast<jbyte*>(credentials.givenHash.data), 0);
@@ -78,7 +156,9 @@ cryfs_init(JNIEnv *env, jstring jbaseDir, jstring jlocalStateDir, jbyteArray jpa
 	}
 	jlong fusePtr = reinterpret_cast<jlong>(fuse);
 	if (fusePtr != 0) {
-		validFusePtrs.insert(fusePtr);
+		mountRegistry.add(fusePtr);
+	} else {
+		mountRegistry.releaseMemorySetting();
 	}
 	return fusePtr;
 }
@@ -208,8 +288,6 @@ extern "C" jint cryfs_release(jlong fusePtr, jlong fileHandle) {
 }
 
 struct readDirHelper {
-	Fuse* fuse;
-	boost::filesystem::path path;
 	void* data;
 	fuse_fill_dir_t filler;
 };
@@ -219,9 +297,6 @@ int readDir(void* data, const char* name, fspp::fuse::STAT* stat) {
 	    return 0;
 	}
 	struct readDirHelper* helper = reinterpret_cast<readDirHelper*>(data);
-	mode_t mode = stat->st_mode; // saving mode because getattr sometimes modifies it badly
-	helper->fuse->getattr(helper->path / name, stat);
-	stat->st_mode = mode;
 	return helper->filler(helper->data, name, stat);
 }
 
@@ -229,17 +304,139 @@ extern "C" jint cryfs_readdir(JNIEnv* env, jlong fusePtr, jstring jpath, void* d
 	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
 	const char* path = env->GetStringUTFChars(jpath, NULL);
 	struct readDirHelper helper;
-	helper.fuse = fuse;
-	helper.path = boost::filesystem::path(path);
 	helper.data = data;
 	helper.filler = filler;
 
-	int result = fuse->readdir(path, &helper, readDir);
+	// readdirplus returns the stat info of all entries, so we don't need a getattr call per entry
+	int result = fuse->readdirplus(path, &helper, readDir);
 
 	env->ReleaseStringUTFChars(jpath, path);
 	return result;
 }
 
+// Asynchronous operations. They return 0 if the operation was submitted, or a negative errno if the arguments are
+// invalid. The operation then runs on the thread pool of the queue, and its result can be fetched with cryfs_async_poll.
+// The filesystem and file handles used must stay valid until the operation completed.
+// A queue can be shared by several mounted filesystems, or each of them can get its own queue and thread pool.
+
+extern "C" jlong cryfs_async_create(jint numThreads) {
+	return reinterpret_cast<jlong>(new CompletionQueue(numThreads > 0 ? numThreads : 0));
+}
+
+// Waits for all pending operations
+extern "C" void cryfs_async_destroy(JNIEnv* env, jlong queuePtr) {
+	CompletionQueue* queue = reinterpret_cast<CompletionQueue*>(queuePtr);
+	for (const CompletionQueue::Completion& completion : queue->drain()) {
+		if (completion.buffer != NULL) {
+			env->DeleteGlobalRef(completion.buffer);
+		}
+		if (completion.data != 0) {
+			delete reinterpret_cast<std::vector<std::pair<std::string, fspp::fuse::STAT>>*>(completion.data);
+		}
+	}
+	delete queue;
+}
+
+// jbuffer has to be a direct ByteBuffer. It is kept alive until the completion was polled.
+char* getDirectBuffer(JNIEnv* env, jobject jbuffer, jlong offset, jlong length) {
+	char* buffer = reinterpret_cast<char*>(env->GetDirectBufferAddress(jbuffer));
+	if (buffer == NULL || offset < 0 || length < 0 || offset + length > env->GetDirectBufferCapacity(jbuffer)) {
+		return NULL;
+	}
+	return buffer + offset;
+}
+
+extern "C" jint cryfs_read_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jlong fileHandle, jlong fileOffset, jobject jbuffer, jlong dstOffset, jlong length, jlong userData) {
+	CompletionQueue* queue = reinterpret_cast<CompletionQueue*>(queuePtr);
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	char* buff = getDirectBuffer(env, jbuffer, dstOffset, length);
+	if (buff == NULL) {
+		return -EINVAL;
+	}
+
+	queue->submit(userData, env->NewGlobalRef(jbuffer), [fuse, fileHandle, fileOffset, buff, length] () -> std::pair<jlong, jlong> {
+		return {fuse->read(buff, length, fileOffset, fileHandle), 0};
+	});
+	return 0;
+}
+
+extern "C" jint cryfs_write_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jlong fileHandle, jlong fileOffset, jobject jbuffer, jlong srcOffset, jlong length, jlong userData) {
+	CompletionQueue* queue = reinterpret_cast<CompletionQueue*>(queuePtr);
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* buff = getDirectBuffer(env, jbuffer, srcOffset, length);
+	if (buff == NULL) {
+		return -EINVAL;
+	}
+
+	queue->submit(userData, env->NewGlobalRef(jbuffer), [fuse, fileHandle, fileOffset, buff, length] () -> std::pair<jlong, jlong> {
+		return {fuse->write(buff, length, fileOffset, fileHandle), 0};
+	});
+	return 0;
+}
+
+using ReaddirAsyncResult = std::vector<std::pair<std::string, fspp::fuse::STAT>>;
+
+int collectDirEntry(void* data, const char* name, fspp::fuse::STAT* stat) {
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+	    return 0;
+	}
+	reinterpret_cast<ReaddirAsyncResult*>(data)->emplace_back(name, *stat);
+	return 0;
+}
+
+// On success, the data of the completion holds the entries. Pass it to cryfs_readdir_async_result.
+extern "C" jint cryfs_readdir_async(JNIEnv* env, jlong queuePtr, jlong fusePtr, jstring jpath, jlong userData) {
+	CompletionQueue* queue = reinterpret_cast<CompletionQueue*>(queuePtr);
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* path = env->GetStringUTFChars(jpath, NULL);
+	boost::filesystem::path dirPath(path);
+	env->ReleaseStringUTFChars(jpath, path);
+
+	queue->submit(userData, NULL, [fuse, dirPath] () -> std::pair<jlong, jlong> {
+		auto entries = std::make_unique<ReaddirAsyncResult>();
+		int result = fuse->readdirplus(dirPath, entries.get(), collectDirEntry);
+		if (result != 0) {
+			return {result, 0};
+		}
+		return {result, reinterpret_cast<jlong>(entries.release())};
+	});
+	return 0;
+}
+
+// Passes the entries of a completed cryfs_readdir_async to filler and frees them
+extern "C" jint cryfs_readdir_async_result(jlong data, void* fillerData, fuse_fill_dir_t filler) {
+	std::unique_ptr<ReaddirAsyncResult> entries(reinterpret_cast<ReaddirAsyncResult*>(data));
+	for (auto& entry : *entries) {
+		int result = filler(fillerData, entry.first.c_str(), &entry.second);
+		if (result != 0) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+// Waits up to timeoutMs for completions and writes them to jcompletions as triples of (userData, result, data).
+// Returns the number of completions written.
+extern "C" jint cryfs_async_poll(JNIEnv* env, jlong queuePtr, jlongArray jcompletions, jlong timeoutMs) {
+	CompletionQueue* queue = reinterpret_cast<CompletionQueue*>(queuePtr);
+	const size_t maxCompletions = env->GetArrayLength(jcompletions) / 3;
+
+	std::vector<CompletionQueue::Completion> completions = queue->poll(maxCompletions, std::chrono::milliseconds(timeoutMs));
+
+	std::vector<jlong> values;
+	values.reserve(3 * completions.size());
+	for (const CompletionQueue::Completion& completion : completions) {
+		if (completion.buffer != NULL) {
+			env->DeleteGlobalRef(completion.buffer);
+		}
+		values.push_back(completion.userData);
+		values.push_back(completion.result);
+		values.push_back(completion.data);
+	}
+	env->SetLongArrayRegion(jcompletions, 0, values.size(), values.data());
+	return completions.size();
+}
+
 extern "C" jint cryfs_mkdir(JNIEnv* env, jlong fusePtr, jstring jpath, mode_t mode) {
 	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
 	const char* path = env->GetStringUTFChars(jpath, NULL);
@@ -270,6 +467,102 @@ extern "C" jint cryfs_getattr(JNIEnv* env, jlong fusePtr, jstring jpath, fspp::f
 	return result;
 }
 
+std::vector<boost::filesystem::path> getPaths(JNIEnv* env, jobjectArray jpaths) {
+	const std::vector<string> strings = getStrings(env, jpaths);
+	return std::vector<boost::filesystem::path>(strings.begin(), strings.end());
+}
+
+// Batched operations take an array of paths and write the result of each path (0 or a negative errno) to jresults,
+// which has to be at least as long. The return value is the error of the batch as a whole.
+extern "C" jint cryfs_mkdirs(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, mode_t mode, jboolean parents, jintArray jresults) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	std::vector<int> results;
+
+	int result = fuse->mkdirs(getPaths(env, jpaths), mode, parents, &results);
+
+	env->SetIntArrayRegion(jresults, 0, results.size(), reinterpret_cast<const jint*>(results.data()));
+	return result;
+}
+
+extern "C" jint cryfs_unlinks(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, jintArray jresults) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	std::vector<int> results;
+
+	int result = fuse->unlinks(getPaths(env, jpaths), &results);
+
+	env->SetIntArrayRegion(jresults, 0, results.size(), reinterpret_cast<const jint*>(results.data()));
+	return result;
+}
+
+// stats has to have room for one entry per path
+extern "C" jint cryfs_getattrs(JNIEnv* env, jlong fusePtr, jobjectArray jpaths, fspp::fuse::STAT* stats, jintArray jresults) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	std::vector<fspp::fuse::STAT> stbufs;
+	std::vector<int> results;
+
+	int result = fuse->getattrs(getPaths(env, jpaths), &stbufs, &results);
+
+	std::copy(stbufs.begin(), stbufs.end(), stats);
+	env->SetIntArrayRegion(jresults, 0, results.size(), reinterpret_cast<const jint*>(results.data()));
+	return result;
+}
+
+typedef jboolean (*progress_callback_t)(void*, jlong);
+
+// progress is called on the calling thread with the number of nodes processed so far. Returning false cancels the
+// operation with -ECANCELED. It can be NULL.
+fspp::Device::ProgressCallback makeProgressCallback(void* data, progress_callback_t progress) {
+	return [data, progress] (uint64_t numNodesDone) {
+		return progress == NULL || progress(data, numNodesDone) != JNI_FALSE;
+	};
+}
+
+extern "C" jint cryfs_remove_tree(JNIEnv* env, jlong fusePtr, jstring jpath, void* data, progress_callback_t progress) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* path = env->GetStringUTFChars(jpath, NULL);
+
+	int result = fuse->removeTree(path, makeProgressCallback(data, progress));
+
+	env->ReleaseStringUTFChars(jpath, path);
+	return result;
+}
+
+extern "C" jint cryfs_copy_tree(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath, void* data, progress_callback_t progress) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* srcPath = env->GetStringUTFChars(jsrcPath, NULL);
+	const char* dstPath = env->GetStringUTFChars(jdstPath, NULL);
+
+	int result = fuse->copyTree(srcPath, dstPath, makeProgressCallback(data, progress));
+
+	env->ReleaseStringUTFChars(jsrcPath, srcPath);
+	env->ReleaseStringUTFChars(jdstPath, dstPath);
+	return result;
+}
+
+extern "C" jint cryfs_copy_file(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* srcPath = env->GetStringUTFChars(jsrcPath, NULL);
+	const char* dstPath = env->GetStringUTFChars(jdstPath, NULL);
+
+	int result = fuse->copyFile(srcPath, dstPath);
+
+	env->ReleaseStringUTFChars(jsrcPath, srcPath);
+	env->ReleaseStringUTFChars(jdstPath, dstPath);
+	return result;
+}
+
+extern "C" jint cryfs_clone_file(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath) {
+	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
+	const char* srcPath = env->GetStringUTFChars(jsrcPath, NULL);
+	const char* dstPath = env->GetStringUTFChars(jdstPath, NULL);
+
+	int result = fuse->cloneFile(srcPath, dstPath);
+
+	env->ReleaseStringUTFChars(jsrcPath, srcPath);
+	env->ReleaseStringUTFChars(jdstPath, dstPath);
+	return result;
+}
+
 extern "C" jint cryfs_rename(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstring jdstPath) {
 	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
 	const char* srcPath = env->GetStringUTFChars(jsrcPath, NULL);
@@ -283,12 +576,23 @@ extern "C" jint cryfs_rename(JNIEnv* env, jlong fusePtr, jstring jsrcPath, jstri
 }
 
 extern "C" void cryfs_destroy(jlong fusePtr) {
+	// Unregister first, so that concurrent calls to cryfs_destroy for the same handle don't delete it twice
+	if (!mountRegistry.remove(fusePtr)) {
+		return;
+	}
 	Fuse* fuse = reinterpret_cast<Fuse*>(fusePtr);
 	fuse->destroy();
 	delete fuse;
-	validFusePtrs.erase(fusePtr);
+	mountRegistry.releaseMemorySetting();
 }
 
 extern "C" jboolean cryfs_is_closed(jlong fusePtr) {
-	return validFusePtrs.find(fusePtr) == validFusePtrs.end();
+	return !mountRegistry.contains(fusePtr);
+}
+
+// Returns a JSON snapshot of all metrics, see cpputils::metrics::MetricsSnapshot::toJson().
+// Metrics are process wide, i.e. they cover all filesystems mounted since the library was loaded.
+extern "C" jstring cryfs_get_metrics(JNIEnv* env) {
+	const std::string metrics = cpputils::metrics::Metrics::singleton().snapshot().toJson();
+	return env->NewStringUTF(metrics.c_str());
 }
@@ -5,6 +5,7 @@
 #include <cpp-utils/pointer/unique_ref.h>
 #include <boost/optional.hpp>
 #include <blockstore/utils/BlockId.h>
+#include <vector>
 
 namespace parallelaccessstore {
 
@@ -15,6 +16,12 @@ public:
   virtual boost::optional<cpputils::unique_ref<Resource>> loadFromBaseStore(const Key &key) = 0;
   virtual void removeFromBaseStore(cpputils::unique_ref<Resource> block) = 0;
   virtual void removeFromBaseStore(const blockstore::BlockId &blockId) = 0;
+  // Removes resources that aren't loaded. Override this if the base store can remove many of them at once.
+  virtual void removeManyFromBaseStore(const std::vector<Key> &keys) {
+    for (const Key &key : keys) {
+      removeFromBaseStore(key);
+    }
+  }
 };
 
 }
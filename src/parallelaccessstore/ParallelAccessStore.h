@@ -3,9 +3,11 @@
 #define MESSMER_PARALLELACCESSSTORE_PARALLELACCESSSTORE_H_
 
 #include <mutex>
+#include <condition_variable>
 #include <memory>
 #include <map>
 #include <unordered_map>
+#include <vector>
 #include <boost/thread/future.hpp>
 #include <cassert>
 #include <type_traits>
@@ -58,6 +60,8 @@ public:
   cpputils::unique_ref<ResourceRef> loadOrAdd(const Key &key, std::function<void (ResourceRef*)> onExists, std::function<cpputils::unique_ref<Resource> ()> onAdd, std::function<cpputils::unique_ref<ResourceRef>(Resource*)> createResourceRef);
   void remove(const Key &key, cpputils::unique_ref<ResourceRef> block);
   void remove(const Key &key);
+  // Like calling remove(key) for each key, but resources that aren't loaded are removed from the base store at once
+  void removeMany(const std::vector<Key> &keys);
 
 private:
   class OpenResource final {
@@ -89,16 +93,22 @@ private:
   };
 
   mutable std::mutex _mutex;
+  std::condition_variable _resourceRemoved;
   cpputils::unique_ref<ParallelAccessBaseStore<Resource, Key>> _baseStore;
 
   std::unordered_map<Key, OpenResource> _openResources;
+  // Keys stay in here until they're removed from the base store, so they aren't loaded from there in the meantime
   std::map<Key, boost::promise<cpputils::unique_ref<Resource>>> _resourcesToRemove;
 
   template<class ActualResourceRef>
   cpputils::unique_ref<ActualResourceRef> _add(const Key &key, cpputils::unique_ref<Resource> resource, std::function<cpputils::unique_ref<ActualResourceRef>(Resource*)> createResourceRef);
 
+  // Needs _mutex to be locked
   boost::future<cpputils::unique_ref<Resource>> _resourceToRemoveFuture(const Key &key);
-  cpputils::unique_ref<Resource> _waitForResourceToRemove(const Key &key, boost::future<cpputils::unique_ref<Resource>> resourceToRemoveFuture);
+  // Needs _mutex to be locked. Waits until a resource that isn't open anymore is removed from the base store.
+  void _waitUntilNotBeingRemoved(std::unique_lock<std::mutex> *lock, const Key &key);
+  template<class RemoveFromBaseStore>
+  void _removeFromBaseStoreAndFinish(const std::vector<Key> &keys, RemoveFromBaseStore removeFromBaseStore);
 
   void release(const Key &key);
   friend class CachedResource;
@@ -156,7 +166,8 @@ cpputils::unique_ref<ResourceRef> ParallelAccessStore<Resource, ResourceRef, Key
 
 template<class Resource, class ResourceRef, class Key>
 cpputils::unique_ref<ResourceRef> ParallelAccessStore<Resource, ResourceRef, Key>::loadOrAdd(const Key &key, std::function<void (ResourceRef*)> onExists, std::function<cpputils::unique_ref<Resource> ()> onAdd, std::function<cpputils::unique_ref<ResourceRef>(Resource*)> createResourceRef) {
-    const std::lock_guard<std::mutex> lock(_mutex);
+    std::unique_lock<std::mutex> lock(_mutex);
+    _waitUntilNotBeingRemoved(&lock, key);
     auto found = _openResources.find(key);
     if (found == _openResources.end()) {
         auto resource = onAdd();
@@ -179,7 +190,8 @@ boost::optional<cpputils::unique_ref<ResourceRef>> ParallelAccessStore<Resource,
 template<class Resource, class ResourceRef, class Key>
 boost::optional<cpputils::unique_ref<ResourceRef>> ParallelAccessStore<Resource, ResourceRef, Key>::load(const Key &key, std::function<cpputils::unique_ref<ResourceRef>(Resource*)> createResourceRef) {
   //TODO This lock doesn't allow loading different blocks in parallel. Can we only lock the requested key?
-  const std::lock_guard<std::mutex> lock(_mutex);
+  std::unique_lock<std::mutex> lock(_mutex);
+  _waitUntilNotBeingRemoved(&lock, key);
   auto found = _openResources.find(key);
   if (found == _openResources.end()) {
     auto resource = _baseStore->loadFromBaseStore(key);
@@ -196,40 +208,107 @@ boost::optional<cpputils::unique_ref<ResourceRef>> ParallelAccessStore<Resource,
 
 template<class Resource, class ResourceRef, class Key>
 void ParallelAccessStore<Resource, ResourceRef, Key>::remove(const Key &key, cpputils::unique_ref<ResourceRef> resource) {
-  auto resourceToRemoveFuture = _resourceToRemoveFuture(key);
+  boost::future<cpputils::unique_ref<Resource>> resourceToRemoveFuture;
+  {
+    const std::lock_guard<std::mutex> lock(_mutex);
+    resourceToRemoveFuture = _resourceToRemoveFuture(key);
+  }
 
   cpputils::destruct(std::move(resource));
 
   //Wait for last resource user to release it
   auto resourceToRemove = resourceToRemoveFuture.get();
-  const std::lock_guard<std::mutex> lock(_mutex); // TODO Just added this as a precaution on a whim, but I seriously need to rethink locking here.
-  _resourcesToRemove.erase(key); //TODO Is this erase causing a race condition?
-  _baseStore->removeFromBaseStore(std::move(resourceToRemove));
+  _removeFromBaseStoreAndFinish({key}, [this, &resourceToRemove] {
+    _baseStore->removeFromBaseStore(std::move(resourceToRemove));
+  });
 }
 
 template<class Resource, class ResourceRef, class Key>
 boost::future<cpputils::unique_ref<Resource>> ParallelAccessStore<Resource, ResourceRef, Key>::_resourceToRemoveFuture(const Key &key) {
-    const std::lock_guard <std::mutex> lock(_mutex); // TODO Lock needed for _resourcesToRemove?
     auto insertResult = _resourcesToRemove.emplace(key, boost::promise<cpputils::unique_ref<Resource>>());
     ASSERT(true == insertResult.second, "Inserting failed");
     return insertResult.first->second.get_future();
 };
 
+template<class Resource, class ResourceRef, class Key>
+void ParallelAccessStore<Resource, ResourceRef, Key>::_waitUntilNotBeingRemoved(std::unique_lock<std::mutex> *lock, const Key &key) {
+    // A resource that is still open can be handed out, remove() waits for all references to it
+    _resourceRemoved.wait(*lock, [this, &key] {
+        return _resourcesToRemove.find(key) == _resourcesToRemove.end() || _openResources.find(key) != _openResources.end();
+    });
+}
+
+template<class Resource, class ResourceRef, class Key>
+template<class RemoveFromBaseStore>
+void ParallelAccessStore<Resource, ResourceRef, Key>::_removeFromBaseStoreAndFinish(const std::vector<Key> &keys, RemoveFromBaseStore removeFromBaseStore) {
+    // Don't hold the lock while removing. Removing a large resource (e.g. a blob with many blocks) would otherwise
+    // block every other access to the store until it is done. Loads of these keys wait until it is done instead.
+    auto finish = [this, &keys] {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        for (const Key &key : keys) {
+            _resourcesToRemove.erase(key);
+        }
+        _resourceRemoved.notify_all();
+    };
+    try {
+        removeFromBaseStore();
+    } catch (...) {
+        finish();
+        throw;
+    }
+    finish();
+}
+
 template<class Resource, class ResourceRef, class Key>
 void ParallelAccessStore<Resource, ResourceRef, Key>::remove(const Key &key) {
-    auto found = _openResources.find(key);
-    if (found != _openResources.end()) {
-        auto resourceToRemoveFuture = _resourceToRemoveFuture(key);
+    boost::future<cpputils::unique_ref<Resource>> resourceToRemoveFuture;
+    bool isOpened = false;
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        isOpened = _openResources.find(key) != _openResources.end();
+        // Also registered if the resource isn't open, so it isn't loaded while it is removed
+        resourceToRemoveFuture = _resourceToRemoveFuture(key);
+    }
+    if (isOpened) {
         //Wait for last resource user to release it
         auto resourceToRemove = resourceToRemoveFuture.get();
-        const std::lock_guard<std::mutex> lock(_mutex); // TODO Just added this as a precaution on a whim, but I seriously need to rethink locking here.
-        _resourcesToRemove.erase(key); //TODO Is this erase causing a race condition?
-        _baseStore->removeFromBaseStore(std::move(resourceToRemove));
+        _removeFromBaseStoreAndFinish({key}, [this, &resourceToRemove] {
+            _baseStore->removeFromBaseStore(std::move(resourceToRemove));
+        });
     } else {
-        _baseStore->removeFromBaseStore(key);
+        _removeFromBaseStoreAndFinish({key}, [this, &key] {
+            _baseStore->removeFromBaseStore(key);
+        });
     }
 };
 
+template<class Resource, class ResourceRef, class Key>
+void ParallelAccessStore<Resource, ResourceRef, Key>::removeMany(const std::vector<Key> &keys) {
+    std::vector<boost::future<cpputils::unique_ref<Resource>>> openedResourcesToRemove;
+    std::vector<Key> notOpened;
+    notOpened.reserve(keys.size());
+    {
+        // Register all keys at once, so none of them is loaded from the base store while they're removed
+        const std::lock_guard<std::mutex> lock(_mutex);
+        for (const Key &key : keys) {
+            const bool isOpened = _openResources.find(key) != _openResources.end();
+            auto resourceToRemoveFuture = _resourceToRemoveFuture(key);
+            if (isOpened) {
+                openedResourcesToRemove.push_back(std::move(resourceToRemoveFuture));
+            } else {
+                notOpened.push_back(key);
+            }
+        }
+    }
+    _removeFromBaseStoreAndFinish(keys, [this, &openedResourcesToRemove, &notOpened] {
+        for (auto &resourceToRemoveFuture : openedResourcesToRemove) {
+            //Wait for last resource user to release it
+            _baseStore->removeFromBaseStore(resourceToRemoveFuture.get());
+        }
+        _baseStore->removeManyFromBaseStore(notOpened);
+    });
+}
+
 template<class Resource, class ResourceRef, class Key>
 void ParallelAccessStore<Resource, ResourceRef, Key>::release(const Key &key) {
   const std::lock_guard<std::mutex> lock(_mutex);